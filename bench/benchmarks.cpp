@@ -0,0 +1,1045 @@
+/********
+ * benchmarks.cpp
+ * Author: Simon Chamorro
+ * Benchmarks for Robot Manipulator
+ *
+ * Usage: run-benchmarks [--format text|csv|json] [--threads N]
+ *                       [--samples N] [--filter NAME]
+********/
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include "batch_kinematics.h"
+#include "fast_math.h"
+#include "fixed_manipulator.h"
+#include "ik_cache.h"
+#include "ik_scheduler.h"
+#include "kinematics.h"
+#include "manipulator.h"
+#include "numerical_ik.h"
+#include "obstacle_set.h"
+#include "parallel_chain.h"
+#include "reachability_map.h"
+#include "robot_configuration.h"
+#include "self_collision.h"
+#include "socket_server.h"
+#include "thread_pool.h"
+#include "velocity_controller.h"
+
+using namespace std;
+
+const unsigned SEED = 42;
+const int WORKLOAD_SIZE = 4096;
+// Results are stored here so they are not optimized away. One slot per
+// thread, threads/ and scheduler/ entries write it from several threads.
+thread_local volatile double sink;
+
+
+struct BenchOptions{
+
+    string format;
+    string filter;
+    int max_threads;
+    int samples;
+};
+
+struct BenchResult{
+
+    string name;
+    int threads;
+    int ops_per_sample;
+    int samples;
+    double mean_ns;
+    double p50_ns;
+    double p90_ns;
+    double p99_ns;
+    double max_ns;
+    double ops_per_s;
+};
+
+// One sample runs ops_per_sample operations, thread is the worker index
+typedef function<void(int thread, int sample)> SampleFunction;
+
+
+// Fixed seed joint vectors and reachable targets shared by all benchmarks
+struct Workload{
+
+    Configuration config;
+    vector<double> angles[INLINE_LINKS];
+    vector<double> x;
+    vector<double> y;
+    vector<double> theta;
+
+    Workload(int num_links){
+        Manipulator manipulator;
+        double links[INLINE_LINKS];
+        for (int i = 0; i < num_links; i += 1){
+            links[i] = 1.0;
+        }
+        manipulator.set_parameters(num_links, links);
+        config = manipulator.get_config();
+
+        mt19937_64 rng(SEED);
+        uniform_real_distribution<double> joint(-170.0, 170.0);
+        for (int j = 0; j < num_links; j += 1){
+            angles[j].resize(WORKLOAD_SIZE);
+        }
+        x.resize(WORKLOAD_SIZE);
+        y.resize(WORKLOAD_SIZE);
+        theta.resize(WORKLOAD_SIZE);
+        for (int i = 0; i < WORKLOAD_SIZE; i += 1){
+            double pose_angles[INLINE_LINKS];
+            for (int j = 0; j < num_links; j += 1){
+                angles[j][i] = joint(rng);
+                pose_angles[j] = angles[j][i];
+            }
+            Pose pose = compute_forward_kinematics(config, pose_angles);
+            x[i] = pose.x;
+            y[i] = pose.y;
+            theta[i] = pose.theta;
+        }
+    }
+
+    void pose(int i, double *out) const{
+        for (int j = 0; j < config.num_links; j += 1){
+            out[j] = angles[j][i % WORKLOAD_SIZE];
+        }
+    }
+};
+
+
+double percentile(const vector<double> &sorted, double p){
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+
+/**
+ * Time a benchmark on a number of threads.
+ * Each thread runs options.samples samples, each sample is timed separately
+ * and divided by ops_per_sample to get the latency distribution.
+ */
+BenchResult run_benchmark(const string &name, int threads, int ops_per_sample,
+                        const BenchOptions &options, const SampleFunction &f){
+    vector<vector<double> > per_thread(threads);
+    auto worker = [&](int t){
+        vector<double> &times = per_thread[t];
+        times.reserve(options.samples);
+        // Warm up caches and branch predictors
+        for (int s = 0; s < options.samples / 10 + 1; s += 1){
+            f(t, s);
+        }
+        for (int s = 0; s < options.samples; s += 1){
+            auto start = chrono::steady_clock::now();
+            f(t, s);
+            auto end = chrono::steady_clock::now();
+            times.push_back(chrono::duration<double, nano>(end - start).count() / ops_per_sample);
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    if (threads == 1){
+        worker(0);
+    }
+    else{
+        vector<thread> workers;
+        for (int t = 0; t < threads; t += 1){
+            workers.push_back(thread(worker, t));
+        }
+        for (int t = 0; t < threads; t += 1){
+            workers[t].join();
+        }
+    }
+    auto end = chrono::steady_clock::now();
+
+    vector<double> all;
+    double total = 0;
+    for (int t = 0; t < threads; t += 1){
+        for (size_t s = 0; s < per_thread[t].size(); s += 1){
+            all.push_back(per_thread[t][s]);
+            total += per_thread[t][s];
+        }
+    }
+    sort(all.begin(), all.end());
+
+    BenchResult result;
+    result.name = name;
+    result.threads = threads;
+    result.ops_per_sample = ops_per_sample;
+    result.samples = (int)all.size();
+    result.mean_ns = total / all.size();
+    result.p50_ns = percentile(all, 0.50);
+    result.p90_ns = percentile(all, 0.90);
+    result.p99_ns = percentile(all, 0.99);
+    result.max_ns = all.back();
+    double wall_s = chrono::duration<double>(end - start).count();
+    double warmup_ops = (double)threads * (options.samples / 10 + 1) * ops_per_sample;
+    result.ops_per_s = ((double)all.size() * ops_per_sample + warmup_ops) / wall_s;
+    return result;
+}
+
+
+// Output
+
+void print_header(const BenchOptions &options){
+    if (options.format == "csv"){
+        cout << "name,threads,ops_per_sample,samples,mean_ns,p50_ns,p90_ns,p99_ns,max_ns,ops_per_s\n";
+    }
+    else if (options.format == "json"){
+        cout << "[\n";
+    }
+    else{
+        cout << "benchmark                              threads   mean ns    p50 ns    p90 ns"
+            << "    p99 ns        ops/s\n";
+    }
+}
+
+
+void print_result(const BenchResult &r, const BenchOptions &options, bool first){
+    char line[512];
+    if (options.format == "csv"){
+        snprintf(line, sizeof(line), "%s,%d,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.1f\n",
+                r.name.c_str(), r.threads, r.ops_per_sample, r.samples, r.mean_ns,
+                r.p50_ns, r.p90_ns, r.p99_ns, r.max_ns, r.ops_per_s);
+    }
+    else if (options.format == "json"){
+        snprintf(line, sizeof(line), "%s  {\"name\": \"%s\", \"threads\": %d, \"ops_per_sample\": %d, "
+                "\"samples\": %d, \"mean_ns\": %.3f, \"p50_ns\": %.3f, \"p90_ns\": %.3f, "
+                "\"p99_ns\": %.3f, \"max_ns\": %.3f, \"ops_per_s\": %.1f}",
+                first ? "" : ",\n", r.name.c_str(), r.threads, r.ops_per_sample, r.samples,
+                r.mean_ns, r.p50_ns, r.p90_ns, r.p99_ns, r.max_ns, r.ops_per_s);
+    }
+    else{
+        snprintf(line, sizeof(line), "%-38s %7d %9.2f %9.2f %9.2f %9.2f %12.0f\n",
+                r.name.c_str(), r.threads, r.mean_ns, r.p50_ns, r.p90_ns, r.p99_ns, r.ops_per_s);
+    }
+    cout << line;
+}
+
+
+void print_footer(const BenchOptions &options){
+    if (options.format == "json"){
+        cout << "\n]\n";
+    }
+}
+
+
+// Benchmarks
+
+struct BenchRunner{
+
+    BenchOptions options;
+    bool first;
+
+    void run(const string &name, int threads, int ops_per_sample, const SampleFunction &f){
+        if (!options.filter.empty() && name.find(options.filter) == string::npos){
+            return;
+        }
+        print_result(run_benchmark(name, threads, ops_per_sample, options, f), options, first);
+        first = false;
+    }
+};
+
+
+void bench_manipulator(BenchRunner &runner){
+    const int ops = 64;
+    Workload w(3);
+    Manipulator manipulator;
+
+    runner.run("manipulator/forward_kinematics", 1, ops, [&](int, int s){
+        double angles[INLINE_LINKS];
+        for (int i = 0; i < ops; i += 1){
+            w.pose(s*ops + i, angles);
+            manipulator.forward_kinematics(angles);
+        }
+        sink = manipulator.get_config_ref().x;
+    });
+    runner.run("manipulator/update_joint", 1, ops, [&](int, int s){
+        for (int i = 0; i < ops; i += 1){
+            manipulator.update_joint(2, w.angles[2][(s*ops + i) % WORKLOAD_SIZE]);
+        }
+        sink = manipulator.get_config_ref().x;
+    });
+    runner.run("manipulator/intersection", 1, ops, [&](int, int s){
+        double angles[INLINE_LINKS];
+        int hits = 0;
+        for (int i = 0; i < ops; i += 1){
+            w.pose(s*ops + i, angles);
+            hits += manipulator.intersection(1.0, 1.0, 1.0, angles);
+        }
+        sink = hits;
+    });
+    runner.run("manipulator/inverse_kinematics", 1, ops, [&](int, int s){
+        double angles_1[INLINE_LINKS], angles_2[INLINE_LINKS];
+        for (int i = 0; i < ops; i += 1){
+            int k = (s*ops + i) % WORKLOAD_SIZE;
+            manipulator.inverse_kinematics(w.x[k], w.y[k], w.theta[k], angles_1, angles_2);
+        }
+        sink = angles_1[0];
+    });
+    runner.run("manipulator/inverse_dynamics", 1, ops, [&](int, int s){
+        double torques[INLINE_LINKS];
+        for (int i = 0; i < ops; i += 1){
+            manipulator.inverse_dynamics(1.0, (double)(s + i), 0.5, torques);
+        }
+        sink = torques[0];
+    });
+
+    Workload w6(6);
+    Manipulator six;
+    six.set_parameters(6, w6.config.links);
+    IkSolverOptions ik_options = default_ik_solver_options();
+    runner.run("manipulator/inverse_kinematics_dls_6", 1, 1, [&](int, int s){
+        double angles[INLINE_LINKS];
+        int k = s % WORKLOAD_SIZE;
+        six.inverse_kinematics_numerical(w6.x[k], w6.y[k], w6.theta[k], angles, ik_options, NULL);
+        sink = angles[0];
+    });
+}
+
+
+template <int N>
+void bench_fixed_manipulator(BenchRunner &runner){
+    const int ops = 64;
+    Workload w(N);
+    Manipulator manipulator;
+    manipulator.set_parameters(N, w.config.links);
+    FixedManipulator<N> fixed;
+    string suffix = "_" + to_string(N);
+
+    runner.run("fixed/manipulator_fk" + suffix, 1, ops, [&](int, int s){
+        double angles[INLINE_LINKS];
+        for (int i = 0; i < ops; i += 1){
+            w.pose(s*ops + i, angles);
+            manipulator.forward_kinematics(angles);
+        }
+        sink = manipulator.get_config_ref().x;
+    });
+    runner.run("fixed/fixed_manipulator_fk" + suffix, 1, ops, [&](int, int s){
+        array<double, N> angles;
+        for (int i = 0; i < ops; i += 1){
+            w.pose(s*ops + i, angles.data());
+            fixed.forward_kinematics(angles);
+        }
+        sink = fixed.get_config().x;
+    });
+}
+
+
+void bench_batch(BenchRunner &runner){
+    const int count = WORKLOAD_SIZE;
+    Workload w(3);
+    vector<double> x(count), y(count), theta(count);
+    vector<double> out[6];
+    for (int j = 0; j < 6; j += 1){
+        out[j].resize(count);
+    }
+    vector<unsigned char> reachable(count);
+    const double *angles[INLINE_LINKS];
+    for (int j = 0; j < 3; j += 1){
+        angles[j] = w.angles[j].data();
+    }
+    double *angles_1[3] = {out[0].data(), out[1].data(), out[2].data()};
+    double *angles_2[3] = {out[3].data(), out[4].data(), out[5].data()};
+
+    SimdLevel levels[4] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512};
+    for (int l = 0; l < 4; l += 1){
+        if (levels[l] > detect_simd_level()){
+            continue;
+        }
+        SimdLevel level = levels[l];
+        string name = simd_level_name(level);
+        runner.run("batch/forward_kinematics_" + name, 1, count, [&, level](int, int){
+            forward_kinematics_batch(w.config, count, angles, x.data(), y.data(), theta.data(), level);
+            sink = x[0];
+        });
+        runner.run("batch/inverse_kinematics_" + name, 1, count, [&, level](int, int){
+            inverse_kinematics_batch(w.config, count, w.x.data(), w.y.data(), w.theta.data(),
+                                    angles_1, angles_2, reachable.data(), level);
+            sink = out[0][0];
+        });
+    }
+
+    double pose_angles[INLINE_LINKS];
+    w.pose(0, pose_angles);
+    double *torques[3] = {out[0].data(), out[1].data(), out[2].data()};
+    runner.run("batch/inverse_dynamics", 1, count, [&](int, int){
+        inverse_dynamics_batch(w.config, pose_angles, count, w.x.data(), w.y.data(),
+                            w.theta.data(), torques);
+        sink = out[0][0];
+    });
+}
+
+
+// Stateless kinematics scale with threads since they share a const Configuration
+void bench_threads(BenchRunner &runner){
+    const int ops = 256;
+    Workload w(3);
+    vector<int> thread_counts;
+    for (int threads = 1; threads < runner.options.max_threads; threads *= 2){
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(runner.options.max_threads);
+
+    for (size_t c = 0; c < thread_counts.size(); c += 1){
+        int threads = thread_counts[c];
+        string suffix = "_t" + to_string(threads);
+        runner.run("threads/compute_forward_kinematics" + suffix, threads, ops, [&](int t, int s){
+            double angles[INLINE_LINKS];
+            double acc = 0;
+            for (int i = 0; i < ops; i += 1){
+                w.pose((t*977 + s)*ops + i, angles);
+                acc += compute_forward_kinematics(w.config, angles).x;
+            }
+            sink = acc;
+        });
+        runner.run("threads/compute_inverse_kinematics" + suffix, threads, ops, [&](int t, int s){
+            double angles_1[INLINE_LINKS], angles_2[INLINE_LINKS];
+            for (int i = 0; i < ops; i += 1){
+                int k = ((t*977 + s)*ops + i) % WORKLOAD_SIZE;
+                compute_inverse_kinematics(w.config, w.x[k], w.y[k], w.theta[k], angles_1, angles_2);
+            }
+            sink = angles_1[0];
+        });
+    }
+}
+
+
+// Batch jobs split across a work-stealing pool of --threads workers, to
+// compare with the single thread batch/ entries
+void bench_thread_pool(BenchRunner &runner){
+    const int count = WORKLOAD_SIZE;
+    Workload w(3);
+    ThreadPoolOptions options = default_thread_pool_options();
+    options.threads = runner.options.max_threads;
+    ThreadPool pool(options);
+    string suffix = "_t" + to_string(pool.size());
+
+    vector<double> x(count), y(count), theta(count);
+    vector<double> out[6];
+    for (int j = 0; j < 6; j += 1){
+        out[j].resize(count);
+    }
+    vector<unsigned char> flags(count);
+    const double *angles[3] = {w.angles[0].data(), w.angles[1].data(), w.angles[2].data()};
+    double *angles_1[3] = {out[0].data(), out[1].data(), out[2].data()};
+    double *angles_2[3] = {out[3].data(), out[4].data(), out[5].data()};
+    ObstacleSet obstacles;
+    obstacles.add(1.0, 1.0, 0.5);
+    obstacles.build();
+
+    runner.run("pool/forward_kinematics" + suffix, 1, count, [&](int, int){
+        forward_kinematics_batch(pool, w.config, count, angles, x.data(), y.data(), theta.data());
+        sink = x[0];
+    });
+    runner.run("pool/inverse_kinematics" + suffix, 1, count, [&](int, int){
+        inverse_kinematics_batch(pool, w.config, count, w.x.data(), w.y.data(), w.theta.data(),
+                                angles_1, angles_2, flags.data());
+        sink = out[0][0];
+    });
+    runner.run("pool/intersection" + suffix, 1, count, [&](int, int){
+        intersection_batch(pool, obstacles, w.config, count, angles, flags.data());
+        sink = flags[0];
+    });
+}
+
+
+void bench_reachability(BenchRunner &runner){
+    const int ops = 64;
+    Workload w(3);
+    ReachabilityMapOptions options = default_reachability_map_options();
+    ReachabilityMap map;
+    map.build(w.config, options);
+
+    // Targets spread over the whole grid, most of them unreachable
+    vector<double> x(WORKLOAD_SIZE), y(WORKLOAD_SIZE), theta(WORKLOAD_SIZE);
+    mt19937_64 rng(SEED);
+    uniform_real_distribution<double> position(-3.0, 3.0);
+    uniform_real_distribution<double> orientation(-180.0, 180.0);
+    for (int k = 0; k < WORKLOAD_SIZE; k += 1){
+        x[k] = position(rng);
+        y[k] = position(rng);
+        theta[k] = orientation(rng);
+    }
+
+    options.threads = 1;
+    runner.run("reachability/build_1_thread", 1, 1, [&](int, int){
+        ReachabilityMap built;
+        built.build(w.config, options);
+        sink = built.lookup(0.0, 0.0, 0.0);
+    });
+    runner.run("reachability/compute_pose_reachable", 1, ops, [&](int, int s){
+        int hits = 0;
+        for (int i = 0; i < ops; i += 1){
+            int k = (s*ops + i) % WORKLOAD_SIZE;
+            hits += compute_pose_reachable(w.config, x[k], y[k], theta[k]);
+        }
+        sink = hits;
+    });
+    runner.run("reachability/map_is_reachable", 1, ops, [&](int, int s){
+        int hits = 0;
+        for (int i = 0; i < ops; i += 1){
+            int k = (s*ops + i) % WORKLOAD_SIZE;
+            hits += map.is_reachable(x[k], y[k], theta[k]);
+        }
+        sink = hits;
+    });
+}
+
+
+void bench_obstacles(BenchRunner &runner){
+    const int ops = 64;
+    const int count = 10000;
+    Workload w(3);
+    mt19937_64 rng(SEED);
+    uniform_real_distribution<double> position(-3.0, 3.0);
+    uniform_real_distribution<double> radius(0.0, 0.05);
+    ObstacleSet scan, grid;
+    for (int i = 0; i < count; i += 1){
+        double x = position(rng), y = position(rng), r = radius(rng);
+        scan.add(x, y, r);
+        grid.add(x, y, r);
+    }
+    grid.build();
+
+    runner.run("obstacles/contains_any_scan_10000", 1, ops, [&](int, int s){
+        int hits = 0;
+        for (int i = 0; i < ops; i += 1){
+            int k = (s*ops + i) % WORKLOAD_SIZE;
+            hits += scan.contains_any(w.x[k], w.y[k]);
+        }
+        sink = hits;
+    });
+    runner.run("obstacles/contains_any_grid_10000", 1, ops, [&](int, int s){
+        int hits = 0;
+        for (int i = 0; i < ops; i += 1){
+            int k = (s*ops + i) % WORKLOAD_SIZE;
+            hits += grid.contains_any(w.x[k], w.y[k]);
+        }
+        sink = hits;
+    });
+    vector<unsigned char> hits(WORKLOAD_SIZE);
+    const double *angles[3] = {w.angles[0].data(), w.angles[1].data(), w.angles[2].data()};
+    runner.run("obstacles/intersection_batch_10000", 1, WORKLOAD_SIZE, [&](int, int){
+        grid.intersection_batch(w.config, WORKLOAD_SIZE, angles, hits.data());
+        sink = hits[0];
+    });
+
+    Manipulator manipulator;
+    runner.run("obstacles/arm_collision_10000", 1, ops, [&](int, int s){
+        double joints[INLINE_LINKS];
+        int collisions = 0;
+        for (int i = 0; i < ops; i += 1){
+            w.pose(s*ops + i, joints);
+            manipulator.forward_kinematics(joints);
+            collisions += manipulator.arm_collision(grid) >= 0;
+        }
+        sink = collisions;
+    });
+    runner.run("obstacles/collision_batch_10000", 1, WORKLOAD_SIZE, [&](int, int){
+        grid.collision_batch(w.config, WORKLOAD_SIZE, angles, hits.data());
+        sink = hits[0];
+    });
+    ObstacleSet few;
+    for (int i = 0; i < OBSTACLE_SIMD_MAX_CIRCLES; i += 1){
+        few.add(position(rng), position(rng), 0.1);
+    }
+    few.build();
+    runner.run("obstacles/arm_collision_32", 1, ops, [&](int, int s){
+        double joints[INLINE_LINKS];
+        int collisions = 0;
+        for (int i = 0; i < ops; i += 1){
+            w.pose(s*ops + i, joints);
+            manipulator.forward_kinematics(joints);
+            collisions += manipulator.arm_collision(few) >= 0;
+        }
+        sink = collisions;
+    });
+    runner.run("obstacles/collision_batch_32", 1, WORKLOAD_SIZE, [&](int, int){
+        few.collision_batch(w.config, WORKLOAD_SIZE, angles, hits.data());
+        sink = hits[0];
+    });
+}
+
+
+// Chains curled over 300 degrees never touch themselves, so every check
+// runs to the end. Each sample moves to a slightly different curl.
+void bench_self_collision(BenchRunner &runner){
+    const int variants = 16;
+    int sizes[3] = {10, 100, 1000};
+    mt19937_64 rng(SEED);
+    for (int s = 0; s < 3; s += 1){
+        int n = sizes[s];
+        string suffix = "_" + to_string(n);
+        uniform_real_distribution<double> jitter(-0.1, 0.1);
+        vector<double> links(n, 1.0), angles(n), theta(n + 1);
+        vector<vector<double> > x(variants, vector<double>(n + 1));
+        vector<vector<double> > y(variants, vector<double>(n + 1));
+        for (int v = 0; v < variants; v += 1){
+            for (int i = 0; i < n; i += 1){
+                angles[i] = 300.0 / n * (1.0 + jitter(rng));
+            }
+            compute_joint_frames(n, links.data(), angles.data(), 0, x[v].data(), y[v].data(), 
+                                theta.data());
+        }
+
+        runner.run("self_collision/naive" + suffix, 1, 1, [&](int, int k){
+            sink = compute_self_collision_naive(n, x[k % variants].data(), 
+                                                y[k % variants].data(), NULL, NULL);
+        });
+        SelfCollisionChecker checker;
+        runner.run("self_collision/sweep_and_prune" + suffix, 1, 1, [&](int, int k){
+            sink = checker.check(n, x[k % variants].data(), y[k % variants].data(), NULL, NULL);
+        });
+    }
+}
+
+
+// Hyper-redundant chains: the one link at a time libm loop of short arms
+// against the vectorized long chain path of compute_joint_frames.
+void bench_long_chain(BenchRunner &runner){
+    int sizes[3] = {100, 1000, 10000};
+    mt19937_64 rng(SEED);
+    uniform_real_distribution<double> angle(-10.0, 10.0);
+    for (int s = 0; s < 3; s += 1){
+        int n = sizes[s];
+        string suffix = "_" + to_string(n);
+        Configuration config;
+        config.resize(n);
+        for (int i = 0; i < n; i += 1){
+            config.links[i] = 1.0;
+            config.angles[i] = angle(rng);
+        }
+        vector<double> x(n + 1), y(n + 1), theta(n + 1), jacobian(3*n);
+
+        runner.run("long_chain/libm_fk" + suffix, 1, 1, [&](int, int){
+            double t = 0, px = 0, py = 0;
+            for (int i = 0; i < n; i += 1){
+                t += config.angles[i];
+                px += config.links[i]*cos(t*3.14159265359/180.0);
+                py += config.links[i]*sin(t*3.14159265359/180.0);
+                x[i + 1] = px;
+                y[i + 1] = py;
+            }
+            sink = x[n];
+        });
+        runner.run("long_chain/joint_frames" + suffix, 1, 1, [&](int, int){
+            compute_joint_frames(n, config.links, config.angles, 0, x.data(), y.data(), theta.data());
+            sink = x[n];
+        });
+        runner.run("long_chain/jacobian" + suffix, 1, 1, [&](int, int){
+            compute_jacobian(config, config.angles, jacobian.data());
+            sink = jacobian[0];
+        });
+    }
+}
+
+
+// One very long chain on one thread and with the parallel scan on 2 to
+// --threads workers, forced past the crossover so every thread count is
+// measured: scan_1t is the serial path.
+void bench_parallel_chain(BenchRunner &runner){
+    int sizes[3] = {10000, 100000, 1000000};
+    mt19937_64 rng(SEED);
+    uniform_real_distribution<double> angle(-10.0, 10.0);
+    int max_threads = max(runner.options.max_threads, 2);
+    vector<unique_ptr<ThreadPool>> pools(max_threads + 1);
+    for (int threads = 2; threads <= max_threads; threads += 1){
+        ThreadPoolOptions pool_options = default_thread_pool_options();
+        pool_options.threads = threads;
+        pools[threads].reset(new ThreadPool(pool_options));
+    }
+    for (int s = 0; s < 3; s += 1){
+        int n = sizes[s];
+        string suffix = "_" + to_string(n);
+        vector<double> links(n, 1.0), angles(n), x(n + 1), y(n + 1), theta(n + 1);
+        for (int i = 0; i < n; i += 1){
+            angles[i] = angle(rng);
+        }
+        runner.run("parallel_chain/scan_1t" + suffix, 1, 1, [&](int, int){
+            compute_joint_frames(n, links.data(), angles.data(), 0, x.data(), y.data(), theta.data());
+            sink = x[n];
+        });
+        for (int threads = 2; threads <= max_threads; threads += 1){
+            ParallelChainOptions options = default_parallel_chain_options();
+            options.threads = threads;
+            options.min_threads = 2;
+            options.min_links_per_thread = 1;
+            options.pool = pools[threads].get();
+            runner.run("parallel_chain/scan_" + to_string(threads) + "t" + suffix, 1, 1, [&](int, int){
+                compute_joint_frames_parallel(n, links.data(), angles.data(), 0, 
+                                            x.data(), y.data(), theta.data(), options);
+                sink = x[n];
+            });
+        }
+    }
+}
+
+
+void bench_ik_cache(BenchRunner &runner){
+    const int ops = 256;
+    const int fixtures = 16;
+    Workload w(3);
+    Manipulator manipulator;
+    manipulator.enable_ik_cache(default_ik_cache_options());
+
+    runner.run("ik_cache/inverse_kinematics_hit", 1, ops, [&](int, int s){
+        double angles_1[INLINE_LINKS], angles_2[INLINE_LINKS];
+        for (int i = 0; i < ops; i += 1){
+            int k = (s + i) % fixtures;
+            manipulator.inverse_kinematics(w.x[k], w.y[k], w.theta[k], angles_1, angles_2);
+        }
+        sink = angles_1[0];
+    });
+    runner.run("ik_cache/inverse_kinematics_miss", 1, ops, [&](int, int s){
+        double angles_1[INLINE_LINKS], angles_2[INLINE_LINKS];
+        for (int i = 0; i < ops; i += 1){
+            int k = (s*ops + i) % WORKLOAD_SIZE;
+            manipulator.inverse_kinematics(w.x[k] + 1e-6*s, w.y[k], w.theta[k], angles_1, angles_2);
+        }
+        sink = angles_1[0];
+    });
+}
+
+
+void bench_ik_scheduler(BenchRunner &runner){
+    Workload w(3);
+    IkScheduler scheduler(w.config);
+    int callers[2] = {1, 16};
+    for (int c = 0; c < 2; c += 1){
+        runner.run("scheduler/solve_c" + to_string(callers[c]), callers[c], 1, [&](int t, int s){
+            double angles_1[3], angles_2[3];
+            int k = (t*977 + s) % WORKLOAD_SIZE;
+            scheduler.solve(w.x[k], w.y[k], w.theta[k], angles_1, angles_2);
+            sink = angles_1[0];
+        });
+    }
+}
+
+
+// One resolved-rate cycle, which bounds the control rate, then the cost of
+// reading the state while a 10 kHz loop publishes it.
+void bench_velocity_control(BenchRunner &runner){
+    const int ops = 256;
+    int sizes[2] = {6, 100};
+    Twist twist = {0.1, -0.05, 2.0};
+    Workload w(6);
+    for (int c = 0; c < 2; c += 1){
+        int n = sizes[c];
+        Configuration config;
+        config.resize(n);
+        for (int i = 0; i < n; i += 1){
+            config.links[i] = 1.0;
+        }
+        vector<double> angles(n), jacobian(3*n), velocities(n);
+        runner.run("velocity/cycle_" + to_string(n), 1, ops, [&](int, int s){
+            for (int i = 0; i < ops; i += 1){
+                int k = (s*ops + i) % WORKLOAD_SIZE;
+                for (int j = 0; j < n; j += 1){
+                    angles[j] = w.angles[j % 6][k];
+                }
+                compute_jacobian(config, angles.data(), jacobian.data());
+                compute_joint_velocities(n, jacobian.data(), twist, 1e-3*n, 1.0, velocities.data());
+            }
+            sink = velocities[0];
+        });
+    }
+
+    double angles[INLINE_LINKS], velocities[INLINE_LINKS];
+    w.pose(0, angles);
+    VelocityControllerOptions options = default_velocity_controller_options();
+    options.rate_hz = VELOCITY_CONTROL_MAX_HZ;
+    VelocityController controller(w.config, angles, options);
+    controller.set_twist(twist);
+    controller.start();
+    runner.run("velocity/get_state_10khz", 1, 1, [&](int, int){
+        controller.get_state(angles, velocities);
+        sink = velocities[0];
+    });
+    controller.stop();
+}
+
+
+void bench_math_backend(BenchRunner &runner){
+    const int ops = 256;
+    Workload w(3);
+    Workload w6(6);
+    const MathBackend backends[2] = {MATH_LIBM, MATH_FAST};
+    const char *names[2] = {"libm", "fast"};
+
+    for (int m = 0; m < 2; m += 1){
+        MathBackend math = backends[m];
+        string suffix = string("_") + names[m];
+        runner.run("math/compute_forward_kinematics_6" + suffix, 1, ops, [&](int, int s){
+            double angles[INLINE_LINKS];
+            double acc = 0;
+            for (int i = 0; i < ops; i += 1){
+                w6.pose(s*ops + i, angles);
+                acc += compute_forward_kinematics(w6.config, angles, math).x;
+            }
+            sink = acc;
+        });
+        runner.run("math/compute_inverse_kinematics" + suffix, 1, ops, [&](int, int s){
+            double angles_1[INLINE_LINKS], angles_2[INLINE_LINKS];
+            for (int i = 0; i < ops; i += 1){
+                int k = (s*ops + i) % WORKLOAD_SIZE;
+                compute_inverse_kinematics(w.config, w.x[k], w.y[k], w.theta[k], angles_1, angles_2,
+                                        math);
+            }
+            sink = angles_1[0];
+        });
+        runner.run("math/compute_inverse_dynamics_6" + suffix, 1, ops, [&](int, int s){
+            double angles[INLINE_LINKS], torques[INLINE_LINKS];
+            for (int i = 0; i < ops; i += 1){
+                w6.pose(s*ops + i, angles);
+                compute_inverse_dynamics(w6.config, angles, 1.0, 0.5, 0.1, torques, math);
+            }
+            sink = torques[0];
+        });
+    }
+}
+
+
+// Radian entry points next to the degree ones of bench_math_backend and
+// bench_batch, same poses converted once up front
+void bench_radian_api(BenchRunner &runner){
+    const int ops = 256;
+    const int count = WORKLOAD_SIZE;
+    Workload w(3);
+    Workload w6(6);
+    vector<double> rad6[6];
+    for (int j = 0; j < 6; j += 1){
+        rad6[j].resize(count);
+        for (int i = 0; i < count; i += 1){
+            rad6[j][i] = w6.angles[j][i]*FAST_DEG_TO_RAD;
+        }
+    }
+    vector<double> rad3[3];
+    const double *angles[3];
+    for (int j = 0; j < 3; j += 1){
+        rad3[j].resize(count);
+        for (int i = 0; i < count; i += 1){
+            rad3[j][i] = w.angles[j][i]*FAST_DEG_TO_RAD;
+        }
+        angles[j] = rad3[j].data();
+    }
+    vector<double> theta_rad(count);
+    for (int i = 0; i < count; i += 1){
+        theta_rad[i] = w.theta[i]*FAST_DEG_TO_RAD;
+    }
+    const MathBackend backends[2] = {MATH_LIBM, MATH_FAST};
+    const char *names[2] = {"libm", "fast"};
+
+    for (int m = 0; m < 2; m += 1){
+        MathBackend math = backends[m];
+        string suffix = string("_") + names[m];
+        runner.run("radian/compute_forward_kinematics_6" + suffix, 1, ops, [&](int, int s){
+            double pose[INLINE_LINKS];
+            double acc = 0;
+            for (int i = 0; i < ops; i += 1){
+                int k = (s*ops + i) % WORKLOAD_SIZE;
+                for (int j = 0; j < 6; j += 1){
+                    pose[j] = rad6[j][k];
+                }
+                acc += compute_forward_kinematics_rad(w6.config, pose, math).x;
+            }
+            sink = acc;
+        });
+        runner.run("radian/compute_inverse_kinematics" + suffix, 1, ops, [&](int, int s){
+            double angles_1[INLINE_LINKS], angles_2[INLINE_LINKS];
+            for (int i = 0; i < ops; i += 1){
+                int k = (s*ops + i) % WORKLOAD_SIZE;
+                compute_inverse_kinematics_rad(w.config, w.x[k], w.y[k], theta_rad[k],
+                                            angles_1, angles_2, math);
+            }
+            sink = angles_1[0];
+        });
+    }
+
+    vector<double> x(count), y(count), theta(count);
+    vector<double> out[6];
+    for (int j = 0; j < 6; j += 1){
+        out[j].resize(count);
+    }
+    vector<unsigned char> reachable(count);
+    double *angles_1[3] = {out[0].data(), out[1].data(), out[2].data()};
+    double *angles_2[3] = {out[3].data(), out[4].data(), out[5].data()};
+    runner.run("radian/forward_kinematics_batch", 1, count, [&](int, int){
+        forward_kinematics_batch_rad(w.config, count, angles, x.data(), y.data(), theta.data());
+        sink = x[0];
+    });
+    runner.run("radian/inverse_kinematics_batch", 1, count, [&](int, int){
+        inverse_kinematics_batch_rad(w.config, count, w.x.data(), w.y.data(), theta_rad.data(),
+                                    angles_1, angles_2, reachable.data());
+        sink = out[0][0];
+    });
+}
+
+
+// Single precision kernels against the double ones, and the three
+// precisions of the end effector circle test
+void bench_precision(BenchRunner &runner){
+    const int count = WORKLOAD_SIZE;
+    Workload w(6);
+    vector<float> angles_f[6];
+    const double *angles[6];
+    const float *rows_f[6];
+    for (int j = 0; j < 6; j += 1){
+        angles_f[j].assign(w.angles[j].begin(), w.angles[j].end());
+        angles[j] = w.angles[j].data();
+        rows_f[j] = angles_f[j].data();
+    }
+    vector<float> x(count), y(count), theta(count);
+    vector<double> xd(count), yd(count), td(count);
+    vector<unsigned char> hits(count);
+
+    SimdLevel levels[4] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512};
+    for (int l = 0; l < 4; l += 1){
+        if (levels[l] > detect_simd_level()){
+            continue;
+        }
+        SimdLevel level = levels[l];
+        runner.run(string("precision/forward_kinematics_6_double_") + simd_level_name(level), 1,
+                count, [&, level](int, int){
+            forward_kinematics_batch(w.config, count, angles, xd.data(), yd.data(), td.data(),
+                                    level);
+            sink = xd[0];
+        });
+        runner.run(string("precision/forward_kinematics_6_float_") + simd_level_name(level), 1,
+                count, [&, level](int, int){
+            forward_kinematics_batch(w.config, count, rows_f, x.data(), y.data(), theta.data(),
+                                    level);
+            sink = x[0];
+        });
+    }
+    const Precision precisions[3] = {PRECISION_DOUBLE, PRECISION_FLOAT, PRECISION_MIXED};
+    const char *names[3] = {"double", "float", "mixed"};
+    for (int p = 0; p < 3; p += 1){
+        Precision precision = precisions[p];
+        runner.run(string("precision/intersection_6_") + names[p], 1, count, [&, precision](int, int){
+            intersection_batch(w.config, 1.0, 2.0, 1.5, count, angles, hits.data(), precision, NULL);
+            sink = hits[0];
+        });
+    }
+}
+
+
+void bench_socket_server(BenchRunner &runner){
+    const int pipeline = 64;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/robot-manipulator-bench-%d.sock", (int)getpid());
+    SocketServer server;
+    SocketClient client;
+    if (!server.listen(path)){
+        return;
+    }
+    thread serving([&server](){ server.run(); });
+    if (client.connect(path)){
+        Workload w(3);
+        SocketResponse response;
+        double angles[3];
+        runner.run("socket/round_trip", 1, 1, [&](int, int s){
+            for (int j = 0; j < 3; j += 1){
+                angles[j] = w.angles[j][s % WORKLOAD_SIZE];
+            }
+            client.send(OP_FORWARD, s, angles, 3);
+            client.receive(response);
+            sink = response.values[0];
+        });
+        runner.run("socket/pipelined_forward_x" + to_string(pipeline), 1, pipeline, [&](int, int s){
+            for (int i = 0; i < pipeline; i += 1){
+                int k = (s*pipeline + i) % WORKLOAD_SIZE;
+                for (int j = 0; j < 3; j += 1){
+                    angles[j] = w.angles[j][k];
+                }
+                client.send(OP_FORWARD, i, angles, 3);
+            }
+            for (int i = 0; i < pipeline; i += 1){
+                client.receive(response);
+            }
+            sink = response.values[0];
+        });
+        client.close();
+    }
+    server.stop();
+    serving.join();
+    server.close();
+}
+
+
+void print_usage(){
+    cout << "Usage: run-benchmarks [--format text|csv|json] [--threads N] "
+        << "[--samples N] [--filter NAME]\n";
+}
+
+
+int main(int argc, char **argv)
+{
+    BenchRunner runner;
+    runner.first = true;
+    runner.options.format = "text";
+    runner.options.max_threads = (int)thread::hardware_concurrency();
+    runner.options.samples = 2000;
+    if (runner.options.max_threads < 1){
+        runner.options.max_threads = 1;
+    }
+
+    for (int i = 1; i < argc; i += 1){
+        string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc){
+            runner.options.format = argv[++i];
+        }
+        else if (arg == "--threads" && i + 1 < argc){
+            runner.options.max_threads = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--samples" && i + 1 < argc){
+            runner.options.samples = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--filter" && i + 1 < argc){
+            runner.options.filter = argv[++i];
+        }
+        else{
+            print_usage();
+            return 1;
+        }
+    }
+    if (runner.options.format != "text" && runner.options.format != "csv"
+            && runner.options.format != "json"){
+        print_usage();
+        return 1;
+    }
+
+    print_header(runner.options);
+    bench_manipulator(runner);
+    bench_math_backend(runner);
+    bench_radian_api(runner);
+    bench_fixed_manipulator<3>(runner);
+    bench_fixed_manipulator<6>(runner);
+    bench_fixed_manipulator<10>(runner);
+    bench_batch(runner);
+    bench_precision(runner);
+    bench_threads(runner);
+    bench_thread_pool(runner);
+    bench_reachability(runner);
+    bench_obstacles(runner);
+    bench_self_collision(runner);
+    bench_long_chain(runner);
+    bench_parallel_chain(runner);
+    bench_socket_server(runner);
+    bench_ik_scheduler(runner);
+    bench_ik_cache(runner);
+    bench_velocity_control(runner);
+    print_footer(runner.options);
+    return 0;
+}
@@ -0,0 +1,120 @@
+/********
+ * batch_kinematics.h
+ * Author: Simon Chamorro
+ * Batched structure-of-arrays kinematics with SIMD dispatch
+********/
+
+#ifndef BATCH_KINEMATICS_H
+#define BATCH_KINEMATICS_H
+
+#include "robot_configuration.h"
+
+using namespace std;
+
+// Max absolute difference between SIMD kernels and the scalar path, in
+// length units for x and y and in degrees for theta (|angles| <= 1e4 deg).
+const double BATCH_FK_TOLERANCE = 1e-9;
+
+// Max absolute difference in degrees between SIMD and scalar IK kernels,
+// away from the workspace boundary where the elbow angle is ill-conditioned.
+const double BATCH_IK_TOLERANCE = 1e-9;
+
+// Slack on cos(theta2) accepted as reachable, absorbs rounding on the
+// outer and inner workspace boundaries.
+const double BATCH_IK_REACH_TOLERANCE = 1e-12;
+
+// Decisions of intersection_batch. PRECISION_MIXED screens with the float
+// kernels and recomputes in double the poses within float_fk_error_bound
+// of the decision boundary, so it gives the same answers as PRECISION_DOUBLE.
+enum Precision{
+    PRECISION_DOUBLE = 0,
+    PRECISION_FLOAT,
+    PRECISION_MIXED
+};
+
+// Single precision forward kinematics against the double kernels
+struct PrecisionReport{
+
+    int count;
+    double max_position_error;      // Distance between end effectors
+    double mean_position_error;
+    double max_theta_error;         // In degrees
+    double max_bound_ratio;         // Error over float_fk_error_bound, at most 1
+};
+
+enum SimdLevel{
+    SIMD_SCALAR = 0,
+    SIMD_SSE2,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+SimdLevel detect_simd_level();
+const char *simd_level_name(SimdLevel level);
+
+bool forward_kinematics_batch(const Configuration &config, int count, 
+                            const double *const *angles, 
+                            double *x, double *y, double *theta);
+bool forward_kinematics_batch(const Configuration &config, int count, 
+                            const double *const *angles, 
+                            double *x, double *y, double *theta, SimdLevel level);
+
+bool joint_positions_batch(const Configuration &config, int count,
+                        const double *const *angles,
+                        double *const *joint_x, double *const *joint_y);
+bool joint_positions_batch(const Configuration &config, int count,
+                        const double *const *angles,
+                        double *const *joint_x, double *const *joint_y, SimdLevel level);
+
+void link_vectors_batch(int count, const double *links, const double *theta,
+                        double *dx, double *dy);
+void link_vectors_batch(int count, const double *links, const double *theta,
+                        double *dx, double *dy, SimdLevel level);
+
+bool inverse_kinematics_batch(const Configuration &config, int count, 
+                            const double *x, const double *y, const double *theta, 
+                            double *const *angles_1, double *const *angles_2, 
+                            unsigned char *reachable);
+bool inverse_kinematics_batch(const Configuration &config, int count, 
+                            const double *x, const double *y, const double *theta, 
+                            double *const *angles_1, double *const *angles_2, 
+                            unsigned char *reachable, SimdLevel level);
+
+// Radian variants, same kernels without any unit conversion
+bool forward_kinematics_batch_rad(const Configuration &config, int count,
+                                const double *const *angles,
+                                double *x, double *y, double *theta);
+bool forward_kinematics_batch_rad(const Configuration &config, int count,
+                                const double *const *angles,
+                                double *x, double *y, double *theta, SimdLevel level);
+void link_vectors_batch_rad(int count, const double *links, const double *theta,
+                            double *dx, double *dy);
+void link_vectors_batch_rad(int count, const double *links, const double *theta,
+                            double *dx, double *dy, SimdLevel level);
+bool inverse_kinematics_batch_rad(const Configuration &config, int count,
+                                const double *x, const double *y, const double *theta,
+                                double *const *angles_1, double *const *angles_2,
+                                unsigned char *reachable);
+bool inverse_kinematics_batch_rad(const Configuration &config, int count,
+                                const double *x, const double *y, const double *theta,
+                                double *const *angles_1, double *const *angles_2,
+                                unsigned char *reachable, SimdLevel level);
+
+// Single precision variants, twice the lanes of the double kernels
+bool forward_kinematics_batch(const Configuration &config, int count,
+                            const float *const *angles, float *x, float *y, float *theta);
+bool forward_kinematics_batch(const Configuration &config, int count,
+                            const float *const *angles, float *x, float *y, float *theta,
+                            SimdLevel level);
+double float_fk_error_bound(const Configuration &config, double angle_sum);
+bool intersection_batch(const Configuration &config, double x, double y, double r, int count,
+                        const double *const *angles, unsigned char *hits, Precision precision,
+                        int *refined);
+bool float_precision_report(const Configuration &config, int count, const double *const *angles,
+                            PrecisionReport &report);
+
+bool inverse_dynamics_batch(const Configuration &config, const double *angles, int count, 
+                            const double *fx, const double *fy, const double *tau, 
+                            double *const *torques);
+
+#endif
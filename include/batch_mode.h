@@ -0,0 +1,28 @@
+/********
+ * batch_mode.h
+ * Author: Simon Chamorro
+ * Non-interactive command stream for the Robot Manipulator program
+********/
+
+#ifndef BATCH_MODE_H
+#define BATCH_MODE_H
+
+#include <stdio.h>
+
+using namespace std;
+
+
+// Decimals accepted by BatchOptions::precision, past 17 a double has no more
+const int BATCH_MAX_PRECISION = 17;
+
+
+struct BatchOptions{
+
+    int flush_every;    // Flush output every N commands, 0 to flush only at the end
+    int precision;      // Decimals printed for each number, in [0, BATCH_MAX_PRECISION]
+};
+
+BatchOptions default_batch_options();
+int run_batch(FILE *in, FILE *out, const BatchOptions &options);
+
+#endif
@@ -0,0 +1,106 @@
+/********
+ * columnar_io.h
+ * Author: Simon Chamorro
+ * Binary columnar files of joint angles and poses
+ *
+ * Layout (native little endian):
+ *   header   magic "RMCOL001", byte order tag, num_links, column type,
+ *            column set, block rows, num rows, then num_links link lengths
+ *            as float64, zero padded to COLUMNAR_ALIGNMENT bytes
+ *   blocks   rows are stored in blocks of block_rows (the last block may be
+ *            shorter), each block holds one contiguous column after another:
+ *            angle of joint 1..num_links, then x, y, theta
+ * Every column of every block starts on a COLUMNAR_ALIGNMENT boundary.
+********/
+
+#ifndef COLUMNAR_IO_H
+#define COLUMNAR_IO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "robot_configuration.h"
+
+using namespace std;
+
+const int COLUMNAR_ALIGNMENT = 64;
+const int COLUMNAR_BLOCK_ROWS = 16384;
+
+enum ColumnType{
+    COLUMN_FLOAT32 = 4,
+    COLUMN_FLOAT64 = 8
+};
+
+// Which columns a file holds, may be combined
+enum ColumnSet{
+    COLUMNS_ANGLES = 1,
+    COLUMNS_POSE = 2
+};
+
+
+// Writes rows one block at a time, memory use is one block
+class ColumnarWriter{
+    public:
+        ColumnarWriter();
+        ~ColumnarWriter();
+
+        bool open(const char *path, const Configuration &config, ColumnType type,
+                int column_set);
+        bool open(const char *path, const Configuration &config, ColumnType type,
+                int column_set, int block_rows);
+        bool write(int count, const double *const *columns);
+        bool write_row(const double *values);
+        bool close();
+        int get_num_columns() const;
+        int64_t get_num_rows() const;
+
+    private:
+        bool flush_block();
+
+        FILE *file;
+        int num_columns;
+        int block_rows;
+        int pending;
+        ColumnType type;
+        int64_t num_rows;
+        vector<double> block;
+        vector<float> narrow;
+};
+
+
+// Maps a whole file read only, columns are read in place
+class ColumnarReader{
+    public:
+        ColumnarReader();
+        ~ColumnarReader();
+
+        bool open(const char *path);
+        void close();
+        const Configuration &get_config() const;
+        ColumnType get_type() const;
+        int get_column_set() const;
+        int get_num_columns() const;
+        int64_t get_num_rows() const;
+        int get_num_blocks() const;
+        int get_block_rows(int block) const;
+        const void *column(int block, int column) const;
+        const double *column_f64(int block, int column) const;
+        const float *column_f32(int block, int column) const;
+        bool read(int64_t first, int count, int column, double *out) const;
+
+    private:
+        const unsigned char *data;
+        size_t size;
+        Configuration robot_config;
+        ColumnType type;
+        int column_set;
+        int num_columns;
+        int block_rows;
+        int64_t num_rows;
+        size_t header_size;
+};
+
+int columnar_num_columns(int num_links, int column_set);
+bool forward_kinematics_columnar(const ColumnarReader &in, ColumnarWriter &out);
+
+#endif
@@ -0,0 +1,250 @@
+/********
+ * fast_math.h
+ * Author: Simon Chamorro
+ * Branch-free polynomial math kernels for the kinematics hot path
+********/
+
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include <math.h>
+
+using namespace std;
+
+#define FAST_MATH_INLINE inline __attribute__((always_inline))
+
+const double FAST_DEG_TO_RAD = 1.74532925199432957692e-2;
+const double FAST_RAD_TO_DEG = 5.72957795130823208768e1;
+const double FAST_PI = 3.14159265358979323846;
+const double FAST_2_OVER_PI = 6.36619772367581382433e-1;
+
+// pi/2 in three parts, the first with 33 significant bits so k*FAST_PIO2_1
+// is exact for |k| < 2^20
+const double FAST_PIO2_1 = 1.57079632673412561417e+00;
+const double FAST_PIO2_2 = 6.07710050630396597660e-11;
+const double FAST_PIO2_3 = 2.02226624879595063154e-21;
+
+// Inputs of fast_sincos up to this magnitude are reduced exactly
+const double FAST_SINCOS_MAX_RAD = 1.5e6;
+
+// Max absolute error of fast_sincos_deg against the exact sine and cosine,
+// and the same error expressed as an angle, over |deg| < 2^51. Also holds
+// for fast_sincos over |rad| < FAST_SINCOS_MAX_RAD.
+const double FAST_SINCOS_MAX_ERROR = 4e-16;
+const double FAST_SINCOS_MAX_ERROR_DEG = 2.5e-14;
+
+// Max absolute error in degrees of fast_acos_deg and fast_asin_deg over
+// [-1, 1], and of fast_atan2 times FAST_RAD_TO_DEG
+const double FAST_ACOS_MAX_ERROR_DEG = 6e-14;
+const double FAST_ATAN2_MAX_ERROR_DEG = 6e-14;
+
+// Single precision counterparts, for kernels that trade accuracy for twice
+// the lanes. Max absolute error of fast_sincosf_deg over |deg| < 2^22.
+const float FAST_DEG_TO_RAD_F = 1.74532925199432957692e-2f;
+const double FAST_SINCOSF_MAX_ERROR = 1.2e-7;
+
+// Inputs of fast_wrap_180 up to this magnitude (2^51) are wrapped exactly
+constexpr double FAST_WRAP_MAX_DEG = 2251799813685248.0;
+
+// Inputs of fast_wrap_pi up to this magnitude are wrapped exactly
+const double FAST_WRAP_MAX_RAD = 1e6;
+
+// Round to nearest integer with the 1.5*2^52 trick. Valid for |x| < 2^51,
+// needs no SSE4.1 rounding instruction so it vectorizes on every target.
+FAST_MATH_INLINE constexpr double fast_round(double x){
+    const double magic = 6755399441055744.0;
+    return (x + magic) - magic;
+}
+
+
+// Sine and cosine of r + k*pi/2, for |r| <= pi/4 and k integral
+FAST_MATH_INLINE void fast_sincos_quadrant(double r, double k, double &s, double &c){
+    // Quadrant m = k mod 4 in {0, 1, 2, 3}, kept in floating point and
+    // combined arithmetically so no lane takes a branch
+    double m = k - 4.0*fast_round((k - 1.5) * 0.25);
+    double h = fast_round((m - 0.5) * 0.5);
+    double odd = m - 2.0*h;
+
+    double z = r*r;
+    double ps = ((((( 1.58962301576546568060e-10 *z
+                     -2.50507477628578072866e-8) *z
+                     +2.75573136213857245213e-6) *z
+                     -1.98412698295895385996e-4) *z
+                     +8.33333333332211858878e-3) *z
+                     -1.66666666666666307295e-1);
+    double pc = (((((-1.13585365213876817300e-11 *z
+                     +2.08757008419747316778e-9) *z
+                     -2.75573141792967388112e-7) *z
+                     +2.48015872888517045348e-5) *z
+                     -1.38888888888730564116e-3) *z
+                     +4.16666666666665929218e-2);
+    double s0 = r + r*z*ps;
+    double c0 = 1.0 - 0.5*z + z*z*pc;
+
+    double sin_sign = 1.0 - 2.0*h;
+    double cos_sign = 1.0 - 2.0*(odd - h)*(odd - h);
+    s = sin_sign * ((1.0 - odd)*s0 + odd*c0);
+    c = cos_sign * ((1.0 - odd)*c0 + odd*s0);
+}
+
+
+/**
+ * Sine and cosine of an angle given in degrees.
+ * The reduction to [-45, 45] degrees is exact, then Cephes minimax
+ * polynomials are evaluated on the remainder. Max error is about 1 ulp.
+ *
+ * @param[in] deg angle in degrees, |deg| < 2^51.
+ * @param[out] s sine of angle.
+ * @param[out] c cosine of angle.
+ */
+FAST_MATH_INLINE void fast_sincos_deg(double deg, double &s, double &c){
+    double k = fast_round(deg * (1.0/90.0));
+    double r = (deg - k*90.0) * FAST_DEG_TO_RAD;
+    fast_sincos_quadrant(r, k, s, c);
+}
+
+
+// Round to nearest integer with the 1.5*2^23 trick, for |x| < 2^22
+FAST_MATH_INLINE float fast_roundf(float x){
+    const float magic = 12582912.0f;
+    return (x + magic) - magic;
+}
+
+
+/**
+ * Single precision sine and cosine of an angle given in degrees. Same exact
+ * reduction and quadrant selection as fast_sincos_deg, with the Cephes
+ * sinf and cosf polynomials.
+ *
+ * @param[in] deg angle in degrees, |deg| < 2^22.
+ * @param[out] s sine of angle.
+ * @param[out] c cosine of angle.
+ */
+FAST_MATH_INLINE void fast_sincosf_deg(float deg, float &s, float &c){
+    float k = fast_roundf(deg * (1.0f/90.0f));
+    float r = (deg - k*90.0f) * FAST_DEG_TO_RAD_F;
+    float m = k - 4.0f*fast_roundf((k - 1.5f) * 0.25f);
+    float h = fast_roundf((m - 0.5f) * 0.5f);
+    float odd = m - 2.0f*h;
+
+    float z = r*r;
+    float s0 = ((-1.9515295891e-4f*z + 8.3321608736e-3f)*z - 1.6666654611e-1f)*z*r + r;
+    float c0 = ((2.443315711809948e-5f*z - 1.388731625493765e-3f)*z
+                + 4.166664568298827e-2f)*z*z - 0.5f*z + 1.0f;
+
+    float sin_sign = 1.0f - 2.0f*h;
+    float cos_sign = 1.0f - 2.0f*(odd - h)*(odd - h);
+    s = sin_sign * ((1.0f - odd)*s0 + odd*c0);
+    c = cos_sign * ((1.0f - odd)*c0 + odd*s0);
+}
+
+
+// Wrap an angle in degrees to (-180, 180] in single precision, |deg| < 2^22
+FAST_MATH_INLINE float fast_wrap_180f(float deg){
+    float w = deg - 360.0f*fast_roundf(deg * (1.0f/360.0f));
+    w = (w <= -180.0f) ? w + 360.0f : w;
+    return (w > 180.0f) ? w - 360.0f : w;
+}
+
+
+/**
+ * Sine and cosine of an angle given in radians.
+ * Cody-Waite reduction by pi/2 in three parts, exact while k*FAST_PIO2_1
+ * is, then the same polynomials as fast_sincos_deg.
+ *
+ * @param[in] rad angle in radians, |rad| < FAST_SINCOS_MAX_RAD.
+ * @param[out] s sine of angle.
+ * @param[out] c cosine of angle.
+ */
+FAST_MATH_INLINE void fast_sincos(double rad, double &s, double &c){
+    double k = fast_round(rad * FAST_2_OVER_PI);
+    double r = ((rad - k*FAST_PIO2_1) - k*FAST_PIO2_2) - k*FAST_PIO2_3;
+    fast_sincos_quadrant(r, k, s, c);
+}
+
+
+// Wrap an angle in degrees to (-180, 180] without loops, |deg| < FAST_WRAP_MAX_DEG
+FAST_MATH_INLINE constexpr double fast_wrap_180(double deg){
+    double w = deg - 360.0*fast_round(deg * (1.0/360.0));
+    w = (w <= -180.0) ? w + 360.0 : w;
+    return (w > 180.0) ? w - 360.0 : w;
+}
+
+
+// Wrap an angle in radians to (-pi, pi] without loops. 2*pi is removed in
+// two parts, exactly for |rad| < FAST_WRAP_MAX_RAD. Larger inputs are not
+// wrapped, wrap_angle_pi takes any angle.
+FAST_MATH_INLINE double fast_wrap_pi(double rad){
+    double k = fast_round(rad * (0.25*FAST_2_OVER_PI));
+    double w = (rad - k*(4.0*FAST_PIO2_1)) - k*(4.0*(FAST_PIO2_2 + FAST_PIO2_3));
+    w = (w <= -FAST_PI) ? w + 2.0*FAST_PI : w;
+    return (w > FAST_PI) ? w - 2.0*FAST_PI : w;
+}
+
+
+/**
+ * Four quadrant arc tangent of y/x, in radians.
+ * Octant reduction to |t| <= tan(pi/8) then the Cephes atan rational
+ * approximation, all selects are branch-free. Max error is about 2 ulp.
+ * Returns 0 for atan2(0, 0).
+ *
+ * @param[in] y ordinate.
+ * @param[in] x abscissa.
+ * @return angle in [-pi, pi].
+ */
+FAST_MATH_INLINE double fast_atan2(double y, double x){
+    double ax = (x < 0.0) ? -x : x;
+    double ay = (y < 0.0) ? -y : y;
+    double mx = (ax > ay) ? ax : ay;
+    double mn = (ax > ay) ? ay : ax;
+    // Divisions are done unconditionally, a guarded division is a branch
+    double a = mn / ((mx > 0.0) ? mx : 1.0);
+    double shifted = (a - 1.0) / (a + 1.0);
+
+    bool big = a > 0.41421356237309504880;
+    double t = big ? shifted : a;
+    double base = big ? 0.25*FAST_PI : 0.0;
+
+    double z = t*t;
+    double p = ((((-8.750608600031904122785e-1 *z
+                   -1.615753718733365076637e1) *z
+                   -7.500855792314704667340e1) *z
+                   -1.228866684490136173410e2) *z
+                   -6.485021904942025371773e1);
+    double q = (((((z
+                   +2.485846490142306297962e1) *z
+                   +1.650270098316988542046e2) *z
+                   +4.328810604912902668951e2) *z
+                   +4.853903996359136964868e2) *z
+                   +1.945506571482613964425e2);
+    double r = base + (t + t*z*p/q);
+
+    r = (ay > ax) ? 0.5*FAST_PI - r : r;
+    r = (x < 0.0) ? FAST_PI - r : r;
+    return (y < 0.0) ? -r : r;
+}
+
+
+// Arc cosine in radians as atan2(sqrt(1 - x^2), x). (1 - x)(1 + x) keeps full
+// precision next to +-1, where acos is steepest. x must be in [-1, 1].
+FAST_MATH_INLINE double fast_acos(double x){
+    return fast_atan2(sqrt((1.0 - x)*(1.0 + x)), x);
+}
+
+
+// Arc sine in radians, in [-pi/2, pi/2]. x must be in [-1, 1].
+FAST_MATH_INLINE double fast_asin(double x){
+    return fast_atan2(x, sqrt((1.0 - x)*(1.0 + x)));
+}
+
+
+FAST_MATH_INLINE double fast_acos_deg(double x){
+    return fast_acos(x)*FAST_RAD_TO_DEG;
+}
+
+
+FAST_MATH_INLINE double fast_asin_deg(double x){
+    return fast_asin(x)*FAST_RAD_TO_DEG;
+}
+
+#endif
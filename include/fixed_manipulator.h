@@ -0,0 +1,227 @@
+/********
+ * fixed_manipulator.h
+ * Author: Simon Chamorro
+ * Robot Manipulator with a number of links fixed at compile time
+********/
+
+#ifndef FIXED_MANIPULATOR_H
+#define FIXED_MANIPULATOR_H
+
+#include <array>
+#include <math.h>
+#include "kinematics.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+constexpr double FIXED_DEG_TO_RAD = 3.14159265359/180.0;
+
+constexpr double deg_to_rad(double angle){
+    return angle*FIXED_DEG_TO_RAD;
+}
+
+
+// Calls f(I), f(I + 1), ..., f(N - 1) with no loop left after inlining
+template <int I, int N>
+struct Unroll{
+    template <typename F>
+    static inline void run(F &&f){
+        f(I);
+        Unroll<I + 1, N>::run(f);
+    }
+};
+
+template <int N>
+struct Unroll<N, N>{
+    template <typename F>
+    static inline void run(F &&){
+    }
+};
+
+
+template <int N>
+struct FixedConfiguration{
+
+    static_assert(N > 0, "A manipulator needs at least one link");
+
+    array<double, N> links;
+    array<double, N> angles;
+    double x;
+    double y;
+    double theta;
+};
+
+
+template <int N>
+class FixedManipulator{
+    public:
+        FixedManipulator();
+        explicit FixedManipulator(const array<double, N> &links);
+
+        const FixedConfiguration<N> &get_config() const;
+        Configuration to_configuration() const;
+        bool reset();
+        bool set_parameters(const array<double, N> &links);
+        bool forward_kinematics(const array<double, N> &angles);
+        bool intersection(double x, double y, double r, const array<double, N> &angles);
+        void jacobian(array<array<double, N>, 3> &jac) const;
+        bool inverse_dynamics(double fx, double fy, double tau, array<double, N> &torques) const;
+
+    private:
+        FixedConfiguration<N> robot_config;
+};
+
+
+// Constructor, N links of length 1
+template <int N>
+FixedManipulator<N>::FixedManipulator(){
+    reset();
+}
+
+
+template <int N>
+FixedManipulator<N>::FixedManipulator(const array<double, N> &links){
+    set_parameters(links);
+}
+
+
+template <int N>
+const FixedConfiguration<N> &FixedManipulator<N>::get_config() const{
+    return robot_config;
+}
+
+
+// Copy into a runtime Configuration, to use the stateless kinematics API
+template <int N>
+Configuration FixedManipulator<N>::to_configuration() const{
+    Configuration config;
+    config.resize(N);
+    for (int i = 0; i < N; i += 1){
+        config.links[i] = robot_config.links[i];
+        config.angles[i] = robot_config.angles[i];
+    }
+    config.x = robot_config.x;
+    config.y = robot_config.y;
+    config.theta = robot_config.theta;
+    return config;
+}
+
+
+// Reset to default params
+template <int N>
+bool FixedManipulator<N>::reset(){
+    array<double, N> links;
+    links.fill(1.0);
+    return set_parameters(links);
+}
+
+
+/**
+ * Set Robot Manipulator link lengths, joints go back to 0.
+ *
+ * @param[in] links Array with links' lengths.
+ */
+template <int N>
+bool FixedManipulator<N>::set_parameters(const array<double, N> &links){
+    robot_config.links = links;
+    array<double, N> angles;
+    angles.fill(0.0);
+    return forward_kinematics(angles);
+}
+
+
+/**
+ * Move each joint of the Robot Manipulator to a specific angle.
+ * Angles are assumed to be in degres.
+ *
+ * @param[in] angles Array with desired joint angles.
+ * @return true once done.
+ */
+template <int N>
+bool FixedManipulator<N>::forward_kinematics(const array<double, N> &angles){
+    double theta = 0;
+    double x = 0;
+    double y = 0;
+    const array<double, N> &links = robot_config.links;
+    Unroll<0, N>::run([&](int i){
+        theta += angles[i];
+        x += links[i]*cos(deg_to_rad(theta));
+        y += links[i]*sin(deg_to_rad(theta));
+    });
+    robot_config.angles = angles;
+    robot_config.x = x;
+    robot_config.y = y;
+    robot_config.theta = clip_angle_180(theta);
+    return true;
+}
+
+
+/**
+ * Checks if end effector is within a given circle.
+ *
+ * @param[in] x coordinate of circle center.
+ * @param[in] y coordinate of circle center.
+ * @param[in] r radius of circle.
+ * @param[in] angles Array with desired joint angles.
+ * @return is_within_circle bool.
+ */
+template <int N>
+bool FixedManipulator<N>::intersection(double x, double y, double r,
+                                    const array<double, N> &angles){
+    forward_kinematics(angles);
+    return point_in_circle(x, y, r, robot_config.x, robot_config.y);
+}
+
+
+/**
+ * Jacobian of the end effector pose at the current configuration.
+ * Column i is the pose velocity for a unit velocity (rad/s) of joint i.
+ *
+ * @param[out] jac 3 x N Jacobian.
+ */
+template <int N>
+void FixedManipulator<N>::jacobian(array<array<double, N>, 3> &jac) const{
+    array<double, N> dx;
+    array<double, N> dy;
+    double theta = 0;
+    Unroll<0, N>::run([&](int i){
+        theta += robot_config.angles[i];
+        dx[i] = robot_config.links[i]*cos(deg_to_rad(theta));
+        dy[i] = robot_config.links[i]*sin(deg_to_rad(theta));
+    });
+
+    // Suffix sums, joint i moves every link from i to the end effector
+    double sum_x = 0;
+    double sum_y = 0;
+    Unroll<0, N>::run([&](int k){
+        const int i = N - 1 - k;
+        sum_x += dx[i];
+        sum_y += dy[i];
+        jac[0][i] = -sum_y;
+        jac[1][i] = sum_x;
+        jac[2][i] = 1.0;
+    });
+}
+
+
+/**
+ * Inverse dynamics of Robot Manipulator, torques = J^T * forces.
+ *
+ * @param[in] fx desired force at end effector.
+ * @param[in] fy desired force at end effector.
+ * @param[in] tau desired torque at end effector.
+ * @param[out] torques at robot joints.
+ * @return bool: true if success, false otherwise.
+ */
+template <int N>
+bool FixedManipulator<N>::inverse_dynamics(double fx, double fy, double tau,
+                                        array<double, N> &torques) const{
+    array<array<double, N>, 3> jac;
+    jacobian(jac);
+    Unroll<0, N>::run([&](int i){
+        torques[i] = jac[0][i]*fx + jac[1][i]*fy + jac[2][i]*tau;
+    });
+    return true;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/********
+ * ik_cache.h
+ * Author: Simon Chamorro
+ * Bounded concurrent cache of inverse kinematics solutions
+********/
+
+#ifndef IK_CACHE_H
+#define IK_CACHE_H
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include "kinematics.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+// Entries of one set, the oldest one is evicted when a set is full
+const int IK_CACHE_WAYS = 4;
+
+// Sets are split in shards with their own lock, so threads rarely contend
+const int IK_CACHE_SHARDS = 16;
+
+
+struct IkCacheOptions{
+
+    int capacity;               // Max entries, rounded up to whole sets
+    double position_tolerance;  // Size of a quantization cell along x and y, positive
+    double angle_tolerance;     // Size of a quantization cell along theta in degrees, positive
+};
+
+IkCacheOptions default_ik_cache_options();
+
+// Counters since the cache was created or since reset_stats
+struct IkCacheStats{
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    int size;       // Entries held
+    int capacity;
+};
+
+uint64_t hash_links(const Configuration &config);
+
+
+// Closed form 3 links solutions keyed by the quantized target pose, a hash
+// of the link lengths and the math backend. Targets in the same quantization cell share
+// the solution of the first one solved, exact repeats always get the exact
+// answer. Unreachable targets are cached too.
+class IkCache{
+    public:
+        IkCache();
+        explicit IkCache(const IkCacheOptions &options);
+        ~IkCache();
+
+        bool solve(const Configuration &config, uint64_t links_hash, double x, double y,
+                double theta, double *angles_1, double *angles_2);
+        bool solve(const Configuration &config, uint64_t links_hash, double x, double y,
+                double theta, double *angles_1, double *angles_2, MathBackend math);
+        void clear();
+        IkCacheOptions get_options() const;
+        IkCacheStats get_stats() const;
+        void reset_stats();
+
+    private:
+        struct Entry;
+        struct Shard;
+
+        bool quantize(double x, double y, double theta, uint64_t links_hash,
+                    Entry &key, uint64_t &hash) const;
+
+        IkCacheOptions options;
+        double inv_position;
+        double inv_angle;
+        int sets_per_shard;
+        unique_ptr<Shard[]> shards;
+        atomic<uint64_t> hits;
+        atomic<uint64_t> misses;
+        atomic<uint64_t> evictions;
+        atomic<int> size;
+};
+
+#endif
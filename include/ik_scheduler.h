@@ -0,0 +1,83 @@
+/********
+ * ik_scheduler.h
+ * Author: Simon Chamorro
+ * Micro-batching scheduler for independent inverse kinematics requests
+********/
+
+#ifndef IK_SCHEDULER_H
+#define IK_SCHEDULER_H
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#include "robot_configuration.h"
+
+using namespace std;
+
+// Latencies kept for the percentiles of get_stats, the most recent ones win
+const int IK_SCHEDULER_LATENCY_SAMPLES = 8192;
+
+
+struct IkSchedulerOptions{
+
+    int max_batch;          // Dispatch as soon as this many requests wait
+    double max_delay_us;    // Dispatch once the oldest request waited this long
+};
+
+IkSchedulerOptions default_ik_scheduler_options();
+
+struct IkResult{
+
+    bool reachable;
+    double angles_1[3];     // Same solutions as inverse_kinematics_batch
+    double angles_2[3];
+};
+
+typedef function<void(const IkResult &result)> IkCallback;
+
+// Counters since the scheduler started or since reset_stats
+struct IkSchedulerStats{
+
+    uint64_t requests;
+    uint64_t batches;
+    uint64_t full_batches;      // Dispatched because max_batch requests waited
+    uint64_t deadline_batches;  // Dispatched at the deadline, on flush or on exit
+    vector<uint64_t> batch_sizes;   // Batches of each size, index 0 unused
+    double mean_batch;
+    // Time from submit to the callback, in us, over the latest samples
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double max_us;
+};
+
+
+// Collects requests from any number of threads and solves them together
+// with the vectorized inverse_kinematics_batch on one dispatcher thread.
+// A batch leaves when max_batch requests wait or when its oldest request
+// waited max_delay_us, whichever comes first, so a lone request is never
+// delayed by more than the deadline.
+class IkScheduler{
+    public:
+        explicit IkScheduler(const Configuration &config);
+        IkScheduler(const Configuration &config, const IkSchedulerOptions &options);
+        ~IkScheduler();
+
+        bool submit(double x, double y, double theta, const IkCallback &callback);
+        bool solve(double x, double y, double theta, double *angles_1, double *angles_2);
+        void flush();
+        IkSchedulerStats get_stats() const;
+        void reset_stats();
+
+    private:
+        struct Queue;
+
+        void run_dispatcher();
+
+        Configuration config;
+        IkSchedulerOptions options;
+        unique_ptr<Queue> queue;
+};
+
+#endif
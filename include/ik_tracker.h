@@ -0,0 +1,33 @@
+/********
+ * ik_tracker.h
+ * Author: Simon Chamorro
+ * Warm-started inverse kinematics for trajectory tracking
+********/
+
+#ifndef IK_TRACKER_H
+#define IK_TRACKER_H
+
+#include "numerical_ik.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+
+class IkTracker{
+    public:
+        IkTracker(const Configuration &config);
+        IkTracker(const Configuration &config, const IkSolverOptions &options);
+
+        void reset(const double *angles);
+        bool track(double x, double y, double theta, double *angles, IkSolverStats *stats);
+        int get_elbow() const;
+
+    private:
+        Configuration robot_config;
+        IkSolverOptions options;
+        LinkArray previous;
+        LinkArray velocity;
+        int elbow;
+};
+
+#endif
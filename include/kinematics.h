@@ -0,0 +1,129 @@
+/********
+ * kinematics.h
+ * Author: Simon Chamorro
+ * Stateless kinematics functions over a const Robot Configuration
+********/
+
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <math.h>
+#include "fast_math.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+
+struct Pose{
+
+    double x;
+    double y;
+    double theta;
+};
+
+// Chains with at least this many links compute link vectors with the
+// vectorized kernels of batch_kinematics, a block of links at a time, instead
+// of calling libm once per link. Each link vector is then within
+// BATCH_FK_TOLERANCE times its length of the libm one; shorter chains are
+// unchanged.
+const int LONG_CHAIN_LINKS = 64;
+
+// Math used by the overloads taking a backend. MATH_FAST evaluates the
+// branch-free polynomials of fast_math.h instead of libm: sines and cosines
+// are within FAST_SINCOS_MAX_ERROR, arc cosines and arc sines within
+// FAST_ACOS_MAX_ERROR_DEG degrees. The overloads without a backend use libm.
+enum MathBackend{
+    MATH_LIBM = 0,
+    MATH_FAST
+};
+
+// Only config.num_links and config.links are read, so a single Configuration
+// can be shared by any number of threads calling these functions.
+Pose compute_forward_kinematics(const Configuration &config, const double *angles);
+Pose compute_forward_kinematics(const Configuration &config, const double *angles,
+                                MathBackend math);
+bool compute_intersection(const Configuration &config, double x, double y, double r, 
+                        const double *angles);
+void compute_wrist_annulus(const Configuration &config, double &r_min, double &r_max);
+bool compute_pose_reachable(const Configuration &config, double x, double y, double theta);
+bool compute_inverse_kinematics(const Configuration &config, double x, double y, double theta, 
+                                double *angles_1, double *angles_2);
+bool compute_inverse_kinematics(const Configuration &config, double x, double y, double theta,
+                                double *angles_1, double *angles_2, MathBackend math);
+bool compute_jacobian(const Configuration &config, const double *angles, double *jacobian);
+bool compute_jacobian(const Configuration &config, const double *angles, double *jacobian,
+                    MathBackend math);
+bool compute_inverse_dynamics(const Configuration &config, const double *angles, 
+                            double fx, double fy, double tau, double *torques);
+bool compute_inverse_dynamics(const Configuration &config, const double *angles,
+                            double fx, double fy, double tau, double *torques, MathBackend math);
+void compute_inverse_dynamics_from_joints(int num_links, const double *joint_x, const double *joint_y,
+                                        double fx, double fy, double tau, double *torques);
+void compute_joint_frames(int num_links, const double *links, const double *angles, int first,
+                        double *joint_x, double *joint_y, double *joint_theta);
+void compute_joint_frames(int num_links, const double *links, const double *angles, int first,
+                        double *joint_x, double *joint_y, double *joint_theta, MathBackend math);
+
+// Same functions with every angle in radians, on the same templated bodies
+// as the degree ones minus the conversions, for inner loops that never need
+// degrees. Orientations are wrapped to (-pi, pi] by wrap_angle_pi.
+Pose compute_forward_kinematics_rad(const Configuration &config, const double *angles);
+Pose compute_forward_kinematics_rad(const Configuration &config, const double *angles,
+                                    MathBackend math);
+bool compute_inverse_kinematics_rad(const Configuration &config, double x, double y,
+                                    double theta, double *angles_1, double *angles_2);
+bool compute_inverse_kinematics_rad(const Configuration &config, double x, double y,
+                                    double theta, double *angles_1, double *angles_2,
+                                    MathBackend math);
+bool compute_jacobian_rad(const Configuration &config, const double *angles, double *jacobian);
+bool compute_jacobian_rad(const Configuration &config, const double *angles, double *jacobian,
+                        MathBackend math);
+bool compute_inverse_dynamics_rad(const Configuration &config, const double *angles,
+                                double fx, double fy, double tau, double *torques);
+bool compute_inverse_dynamics_rad(const Configuration &config, const double *angles,
+                                double fx, double fy, double tau, double *torques,
+                                MathBackend math);
+void compute_joint_frames_rad(int num_links, const double *links, const double *angles, int first,
+                            double *joint_x, double *joint_y, double *joint_theta);
+void compute_joint_frames_rad(int num_links, const double *links, const double *angles, int first,
+                            double *joint_x, double *joint_y, double *joint_theta,
+                            MathBackend math);
+
+double compute_theta_1(const Configuration &config, double theta2, double x, double y);
+
+bool point_in_circle(double x_center, double y_center, double radius, double x, double y);
+
+
+// Wrap to (-180, 180] of angles too large for fast_wrap_180, NaN and
+// infinities give NaN
+inline double clip_angle_180_remainder(double angle){
+    double w = remainder(angle, 360.0);
+    return (w <= -180) ? w + 360 : w;
+}
+
+
+// Keep angle between -180 and 180 degres. Without loops, so huge angles
+// cost the same as small ones.
+constexpr double clip_angle_180(double angle){
+    if (angle < FAST_WRAP_MAX_DEG && angle > -FAST_WRAP_MAX_DEG){
+        return fast_wrap_180(angle);
+    }
+    return clip_angle_180_remainder(angle);
+}
+
+/**
+ * Wrap an angle in radians to (-pi, pi]. fast_wrap_pi within its exact
+ * range, remainder beyond, where a double holds less than a turn anyway.
+ *
+ * @param[in] angle Angle (rad), NaN and infinities give NaN.
+ * @return wrapped angle.
+ */
+inline double wrap_angle_pi(double angle){
+    if (fabs(angle) < FAST_WRAP_MAX_RAD){
+        return fast_wrap_pi(angle);
+    }
+    double w = remainder(angle, 2.0*FAST_PI);
+    return (w <= -FAST_PI) ? w + 2.0*FAST_PI : w;
+}
+
+#endif
@@ -8,7 +8,15 @@
 #define MANIPULATOR_H
 
 #include <iostream>
+#include <memory>
+#include <stdint.h>
 #include "robot_configuration.h"
+#include "ik_cache.h"
+#include "kinematics.h"
+#include "numerical_ik.h"
+#include "obstacle_set.h"
+#include "parallel_chain.h"
+#include "reachability_map.h"
 
 using namespace std;
 
@@ -18,22 +26,59 @@ class Manipulator{
         Manipulator();
         ~Manipulator();
         
-        Configuration get_config();
+        Configuration get_config() const;
+        const Configuration &get_config_ref() const;
         bool reset();
-        bool set_parameters(int num_links, double links[MAX_LINKS]);
-        bool forward_kinematics(double angles[MAX_LINKS]);
-        bool intersection(double x, double y, double r, double angles[MAX_LINKS]);
-        bool inverse_kinematics(double x, double y, double theta, double *angles_1, double *angles_2);
-        bool inverse_dynamics(double fx, double fy, double tau, double *torques);
-        double solve_theta_1(double theta2, double x, double y);
+        bool set_parameters(int num_links, const double *links);
+        void set_parallel_chain_options(const ParallelChainOptions &options);
+        void set_math_backend(MathBackend math);
+        bool forward_kinematics(const double *angles);
+        int update_joint(int joint, double angle);
+        bool get_joint_positions(double *x, double *y) const;
+        bool intersection(double x, double y, double r, const double *angles);
+        bool intersection(const ObstacleSet &obstacles, const double *angles);
+        int arm_collision(const ObstacleSet &obstacles) const;
+        bool self_collision(int *link_a, int *link_b) const;
+        bool inverse_kinematics(double x, double y, double theta, double *angles_1, double *angles_2) const;
+        bool inverse_kinematics_numerical(double x, double y, double theta, double *angles,
+                                        const IkSolverOptions &options, IkSolverStats *stats) const;
+        bool inverse_dynamics(double fx, double fy, double tau, double *torques) const;
+        double solve_theta_1(double theta2, double x, double y) const;
+        bool enable_reachability_map(const ReachabilityMapOptions &options);
+        void disable_reachability_map();
+        bool load_reachability_map(const char *path);
+        bool save_reachability_map(const char *path) const;
+        bool is_reachable(double x, double y, double theta) const;
+        void enable_ik_cache(const IkCacheOptions &options);
+        void disable_ik_cache();
+        IkCacheStats get_ik_cache_stats() const;
 
     private:
+        void update_frames(int first);
+        void update_pose();
+
         Configuration robot_config;
-};
 
-double clip_angle_180(double angle);
-bool point_in_circle(double x_center, double y_center, double radius, double x, double y);
-bool mult_matrices(int r1, int c1, int r2, int c2, double m1[3][3], double m2[3][3], double (&m3)[3][3]);
+        // Cached joint frames, index 0 is the base and num_links the end effector
+        LinkArray joint_x;
+        LinkArray joint_y;
+        LinkArray joint_theta;
+
+        // Rebuilt by set_parameters while enabled
+        ReachabilityMap reachability;
+        ReachabilityMapOptions reachability_options;
+        bool reachability_enabled;
+
+        // Threads for the joint frames of very long chains
+        ParallelChainOptions parallel_options;
+
+        // Sines, cosines and arc cosines of forward and inverse kinematics
+        MathBackend math;
+
+        // Cleared by set_parameters, copies of the manipulator share it
+        shared_ptr<IkCache> ik_cache;
+        uint64_t links_hash;
+};
 
 #endif
 
@@ -0,0 +1,48 @@
+/********
+ * numerical_ik.h
+ * Author: Simon Chamorro
+ * Damped least squares inverse kinematics for any number of links
+********/
+
+#ifndef NUMERICAL_IK_H
+#define NUMERICAL_IK_H
+
+#include "robot_configuration.h"
+
+using namespace std;
+
+
+struct IkSolverOptions{
+
+    int max_iterations;
+    double position_tolerance;      // Same unit as links
+    double orientation_tolerance;   // Degres
+    double orientation_weight;      // Length unit per radian of orientation error
+    double damping;                 // Initial damping, relative to total arm length
+    double min_damping;             // Lower bound when the error keeps decreasing
+    double max_step;                // Max change of one joint per iteration, degres
+};
+
+struct IkSolverStats{
+
+    int iterations;
+    double position_error;
+    double orientation_error;
+    double damping;
+    bool converged;
+};
+
+IkSolverOptions default_ik_solver_options();
+
+void solve_3x3(const double a[3][3], const double b[3], double out[3]);
+
+bool solve_inverse_kinematics_dls(int num_links, const double *links,
+                                double x, double y, double theta,
+                                const double *seed, double *angles,
+                                const IkSolverOptions &options, IkSolverStats *stats);
+bool solve_inverse_kinematics_dls(const Configuration &config,
+                                double x, double y, double theta,
+                                const double *seed, double *angles,
+                                const IkSolverOptions &options, IkSolverStats *stats);
+
+#endif
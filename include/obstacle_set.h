@@ -0,0 +1,82 @@
+/********
+ * obstacle_set.h
+ * Author: Simon Chamorro
+ * Set of circles indexed by a uniform grid for point containment queries
+********/
+
+#ifndef OBSTACLE_SET_H
+#define OBSTACLE_SET_H
+
+#include <vector>
+#include "robot_configuration.h"
+
+using namespace std;
+
+// Circles overlapping more cells than this are kept out of the grid and
+// checked on every query, so one huge circle does not fill every cell.
+const int OBSTACLE_MAX_CELLS_PER_CIRCLE = 64;
+
+// The grid has at most about 4 cells per circle, and never more than this
+const int OBSTACLE_MAX_GRID_CELLS = 1 << 24;
+
+// Circles must lie within this distance of the origin, so spans stay finite
+const double OBSTACLE_MAX_COORDINATE = 1e300;
+
+// Sets up to this size are checked against whole arms with every circle in
+// turn, vectorized across poses, instead of with one grid query per link.
+const int OBSTACLE_SIMD_MAX_CIRCLES = 32;
+
+
+struct Circle{
+
+    double x;
+    double y;
+    double r;
+};
+
+
+class ObstacleSet{
+    public:
+        ObstacleSet();
+
+        int add(double x, double y, double r);
+        void clear();
+        void build();
+        bool is_built() const;
+        int size() const;
+        Circle get(int id) const;
+        bool contains_any(double x, double y) const;
+        int find_all(double x, double y, vector<int> &ids) const;
+        bool contains_any_batch(int count, const double *x, const double *y,
+                                unsigned char *hits) const;
+        bool intersection_batch(const Configuration &config, int count,
+                                const double *const *angles, unsigned char *hits) const;
+        bool segment_intersects_any(double x0, double y0, double x1, double y1) const;
+        int first_collision(int num_links, const double *joint_x, const double *joint_y) const;
+        bool collision_batch(const Configuration &config, int count,
+                            const double *const *angles, unsigned char *hits) const;
+
+    private:
+        // Circle copied into each cell it overlaps, r is squared
+        struct Entry{
+            double x;
+            double y;
+            double r_squared;
+            int id;
+        };
+
+        int cell_of(double x, double y) const;
+
+        vector<Circle> circles;
+        bool built;
+        double min_x;
+        double min_y;
+        double inv_cell_size;
+        int cells_x;
+        int cells_y;
+        vector<int> cell_start;
+        vector<Entry> entries;
+        vector<Entry> large;
+};
+
+#endif
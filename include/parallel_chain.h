@@ -0,0 +1,42 @@
+/********
+ * parallel_chain.h
+ * Author: Simon Chamorro
+ * Forward kinematics of one very long chain as a parallel prefix sum
+********/
+
+#ifndef PARALLEL_CHAIN_H
+#define PARALLEL_CHAIN_H
+
+#include "kinematics.h"
+#include "robot_configuration.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Links each thread must get for the parallel scan to beat the serial long
+// chain path (about 5 ns per link): handing each of the three phases to the
+// pool workers costs tens of microseconds.
+const int PARALLEL_CHAIN_MIN_LINKS_PER_THREAD = 16384;
+
+// Fewer threads than this do not make up for the extra passes of the scan
+const int PARALLEL_CHAIN_MIN_THREADS = 3;
+
+
+struct ParallelChainOptions{
+
+    int threads;                // Max threads, 0 for one per core
+    int min_links_per_thread;   // Crossover, fewer links per thread run serially
+    int min_threads;            // Fewer threads run serially, at least 2
+    ThreadPool *pool;           // Workers of the scan, NULL for one shared by the process
+};
+
+ParallelChainOptions default_parallel_chain_options();
+
+int parallel_chain_threads(int num_links, const ParallelChainOptions &options);
+Pose compute_forward_kinematics_parallel(const Configuration &config, const double *angles,
+                                        const ParallelChainOptions &options);
+void compute_joint_frames_parallel(int num_links, const double *links, const double *angles,
+                                int first, double *joint_x, double *joint_y, double *joint_theta,
+                                const ParallelChainOptions &options);
+
+#endif
@@ -0,0 +1,64 @@
+/********
+ * reachability_map.h
+ * Author: Simon Chamorro
+ * Precomputed reachability grid over end effector poses (x, y, theta)
+********/
+
+#ifndef REACHABILITY_MAP_H
+#define REACHABILITY_MAP_H
+
+#include <vector>
+#include "robot_configuration.h"
+
+using namespace std;
+
+
+enum ReachabilityCell{
+    CELL_UNREACHABLE = 0,   // No pose in the cell is reachable
+    CELL_REACHABLE,         // Every pose in the cell is reachable
+    CELL_BOUNDARY           // Mixed, answered by the exact check
+};
+
+struct ReachabilityMapOptions{
+
+    int xy_cells;       // Cells along x and along y, over [-reach, reach]
+    int theta_cells;    // Cells along theta, over [-180, 180]
+    int threads;        // Threads used to build, 0 for one per core
+};
+
+ReachabilityMapOptions default_reachability_map_options();
+
+
+class ReachabilityMap{
+    public:
+        ReachabilityMap();
+
+        bool build(const Configuration &config);
+        bool build(const Configuration &config, const ReachabilityMapOptions &options);
+        bool save(const char *path) const;
+        bool load(const char *path);
+        void clear();
+        bool is_built() const;
+        bool matches(const Configuration &config) const;
+        ReachabilityMapOptions get_options() const;
+        ReachabilityCell lookup(double x, double y, double theta) const;
+        bool is_reachable(double x, double y, double theta) const;
+
+    private:
+        void set_bounds();
+        void build_slices(int first, int last);
+
+        Configuration robot_config;
+        int xy_cells;
+        int theta_cells;
+        double reach;
+        double cell_size;
+        double theta_size;
+        double inv_cell_size;
+        double inv_theta_size;
+        double r_min;
+        double r_max;
+        vector<unsigned char> cells;
+};
+
+#endif
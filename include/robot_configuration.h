@@ -9,17 +9,63 @@
 
 using namespace std;
 
-const int MAX_LINKS = 10;
+// Arms up to this many links keep their arrays inside the Configuration,
+// longer chains move them to the heap.
+const int INLINE_LINKS = 10;
 
+// Heap storage is aligned to a cache line
+const int LINK_ARRAY_ALIGNMENT = 64;
 
+
+// Array of doubles with room for INLINE_LINKS + 1 values in place, so short
+// arms (and their joint frames) never allocate, and cache line aligned heap
+// storage past that. Converts to a plain pointer, so it can be indexed and
+// passed to any function taking a double array.
+class LinkArray{
+    public:
+        LinkArray();
+        explicit LinkArray(int size);
+        LinkArray(const LinkArray &other);
+        LinkArray &operator=(const LinkArray &other);
+        ~LinkArray();
+
+        bool resize(int size);
+        int size() const;
+        int capacity() const;
+        bool is_inline() const;
+        double *data();
+        const double *data() const;
+
+        operator double *(){
+            return values;
+        }
+        operator const double *() const{
+            return values;
+        }
+
+    private:
+        static const int INLINE_CAPACITY = INLINE_LINKS + 1;
+
+        double *values;
+        int length;
+        int allocated;
+        double local[INLINE_CAPACITY];
+};
+
+
+// Set the number of links with resize only, assigning num_links leaves links
+// and angles at their old size.
 struct Configuration{
-    
+
     int num_links;
-    double links[MAX_LINKS];
-    double angles[MAX_LINKS];
+    LinkArray links;
+    LinkArray angles;
     double x;
     double y;
     double theta;
+
+    bool resize(int n);
+    bool is_consistent() const;
 };
 
-#endif
\ No newline at end of file
+#endif
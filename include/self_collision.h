@@ -0,0 +1,45 @@
+/********
+ * self_collision.h
+ * Author: Simon Chamorro
+ * Self-collision of link chains with sweep and prune
+********/
+
+#ifndef SELF_COLLISION_H
+#define SELF_COLLISION_H
+
+#include <vector>
+
+using namespace std;
+
+// Below this many links the pairwise test is faster than sorting
+const int SELF_COLLISION_NAIVE_MAX_LINKS = 16;
+
+
+// Keeps the sweep order and scratch space between calls, so checks of
+// successive configurations allocate nothing and re-sort almost sorted data.
+class SelfCollisionChecker{
+    public:
+        SelfCollisionChecker();
+
+        bool check(int num_links, const double *joint_x, const double *joint_y,
+                int *link_a, int *link_b);
+
+    private:
+        void sort_order(int num_links);
+
+        vector<int> order;
+        vector<int> active;
+        vector<double> min_x;
+        vector<double> max_x;
+        vector<double> min_y;
+        vector<double> max_y;
+};
+
+bool segments_intersect(double ax0, double ay0, double ax1, double ay1,
+                        double bx0, double by0, double bx1, double by1);
+bool compute_self_collision(int num_links, const double *joint_x, const double *joint_y,
+                            int *link_a, int *link_b);
+bool compute_self_collision_naive(int num_links, const double *joint_x, const double *joint_y,
+                                int *link_a, int *link_b);
+
+#endif
@@ -0,0 +1,130 @@
+/********
+ * socket_server.h
+ * Author: Simon Chamorro
+ * Binary request server over a Unix domain socket
+********/
+
+#ifndef SOCKET_SERVER_H
+#define SOCKET_SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// Every message is a header followed by payload_bytes of float64 values.
+// Fields are in native byte order, client and server share the host.
+//   offset 0  uint32 payload_bytes, a multiple of 8
+//   offset 4  uint16 opcode, echoed in the response
+//   offset 6  uint16 status, 0 in requests
+//   offset 8  uint64 id, chosen by the client and echoed in the response
+// Responses come back in request order, so clients may send any number of
+// requests before reading the first response.
+const size_t SOCKET_HEADER_BYTES = 16;
+
+// Payloads larger than this close the connection after a STATUS_BAD_REQUEST
+const size_t SOCKET_MAX_PAYLOAD_BYTES = 1 << 20;
+
+// Requests with a value that is not finite or larger than this in magnitude
+// get a STATUS_BAD_REQUEST, whatever their opcode. Covers any link length,
+// coordinate or angle in degrees a client can mean.
+const double SOCKET_MAX_VALUE = 1e9;
+
+// Same commands as batch mode, each connection has its own manipulator
+enum SocketOpcode{
+    OP_PING = 0,            // -> empty
+    OP_RESET = 1,           // -> empty
+    OP_LINKS = 2,           // L1 ... LN -> empty
+    OP_FORWARD = 3,         // A1 ... AN -> X Y THETA
+    OP_INTERSECTION = 4,    // X Y R A1 ... AN -> 1 or 0
+    OP_INVERSE_K = 5,       // X Y THETA -> A1 A2 A3 B1 B2 B3 (3 links) or A1 ... AN
+    OP_INVERSE_D = 6        // FX FY TAU -> T1 ... TN at the current joint angles
+};
+
+enum SocketStatus{
+    STATUS_OK = 0,
+    STATUS_UNREACHABLE = 1,     // Inverse kinematics found no solution, empty payload
+    STATUS_BAD_REQUEST = 2,     // Wrong number of values or out of range, empty payload
+    STATUS_UNKNOWN_OPCODE = 3
+};
+
+struct SocketServerOptions{
+
+    int backlog;                // Pending connections queued by listen
+    size_t max_output_bytes;    // Stop reading a client with this much unsent output
+};
+
+SocketServerOptions default_socket_server_options();
+
+struct SocketServerStats{
+
+    uint64_t connections;   // Connections accepted
+    uint64_t active;        // Connections open
+    uint64_t requests;      // Requests answered
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+};
+
+
+// Single threaded epoll event loop. Each client is read until the socket is
+// drained, every complete request in its buffer is answered in order, and
+// responses are written as one batch, so pipelined requests cost one read
+// and one write per wake-up.
+class SocketServer{
+    public:
+        SocketServer();
+        ~SocketServer();
+
+        bool listen(const char *path);
+        bool listen(const char *path, const SocketServerOptions &options);
+        bool run();
+        void stop();
+        void close();
+        SocketServerStats get_stats() const;
+
+    private:
+        struct Connection;
+
+        void accept_clients();
+        void handle(Connection &connection, uint32_t events);
+        void process(Connection &connection);
+        bool flush(Connection &connection);
+        void update_events(Connection &connection);
+        void drop(int fd);
+
+        int listen_fd;
+        int epoll_fd;
+        int stop_fd;
+        char socket_path[108];
+        SocketServerOptions options;
+        SocketServerStats stats;
+        vector<Connection *> connections;   // Indexed by file descriptor
+};
+
+
+struct SocketResponse{
+
+    uint16_t opcode;
+    uint16_t status;
+    uint64_t id;
+    vector<double> values;
+};
+
+
+// Blocking client, requests may be sent ahead of reading their responses
+class SocketClient{
+    public:
+        SocketClient();
+        ~SocketClient();
+
+        bool connect(const char *path);
+        void close();
+        bool send(uint16_t opcode, uint64_t id, const double *values, int count);
+        bool receive(SocketResponse &response);
+
+    private:
+        int fd;
+};
+
+#endif
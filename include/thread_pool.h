@@ -0,0 +1,97 @@
+/********
+ * thread_pool.h
+ * Author: Simon Chamorro
+ * Work-stealing thread pool for batch kinematics jobs
+********/
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#include "obstacle_set.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+// Working set of one chunk of a batch job, the size of a typical L1 data
+// cache, so inputs and outputs of a chunk stay in cache while it runs.
+const int THREAD_POOL_CHUNK_BYTES = 32768;
+
+
+enum ThreadPinning{
+    PIN_NONE = 0,       // Let the OS schedule workers
+    PIN_CORES,          // One CPU per worker, filling one NUMA node after the other
+    PIN_NUMA_NODES      // Every CPU of one node per worker, nodes in the same order
+};
+
+struct ThreadPoolOptions{
+
+    int threads;            // Workers, 0 for one per CPU the process may run on
+    ThreadPinning pinning;
+    int chunk_bytes;        // Working set of one chunk of a batch job
+};
+
+ThreadPoolOptions default_thread_pool_options();
+
+// Counters of one worker since the pool started or since reset_stats
+struct WorkerStats{
+
+    int cpu;                // CPU of the worker with PIN_CORES, -1 otherwise
+    int node;               // NUMA node of the worker, 0 without pinning
+    uint64_t chunks;        // Chunks run
+    uint64_t stolen;        // Chunks taken from another worker's queue
+    double busy_seconds;    // Time spent running chunks
+    double utilization;     // busy_seconds over the time elapsed
+};
+
+
+// Fixed set of workers, each with its own queue of chunks. A job is cut in
+// chunks that are handed out as contiguous runs, one per worker; a worker
+// that runs out takes chunks from the far end of another queue, trying
+// workers of its own NUMA node first. One job runs at a time and the
+// calling thread waits for it.
+class ThreadPool{
+    public:
+        ThreadPool();
+        explicit ThreadPool(const ThreadPoolOptions &options);
+        ~ThreadPool();
+
+        int size() const;
+        int get_num_nodes() const;
+        int chunk_size(size_t bytes_per_item) const;
+        void parallel_for(int count, int chunk, const function<void(int, int)> &body);
+        WorkerStats get_worker_stats(int worker) const;
+        void reset_stats();
+
+    private:
+        struct Worker;
+
+        void start(const ThreadPoolOptions &options);
+        void run_worker(int w);
+        bool next_chunk(int w, int &begin, int &end, bool &stolen);
+
+        ThreadPoolOptions options;
+        vector<unique_ptr<Worker> > workers;
+        int num_nodes;
+        struct Job;
+        unique_ptr<Job> job;
+};
+
+bool forward_kinematics_batch(ThreadPool &pool, const Configuration &config, int count,
+                            const double *const *angles,
+                            double *x, double *y, double *theta);
+bool inverse_kinematics_batch(ThreadPool &pool, const Configuration &config, int count,
+                            const double *x, const double *y, const double *theta,
+                            double *const *angles_1, double *const *angles_2,
+                            unsigned char *reachable);
+bool intersection_batch(ThreadPool &pool, const ObstacleSet &obstacles,
+                        const Configuration &config, int count,
+                        const double *const *angles, unsigned char *hits);
+bool inverse_dynamics_batch(ThreadPool &pool, const Configuration &config, const double *angles,
+                            int count, const double *fx, const double *fy, const double *tau,
+                            double *const *torques);
+
+#endif
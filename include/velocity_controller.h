@@ -0,0 +1,97 @@
+/********
+ * velocity_controller.h
+ * Author: Simon Chamorro
+ * Resolved-rate velocity control loop on a fixed-period thread
+********/
+
+#ifndef VELOCITY_CONTROLLER_H
+#define VELOCITY_CONTROLLER_H
+
+#include <memory>
+#include <stdint.h>
+#include "robot_configuration.h"
+
+using namespace std;
+
+// Control rates accepted by VelocityController::start
+const double VELOCITY_CONTROL_MIN_HZ = 1000.0;
+const double VELOCITY_CONTROL_MAX_HZ = 10000.0;
+
+// Jitter samples kept for the percentiles of get_stats, the most recent ones win
+const int VELOCITY_CONTROL_JITTER_SAMPLES = 8192;
+
+
+// End effector velocity
+struct Twist{
+
+    double vx;      // Length unit per second
+    double vy;
+    double omega;   // Degres per second
+};
+
+struct VelocityControllerOptions{
+
+    double rate_hz;             // Control rate, in [VELOCITY_CONTROL_MIN_HZ, VELOCITY_CONTROL_MAX_HZ]
+    double damping;             // Damped least squares factor, relative to total arm length
+    double orientation_weight;  // Length unit per radian of orientation rate
+    double max_joint_speed;     // Degres per second, all joints are scaled together, 0 for none
+    double spin_us;             // Busy wait this long before each period instead of sleeping
+    int priority;               // SCHED_FIFO priority of the loop thread, 0 keeps the default
+};
+
+VelocityControllerOptions default_velocity_controller_options();
+
+// Counters since the loop started or since reset_stats
+struct VelocityControllerStats{
+
+    uint64_t cycles;
+    uint64_t overruns;          // Cycles that ended after the next period had started
+    uint64_t missed_periods;    // Periods skipped to recover from overruns
+    double rate_hz;
+    // Wake up time minus scheduled time, in us, over the latest samples
+    double mean_jitter_us;
+    double p50_jitter_us;
+    double p99_jitter_us;
+    double max_jitter_us;
+    // Time spent computing one cycle, in us
+    double mean_compute_us;
+    double max_compute_us;
+    bool realtime;              // True if the SCHED_FIFO priority was granted
+};
+
+bool compute_joint_velocities(int num_links, const double *jacobian, const Twist &twist,
+                            double damping, double orientation_weight, double *velocities);
+
+
+// Resolved-rate control: every period the commanded twist is mapped to joint
+// velocities through the damped least squares inverse of the Jacobian at the
+// current angles, and the angles are integrated over one period. The loop
+// runs on its own thread and wakes at absolute times, so a late cycle does
+// not shift the following ones.
+class VelocityController{
+    public:
+        VelocityController(const Configuration &config, const double *angles);
+        VelocityController(const Configuration &config, const double *angles,
+                        const VelocityControllerOptions &options);
+        ~VelocityController();
+
+        bool start();
+        void stop();
+        bool is_running() const;
+        bool set_twist(const Twist &twist);
+        void get_state(double *angles, double *velocities) const;
+        VelocityControllerStats get_stats() const;
+        void reset_stats();
+
+    private:
+        struct Loop;
+
+        void run_loop();
+        void control_cycle(double dt);
+
+        Configuration config;
+        VelocityControllerOptions options;
+        unique_ptr<Loop> loop;
+};
+
+#endif
@@ -0,0 +1,1113 @@
+/********
+ * batch_kinematics.cpp
+ * Author: Simon Chamorro
+ * Batched structure-of-arrays kinematics with SIMD dispatch
+********/
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include "batch_kinematics.h"
+#include "fast_math.h"
+#include "kinematics.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+#define PI 3.14159265359
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_X86_DISPATCH
+#endif
+
+// Poses processed per block, keeps x, y and theta of a block in L1
+const int FK_BLOCK = 256;
+
+
+// Math policies. The libm ones are the scalar references, the fast ones
+// evaluate the branch-free polynomials of fast_math.h in every lane. Degree
+// policies keep the expressions of the scalar functions bit for bit, radian
+// ones never convert, float ones fit twice the lanes in a register.
+
+struct LibmMath{
+    typedef double Real;
+    static inline void sincos(double deg, double &s, double &c){
+        s = sin(deg*PI/180.0);
+        c = cos(deg*PI/180.0);
+    }
+    static inline double arctan2(double y, double x){
+        return atan2(y, x)*180.0/PI;
+    }
+    static inline double wrap(double deg){
+        return clip_angle_180(deg);
+    }
+};
+
+struct FastMath{
+    typedef double Real;
+    static FAST_MATH_INLINE void sincos(double deg, double &s, double &c){
+        fast_sincos_deg(deg, s, c);
+    }
+    static FAST_MATH_INLINE double arctan2(double y, double x){
+        return fast_atan2(y, x)*FAST_RAD_TO_DEG;
+    }
+    static FAST_MATH_INLINE double wrap(double deg){
+        return fast_wrap_180(deg);
+    }
+};
+
+struct LibmMathRad{
+    typedef double Real;
+    static inline void sincos(double rad, double &s, double &c){
+        s = sin(rad);
+        c = cos(rad);
+    }
+    static inline double arctan2(double y, double x){
+        return atan2(y, x);
+    }
+    static FAST_MATH_INLINE double wrap(double rad){
+        return wrap_angle_pi(rad);
+    }
+};
+
+struct FastMathRad{
+    typedef double Real;
+    static FAST_MATH_INLINE void sincos(double rad, double &s, double &c){
+        fast_sincos(rad, s, c);
+    }
+    static FAST_MATH_INLINE double arctan2(double y, double x){
+        return fast_atan2(y, x);
+    }
+    static FAST_MATH_INLINE double wrap(double rad){
+        return fast_wrap_pi(rad);
+    }
+};
+
+struct LibmMathF{
+    typedef float Real;
+    static inline void sincos(float deg, float &s, float &c){
+        s = sinf(deg*FAST_DEG_TO_RAD_F);
+        c = cosf(deg*FAST_DEG_TO_RAD_F);
+    }
+    static inline float wrap(float deg){
+        return fast_wrap_180f(deg);
+    }
+};
+
+struct FastMathF{
+    typedef float Real;
+    static FAST_MATH_INLINE void sincos(float deg, float &s, float &c){
+        fast_sincosf_deg(deg, s, c);
+    }
+    static FAST_MATH_INLINE float wrap(float deg){
+        return fast_wrap_180f(deg);
+    }
+};
+
+
+// Kernels
+
+// Scalar reference, same arithmetic as Manipulator::forward_kinematics
+template <typename Math>
+static void fk_scalar(const double *links, int num_links, const typename Math::Real *const *angles,
+                    int start, int end, typename Math::Real *x, typename Math::Real *y,
+                    typename Math::Real *theta){
+    typedef typename Math::Real Real;
+    for (int i = start; i < end; i += 1){
+        Real t = 0;
+        Real px = 0;
+        Real py = 0;
+        for (int j = 0; j < num_links; j += 1){
+            const Real l = links[j];
+            Real s, c;
+            Math::sincos(t + angles[j][i], s, c);
+            px += l*c;
+            py += l*s;
+            t += angles[j][i];
+        }
+        x[i] = px;
+        y[i] = py;
+        theta[i] = Math::wrap(t);
+    }
+}
+
+
+// Vectorizable kernel, instantiated once per instruction set below.
+// Joints are the outer loop so the inner loop runs across poses.
+template <typename Math>
+FAST_MATH_INLINE void fk_lanes(const double *links, int num_links, const typename Math::Real *const *angles,
+                            int start, int end, typename Math::Real *x, typename Math::Real *y,
+                    typename Math::Real *theta){
+    typedef typename Math::Real Real;
+    for (int b = start; b < end; b += FK_BLOCK){
+        int len = (end - b < FK_BLOCK) ? end - b : FK_BLOCK;
+        Real *__restrict px = x + b;
+        Real *__restrict py = y + b;
+        Real *__restrict pt = theta + b;
+        for (int i = 0; i < len; i += 1){
+            px[i] = 0;
+            py[i] = 0;
+            pt[i] = 0;
+        }
+        for (int j = 0; j < num_links; j += 1){
+            const Real l = links[j];
+            const Real *__restrict a = angles[j] + b;
+            for (int i = 0; i < len; i += 1){
+                Real t = pt[i] + a[i];
+                Real s, c;
+                Math::sincos(t, s, c);
+                pt[i] = t;
+                px[i] += l*c;
+                py[i] += l*s;
+            }
+        }
+        for (int i = 0; i < len; i += 1){
+            pt[i] = Math::wrap(pt[i]);
+        }
+    }
+}
+
+
+template <typename Math>
+static void fk_sse2(const double *links, int num_links, const typename Math::Real *const *angles,
+                    int start, int end, typename Math::Real *x, typename Math::Real *y,
+                    typename Math::Real *theta){
+    fk_lanes<Math>(links, num_links, angles, start, end, x, y, theta);
+}
+
+#ifdef BATCH_X86_DISPATCH
+template <typename Math>
+__attribute__((target("avx2,fma")))
+static void fk_avx2(const double *links, int num_links, const typename Math::Real *const *angles,
+                    int start, int end, typename Math::Real *x, typename Math::Real *y,
+                    typename Math::Real *theta){
+    fk_lanes<Math>(links, num_links, angles, start, end, x, y, theta);
+}
+
+template <typename Math>
+__attribute__((target("avx512f,avx512dq,fma")))
+static void fk_avx512(const double *links, int num_links, const typename Math::Real *const *angles,
+                    int start, int end, typename Math::Real *x, typename Math::Real *y,
+                    typename Math::Real *theta){
+    fk_lanes<Math>(links, num_links, angles, start, end, x, y, theta);
+}
+#endif
+
+
+// Joint position kernels
+
+// Scalar reference, same arithmetic as compute_joint_frames
+static void jp_scalar(const double *links, int num_links, const double *const *angles,
+                    int start, int end, double *const *joint_x, double *const *joint_y){
+    for (int i = start; i < end; i += 1){
+        double t = 0;
+        double px = 0;
+        double py = 0;
+        joint_x[0][i] = 0.0;
+        joint_y[0][i] = 0.0;
+        for (int j = 0; j < num_links; j += 1){
+            px += links[j]*cos((t + angles[j][i])*PI/180.0);
+            py += links[j]*sin((t + angles[j][i])*PI/180.0);
+            t += angles[j][i];
+            joint_x[j + 1][i] = px;
+            joint_y[j + 1][i] = py;
+        }
+    }
+}
+
+
+// One link across poses: joint j + 1 from joint j and the accumulated angle
+FAST_MATH_INLINE void jp_link(int len, double l, const double *__restrict a,
+                            const double *__restrict x0, const double *__restrict y0,
+                            double *__restrict x1, double *__restrict y1,
+                            double *__restrict t){
+    for (int i = 0; i < len; i += 1){
+        double angle = t[i] + a[i];
+        double s, c;
+        fast_sincos_deg(angle, s, c);
+        t[i] = angle;
+        x1[i] = x0[i] + l*c;
+        y1[i] = y0[i] + l*s;
+    }
+}
+
+
+FAST_MATH_INLINE void jp_lanes(const double *links, int num_links, const double *const *angles,
+                            int start, int end, double *const *joint_x, double *const *joint_y){
+    double t[FK_BLOCK];
+    for (int b = start; b < end; b += FK_BLOCK){
+        int len = (end - b < FK_BLOCK) ? end - b : FK_BLOCK;
+        for (int i = 0; i < len; i += 1){
+            t[i] = 0.0;
+            joint_x[0][b + i] = 0.0;
+            joint_y[0][b + i] = 0.0;
+        }
+        for (int j = 0; j < num_links; j += 1){
+            jp_link(len, links[j], angles[j] + b, joint_x[j] + b, joint_y[j] + b,
+                    joint_x[j + 1] + b, joint_y[j + 1] + b, t);
+        }
+    }
+}
+
+
+static void jp_sse2(const double *links, int num_links, const double *const *angles,
+                    int start, int end, double *const *joint_x, double *const *joint_y){
+    jp_lanes(links, num_links, angles, start, end, joint_x, joint_y);
+}
+
+#ifdef BATCH_X86_DISPATCH
+__attribute__((target("avx2,fma")))
+static void jp_avx2(const double *links, int num_links, const double *const *angles,
+                    int start, int end, double *const *joint_x, double *const *joint_y){
+    jp_lanes(links, num_links, angles, start, end, joint_x, joint_y);
+}
+
+__attribute__((target("avx512f,avx512dq,fma")))
+static void jp_avx512(const double *links, int num_links, const double *const *angles,
+                    int start, int end, double *const *joint_x, double *const *joint_y){
+    jp_lanes(links, num_links, angles, start, end, joint_x, joint_y);
+}
+#endif
+
+
+// Link vector kernels
+
+// Scalar reference, libm on the same angles as compute_joint_frames
+template <typename Math>
+static void lv_scalar(int count, const double *links, const double *theta,
+                    double *dx, double *dy){
+    for (int i = 0; i < count; i += 1){
+        double s, c;
+        Math::sincos(theta[i], s, c);
+        dx[i] = links[i]*c;
+        dy[i] = links[i]*s;
+    }
+}
+
+
+// Vectorizable kernel, the loop runs across the links of one chain
+template <typename Math>
+FAST_MATH_INLINE void lv_lanes(int count, const double *__restrict links,
+                            const double *__restrict theta,
+                            double *__restrict dx, double *__restrict dy){
+    for (int i = 0; i < count; i += 1){
+        double s, c;
+        Math::sincos(theta[i], s, c);
+        dx[i] = links[i]*c;
+        dy[i] = links[i]*s;
+    }
+}
+
+
+template <typename Math>
+static void lv_sse2(int count, const double *links, const double *theta,
+                    double *dx, double *dy){
+    lv_lanes<Math>(count, links, theta, dx, dy);
+}
+
+#ifdef BATCH_X86_DISPATCH
+template <typename Math>
+__attribute__((target("avx2,fma")))
+static void lv_avx2(int count, const double *links, const double *theta,
+                    double *dx, double *dy){
+    lv_lanes<Math>(count, links, theta, dx, dy);
+}
+
+template <typename Math>
+__attribute__((target("avx512f,avx512dq,fma")))
+static void lv_avx512(int count, const double *links, const double *theta,
+                    double *dx, double *dy){
+    lv_lanes<Math>(count, links, theta, dx, dy);
+}
+#endif
+
+
+// Inverse kinematics kernels
+
+// Closed form 3 links IK without branches. Elbow angle is clamped so that
+// unreachable lanes still run the same instructions, the mask tells them apart.
+template <typename Math>
+FAST_MATH_INLINE void ik_lanes(const double *links, const double *__restrict x, 
+                            const double *__restrict y, const double *__restrict theta, 
+                            int start, int end,
+                            double *__restrict a1_0, double *__restrict a1_1, 
+                            double *__restrict a1_2, double *__restrict a2_0, 
+                            double *__restrict a2_1, double *__restrict a2_2, 
+                            unsigned char *__restrict mask){
+    const double l1 = links[0];
+    const double l2 = links[1];
+    const double l3 = links[2];
+    const double inv_d = 1.0 / (2*l1*l2);
+    const double f0 = l1*l1 + l2*l2;
+    const double nan = NAN;
+
+    for (int i = start; i < end; i += 1){
+        double s, c;
+        Math::sincos(theta[i], s, c);
+        double x3 = x[i] - l3*c;
+        double y3 = y[i] - l3*s;
+
+        double c2 = (x3*x3 + y3*y3 - f0) * inv_d;
+        double ok = (c2 >= -1.0 - BATCH_IK_REACH_TOLERANCE) ? 1.0 : 0.0;
+        ok = (c2 <= 1.0 + BATCH_IK_REACH_TOLERANCE) ? ok : 0.0;
+        c2 = (c2 > 1.0) ? 1.0 : c2;
+        c2 = (c2 < -1.0) ? -1.0 : c2;
+        double s2 = sqrt(1.0 - c2*c2);
+
+        double theta2 = Math::arctan2(s2, c2);
+        double phi = Math::arctan2(y3, x3);
+        double beta = Math::arctan2(l2*s2, l1 + l2*c2);
+
+        double t1_a = Math::wrap(phi - beta);
+        double t1_b = Math::wrap(phi + beta);
+        double t3_a = Math::wrap(theta[i] - t1_a - theta2);
+        double t3_b = Math::wrap(theta[i] - t1_b + theta2);
+
+        a1_0[i] = (ok != 0.0) ? t1_a : nan;
+        a1_1[i] = (ok != 0.0) ? theta2 : nan;
+        a1_2[i] = (ok != 0.0) ? t3_a : nan;
+        a2_0[i] = (ok != 0.0) ? t1_b : nan;
+        a2_1[i] = (ok != 0.0) ? -theta2 : nan;
+        a2_2[i] = (ok != 0.0) ? t3_b : nan;
+    }
+
+    // Separate pass, mixing byte and double lanes would stop vectorization
+    for (int i = start; i < end; i += 1){
+        mask[i] = (a1_1[i] == a1_1[i]);
+    }
+}
+
+
+template <typename Math>
+static void ik_scalar(const double *links, const double *x, const double *y,
+                    const double *theta, int start, int end,
+                    double *const *angles_1, double *const *angles_2,
+                    unsigned char *reachable){
+    ik_lanes<Math>(links, x, y, theta, start, end, angles_1[0], angles_1[1], angles_1[2],
+                    angles_2[0], angles_2[1], angles_2[2], reachable);
+}
+
+template <typename Math>
+static void ik_sse2(const double *links, const double *x, const double *y,
+                    const double *theta, int start, int end,
+                    double *const *angles_1, double *const *angles_2,
+                    unsigned char *reachable){
+    ik_lanes<Math>(links, x, y, theta, start, end, angles_1[0], angles_1[1], angles_1[2],
+                    angles_2[0], angles_2[1], angles_2[2], reachable);
+}
+
+#ifdef BATCH_X86_DISPATCH
+template <typename Math>
+__attribute__((target("avx2,fma")))
+static void ik_avx2(const double *links, const double *x, const double *y,
+                    const double *theta, int start, int end,
+                    double *const *angles_1, double *const *angles_2,
+                    unsigned char *reachable){
+    ik_lanes<Math>(links, x, y, theta, start, end, angles_1[0], angles_1[1], angles_1[2],
+                    angles_2[0], angles_2[1], angles_2[2], reachable);
+}
+
+template <typename Math>
+__attribute__((target("avx512f,avx512dq,fma")))
+static void ik_avx512(const double *links, const double *x, const double *y,
+                    const double *theta, int start, int end,
+                    double *const *angles_1, double *const *angles_2,
+                    unsigned char *reachable){
+    ik_lanes<Math>(links, x, y, theta, start, end, angles_1[0], angles_1[1], angles_1[2],
+                    angles_2[0], angles_2[1], angles_2[2], reachable);
+}
+#endif
+
+
+// Float screening kernels
+
+// float_fk_error_bound from the precomputed sum of link lengths
+FAST_MATH_INLINE double float_error_bound(double reach, int num_links, double angle_sum){
+    const double u = 5.9604644775390625e-8;     // 2^-24, float rounding unit
+    // Each cumulative angle carries up to num_links roundings of the
+    // partial sums, each sine and cosine FAST_SINCOSF_MAX_ERROR, and every
+    // product and sum one more rounding
+    double angle_error = num_links*angle_sum*u*FAST_DEG_TO_RAD;
+    double value_error = FAST_SINCOSF_MAX_ERROR + (num_links + 4)*u;
+    return 2*reach*(angle_error + value_error) + BATCH_FK_TOLERANCE;
+}
+
+
+// Rows of a block of poses rounded to float, and the sum of their absolute
+// angles for the error bound
+FAST_MATH_INLINE void float_block(int num_links, const double *const *angles, int first, int len,
+                                float *storage, const float **rows, double *angle_sum){
+    for (int i = 0; i < len; i += 1){
+        angle_sum[i] = 0;
+    }
+    for (int j = 0; j < num_links; j += 1){
+        float *__restrict row = storage + j*FK_BLOCK;
+        const double *__restrict a = angles[j] + first;
+        double *__restrict sum = angle_sum;
+        for (int i = 0; i < len; i += 1){
+            row[i] = (float)a[i];
+            sum[i] += fabs(a[i]);
+        }
+        rows[j] = row;
+    }
+}
+
+
+// One block of poses against a circle: float forward kinematics, then for
+// each pose whether the circle contains its end effector and whether it is
+// within its error bound of the circle. Squared distances decide, so no
+// lane takes a branch. storage holds num_links + 3 float rows of FK_BLOCK,
+// the end effectors go in the last three: with them on the stack of the
+// kernel GCC reorders the joint loops and stops vectorizing.
+FAST_MATH_INLINE void screen_lanes(const double *links, int num_links, double reach,
+                                const double *const *angles, int first, int len,
+                                double cx, double cy, double r,
+                                float *storage, const float **rows, double *angle_sum,
+                                double *__restrict inside, double *__restrict near){
+    float *__restrict xf = storage + num_links*FK_BLOCK;
+    float *__restrict yf = xf + FK_BLOCK;
+    float *__restrict tf = yf + FK_BLOCK;
+    float_block(num_links, angles, first, len, storage, rows, angle_sum);
+    fk_lanes<FastMathF>(links, num_links, rows, 0, len, xf, yf, tf);
+    for (int i = 0; i < len; i += 1){
+        double dx = (double)xf[i] - cx;
+        double dy = (double)yf[i] - cy;
+        double d2 = dx*dx + dy*dy;
+        double e = float_error_bound(reach, num_links, angle_sum[i]);
+        double lo = (r > e) ? r - e : 0.0;
+        double hi = r + e;
+        inside[i] = (d2 <= r*r) ? 1.0 : 0.0;
+        near[i] = (d2 >= lo*lo && d2 <= hi*hi) ? 1.0 : 0.0;
+    }
+}
+
+
+static void screen_sse2(const double *links, int num_links, double reach,
+                        const double *const *angles, int first, int len,
+                        double cx, double cy, double r, float *storage, const float **rows,
+                        double *angle_sum, double *inside, double *near){
+    screen_lanes(links, num_links, reach, angles, first, len, cx, cy, r, storage, rows,
+                angle_sum, inside, near);
+}
+
+#ifdef BATCH_X86_DISPATCH
+__attribute__((target("avx2,fma")))
+static void screen_avx2(const double *links, int num_links, double reach,
+                        const double *const *angles, int first, int len,
+                        double cx, double cy, double r, float *storage, const float **rows,
+                        double *angle_sum, double *inside, double *near){
+    screen_lanes(links, num_links, reach, angles, first, len, cx, cy, r, storage, rows,
+                angle_sum, inside, near);
+}
+
+__attribute__((target("avx512f,avx512dq,fma")))
+static void screen_avx512(const double *links, int num_links, double reach,
+                        const double *const *angles, int first, int len,
+                        double cx, double cy, double r, float *storage, const float **rows,
+                        double *angle_sum, double *inside, double *near){
+    screen_lanes(links, num_links, reach, angles, first, len, cx, cy, r, storage, rows,
+                angle_sum, inside, near);
+}
+#endif
+
+
+// Dispatch
+
+/**
+ * Detect the widest instruction set supported by the running CPU.
+ * Result is computed once and cached.
+ *
+ * @return SimdLevel of the CPU.
+ */
+SimdLevel detect_simd_level(){
+#ifdef BATCH_X86_DISPATCH
+    static const SimdLevel level = []{
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")){
+            return SIMD_AVX512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+            return SIMD_AVX2;
+        }
+        return SIMD_SSE2;
+    }();
+    return level;
+#else
+    return SIMD_SSE2;
+#endif
+}
+
+
+const char *simd_level_name(SimdLevel level){
+    switch (level){
+        case SIMD_SCALAR: return "scalar";
+        case SIMD_SSE2: return "sse2";
+        case SIMD_AVX2: return "avx2";
+        case SIMD_AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+
+// Kernel selection shared by the degree and radian entry points
+template <typename Libm, typename Fast>
+static bool fk_dispatch(const Configuration &config, int count,
+                        const typename Libm::Real *const *angles, typename Libm::Real *x,
+                        typename Libm::Real *y, typename Libm::Real *theta, SimdLevel level){
+    if (count < 0 || config.num_links < 1){
+        return false;
+    }
+    if (level > detect_simd_level()){
+        level = detect_simd_level();
+    }
+
+    switch (level){
+        case SIMD_SCALAR:
+            fk_scalar<Libm>(config.links, config.num_links, angles, 0, count, x, y, theta);
+            break;
+#ifdef BATCH_X86_DISPATCH
+        case SIMD_AVX512:
+            fk_avx512<Fast>(config.links, config.num_links, angles, 0, count, x, y, theta);
+            break;
+        case SIMD_AVX2:
+            fk_avx2<Fast>(config.links, config.num_links, angles, 0, count, x, y, theta);
+            break;
+#endif
+        default:
+            fk_sse2<Fast>(config.links, config.num_links, angles, 0, count, x, y, theta);
+            break;
+    }
+    return true;
+}
+
+
+template <typename Libm, typename Fast>
+static void lv_dispatch(int count, const double *links, const double *theta,
+                        double *dx, double *dy, SimdLevel level){
+    if (level > detect_simd_level()){
+        level = detect_simd_level();
+    }
+
+    switch (level){
+        case SIMD_SCALAR:
+            lv_scalar<Libm>(count, links, theta, dx, dy);
+            break;
+#ifdef BATCH_X86_DISPATCH
+        case SIMD_AVX512:
+            lv_avx512<Fast>(count, links, theta, dx, dy);
+            break;
+        case SIMD_AVX2:
+            lv_avx2<Fast>(count, links, theta, dx, dy);
+            break;
+#endif
+        default:
+            lv_sse2<Fast>(count, links, theta, dx, dy);
+            break;
+    }
+}
+
+
+template <typename Libm, typename Fast>
+static bool ik_dispatch(const Configuration &config, int count,
+                        const double *x, const double *y, const double *theta,
+                        double *const *angles_1, double *const *angles_2,
+                        unsigned char *reachable, SimdLevel level){
+    if (count < 0 || config.num_links != 3){
+        return false;
+    }
+    if (level > detect_simd_level()){
+        level = detect_simd_level();
+    }
+
+    switch (level){
+        case SIMD_SCALAR:
+            ik_scalar<Libm>(config.links, x, y, theta, 0, count, angles_1, angles_2, reachable);
+            break;
+#ifdef BATCH_X86_DISPATCH
+        case SIMD_AVX512:
+            ik_avx512<Fast>(config.links, x, y, theta, 0, count, angles_1, angles_2, reachable);
+            break;
+        case SIMD_AVX2:
+            ik_avx2<Fast>(config.links, x, y, theta, 0, count, angles_1, angles_2, reachable);
+            break;
+#endif
+        default:
+            ik_sse2<Fast>(config.links, x, y, theta, 0, count, angles_1, angles_2, reachable);
+            break;
+    }
+    return true;
+}
+
+
+/**
+ * Forward kinematics of many poses at once, using the best kernel available.
+ * Does not modify any Manipulator state.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] count Number of poses.
+ * @param[in] angles num_links arrays of count joint angles (deg), one per joint.
+ * @param[out] x Array of count end effector x positions.
+ * @param[out] y Array of count end effector y positions.
+ * @param[out] theta Array of count end effector orientations (deg).
+ * @return bool: true if success, false otherwise.
+ */
+bool forward_kinematics_batch(const Configuration &config, int count,
+                            const double *const *angles,
+                            double *x, double *y, double *theta){
+    return forward_kinematics_batch(config, count, angles, x, y, theta, detect_simd_level());
+}
+
+
+/**
+ * Forward kinematics of many poses at once with a given kernel.
+ * SIMD_SCALAR gives results bitwise identical to Manipulator::forward_kinematics,
+ * other kernels are within BATCH_FK_TOLERANCE of it. Levels not supported by
+ * the CPU fall back to the best supported one.
+ *
+ * @param[in] level Kernel to use.
+ * @return bool: true if success, false otherwise.
+ */
+bool forward_kinematics_batch(const Configuration &config, int count,
+                            const double *const *angles,
+                            double *x, double *y, double *theta, SimdLevel level){
+    return fk_dispatch<LibmMath, FastMath>(config, count, angles, x, y, theta, level);
+}
+
+
+/**
+ * Forward kinematics of many poses at once with angles in radians. Kernels
+ * and tolerances are those of forward_kinematics_batch, theta is wrapped
+ * to (-pi, pi] and compares in radians.
+ *
+ * @param[in] angles num_links arrays of count joint angles (rad), one per joint.
+ * @param[out] theta Array of count end effector orientations (rad).
+ * @return bool: true if success, false otherwise.
+ */
+bool forward_kinematics_batch_rad(const Configuration &config, int count,
+                                const double *const *angles,
+                                double *x, double *y, double *theta){
+    return forward_kinematics_batch_rad(config, count, angles, x, y, theta,
+                                        detect_simd_level());
+}
+
+
+bool forward_kinematics_batch_rad(const Configuration &config, int count,
+                                const double *const *angles,
+                                double *x, double *y, double *theta, SimdLevel level){
+    return fk_dispatch<LibmMathRad, FastMathRad>(config, count, angles, x, y, theta, level);
+}
+
+
+/**
+ * Forward kinematics of many poses at once in single precision, using the
+ * best kernel available. Kernels are those of the double version with twice
+ * the lanes; end effectors are within float_fk_error_bound of it.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] count Number of poses.
+ * @param[in] angles num_links arrays of count joint angles (deg), one per joint.
+ * @param[out] x Array of count end effector x positions.
+ * @param[out] y Array of count end effector y positions.
+ * @param[out] theta Array of count end effector orientations (deg).
+ * @return bool: true if success, false otherwise.
+ */
+bool forward_kinematics_batch(const Configuration &config, int count,
+                            const float *const *angles, float *x, float *y, float *theta){
+    return forward_kinematics_batch(config, count, angles, x, y, theta, detect_simd_level());
+}
+
+
+// Single precision forward kinematics with a given kernel
+bool forward_kinematics_batch(const Configuration &config, int count,
+                            const float *const *angles, float *x, float *y, float *theta,
+                            SimdLevel level){
+    return fk_dispatch<LibmMathF, FastMathF>(config, count, angles, x, y, theta, level);
+}
+
+
+/**
+ * Bound on the distance between the end effectors of the single and double
+ * precision forward kinematics of a pose, with a safety factor of 2.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] angle_sum Sum of the absolute joint angles of the pose (deg).
+ * @return double: bound, in length units.
+ */
+double float_fk_error_bound(const Configuration &config, double angle_sum){
+    double reach = 0;
+    for (int i = 0; i < config.num_links; i += 1){
+        reach += fabs(config.links[i]);
+    }
+    return float_error_bound(reach, config.num_links, fabs(angle_sum));
+}
+
+
+/**
+ * Checks for many poses if the end effector is within a given circle, like
+ * compute_intersection. PRECISION_FLOAT decides on the float kinematics
+ * alone, so poses within float_fk_error_bound of the circle may be wrong.
+ * PRECISION_MIXED screens with the float kinematics, then recomputes in
+ * double the poses that close to the circle: answers are those of
+ * PRECISION_DOUBLE.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] x coordinate of circle center.
+ * @param[in] y coordinate of circle center.
+ * @param[in] r radius of circle.
+ * @param[in] count Number of poses.
+ * @param[in] angles num_links arrays of count joint angles (deg).
+ * @param[out] hits Array of count flags, 1 if the circle contains the end effector.
+ * @param[in] precision PRECISION_DOUBLE, PRECISION_FLOAT or PRECISION_MIXED.
+ * @param[out] refined Number of poses recomputed in double, may be null.
+ * @return bool: true if success, false otherwise.
+ */
+bool intersection_batch(const Configuration &config, double x, double y, double r, int count,
+                        const double *const *angles, unsigned char *hits, Precision precision,
+                        int *refined){
+    int n = config.num_links;
+    if (count < 0 || n < 1){
+        return false;
+    }
+    double reach = 0;
+    for (int i = 0; i < n; i += 1){
+        reach += fabs(config.links[i]);
+    }
+    vector<float> storage_f((n + 3)*FK_BLOCK);
+    vector<double> storage(n*FK_BLOCK);
+    vector<const float *> rows_f(n);
+    vector<const double *> rows(n);
+    double xd[FK_BLOCK], yd[FK_BLOCK], td[FK_BLOCK];
+    double angle_sum[FK_BLOCK], inside[FK_BLOCK], near[FK_BLOCK];
+    int candidates[FK_BLOCK];
+    int refined_count = 0;
+    SimdLevel level = detect_simd_level();
+
+    for (int b = 0; b < count; b += FK_BLOCK){
+        int len = (count - b < FK_BLOCK) ? count - b : FK_BLOCK;
+        if (precision == PRECISION_DOUBLE){
+            for (int j = 0; j < n; j += 1){
+                rows[j] = angles[j] + b;
+            }
+            forward_kinematics_batch(config, len, &rows[0], xd, yd, td);
+            for (int i = 0; i < len; i += 1){
+                hits[b + i] = point_in_circle(x, y, r, xd[i], yd[i]);
+            }
+            continue;
+        }
+
+        switch (level){
+#ifdef BATCH_X86_DISPATCH
+            case SIMD_AVX512:
+                screen_avx512(config.links, n, reach, angles, b, len, x, y, r, &storage_f[0],
+                            &rows_f[0], angle_sum, inside, near);
+                break;
+            case SIMD_AVX2:
+                screen_avx2(config.links, n, reach, angles, b, len, x, y, r, &storage_f[0],
+                            &rows_f[0], angle_sum, inside, near);
+                break;
+#endif
+            default:
+                screen_sse2(config.links, n, reach, angles, b, len, x, y, r, &storage_f[0],
+                            &rows_f[0], angle_sum, inside, near);
+                break;
+        }
+        // Separate passes, mixing byte and double lanes would stop vectorization
+        for (int i = 0; i < len; i += 1){
+            hits[b + i] = (inside[i] != 0.0);
+        }
+        if (precision != PRECISION_MIXED){
+            continue;
+        }
+        int m = 0;
+        for (int i = 0; i < len; i += 1){
+            if (near[i] != 0.0){
+                candidates[m] = i;
+                m += 1;
+            }
+        }
+        if (m == 0){
+            continue;
+        }
+
+        // Poses next to the circle are gathered and recomputed in double
+        for (int j = 0; j < n; j += 1){
+            double *row = &storage[j*FK_BLOCK];
+            for (int k = 0; k < m; k += 1){
+                row[k] = angles[j][b + candidates[k]];
+            }
+            rows[j] = row;
+        }
+        forward_kinematics_batch(config, m, &rows[0], xd, yd, td);
+        for (int k = 0; k < m; k += 1){
+            hits[b + candidates[k]] = point_in_circle(x, y, r, xd[k], yd[k]);
+        }
+        refined_count += m;
+    }
+    if (refined){
+        *refined = refined_count;
+    }
+    return true;
+}
+
+
+/**
+ * Accuracy of the single precision forward kinematics against the double
+ * one, on a set of poses.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] count Number of poses.
+ * @param[in] angles num_links arrays of count joint angles (deg).
+ * @param[out] report Error statistics.
+ * @return bool: true if success, false otherwise.
+ */
+bool float_precision_report(const Configuration &config, int count, const double *const *angles,
+                            PrecisionReport &report){
+    int n = config.num_links;
+    if (count < 0 || n < 1){
+        return false;
+    }
+    double reach = 0;
+    for (int i = 0; i < n; i += 1){
+        reach += fabs(config.links[i]);
+    }
+    vector<float> storage_f(n*FK_BLOCK);
+    vector<const float *> rows_f(n);
+    vector<const double *> rows(n);
+    float xf[FK_BLOCK], yf[FK_BLOCK], tf[FK_BLOCK];
+    double xd[FK_BLOCK], yd[FK_BLOCK], td[FK_BLOCK];
+    double angle_sum[FK_BLOCK];
+    double total = 0;
+
+    report.count = count;
+    report.max_position_error = 0;
+    report.mean_position_error = 0;
+    report.max_theta_error = 0;
+    report.max_bound_ratio = 0;
+    for (int b = 0; b < count; b += FK_BLOCK){
+        int len = (count - b < FK_BLOCK) ? count - b : FK_BLOCK;
+        for (int j = 0; j < n; j += 1){
+            rows[j] = angles[j] + b;
+        }
+        float_block(n, angles, b, len, &storage_f[0], &rows_f[0], angle_sum);
+        forward_kinematics_batch(config, len, &rows[0], xd, yd, td);
+        forward_kinematics_batch(config, len, &rows_f[0], xf, yf, tf);
+        for (int i = 0; i < len; i += 1){
+            double dx = (double)xf[i] - xd[i];
+            double dy = (double)yf[i] - yd[i];
+            double error = sqrt(dx*dx + dy*dy);
+            double theta_error = fabs(clip_angle_180((double)tf[i] - td[i]));
+            double ratio = error / float_error_bound(reach, n, angle_sum[i]);
+            total += error;
+            report.max_position_error = max(report.max_position_error, error);
+            report.max_theta_error = max(report.max_theta_error, theta_error);
+            report.max_bound_ratio = max(report.max_bound_ratio, ratio);
+        }
+    }
+    report.mean_position_error = (count > 0) ? total / count : 0.0;
+    return true;
+}
+
+
+/**
+ * Positions of every joint of many poses at once, using the best kernel
+ * available. Index 0 is the base and index num_links the end effector.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] count Number of poses.
+ * @param[in] angles num_links arrays of count joint angles (deg), one per joint.
+ * @param[out] joint_x num_links + 1 arrays of count x positions, one per joint.
+ * @param[out] joint_y num_links + 1 arrays of count y positions, one per joint.
+ * @return bool: true if success, false otherwise.
+ */
+bool joint_positions_batch(const Configuration &config, int count,
+                        const double *const *angles,
+                        double *const *joint_x, double *const *joint_y){
+    return joint_positions_batch(config, count, angles, joint_x, joint_y, detect_simd_level());
+}
+
+
+/**
+ * Positions of every joint of many poses at once with a given kernel.
+ * SIMD_SCALAR matches compute_joint_frames bitwise, other kernels are within
+ * BATCH_FK_TOLERANCE of it.
+ *
+ * @param[in] level Kernel to use.
+ * @return bool: true if success, false otherwise.
+ */
+bool joint_positions_batch(const Configuration &config, int count,
+                        const double *const *angles,
+                        double *const *joint_x, double *const *joint_y, SimdLevel level){
+    if (count < 0 || config.num_links < 1){
+        return false;
+    }
+    if (level > detect_simd_level()){
+        level = detect_simd_level();
+    }
+
+    switch (level){
+        case SIMD_SCALAR:
+            jp_scalar(config.links, config.num_links, angles, 0, count, joint_x, joint_y);
+            break;
+#ifdef BATCH_X86_DISPATCH
+        case SIMD_AVX512:
+            jp_avx512(config.links, config.num_links, angles, 0, count, joint_x, joint_y);
+            break;
+        case SIMD_AVX2:
+            jp_avx2(config.links, config.num_links, angles, 0, count, joint_x, joint_y);
+            break;
+#endif
+        default:
+            jp_sse2(config.links, config.num_links, angles, 0, count, joint_x, joint_y);
+            break;
+    }
+    return true;
+}
+
+
+/**
+ * Vector of every link of one chain from its absolute angle, using the best
+ * kernel available. Long chains use this to stay vectorized along the chain.
+ *
+ * @param[in] count Number of links.
+ * @param[in] links Array of count links' lengths.
+ * @param[in] theta Array of count cumulative joint angles (deg), link i points along theta[i].
+ * @param[out] dx Array of count x components.
+ * @param[out] dy Array of count y components.
+ */
+void link_vectors_batch(int count, const double *links, const double *theta,
+                        double *dx, double *dy){
+    link_vectors_batch(count, links, theta, dx, dy, detect_simd_level());
+}
+
+
+/**
+ * Link vectors with a given kernel. SIMD_SCALAR uses libm like
+ * compute_joint_frames, other kernels are within BATCH_FK_TOLERANCE times
+ * the link length of it for |theta| <= 1e4 deg.
+ *
+ * @param[in] level Kernel to use.
+ */
+void link_vectors_batch(int count, const double *links, const double *theta,
+                        double *dx, double *dy, SimdLevel level){
+    lv_dispatch<LibmMath, FastMath>(count, links, theta, dx, dy, level);
+}
+
+
+// link_vectors_batch with cumulative angles in radians
+void link_vectors_batch_rad(int count, const double *links, const double *theta,
+                            double *dx, double *dy){
+    link_vectors_batch_rad(count, links, theta, dx, dy, detect_simd_level());
+}
+
+
+void link_vectors_batch_rad(int count, const double *links, const double *theta,
+                            double *dx, double *dy, SimdLevel level){
+    lv_dispatch<LibmMathRad, FastMathRad>(count, links, theta, dx, dy, level);
+}
+
+
+/**
+ * Closed form inverse kinematics of many targets at once for a 3 links robot,
+ * using the best kernel available. Both elbow solutions are returned, in the
+ * same order as compute_inverse_kinematics.
+ *
+ * @param[in] config Robot configuration, must have 3 links.
+ * @param[in] count Number of targets.
+ * @param[in] x Array of count target x positions.
+ * @param[in] y Array of count target y positions.
+ * @param[in] theta Array of count target orientations (deg).
+ * @param[out] angles_1 3 arrays of count joint angles (deg), first solution.
+ * @param[out] angles_2 3 arrays of count joint angles (deg), other solution.
+ * @param[out] reachable Array of count flags, 1 if target is reachable. 
+ *                       Angles of unreachable targets are NaN.
+ * @return bool: true if success, false otherwise.
+ */
+bool inverse_kinematics_batch(const Configuration &config, int count,
+                            const double *x, const double *y, const double *theta,
+                            double *const *angles_1, double *const *angles_2,
+                            unsigned char *reachable){
+    return inverse_kinematics_batch(config, count, x, y, theta, angles_1, angles_2, 
+                                    reachable, detect_simd_level());
+}
+
+
+/**
+ * Closed form inverse kinematics of many targets at once with a given kernel.
+ * SIMD_SCALAR uses libm, other kernels agree with it within BATCH_IK_TOLERANCE.
+ *
+ * @param[in] level Kernel to use.
+ * @return bool: true if success, false otherwise.
+ */
+bool inverse_kinematics_batch(const Configuration &config, int count,
+                            const double *x, const double *y, const double *theta,
+                            double *const *angles_1, double *const *angles_2,
+                            unsigned char *reachable, SimdLevel level){
+    return ik_dispatch<LibmMath, FastMath>(config, count, x, y, theta, angles_1, angles_2,
+                                        reachable, level);
+}
+
+
+/**
+ * Closed form inverse kinematics of many targets at once in radians, same
+ * kernels as inverse_kinematics_batch. Angles are wrapped to (-pi, pi] and
+ * kernels agree within BATCH_IK_TOLERANCE radians.
+ *
+ * @param[in] theta Array of count target orientations (rad).
+ * @param[out] angles_1 3 arrays of count joint angles (rad), first solution.
+ * @param[out] angles_2 3 arrays of count joint angles (rad), other solution.
+ * @return bool: true if success, false otherwise.
+ */
+bool inverse_kinematics_batch_rad(const Configuration &config, int count,
+                                const double *x, const double *y, const double *theta,
+                                double *const *angles_1, double *const *angles_2,
+                                unsigned char *reachable){
+    return inverse_kinematics_batch_rad(config, count, x, y, theta, angles_1, angles_2,
+                                        reachable, detect_simd_level());
+}
+
+
+bool inverse_kinematics_batch_rad(const Configuration &config, int count,
+                                const double *x, const double *y, const double *theta,
+                                double *const *angles_1, double *const *angles_2,
+                                unsigned char *reachable, SimdLevel level){
+    return ik_dispatch<LibmMathRad, FastMathRad>(config, count, x, y, theta, angles_1,
+                                                angles_2, reachable, level);
+}
+
+
+/**
+ * Inverse dynamics of many end effector wrenches at the same joint angles.
+ * Joint positions are computed once, then every torque is a dot product of
+ * a wrench with one column of the Jacobian.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] angles Array with num_links joint angles (deg).
+ * @param[in] count Number of wrenches.
+ * @param[in] fx Array of count forces at end effector.
+ * @param[in] fy Array of count forces at end effector.
+ * @param[in] tau Array of count torques at end effector.
+ * @param[out] torques num_links arrays of count joint torques, one per joint.
+ * @return bool: true if success, false otherwise.
+ */
+bool inverse_dynamics_batch(const Configuration &config, const double *angles, int count,
+                            const double *fx, const double *fy, const double *tau,
+                            double *const *torques){
+    int n = config.num_links;
+    if (count < 0 || n < 1){
+        return false;
+    }
+    LinkArray joint_x(n + 1);
+    LinkArray joint_y(n + 1);
+    LinkArray joint_theta(n + 1);
+    compute_joint_frames(n, config.links, angles, 0, joint_x, joint_y, joint_theta);
+
+    for (int i = 0; i < n; i += 1){
+        const double a = -(joint_y[n] - joint_y[i]);
+        const double b = joint_x[n] - joint_x[i];
+        double *__restrict out = torques[i];
+        for (int k = 0; k < count; k += 1){
+            out[k] = a*fx[k] + b*fy[k] + tau[k];
+        }
+    }
+    return true;
+}
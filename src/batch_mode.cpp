@@ -0,0 +1,260 @@
+/********
+ * batch_mode.cpp
+ * Author: Simon Chamorro
+ * Non-interactive command stream for the Robot Manipulator program
+ *
+ * Reads the same commands as the interactive mode, one per line, and writes
+ * one result line per command:
+ *   reset, links          -> ok
+ *   forward               -> X Y THETA
+ *   intersection          -> true | false
+ *   inverse_k (3 links)   -> A1 A2 A3 B1 B2 B3 | unreachable
+ *   inverse_k (N links)   -> A1 ... AN | unreachable
+ *   inverse_d             -> T1 ... TN
+ *   invalid input         -> error: MESSAGE
+ * Empty lines, lines starting with # and help produce no output.
+********/
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "batch_mode.h"
+#include "manipulator.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+const size_t OUTPUT_BUFFER_SIZE = 1 << 16;
+
+
+BatchOptions default_batch_options(){
+    BatchOptions options;
+    options.flush_every = 0;
+    options.precision = 3;
+    return options;
+}
+
+
+// Fixed size output buffer, handed to stdio only when full or on flush
+class OutputBuffer{
+    public:
+        OutputBuffer(FILE *out, int precision) : out(out), used(0), precision(precision){
+        }
+
+        void text(const char *s){
+            size_t n = strlen(s);
+            if (used + n > OUTPUT_BUFFER_SIZE){
+                drain();
+            }
+            memcpy(data + used, s, n);
+            used += n;
+        }
+
+        void number(double value, bool first){
+            // Room for DBL_MAX in %f with BATCH_MAX_PRECISION decimals
+            char tmp[352];
+            snprintf(tmp, sizeof(tmp), first ? "%.*f" : " %.*f", precision, value);
+            text(tmp);
+        }
+
+        void numbers(const double *values, int count){
+            for (int i = 0; i < count; i += 1){
+                number(values[i], i == 0);
+            }
+            text("\n");
+        }
+
+        void drain(){
+            fwrite(data, 1, used, out);
+            used = 0;
+        }
+
+        void flush(){
+            drain();
+            fflush(out);
+        }
+
+    private:
+        FILE *out;
+        size_t used;
+        int precision;
+        char data[OUTPUT_BUFFER_SIZE];
+};
+
+
+/**
+ * Split a line in place into a command word and numeric arguments.
+ *
+ * @param[in,out] line Input line, the command word is null terminated in place.
+ * @param[out] command Pointer to the command word.
+ * @param[in,out] args Parsed numbers, grows to fit and keeps its capacity between lines.
+ * @return number of arguments, -1 if one is not a number.
+ */
+static int parse_line(char *line, char **command, vector<double> &args){
+    char *p = line;
+    while (*p == ' ' || *p == '\t'){
+        p += 1;
+    }
+    *command = p;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r'){
+        p += 1;
+    }
+    if (*p){
+        *p = '\0';
+        p += 1;
+    }
+
+    int count = 0;
+    while (true){
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'){
+            p += 1;
+        }
+        if (!*p){
+            break;
+        }
+        if (count == (int)args.size()){
+            args.resize(2*args.size());
+        }
+        char *end;
+        args[count] = strtod(p, &end);
+        if (end == p){
+            return -1;
+        }
+        count += 1;
+        p = end;
+    }
+    return count;
+}
+
+
+/**
+ * Run commands from a stream until end of input or exit.
+ * Lines are read into one reused buffer and parsed in place, results are
+ * buffered and flushed at the end or every options.flush_every commands.
+ *
+ * @param[in] in Input stream.
+ * @param[in] out Output stream.
+ * @param[in] options Flush interval and precision.
+ * @return number of commands that failed, -1 if the precision is out of range.
+ */
+int run_batch(FILE *in, FILE *out, const BatchOptions &options){
+    if (options.precision < 0 || options.precision > BATCH_MAX_PRECISION){
+        return -1;
+    }
+    Manipulator manipulator;
+    OutputBuffer *buffer = new OutputBuffer(out, options.precision);
+    char *line = NULL;
+    size_t capacity = 0;
+    vector<double> arg_values(INLINE_LINKS + 4);
+    LinkArray angles_1;
+    LinkArray angles_2;
+    int commands = 0;
+    int errors = 0;
+
+    while (getline(&line, &capacity, in) != -1){
+        char *command;
+        int n_args = parse_line(line, &command, arg_values);
+        double *args = arg_values.data();
+        if (*command == '\0' || *command == '#' || strcmp(command, "help") == 0){
+            continue;
+        }
+        const Configuration &config = manipulator.get_config_ref();
+        int n_links = config.num_links;
+        angles_1.resize(n_links > 6 ? n_links : 6);
+        angles_2.resize(n_links);
+        bool ok = true;
+
+        if (n_args < 0){
+            buffer->text("error: invalid arguments\n");
+            ok = false;
+        }
+        else if (strcmp(command, "exit") == 0){
+            break;
+        }
+        else if (strcmp(command, "reset") == 0){
+            manipulator.reset();
+            buffer->text("ok\n");
+        }
+        else if (strcmp(command, "links") == 0){
+            if (n_args >= 1 && manipulator.set_parameters(n_args, args)){
+                buffer->text("ok\n");
+            }
+            else{
+                buffer->text("error: invalid number of links\n");
+                ok = false;
+            }
+        }
+        else if (strcmp(command, "forward") == 0){
+            if (n_args == n_links){
+                manipulator.forward_kinematics(args);
+                double pose[3] = {config.x, config.y, config.theta};
+                buffer->numbers(pose, 3);
+            }
+            else{
+                buffer->text("error: invalid number of angles\n");
+                ok = false;
+            }
+        }
+        else if (strcmp(command, "intersection") == 0){
+            if (n_args == n_links + 3){
+                bool inside = manipulator.intersection(args[0], args[1], args[2], args + 3);
+                buffer->text(inside ? "true\n" : "false\n");
+            }
+            else{
+                buffer->text("error: invalid number of arguments\n");
+                ok = false;
+            }
+        }
+        else if (strcmp(command, "inverse_k") == 0){
+            if (n_args != 3){
+                buffer->text("error: invalid number of arguments\n");
+                ok = false;
+            }
+            else if (n_links == 3){
+                if (manipulator.inverse_kinematics(args[0], args[1], args[2], angles_1, angles_2)
+                        && angles_1[1] == angles_1[1]){
+                    for (int i = 0; i < 3; i += 1){
+                        angles_1[3 + i] = angles_2[i];
+                    }
+                    buffer->numbers(angles_1, 6);
+                }
+                else{
+                    buffer->text("unreachable\n");
+                }
+            }
+            else{
+                if (manipulator.inverse_kinematics_numerical(args[0], args[1], args[2], angles_1,
+                                                            default_ik_solver_options(), NULL)){
+                    buffer->numbers(angles_1, n_links);
+                }
+                else{
+                    buffer->text("unreachable\n");
+                }
+            }
+        }
+        else if (strcmp(command, "inverse_d") == 0){
+            if (n_args == 3 && manipulator.inverse_dynamics(args[0], args[1], args[2], angles_1)){
+                buffer->numbers(angles_1, n_links);
+            }
+            else{
+                buffer->text("error: invalid number of arguments\n");
+                ok = false;
+            }
+        }
+        else{
+            buffer->text("error: not a valid command\n");
+            ok = false;
+        }
+
+        errors += ok ? 0 : 1;
+        commands += 1;
+        if (options.flush_every > 0 && commands % options.flush_every == 0){
+            buffer->flush();
+        }
+    }
+
+    buffer->flush();
+    free(line);
+    delete buffer;
+    return errors;
+}
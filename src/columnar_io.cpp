@@ -0,0 +1,470 @@
+/********
+ * columnar_io.cpp
+ * Author: Simon Chamorro
+ * Binary columnar files of joint angles and poses
+********/
+
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "batch_kinematics.h"
+#include "columnar_io.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+static const char COLUMNAR_MAGIC[8] = {'R', 'M', 'C', 'O', 'L', '0', '0', '1'};
+static const uint32_t COLUMNAR_BYTE_ORDER = 0x01020304;
+static const size_t COLUMNAR_LINKS_OFFSET = 40;
+static const size_t COLUMNAR_ROWS_OFFSET = 32;
+
+// Rows per column stride so that every column starts aligned for both types
+static const int COLUMNAR_ROW_ALIGNMENT = COLUMNAR_ALIGNMENT / COLUMN_FLOAT32;
+
+
+static size_t round_up(size_t value, size_t multiple){
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static size_t header_size_for(int num_links){
+    return round_up(COLUMNAR_LINKS_OFFSET + sizeof(double)*num_links, COLUMNAR_ALIGNMENT);
+}
+
+
+int columnar_num_columns(int num_links, int column_set){
+    int n = 0;
+    if (column_set & COLUMNS_ANGLES){
+        n += num_links;
+    }
+    if (column_set & COLUMNS_POSE){
+        n += 3;
+    }
+    return n;
+}
+
+
+ColumnarWriter::ColumnarWriter() : file(NULL), num_columns(0), block_rows(0), pending(0),
+                                   type(COLUMN_FLOAT64), num_rows(0){
+}
+
+
+ColumnarWriter::~ColumnarWriter(){
+    close();
+}
+
+
+bool ColumnarWriter::open(const char *path, const Configuration &config, ColumnType type,
+                        int column_set){
+    return open(path, config, type, column_set, COLUMNAR_BLOCK_ROWS);
+}
+
+
+/**
+ * Create a file and write its header.
+ *
+ * @param[in] path File to create or truncate, must be seekable.
+ * @param[in] config Robot configuration, number of links and lengths are stored.
+ * @param[in] type Element type of every column.
+ * @param[in] column_set Combination of ColumnSet flags.
+ * @param[in] block_rows Rows per block, a multiple of 16.
+ * @return bool: true if the file was created, false otherwise.
+ */
+bool ColumnarWriter::open(const char *path, const Configuration &config, ColumnType type,
+                        int column_set, int block_rows){
+    close();
+    if (config.num_links < 1
+            || (type != COLUMN_FLOAT32 && type != COLUMN_FLOAT64)
+            || column_set < COLUMNS_ANGLES || column_set > (COLUMNS_ANGLES | COLUMNS_POSE)
+            || block_rows < 1 || block_rows % COLUMNAR_ROW_ALIGNMENT != 0){
+        return false;
+    }
+    file = fopen(path, "wb");
+    if (!file){
+        return false;
+    }
+
+    size_t size = header_size_for(config.num_links);
+    vector<unsigned char> header(size, 0);
+    uint32_t fields[6] = {COLUMNAR_BYTE_ORDER, (uint32_t)config.num_links, (uint32_t)type,
+                          (uint32_t)column_set, (uint32_t)block_rows, 0};
+    int64_t rows = 0;
+    memcpy(&header[0], COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    memcpy(&header[8], fields, sizeof(fields));
+    memcpy(&header[COLUMNAR_ROWS_OFFSET], &rows, sizeof(rows));
+    memcpy(&header[COLUMNAR_LINKS_OFFSET], config.links, sizeof(double)*config.num_links);
+    if (fwrite(&header[0], 1, size, file) != size){
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+
+    this->type = type;
+    this->block_rows = block_rows;
+    num_columns = columnar_num_columns(config.num_links, column_set);
+    num_rows = 0;
+    pending = 0;
+    block.assign((size_t)block_rows*num_columns, 0.0);
+    narrow.assign(type == COLUMN_FLOAT32 ? block_rows : 0, 0.0f);
+    return true;
+}
+
+
+/**
+ * Append rows given as columns.
+ *
+ * @param[in] count Number of rows.
+ * @param[in] columns One array of count values per column, in file order.
+ * @return bool: true if written, false if the writer is not open or on I/O error.
+ */
+bool ColumnarWriter::write(int count, const double *const *columns){
+    if (!file || count < 0){
+        return false;
+    }
+    int done = 0;
+    while (done < count){
+        int n = block_rows - pending;
+        n = (count - done < n) ? count - done : n;
+        for (int c = 0; c < num_columns; c += 1){
+            memcpy(&block[(size_t)c*block_rows + pending], columns[c] + done, sizeof(double)*n);
+        }
+        pending += n;
+        done += n;
+        if (pending == block_rows && !flush_block()){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Append one row.
+ *
+ * @param[in] values One value per column, in file order.
+ * @return bool: true if written, false if the writer is not open or on I/O error.
+ */
+bool ColumnarWriter::write_row(const double *values){
+    if (!file){
+        return false;
+    }
+    for (int c = 0; c < num_columns; c += 1){
+        block[(size_t)c*block_rows + pending] = values[c];
+    }
+    pending += 1;
+    return pending < block_rows || flush_block();
+}
+
+
+// Write the pending rows as one block, padding each column to the alignment
+bool ColumnarWriter::flush_block(){
+    if (pending == 0){
+        return true;
+    }
+    size_t stride = round_up(pending, COLUMNAR_ROW_ALIGNMENT);
+    bool ok = true;
+    for (int c = 0; c < num_columns; c += 1){
+        double *values = &block[(size_t)c*block_rows];
+        for (size_t k = pending; k < stride; k += 1){
+            values[k] = 0.0;
+        }
+        if (type == COLUMN_FLOAT64){
+            ok = ok && fwrite(values, sizeof(double), stride, file) == stride;
+        }
+        else{
+            for (size_t k = 0; k < stride; k += 1){
+                narrow[k] = (float)values[k];
+            }
+            ok = ok && fwrite(&narrow[0], sizeof(float), stride, file) == stride;
+        }
+    }
+    num_rows += pending;
+    pending = 0;
+    return ok;
+}
+
+
+/**
+ * Write pending rows, store the row count in the header and close the file.
+ *
+ * @return bool: true if everything was written, false otherwise.
+ */
+bool ColumnarWriter::close(){
+    if (!file){
+        return false;
+    }
+    bool ok = flush_block();
+    ok = ok && fseeko(file, COLUMNAR_ROWS_OFFSET, SEEK_SET) == 0;
+    ok = ok && fwrite(&num_rows, sizeof(num_rows), 1, file) == 1;
+    ok = (fclose(file) == 0) && ok;
+    file = NULL;
+    return ok;
+}
+
+
+int ColumnarWriter::get_num_columns() const{
+    return num_columns;
+}
+
+
+int64_t ColumnarWriter::get_num_rows() const{
+    return num_rows + pending;
+}
+
+
+ColumnarReader::ColumnarReader() : data(NULL), size(0), type(COLUMN_FLOAT64), column_set(0),
+                                   num_columns(0), block_rows(0), num_rows(0), header_size(0){
+    robot_config.resize(0);
+}
+
+
+ColumnarReader::~ColumnarReader(){
+    close();
+}
+
+
+/**
+ * Map a file read only and check its header against its size.
+ * Pages are loaded on access, so files may be larger than memory.
+ *
+ * @param[in] path File written by ColumnarWriter.
+ * @return bool: true if the file is a valid columnar file, false otherwise.
+ */
+bool ColumnarReader::open(const char *path){
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0){
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)COLUMNAR_LINKS_OFFSET){
+        ::close(fd);
+        return false;
+    }
+    void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED){
+        return false;
+    }
+    data = (const unsigned char *)mapped;
+    size = st.st_size;
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    uint32_t fields[6];
+    memcpy(fields, data + 8, sizeof(fields));
+    memcpy(&num_rows, data + COLUMNAR_ROWS_OFFSET, sizeof(num_rows));
+    int num_links = fields[1];
+    type = (ColumnType)fields[2];
+    column_set = fields[3];
+    block_rows = fields[4];
+    bool valid = memcmp(data, COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC)) == 0
+        && fields[0] == COLUMNAR_BYTE_ORDER
+        && num_links >= 1
+        && (type == COLUMN_FLOAT32 || type == COLUMN_FLOAT64)
+        && column_set >= COLUMNS_ANGLES && column_set <= (COLUMNS_ANGLES | COLUMNS_POSE)
+        && block_rows >= 1 && block_rows % COLUMNAR_ROW_ALIGNMENT == 0
+        && num_rows >= 0
+        && num_rows <= (int64_t)INT_MAX*block_rows;  // Block indices fit in an int
+    if (valid){
+        header_size = header_size_for(num_links);
+        num_columns = columnar_num_columns(num_links, column_set);
+        valid = size >= header_size;
+    }
+    // Link lengths must fit in the file before any storage is sized from them
+    valid = valid && robot_config.resize(num_links);
+    if (valid && num_rows > 0){
+        // Full blocks are checked by division, their total size may overflow
+        int last = get_num_blocks() - 1;
+        size_t block_bytes = (size_t)block_rows*num_columns*type;
+        valid = (size - header_size) / block_bytes >= (size_t)last;
+        if (valid){
+            size_t stride = round_up(get_block_rows(last), COLUMNAR_ROW_ALIGNMENT)*type;
+            size_t end = header_size + (size_t)last*block_bytes + num_columns*stride;
+            valid = size >= end;
+        }
+    }
+    if (!valid){
+        close();
+        return false;
+    }
+
+    robot_config.x = 0;
+    robot_config.y = 0;
+    robot_config.theta = 0;
+    memcpy(robot_config.links, data + COLUMNAR_LINKS_OFFSET, sizeof(double)*num_links);
+    for (int i = 0; i < num_links; i += 1){
+        robot_config.angles[i] = 0;
+        robot_config.x += robot_config.links[i];
+    }
+    return true;
+}
+
+
+void ColumnarReader::close(){
+    if (data){
+        munmap((void *)data, size);
+    }
+    data = NULL;
+    size = 0;
+    num_rows = 0;
+    num_columns = 0;
+    robot_config.resize(0);
+}
+
+
+const Configuration &ColumnarReader::get_config() const{
+    return robot_config;
+}
+
+
+ColumnType ColumnarReader::get_type() const{
+    return type;
+}
+
+
+int ColumnarReader::get_column_set() const{
+    return column_set;
+}
+
+
+int ColumnarReader::get_num_columns() const{
+    return num_columns;
+}
+
+
+int64_t ColumnarReader::get_num_rows() const{
+    return num_rows;
+}
+
+
+int ColumnarReader::get_num_blocks() const{
+    return (int)((num_rows + block_rows - 1) / block_rows);
+}
+
+
+int ColumnarReader::get_block_rows(int block) const{
+    int64_t rest = num_rows - (int64_t)block*block_rows;
+    return (rest < block_rows) ? (int)rest : block_rows;
+}
+
+
+/**
+ * Address of a column inside a block, no copy is made.
+ *
+ * @param[in] block Block index.
+ * @param[in] column Column index, angles first then x, y, theta.
+ * @return pointer to get_block_rows(block) values of get_type(), aligned to
+ *         COLUMNAR_ALIGNMENT, valid until close.
+ */
+const void *ColumnarReader::column(int block, int column) const{
+    size_t element = type;
+    size_t offset = header_size + (size_t)block*block_rows*num_columns*element;
+    size_t stride = round_up(get_block_rows(block), COLUMNAR_ROW_ALIGNMENT)*element;
+    return data + offset + column*stride;
+}
+
+
+const double *ColumnarReader::column_f64(int block, int column) const{
+    return (type == COLUMN_FLOAT64) ? (const double *)this->column(block, column) : NULL;
+}
+
+
+const float *ColumnarReader::column_f32(int block, int column) const{
+    return (type == COLUMN_FLOAT32) ? (const float *)this->column(block, column) : NULL;
+}
+
+
+/**
+ * Copy a range of rows of one column, converting to double.
+ *
+ * @param[in] first First row.
+ * @param[in] count Number of rows.
+ * @param[in] column Column index.
+ * @param[out] out Array of count values.
+ * @return bool: true if the range is inside the file, false otherwise.
+ */
+bool ColumnarReader::read(int64_t first, int count, int column, double *out) const{
+    if (!data || first < 0 || count < 0 || first + count > num_rows
+            || column < 0 || column >= num_columns){
+        return false;
+    }
+    int done = 0;
+    while (done < count){
+        int64_t row = first + done;
+        int block = (int)(row / block_rows);
+        int offset = (int)(row - (int64_t)block*block_rows);
+        int n = get_block_rows(block) - offset;
+        n = (count - done < n) ? count - done : n;
+        if (type == COLUMN_FLOAT64){
+            memcpy(out + done, column_f64(block, column) + offset, sizeof(double)*n);
+        }
+        else{
+            const float *values = column_f32(block, column) + offset;
+            for (int k = 0; k < n; k += 1){
+                out[done + k] = values[k];
+            }
+        }
+        done += n;
+    }
+    return true;
+}
+
+
+/**
+ * Forward kinematics over every row of a file, one block at a time.
+ * Float64 angle columns are passed to the batch kernels in place; float32
+ * columns are widened into one block of scratch space.
+ *
+ * @param[in] in Open reader with angle columns.
+ * @param[in,out] out Open writer for the same robot. If it has angle columns
+ *                    they are copied from the input before the pose.
+ * @return bool: true if every row was written, false otherwise.
+ */
+bool forward_kinematics_columnar(const ColumnarReader &in, ColumnarWriter &out){
+    const Configuration &config = in.get_config();
+    int n = config.num_links;
+    if (n < 1 || !(in.get_column_set() & COLUMNS_ANGLES)){
+        return false;
+    }
+    bool copy_angles = out.get_num_columns() == n + 3;
+    if (!copy_angles && out.get_num_columns() != 3){
+        return false;
+    }
+
+    int rows = (in.get_num_blocks() > 0) ? in.get_block_rows(0) : 0;
+    vector<double> wide(in.get_type() == COLUMN_FLOAT32 ? (size_t)rows*n : 0);
+    vector<double> pose((size_t)rows*3);
+    vector<const double *> column_list(n + 3);
+    const double **columns = &column_list[0];
+    for (int b = 0; b < in.get_num_blocks(); b += 1){
+        int count = in.get_block_rows(b);
+        for (int i = 0; i < n; i += 1){
+            if (in.get_type() == COLUMN_FLOAT64){
+                columns[i] = in.column_f64(b, i);
+            }
+            else{
+                const float *values = in.column_f32(b, i);
+                double *dst = &wide[(size_t)i*rows];
+                for (int k = 0; k < count; k += 1){
+                    dst[k] = values[k];
+                }
+                columns[i] = dst;
+            }
+        }
+        double *x = &pose[0];
+        double *y = x + rows;
+        double *theta = y + rows;
+        if (!forward_kinematics_batch(config, count, columns, x, y, theta)){
+            return false;
+        }
+        columns[n] = x;
+        columns[n + 1] = y;
+        columns[n + 2] = theta;
+        if (!out.write(count, copy_angles ? columns : columns + n)){
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,264 @@
+/********
+ * ik_cache.cpp
+ * Author: Simon Chamorro
+ * Bounded concurrent cache of inverse kinematics solutions
+ *
+ * The table is set associative: the key hash picks a shard and a set of
+ * IK_CACHE_WAYS entries in it. A lookup compares the few entries of its
+ * set under the shard lock; a miss solves outside the lock and stores the
+ * result over an empty or the least recently used entry of the set.
+********/
+
+#include <math.h>
+#include <mutex>
+#include <string.h>
+#include <vector>
+#include "ik_cache.h"
+#include "kinematics.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+
+struct IkCache::Entry{
+
+    int64_t qx;
+    int64_t qy;
+    int64_t qtheta;
+    uint64_t links_hash;
+    uint64_t stamp;     // Last use, 0 for an empty entry
+    bool reachable;
+    double angles_1[3];
+    double angles_2[3];
+};
+
+
+struct IkCache::Shard{
+
+    mutex guard;
+    vector<Entry> entries;
+    uint64_t clock;
+};
+
+
+IkCacheOptions default_ik_cache_options(){
+    IkCacheOptions options;
+    options.capacity = 4096;
+    options.position_tolerance = 1e-9;
+    options.angle_tolerance = 1e-9;
+    return options;
+}
+
+
+static uint64_t mix_hash(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+
+/**
+ * Hash of the number of links and their lengths, bit for bit.
+ *
+ * @param[in] config Robot configuration.
+ * @return uint64_t: hash, equal for equal link lengths.
+ */
+uint64_t hash_links(const Configuration &config){
+    uint64_t h = mix_hash((uint64_t)config.num_links);
+    for (int i = 0; i < config.num_links; i += 1){
+        uint64_t bits;
+        double length = config.links[i] + 0.0;  // -0.0 hashes as 0.0
+        memcpy(&bits, &length, sizeof(bits));
+        h = mix_hash(h ^ bits);
+    }
+    return h;
+}
+
+
+IkCache::IkCache() : IkCache(default_ik_cache_options()){
+}
+
+
+IkCache::IkCache(const IkCacheOptions &options) : options(options), hits(0), misses(0),
+                                                  evictions(0), size(0){
+    int capacity = options.capacity > 0 ? options.capacity : 1;
+    int per_set = IK_CACHE_SHARDS*IK_CACHE_WAYS;
+    sets_per_shard = (capacity + per_set - 1) / per_set;
+    this->options.capacity = sets_per_shard*per_set;
+
+    // Cells must have a positive finite size, others fall back to the defaults
+    IkCacheOptions defaults = default_ik_cache_options();
+    if (!(options.position_tolerance > 0 && options.position_tolerance < INFINITY)){
+        this->options.position_tolerance = defaults.position_tolerance;
+    }
+    if (!(options.angle_tolerance > 0 && options.angle_tolerance < INFINITY)){
+        this->options.angle_tolerance = defaults.angle_tolerance;
+    }
+    inv_position = 1.0 / this->options.position_tolerance;
+    inv_angle = 1.0 / this->options.angle_tolerance;
+    shards.reset(new Shard[IK_CACHE_SHARDS]);
+    for (int s = 0; s < IK_CACHE_SHARDS; s += 1){
+        shards[s].entries.resize(sets_per_shard*IK_CACHE_WAYS);
+        shards[s].clock = 0;
+        for (size_t e = 0; e < shards[s].entries.size(); e += 1){
+            shards[s].entries[e].stamp = 0;
+        }
+    }
+}
+
+
+IkCache::~IkCache(){
+}
+
+
+// Quantization cell of a target, false if it has none (NaN or too large)
+bool IkCache::quantize(double x, double y, double theta, uint64_t links_hash,
+                    Entry &key, uint64_t &hash) const{
+    const double limit = 9.0e18;
+    double cells[3] = {floor(x*inv_position), floor(y*inv_position), floor(theta*inv_angle)};
+    for (int i = 0; i < 3; i += 1){
+        if (!(fabs(cells[i]) < limit)){
+            return false;
+        }
+    }
+    key.qx = (int64_t)cells[0];
+    key.qy = (int64_t)cells[1];
+    key.qtheta = (int64_t)cells[2];
+    key.links_hash = links_hash;
+    hash = mix_hash(links_hash ^ (uint64_t)key.qx);
+    hash = mix_hash(hash ^ (uint64_t)key.qy);
+    hash = mix_hash(hash ^ (uint64_t)key.qtheta);
+    return true;
+}
+
+
+/**
+ * Inverse kinematics of a 3 links configuration through the cache.
+ * Results are those of compute_inverse_kinematics for the first target
+ * solved in the same quantization cell.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] links_hash hash_links of config.
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta orientation of end effector.
+ * @param[out] angles_1 Angles of joints.
+ * @param[out] angles_2 Angles of joints, other possible configuration.
+ * @return bool: true if success, false if not.
+ */
+bool IkCache::solve(const Configuration &config, uint64_t links_hash, double x, double y,
+                    double theta, double *angles_1, double *angles_2){
+    return solve(config, links_hash, x, y, theta, angles_1, angles_2, MATH_LIBM);
+}
+
+
+// solve with a choice of math backend for misses. The backend is part of the
+// key, so callers on different backends can share one cache; MATH_LIBM keys
+// are those of the solve without a backend.
+bool IkCache::solve(const Configuration &config, uint64_t links_hash, double x, double y,
+                    double theta, double *angles_1, double *angles_2, MathBackend math){
+    if (config.num_links != 3){
+        return false;
+    }
+    if (math != MATH_LIBM){
+        links_hash = mix_hash(links_hash ^ (0x9e3779b97f4a7c15ULL*(uint64_t)math));
+    }
+    Entry key;
+    uint64_t hash;
+    if (!quantize(x, y, theta, links_hash, key, hash)){
+        misses += 1;
+        return compute_inverse_kinematics(config, x, y, theta, angles_1, angles_2, math);
+    }
+    Shard &shard = shards[hash % IK_CACHE_SHARDS];
+    size_t first = (size_t)((hash / IK_CACHE_SHARDS) % sets_per_shard)*IK_CACHE_WAYS;
+
+    {
+        lock_guard<mutex> lock(shard.guard);
+        for (int w = 0; w < IK_CACHE_WAYS; w += 1){
+            Entry &entry = shard.entries[first + w];
+            if (entry.stamp != 0 && entry.qx == key.qx && entry.qy == key.qy
+                    && entry.qtheta == key.qtheta && entry.links_hash == key.links_hash){
+                shard.clock += 1;
+                entry.stamp = shard.clock;
+                if (entry.reachable){
+                    memcpy(angles_1, entry.angles_1, sizeof(entry.angles_1));
+                    memcpy(angles_2, entry.angles_2, sizeof(entry.angles_2));
+                }
+                hits += 1;
+                return entry.reachable;
+            }
+        }
+    }
+
+    misses += 1;
+    key.reachable = compute_inverse_kinematics(config, x, y, theta, key.angles_1, key.angles_2,
+                                            math);
+    if (key.reachable){
+        memcpy(angles_1, key.angles_1, sizeof(key.angles_1));
+        memcpy(angles_2, key.angles_2, sizeof(key.angles_2));
+    }
+
+    lock_guard<mutex> lock(shard.guard);
+    int victim = 0;
+    for (int w = 0; w < IK_CACHE_WAYS; w += 1){
+        const Entry &entry = shard.entries[first + w];
+        if (entry.stamp != 0 && entry.qx == key.qx && entry.qy == key.qy
+                && entry.qtheta == key.qtheta && entry.links_hash == key.links_hash){
+            return key.reachable;   // Another thread stored it meanwhile
+        }
+        if (entry.stamp < shard.entries[first + victim].stamp){
+            victim = w;
+        }
+    }
+    Entry &entry = shard.entries[first + victim];
+    if (entry.stamp != 0){
+        evictions += 1;
+    }
+    else{
+        size += 1;
+    }
+    shard.clock += 1;
+    key.stamp = shard.clock;
+    entry = key;
+    return key.reachable;
+}
+
+
+// Drop every entry, counters are kept
+void IkCache::clear(){
+    for (int s = 0; s < IK_CACHE_SHARDS; s += 1){
+        lock_guard<mutex> lock(shards[s].guard);
+        int dropped = 0;
+        for (size_t e = 0; e < shards[s].entries.size(); e += 1){
+            dropped += shards[s].entries[e].stamp != 0;
+            shards[s].entries[e].stamp = 0;
+        }
+        size -= dropped;
+    }
+}
+
+
+IkCacheOptions IkCache::get_options() const{
+    return options;
+}
+
+
+IkCacheStats IkCache::get_stats() const{
+    IkCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.size = size;
+    stats.capacity = options.capacity;
+    return stats;
+}
+
+
+void IkCache::reset_stats(){
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
@@ -0,0 +1,322 @@
+/********
+ * ik_scheduler.cpp
+ * Author: Simon Chamorro
+ * Micro-batching scheduler for independent inverse kinematics requests
+ *
+ * Submitters append to a pending queue under one mutex and only wake the
+ * dispatcher when the queue goes from empty to one request, to start its
+ * deadline, or when it reaches max_batch. The dispatcher solves each batch
+ * outside the lock, so new requests keep queuing while a batch runs.
+********/
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#include "batch_kinematics.h"
+#include "ik_scheduler.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+
+struct IkRequest{
+
+    double x;
+    double y;
+    double theta;
+    IkCallback callback;
+    chrono::steady_clock::time_point arrival;
+};
+
+
+struct IkScheduler::Queue{
+
+    mutex guard;
+    condition_variable wake;
+    bool stopping;
+    bool flushing;          // Dispatch without waiting until the queue is empty
+    vector<IkRequest> pending;
+    thread dispatcher;
+
+    // Used by the dispatcher only
+    vector<IkRequest> batch;
+    vector<double> x;
+    vector<double> y;
+    vector<double> theta;
+    vector<double> solutions;
+    vector<unsigned char> reachable;
+
+    mutable mutex stats_guard;
+    uint64_t requests;
+    uint64_t batches;
+    uint64_t full_batches;
+    uint64_t deadline_batches;
+    vector<uint64_t> batch_sizes;
+    vector<double> latencies;   // Ring of the latest latencies in us
+    size_t latency_next;
+};
+
+
+IkSchedulerOptions default_ik_scheduler_options(){
+    IkSchedulerOptions options;
+    options.max_batch = 64;
+    options.max_delay_us = 50.0;
+    return options;
+}
+
+
+IkScheduler::IkScheduler(const Configuration &config) :
+    IkScheduler(config, default_ik_scheduler_options()){
+}
+
+
+/**
+ * Start the dispatcher thread for a 3 links configuration. The
+ * configuration is copied, later changes to it are not seen.
+ *
+ * @param[in] config Configuration to solve for.
+ * @param[in] options Batch size and deadline.
+ */
+IkScheduler::IkScheduler(const Configuration &config, const IkSchedulerOptions &options) :
+    config(config), options(options), queue(new Queue()){
+    if (this->options.max_batch < 1){
+        this->options.max_batch = 1;
+    }
+    int max_batch = this->options.max_batch;
+    queue->stopping = false;
+    queue->flushing = false;
+    queue->pending.reserve(max_batch);
+    queue->batch.reserve(max_batch);
+    queue->x.resize(max_batch);
+    queue->y.resize(max_batch);
+    queue->theta.resize(max_batch);
+    queue->solutions.resize(6*max_batch);
+    queue->reachable.resize(max_batch);
+    queue->latencies.reserve(IK_SCHEDULER_LATENCY_SAMPLES);
+    reset_stats();
+    queue->dispatcher = thread(&IkScheduler::run_dispatcher, this);
+}
+
+
+// Solves every request still pending, then stops the dispatcher
+IkScheduler::~IkScheduler(){
+    {
+        lock_guard<mutex> lock(queue->guard);
+        queue->stopping = true;
+    }
+    queue->wake.notify_one();
+    queue->dispatcher.join();
+}
+
+
+/**
+ * Queue one target. The callback runs on the dispatcher thread once the
+ * batch holding the request is solved, it should return quickly.
+ *
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta angle of end effector.
+ * @param[in] callback Receives both solutions and the reachable flag.
+ * @return bool: true if queued, false if the configuration is not 3 links.
+ */
+bool IkScheduler::submit(double x, double y, double theta, const IkCallback &callback){
+    if (config.num_links != 3){
+        return false;
+    }
+    IkRequest request;
+    request.x = x;
+    request.y = y;
+    request.theta = theta;
+    request.callback = callback;
+    request.arrival = chrono::steady_clock::now();
+
+    bool notify;
+    {
+        lock_guard<mutex> lock(queue->guard);
+        queue->pending.push_back(move(request));
+        int size = (int)queue->pending.size();
+        notify = size == 1 || size == options.max_batch;
+    }
+    if (notify){
+        queue->wake.notify_one();
+    }
+    return true;
+}
+
+
+/**
+ * Queue one target and wait for its batch.
+ *
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta angle of end effector.
+ * @param[out] angles_1 First solution, NaN if unreachable.
+ * @param[out] angles_2 Second solution, NaN if unreachable.
+ * @return bool: true if the target is reachable.
+ */
+bool IkScheduler::solve(double x, double y, double theta, double *angles_1, double *angles_2){
+    struct Waiter{
+        mutex guard;
+        condition_variable done;
+        bool ready;
+        IkResult result;
+    } waiter;
+    waiter.ready = false;
+
+    bool queued = submit(x, y, theta, [&waiter](const IkResult &result){
+        lock_guard<mutex> lock(waiter.guard);
+        waiter.result = result;
+        waiter.ready = true;
+        waiter.done.notify_one();
+    });
+    if (!queued){
+        return false;
+    }
+    unique_lock<mutex> lock(waiter.guard);
+    waiter.done.wait(lock, [&waiter]{ return waiter.ready; });
+    for (int i = 0; i < 3; i += 1){
+        angles_1[i] = waiter.result.angles_1[i];
+        angles_2[i] = waiter.result.angles_2[i];
+    }
+    return waiter.result.reachable;
+}
+
+
+// Dispatch every pending request without waiting for its deadline
+void IkScheduler::flush(){
+    {
+        lock_guard<mutex> lock(queue->guard);
+        if (queue->pending.empty()){
+            return;
+        }
+        queue->flushing = true;
+    }
+    queue->wake.notify_one();
+}
+
+
+IkSchedulerStats IkScheduler::get_stats() const{
+    IkSchedulerStats stats;
+    vector<double> latencies;
+    {
+        lock_guard<mutex> lock(queue->stats_guard);
+        stats.requests = queue->requests;
+        stats.batches = queue->batches;
+        stats.full_batches = queue->full_batches;
+        stats.deadline_batches = queue->deadline_batches;
+        stats.batch_sizes = queue->batch_sizes;
+        latencies = queue->latencies;
+    }
+    stats.mean_batch = stats.batches > 0 ? (double)stats.requests / stats.batches : 0.0;
+    stats.p50_us = stats.p90_us = stats.p99_us = stats.max_us = 0.0;
+    if (!latencies.empty()){
+        sort(latencies.begin(), latencies.end());
+        size_t last = latencies.size() - 1;
+        stats.p50_us = latencies[(size_t)(0.50*last + 0.5)];
+        stats.p90_us = latencies[(size_t)(0.90*last + 0.5)];
+        stats.p99_us = latencies[(size_t)(0.99*last + 0.5)];
+        stats.max_us = latencies[last];
+    }
+    return stats;
+}
+
+
+void IkScheduler::reset_stats(){
+    lock_guard<mutex> lock(queue->stats_guard);
+    queue->requests = 0;
+    queue->batches = 0;
+    queue->full_batches = 0;
+    queue->deadline_batches = 0;
+    queue->batch_sizes.assign(options.max_batch + 1, 0);
+    queue->latencies.clear();
+    queue->latency_next = 0;
+}
+
+
+void IkScheduler::run_dispatcher(){
+#ifdef __linux__
+    // The default 50 us timer slack would double a 50 us deadline
+    prctl(PR_SET_TIMERSLACK, 1UL);
+#endif
+    Queue &q = *queue;
+    int max_batch = options.max_batch;
+    auto delay = chrono::duration_cast<chrono::steady_clock::duration>(
+        chrono::duration<double, micro>(options.max_delay_us));
+    double *angles_1[3], *angles_2[3];
+    for (int j = 0; j < 3; j += 1){
+        angles_1[j] = &q.solutions[j*max_batch];
+        angles_2[j] = &q.solutions[(3 + j)*max_batch];
+    }
+
+    unique_lock<mutex> lock(q.guard);
+    while (true){
+        q.wake.wait(lock, [&q]{ return !q.pending.empty() || q.stopping; });
+        if (q.pending.empty()){
+            return;
+        }
+        auto deadline = q.pending.front().arrival + delay;
+        while ((int)q.pending.size() < max_batch && !q.flushing && !q.stopping
+                && q.wake.wait_until(lock, deadline) == cv_status::no_timeout){
+        }
+        int count = min((int)q.pending.size(), max_batch);
+        bool full = count == max_batch;
+        q.batch.clear();
+        if (count == (int)q.pending.size()){
+            q.batch.swap(q.pending);
+            q.flushing = false;
+        }
+        else{
+            q.batch.assign(make_move_iterator(q.pending.begin()),
+                        make_move_iterator(q.pending.begin() + count));
+            q.pending.erase(q.pending.begin(), q.pending.begin() + count);
+        }
+        lock.unlock();
+
+        for (int i = 0; i < count; i += 1){
+            q.x[i] = q.batch[i].x;
+            q.y[i] = q.batch[i].y;
+            q.theta[i] = q.batch[i].theta;
+        }
+        inverse_kinematics_batch(config, count, q.x.data(), q.y.data(), q.theta.data(),
+                                angles_1, angles_2, q.reachable.data());
+        auto solved = chrono::steady_clock::now();
+
+        {
+            lock_guard<mutex> stats_lock(q.stats_guard);
+            q.requests += count;
+            q.batches += 1;
+            q.full_batches += full;
+            q.deadline_batches += !full;
+            q.batch_sizes[count] += 1;
+            for (int i = 0; i < count; i += 1){
+                double us = chrono::duration<double, micro>(solved - q.batch[i].arrival).count();
+                if ((int)q.latencies.size() < IK_SCHEDULER_LATENCY_SAMPLES){
+                    q.latencies.push_back(us);
+                }
+                else{
+                    q.latencies[q.latency_next] = us;
+                }
+                q.latency_next = (q.latency_next + 1) % IK_SCHEDULER_LATENCY_SAMPLES;
+            }
+        }
+
+        IkResult result;
+        for (int i = 0; i < count; i += 1){
+            result.reachable = q.reachable[i] != 0;
+            for (int j = 0; j < 3; j += 1){
+                result.angles_1[j] = angles_1[j][i];
+                result.angles_2[j] = angles_2[j][i];
+            }
+            q.batch[i].callback(result);
+        }
+
+        q.batch.clear();
+        lock.lock();
+    }
+}
@@ -0,0 +1,120 @@
+/********
+ * ik_tracker.cpp
+ * Author: Simon Chamorro
+ * Warm-started inverse kinematics for trajectory tracking
+********/
+
+#include <math.h>
+#include "ik_tracker.h"
+#include "kinematics.h"
+#include "numerical_ik.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+
+// Solver options for small steps: few iterations, no large jumps
+static IkSolverOptions tracking_options(){
+    IkSolverOptions options = default_ik_solver_options();
+    options.max_iterations = 10;
+    options.max_step = 10.0;
+    return options;
+}
+
+
+// Constructor, starts from the joint angles stored in config
+IkTracker::IkTracker(const Configuration &config)
+        : previous(config.num_links), velocity(config.num_links){
+    robot_config = config;
+    options = tracking_options();
+    reset(config.angles);
+}
+
+
+IkTracker::IkTracker(const Configuration &config, const IkSolverOptions &options)
+        : previous(config.num_links), velocity(config.num_links){
+    robot_config = config;
+    this->options = options;
+    reset(config.angles);
+}
+
+
+/**
+ * Restart tracking from given joint angles.
+ * The elbow branch of a 3 links robot is taken from angles[1].
+ *
+ * @param[in] angles Array with num_links joint angles.
+ */
+void IkTracker::reset(const double *angles){
+    for (int i = 0; i < robot_config.num_links; i += 1){
+        previous[i] = angles[i];
+        velocity[i] = 0.0;
+    }
+    elbow = (robot_config.num_links > 1 && angles[1] < 0) ? -1 : 1;
+}
+
+
+// Elbow branch being tracked, 1 for angles_1 and -1 for angles_2
+int IkTracker::get_elbow() const{
+    return elbow;
+}
+
+
+/**
+ * Inverse kinematics of the next point of a trajectory.
+ * With 3 links the closed form solution on the same elbow branch as the
+ * previous step is used. Otherwise the damped least squares solver starts
+ * from the previous solution extrapolated with the last joint step, which
+ * leaves a second order error for smooth paths. Angles are unwrapped against the previous step,
+ * so they may leave [-180, 180] but the joint trajectory stays continuous.
+ *
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta orientation of end effector.
+ * @param[out] angles Angles of joints.
+ * @param[out] stats Solver statistics, may be null. Zero iterations for 3 links.
+ * @return bool: true if success, false if the target could not be reached.
+ */
+bool IkTracker::track(double x, double y, double theta, double *angles, IkSolverStats *stats){
+    int n = robot_config.num_links;
+    if (n == 3){
+        double angles_1[3];
+        double angles_2[3];
+        if (!compute_inverse_kinematics(robot_config, x, y, theta, angles_1, angles_2)
+                || angles_1[1] != angles_1[1]){
+            return false;
+        }
+        const double *solution = (elbow > 0) ? angles_1 : angles_2;
+        for (int i = 0; i < n; i += 1){
+            angles[i] = solution[i];
+        }
+        if (stats){
+            stats->iterations = 0;
+            stats->position_error = 0;
+            stats->orientation_error = 0;
+            stats->damping = 0;
+            stats->converged = true;
+        }
+    }
+    else{
+        for (int i = 0; i < n; i += 1){
+            angles[i] = previous[i] + velocity[i];
+        }
+        IkSolverStats solver_stats;
+        solve_inverse_kinematics_dls(robot_config, x, y, theta, angles, angles, 
+                                    options, &solver_stats);
+        if (stats){
+            *stats = solver_stats;
+        }
+        if (!solver_stats.converged){
+            return false;
+        }
+    }
+
+    for (int i = 0; i < n; i += 1){
+        velocity[i] = clip_angle_180(angles[i] - previous[i]);
+        angles[i] = previous[i] + velocity[i];
+        previous[i] = angles[i];
+    }
+    return true;
+}
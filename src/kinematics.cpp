@@ -0,0 +1,758 @@
+/********
+ * kinematics.cpp
+ * Author: Simon Chamorro
+ * Stateless kinematics functions over a const Robot Configuration
+********/
+
+#include <assert.h>
+#include <math.h>
+#include "batch_kinematics.h"
+#include "fast_math.h"
+#include "kinematics.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+#define PI 3.14159265359
+
+// Links per block on the long chain path, keeps angles and link vectors in L1
+const int LONG_CHAIN_BLOCK = 256;
+
+// Utils
+
+// Check if point is within center
+bool point_in_circle(double x_center, double y_center, double radius,
+                    double x, double y){
+    double r_squared = pow(radius, 2);
+    double d_squared = pow(x - x_center, 2) + pow(y - y_center, 2);
+    return (d_squared <= r_squared);
+}
+
+
+// Clamp rounding error out of the domain of acos and asin
+static double clamp_unit(double value){
+    return (value > 1.0) ? 1.0 : ((value < -1.0) ? -1.0 : value);
+}
+
+
+// Math backends. Angles are in the unit of the policy: the degree ones keep
+// the exact expressions of the original functions so MATH_LIBM results are
+// unchanged bit for bit, the radian ones never convert.
+
+struct LibmDegrees{
+    static inline void sincos(double deg, double &s, double &c){
+        s = sin(deg*PI/180.0);
+        c = cos(deg*PI/180.0);
+    }
+    static inline double arccos(double value){
+        return acos(value)*180/PI;
+    }
+    static inline double arcsin(double value){
+        return asin(value)*180/PI;
+    }
+    static inline double wrap(double deg){
+        return clip_angle_180(deg);
+    }
+    static inline double half_turn(){
+        return 180;
+    }
+    static inline double match_tolerance(){
+        return 1e-6;
+    }
+    static inline void link_vectors(int count, const double *links, const double *theta,
+                                    double *dx, double *dy){
+        link_vectors_batch(count, links, theta, dx, dy);
+    }
+};
+
+struct FastDegrees{
+    static FAST_MATH_INLINE void sincos(double deg, double &s, double &c){
+        fast_sincos_deg(deg, s, c);
+    }
+    static FAST_MATH_INLINE double arccos(double value){
+        return fast_acos_deg(value);
+    }
+    static FAST_MATH_INLINE double arcsin(double value){
+        return fast_asin_deg(value);
+    }
+    static inline double wrap(double deg){
+        return clip_angle_180(deg);
+    }
+    static inline double half_turn(){
+        return 180;
+    }
+    static inline double match_tolerance(){
+        return 1e-6;
+    }
+    static inline void link_vectors(int count, const double *links, const double *theta,
+                                    double *dx, double *dy){
+        link_vectors_batch(count, links, theta, dx, dy);
+    }
+};
+
+struct LibmRadians{
+    static inline void sincos(double rad, double &s, double &c){
+        s = sin(rad);
+        c = cos(rad);
+    }
+    static inline double arccos(double value){
+        return acos(value);
+    }
+    static inline double arcsin(double value){
+        return asin(value);
+    }
+    static FAST_MATH_INLINE double wrap(double rad){
+        return wrap_angle_pi(rad);
+    }
+    static inline double half_turn(){
+        return FAST_PI;
+    }
+    static inline double match_tolerance(){
+        return 1e-6*FAST_DEG_TO_RAD;
+    }
+    static inline void link_vectors(int count, const double *links, const double *theta,
+                                    double *dx, double *dy){
+        link_vectors_batch_rad(count, links, theta, dx, dy);
+    }
+};
+
+struct FastRadians{
+    static FAST_MATH_INLINE void sincos(double rad, double &s, double &c){
+        fast_sincos(rad, s, c);
+    }
+    static FAST_MATH_INLINE double arccos(double value){
+        return fast_acos(value);
+    }
+    static FAST_MATH_INLINE double arcsin(double value){
+        return fast_asin(value);
+    }
+    static FAST_MATH_INLINE double wrap(double rad){
+        return wrap_angle_pi(rad);
+    }
+    static inline double half_turn(){
+        return FAST_PI;
+    }
+    static inline double match_tolerance(){
+        return 1e-6*FAST_DEG_TO_RAD;
+    }
+    static inline void link_vectors(int count, const double *links, const double *theta,
+                                    double *dx, double *dy){
+        link_vectors_batch_rad(count, links, theta, dx, dy);
+    }
+};
+
+
+// Long chains
+
+// Cumulative angles of links [first, first + len), starting from theta
+static double accumulate_angles(int len, const double *angles, double theta, double *out){
+    for (int k = 0; k < len; k += 1){
+        theta += angles[k];
+        out[k] = theta;
+    }
+    return theta;
+}
+
+
+// compute_forward_kinematics for chains of LONG_CHAIN_LINKS or more
+template <typename Math>
+static Pose forward_kinematics_long(int num_links, const double *links, const double *angles){
+    double block_theta[LONG_CHAIN_BLOCK];
+    double dx[LONG_CHAIN_BLOCK];
+    double dy[LONG_CHAIN_BLOCK];
+    double theta = 0;
+    double x = 0;
+    double y = 0;
+    for (int b = 0; b < num_links; b += LONG_CHAIN_BLOCK){
+        int len = (num_links - b < LONG_CHAIN_BLOCK) ? num_links - b : LONG_CHAIN_BLOCK;
+        theta = accumulate_angles(len, angles + b, theta, block_theta);
+        Math::link_vectors(len, links + b, block_theta, dx, dy);
+        for (int k = 0; k < len; k += 1){
+            x += dx[k];
+            y += dy[k];
+        }
+    }
+    Pose pose;
+    pose.x = x;
+    pose.y = y;
+    pose.theta = Math::wrap(theta);
+    return pose;
+}
+
+
+// compute_joint_frames for chains of LONG_CHAIN_LINKS or more, the cumulative
+// angles of each block are written in place and turned into link vectors
+template <typename Math>
+static void joint_frames_long(int num_links, const double *links, const double *angles, int first,
+                            double *joint_x, double *joint_y, double *joint_theta){
+    double dx[LONG_CHAIN_BLOCK];
+    double dy[LONG_CHAIN_BLOCK];
+    double theta = joint_theta[first];
+    double x = joint_x[first];
+    double y = joint_y[first];
+    for (int b = first; b < num_links; b += LONG_CHAIN_BLOCK){
+        int len = (num_links - b < LONG_CHAIN_BLOCK) ? num_links - b : LONG_CHAIN_BLOCK;
+        theta = accumulate_angles(len, angles + b, theta, joint_theta + b + 1);
+        Math::link_vectors(len, links + b, joint_theta + b + 1, dx, dy);
+        for (int k = 0; k < len; k += 1){
+            x += dx[k];
+            y += dy[k];
+            joint_x[b + k + 1] = x;
+            joint_y[b + k + 1] = y;
+        }
+    }
+}
+
+
+// compute_inverse_dynamics for chains of LONG_CHAIN_LINKS or more
+template <typename Math>
+static void inverse_dynamics_long(int num_links, const double *links, const double *angles,
+                                double fx, double fy, double *torques){
+    double block_theta[LONG_CHAIN_BLOCK];
+    double dx[LONG_CHAIN_BLOCK];
+    double dy[LONG_CHAIN_BLOCK];
+    double theta = 0;
+    for (int b = 0; b < num_links; b += LONG_CHAIN_BLOCK){
+        int len = (num_links - b < LONG_CHAIN_BLOCK) ? num_links - b : LONG_CHAIN_BLOCK;
+        theta = accumulate_angles(len, angles + b, theta, block_theta);
+        Math::link_vectors(len, links + b, block_theta, dx, dy);
+        for (int k = 0; k < len; k += 1){
+            torques[b + k] = dx[k]*fy - dy[k]*fx;
+        }
+    }
+}
+
+
+// Kinematics
+
+// Short chains, one sine and cosine per link
+template <typename Math>
+static Pose forward_kinematics(const Configuration &config, const double *angles){
+    assert(config.is_consistent());
+    double theta = 0;
+    double x = 0;
+    double y = 0;
+    if (config.num_links >= LONG_CHAIN_LINKS){
+        return forward_kinematics_long<Math>(config.num_links, config.links, angles);
+    }
+    for (int i = 0; i < config.num_links; i += 1){
+        double s, c;
+        Math::sincos(theta + angles[i], s, c);
+        x += config.links[i]*c;
+        y += config.links[i]*s;
+        theta += angles[i];
+    }
+    Pose pose;
+    pose.x = x;
+    pose.y = y;
+    pose.theta = Math::wrap(theta);
+    return pose;
+}
+
+
+/**
+ * Forward kinematics of a Robot Configuration.
+ * Angles are assumed to be in degres.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] angles Array with num_links joint angles.
+ * @return Pose of end effector.
+ */
+Pose compute_forward_kinematics(const Configuration &config, const double *angles){
+    return compute_forward_kinematics(config, angles, MATH_LIBM);
+}
+
+
+/**
+ * Forward kinematics with a choice of math backend.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] angles Array with num_links joint angles (deg).
+ * @param[in] math MATH_LIBM or MATH_FAST.
+ * @return Pose of end effector.
+ */
+Pose compute_forward_kinematics(const Configuration &config, const double *angles,
+                                MathBackend math){
+    if (math == MATH_FAST){
+        return forward_kinematics<FastDegrees>(config, angles);
+    }
+    return forward_kinematics<LibmDegrees>(config, angles);
+}
+
+
+/**
+ * Forward kinematics with angles in radians, no unit conversion is done.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] angles Array with num_links joint angles (rad).
+ * @return Pose of end effector, theta in (-pi, pi].
+ */
+Pose compute_forward_kinematics_rad(const Configuration &config, const double *angles){
+    return compute_forward_kinematics_rad(config, angles, MATH_LIBM);
+}
+
+
+// compute_forward_kinematics_rad with a choice of math backend
+Pose compute_forward_kinematics_rad(const Configuration &config, const double *angles,
+                                    MathBackend math){
+    if (math == MATH_FAST){
+        return forward_kinematics<FastRadians>(config, angles);
+    }
+    return forward_kinematics<LibmRadians>(config, angles);
+}
+
+
+template <typename Math>
+static void joint_frames(int num_links, const double *links, const double *angles, int first,
+                        double *joint_x, double *joint_y, double *joint_theta){
+    if (first == 0){
+        joint_x[0] = 0;
+        joint_y[0] = 0;
+        joint_theta[0] = 0;
+    }
+    if (num_links >= LONG_CHAIN_LINKS){
+        joint_frames_long<Math>(num_links, links, angles, first, joint_x, joint_y, joint_theta);
+        return;
+    }
+    double theta = joint_theta[first];
+    double x = joint_x[first];
+    double y = joint_y[first];
+    for (int i = first; i < num_links; i += 1){
+        double s, c;
+        Math::sincos(theta + angles[i], s, c);
+        x += links[i]*c;
+        y += links[i]*s;
+        theta += angles[i];
+        joint_x[i + 1] = x;
+        joint_y[i + 1] = y;
+        joint_theta[i + 1] = theta;
+    }
+}
+
+
+/**
+ * Position and cumulative angle of every joint frame, from the base (frame 0)
+ * to the end effector (frame num_links). Frames up to first are assumed to
+ * be valid already and only the following ones are recomputed, which gives
+ * the same result as a full pass.
+ *
+ * @param[in] num_links Number of links.
+ * @param[in] links Array with links' lengths.
+ * @param[in] angles Array with joint angles (deg).
+ * @param[in] first Last valid frame, 0 for a full pass.
+ * @param[in,out] joint_x Array of num_links + 1 x positions.
+ * @param[in,out] joint_y Array of num_links + 1 y positions.
+ * @param[in,out] joint_theta Array of num_links + 1 cumulative angles (deg), not clipped.
+ */
+void compute_joint_frames(int num_links, const double *links, const double *angles, int first,
+                        double *joint_x, double *joint_y, double *joint_theta){
+    compute_joint_frames(num_links, links, angles, first, joint_x, joint_y, joint_theta, MATH_LIBM);
+}
+
+
+// compute_joint_frames with a choice of math backend
+void compute_joint_frames(int num_links, const double *links, const double *angles, int first,
+                        double *joint_x, double *joint_y, double *joint_theta, MathBackend math){
+    if (math == MATH_FAST){
+        joint_frames<FastDegrees>(num_links, links, angles, first, joint_x, joint_y, joint_theta);
+    }
+    else{
+        joint_frames<LibmDegrees>(num_links, links, angles, first, joint_x, joint_y, joint_theta);
+    }
+}
+
+
+// compute_joint_frames with angles in radians, joint_theta is in radians too
+void compute_joint_frames_rad(int num_links, const double *links, const double *angles, int first,
+                            double *joint_x, double *joint_y, double *joint_theta){
+    compute_joint_frames_rad(num_links, links, angles, first, joint_x, joint_y, joint_theta,
+                            MATH_LIBM);
+}
+
+
+void compute_joint_frames_rad(int num_links, const double *links, const double *angles, int first,
+                            double *joint_x, double *joint_y, double *joint_theta,
+                            MathBackend math){
+    if (math == MATH_FAST){
+        joint_frames<FastRadians>(num_links, links, angles, first, joint_x, joint_y, joint_theta);
+    }
+    else{
+        joint_frames<LibmRadians>(num_links, links, angles, first, joint_x, joint_y, joint_theta);
+    }
+}
+
+
+/**
+ * Checks if end effector is within a given circle.
+ * Array must contain at least num_links angles.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] x coordinate of circle center.
+ * @param[in] y coordinate of circle center.
+ * @param[in] r radius of circle.
+ * @param[in] angles Array with joint angles.
+ * @return is_within_circle bool.
+ */
+bool compute_intersection(const Configuration &config, double x, double y, double r,
+                        const double *angles){
+    Pose pose = compute_forward_kinematics(config, angles);
+    return point_in_circle(x, y, r, pose.x, pose.y);
+}
+
+
+template <typename Math>
+static double theta_1(const Configuration &config, double theta2, double x, double y){
+    assert(config.is_consistent());
+    double s2, c2;
+    Math::sincos(theta2, s2, c2);
+    double A = config.links[0] + config.links[1] * c2;
+    double B = config.links[1] * s2;
+
+    // Find theta1 in the unit of the backend
+    double theta_c1 = Math::arccos( clamp_unit((A*x + B*y) / (pow(A, 2) + pow(B, 2))) );
+    double theta_c2 = -theta_c1;
+    double theta_s1 = Math::arcsin( clamp_unit((A*y - B*x) / (pow(A, 2) + pow(B, 2))) );
+    double theta_s2 = Math::wrap( Math::half_turn() - theta_s1 );
+
+    double theta1;
+    if ( abs(theta_c1 - theta_s1) < Math::match_tolerance()
+            || abs(theta_c1 - theta_s2) < Math::match_tolerance() ){
+        theta1 = theta_c1;
+    }
+    else{
+        theta1 = theta_c2;
+    }
+    return theta1;
+}
+
+
+/**
+ * Solve for angle of joint 1 form angle of joint 2.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] theta2 Angle of joint 2.
+ * @return theta1 angle of joint 1.
+ */
+double compute_theta_1(const Configuration &config, double theta2, double x, double y){
+    return theta_1<LibmDegrees>(config, theta2, x, y);
+}
+
+
+/**
+ * Distances from the base that the wrist (the joint before the last link)
+ * can reach: the first num_links - 1 links cover an annulus whose outer
+ * radius is their sum and inner radius is what the longest one cannot fold
+ * back with the others.
+ *
+ * @param[in] config Robot configuration.
+ * @param[out] r_min Inner radius.
+ * @param[out] r_max Outer radius.
+ */
+void compute_wrist_annulus(const Configuration &config, double &r_min, double &r_max){
+    assert(config.is_consistent());
+    double longest = 0;
+    r_max = 0;
+    for (int i = 0; i < config.num_links - 1; i += 1){
+        r_max += config.links[i];
+        longest = (config.links[i] > longest) ? config.links[i] : longest;
+    }
+    r_min = (2*longest > r_max) ? 2*longest - r_max : 0.0;
+}
+
+
+template <typename Math>
+static bool pose_reachable(const Configuration &config, double x, double y, double theta){
+    assert(config.is_consistent());
+    if (config.num_links < 1){
+        return false;
+    }
+    int last = config.num_links - 1;
+    double s, c;
+    Math::sincos(theta, s, c);
+    double xw = x - config.links[last]*c;
+    double yw = y - config.links[last]*s;
+    double r_min, r_max;
+    compute_wrist_annulus(config, r_min, r_max);
+    double d_squared = pow(xw, 2) + pow(yw, 2);
+    return point_in_circle(0.0, 0.0, r_max, xw, yw) && d_squared >= pow(r_min, 2);
+}
+
+
+/**
+ * Exact reachability of an end effector pose, for any number of links.
+ * The pose is reachable if and only if its wrist lies in the wrist annulus.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta orientation of end effector.
+ * @return bool: true if some joint angles reach the pose, false otherwise.
+ */
+bool compute_pose_reachable(const Configuration &config, double x, double y, double theta){
+    return pose_reachable<LibmDegrees>(config, x, y, theta);
+}
+
+
+template <typename Math>
+static bool inverse_kinematics(const Configuration &config, double x, double y, double theta,
+                            double *angles_1, double *angles_2){
+    assert(config.is_consistent());
+    if (config.num_links != 3){
+        return false;
+    }
+    // Find pos of J3 and check reachability, inside the inner radius
+    // |links[0] - links[1]| acos(f/d) would have no solution
+    if (!pose_reachable<Math>(config, x, y, theta)){
+        return false;
+    }
+    double s, c;
+    Math::sincos(theta, s, c);
+    double x3 = x - config.links[2]*c;
+    double y3 = y - config.links[2]*s;
+
+    // Find configuration
+    // source: https://drive.google.com/file/d/1j-UEZHs-4KvykbWKMLxDwkFE_MvqaI3l/view
+    double d = 2*config.links[0]*config.links[1];
+    double f = pow(x3, 2) + pow(y3, 2) - pow(config.links[0], 2) - pow(config.links[1], 2);
+    double theta2_a = Math::arccos(clamp_unit(f/d));
+    double theta2_b = -theta2_a;
+
+    double theta1_a = theta_1<Math>(config, theta2_a, x3, y3);
+    double theta1_b = theta_1<Math>(config, theta2_b, x3, y3);
+
+    angles_1[0] = theta1_a;
+    angles_1[1] = theta2_a;
+    angles_1[2] = Math::wrap( theta - theta1_a - theta2_a );
+    angles_2[0] = theta1_b;
+    angles_2[1] = theta2_b;
+    angles_2[2] = Math::wrap( theta - theta1_b - theta2_b);
+    return true;
+}
+
+
+/**
+ * Inverse kinematics of a 3 links Robot Configuration.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta orientation of end effector.
+ * @param[out] angles_1 Angles of joints.
+ * @param[out] angles_2 Angles of joints, other possible configuration.
+ * @return bool: true if success, false if not.
+ */
+bool compute_inverse_kinematics(const Configuration &config, double x, double y, double theta,
+                                double *angles_1, double *angles_2){
+    return inverse_kinematics<LibmDegrees>(config, x, y, theta, angles_1, angles_2);
+}
+
+
+// compute_inverse_kinematics with a choice of math backend
+bool compute_inverse_kinematics(const Configuration &config, double x, double y, double theta,
+                                double *angles_1, double *angles_2, MathBackend math){
+    if (math == MATH_FAST){
+        return inverse_kinematics<FastDegrees>(config, x, y, theta, angles_1, angles_2);
+    }
+    return inverse_kinematics<LibmDegrees>(config, x, y, theta, angles_1, angles_2);
+}
+
+
+/**
+ * Inverse kinematics of a 3 links Robot Configuration in radians. Solutions
+ * are those of compute_inverse_kinematics, wrapped to (-pi, pi].
+ *
+ * @param[in] theta orientation of end effector (rad).
+ * @param[out] angles_1 Angles of joints (rad).
+ * @param[out] angles_2 Angles of joints (rad), other possible configuration.
+ * @return bool: true if success, false if not.
+ */
+bool compute_inverse_kinematics_rad(const Configuration &config, double x, double y,
+                                    double theta, double *angles_1, double *angles_2){
+    return compute_inverse_kinematics_rad(config, x, y, theta, angles_1, angles_2, MATH_LIBM);
+}
+
+
+bool compute_inverse_kinematics_rad(const Configuration &config, double x, double y,
+                                    double theta, double *angles_1, double *angles_2,
+                                    MathBackend math){
+    if (math == MATH_FAST){
+        return inverse_kinematics<FastRadians>(config, x, y, theta, angles_1, angles_2);
+    }
+    return inverse_kinematics<LibmRadians>(config, x, y, theta, angles_1, angles_2);
+}
+
+
+template <typename Math>
+static bool jacobian_matrix(const Configuration &config, const double *angles, double *jacobian){
+    assert(config.is_consistent());
+    int n = config.num_links;
+    if (n < 1){
+        return false;
+    }
+    double *jac_x = jacobian;
+    double *jac_y = jacobian + n;
+    double *jac_t = jacobian + 2*n;
+
+    // Link vectors forward, then suffix sums backward
+    if (n >= LONG_CHAIN_LINKS){
+        // The angle row holds cumulative angles until link vectors are known
+        accumulate_angles(n, angles, 0.0, jac_t);
+        Math::link_vectors(n, config.links, jac_t, jac_y, jac_x);
+        for (int i = 0; i < n; i += 1){
+            jac_x[i] = -jac_x[i];
+            jac_t[i] = 1.0;
+        }
+    }
+    else{
+        double theta = 0;
+        for (int i = 0; i < n; i += 1){
+            theta += angles[i];
+            double s, c;
+            Math::sincos(theta, s, c);
+            jac_x[i] = -config.links[i]*s;
+            jac_y[i] = config.links[i]*c;
+            jac_t[i] = 1.0;
+        }
+    }
+    for (int i = n - 2; i >= 0; i -= 1){
+        jac_x[i] += jac_x[i + 1];
+        jac_y[i] += jac_y[i + 1];
+    }
+    return true;
+}
+
+
+/**
+ * Jacobian of the end effector pose, for any number of links.
+ * Column i is the pose velocity for a unit velocity (rad/s) of joint i:
+ * (-(ye - yi), xe - xi, 1), where (xi, yi) is the position of joint i.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] angles Array with joint angles (deg).
+ * @param[out] jacobian Row major 3 x num_links matrix.
+ * @return bool: true if success, false otherwise.
+ */
+bool compute_jacobian(const Configuration &config, const double *angles, double *jacobian){
+    return jacobian_matrix<LibmDegrees>(config, angles, jacobian);
+}
+
+
+// compute_jacobian with a choice of math backend
+bool compute_jacobian(const Configuration &config, const double *angles, double *jacobian,
+                    MathBackend math){
+    if (math == MATH_FAST){
+        return jacobian_matrix<FastDegrees>(config, angles, jacobian);
+    }
+    return jacobian_matrix<LibmDegrees>(config, angles, jacobian);
+}
+
+
+// compute_jacobian with angles in radians, the matrix is the same
+bool compute_jacobian_rad(const Configuration &config, const double *angles, double *jacobian){
+    return compute_jacobian_rad(config, angles, jacobian, MATH_LIBM);
+}
+
+
+bool compute_jacobian_rad(const Configuration &config, const double *angles, double *jacobian,
+                        MathBackend math){
+    if (math == MATH_FAST){
+        return jacobian_matrix<FastRadians>(config, angles, jacobian);
+    }
+    return jacobian_matrix<LibmRadians>(config, angles, jacobian);
+}
+
+
+template <typename Math>
+static bool inverse_dynamics(const Configuration &config, const double *angles,
+                            double fx, double fy, double tau, double *torques){
+    assert(config.is_consistent());
+    int n = config.num_links;
+    if (n < 1){
+        return false;
+    }
+    if (n >= LONG_CHAIN_LINKS){
+        inverse_dynamics_long<Math>(n, config.links, angles, fx, fy, torques);
+    }
+    else{
+        double theta = 0;
+        for (int i = 0; i < n; i += 1){
+            theta += angles[i];
+            double s, c;
+            Math::sincos(theta, s, c);
+            torques[i] = config.links[i]*(c*fy - s*fx);
+        }
+    }
+    torques[n - 1] += tau;
+    for (int i = n - 2; i >= 0; i -= 1){
+        torques[i] += torques[i + 1];
+    }
+    return true;
+}
+
+
+/**
+ * Inverse dynamics for any number of links, torques = J^T * forces.
+ * The Jacobian is never built: each link adds its lever arm contribution
+ * in a forward pass, then one backward pass sums them from the end effector.
+ *
+ * @param[in] config Robot configuration.
+ * @param[in] angles Array with current joint angles.
+ * @param[in] fx desired force at end effector.
+ * @param[in] fy desired force at end effector.
+ * @param[in] tau desired torque at end effector.
+ * @param[out] torques at robot joints.
+ * @return bool: true if success, false otherwise.
+ */
+bool compute_inverse_dynamics(const Configuration &config, const double *angles,
+                            double fx, double fy, double tau, double *torques){
+    return inverse_dynamics<LibmDegrees>(config, angles, fx, fy, tau, torques);
+}
+
+
+// compute_inverse_dynamics with a choice of math backend
+bool compute_inverse_dynamics(const Configuration &config, const double *angles,
+                            double fx, double fy, double tau, double *torques, MathBackend math){
+    if (math == MATH_FAST){
+        return inverse_dynamics<FastDegrees>(config, angles, fx, fy, tau, torques);
+    }
+    return inverse_dynamics<LibmDegrees>(config, angles, fx, fy, tau, torques);
+}
+
+
+// compute_inverse_dynamics with angles in radians
+bool compute_inverse_dynamics_rad(const Configuration &config, const double *angles,
+                                double fx, double fy, double tau, double *torques){
+    return compute_inverse_dynamics_rad(config, angles, fx, fy, tau, torques, MATH_LIBM);
+}
+
+
+bool compute_inverse_dynamics_rad(const Configuration &config, const double *angles,
+                                double fx, double fy, double tau, double *torques,
+                                MathBackend math){
+    if (math == MATH_FAST){
+        return inverse_dynamics<FastRadians>(config, angles, fx, fy, tau, torques);
+    }
+    return inverse_dynamics<LibmRadians>(config, angles, fx, fy, tau, torques);
+}
+
+
+/**
+ * Inverse dynamics from joint positions, for any number of links.
+ * Torque of joint i is (xe - xi) * fy - (ye - yi) * fx + tau.
+ *
+ * @param[in] num_links Number of links.
+ * @param[in] joint_x Array of num_links + 1 joint x positions, end effector last.
+ * @param[in] joint_y Array of num_links + 1 joint y positions, end effector last.
+ * @param[in] fx desired force at end effector.
+ * @param[in] fy desired force at end effector.
+ * @param[in] tau desired torque at end effector.
+ * @param[out] torques at robot joints.
+ */
+void compute_inverse_dynamics_from_joints(int num_links, const double *joint_x, const double *joint_y,
+                                        double fx, double fy, double tau, double *torques){
+    double xe = joint_x[num_links];
+    double ye = joint_y[num_links];
+    for (int i = num_links - 1; i >= 0; i -= 1){
+        torques[i] = (xe - joint_x[i])*fy - (ye - joint_y[i])*fx + tau;
+    }
+}
@@ -4,16 +4,28 @@
  * Main file to test Robot Manipulator class interactively
 ********/
 
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <iostream>
 #include <string>
 #include <sstream>
 #include <vector>
+#include "batch_mode.h"
 #include "manipulator.h"
 #include "robot_configuration.h"
+#include "socket_server.h"
 
 
 using namespace std;
 
+static SocketServer server;
+
+static void stop_server(int){
+    server.stop();
+}
+
 
 void print_available_commands(){
     cout << "Available Commands:\n";
@@ -45,8 +57,70 @@ void print_robot_config(Configuration config){
     cout << "--------------------------------\n";
 }
 
-int main()
+void print_usage(){
+    cout << "Usage: run-robot-manipulator [--batch [FILE]] [--flush-every N] [--precision N]\n";
+    cout << "       run-robot-manipulator --serve SOCKET_PATH\n";
+    cout << "--precision is the number of decimals, 0 to " << BATCH_MAX_PRECISION << "\n";
+}
+
+int main(int argc, char **argv)
 {
+    // Batch mode: commands from a file or stdin, no banner
+    bool batch = false;
+    const char *batch_file = NULL;
+    BatchOptions batch_options = default_batch_options();
+    const char *serve_path = NULL;
+    for (int i = 1; i < argc; i += 1){
+        if (strcmp(argv[i], "--batch") == 0){
+            batch = true;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0){
+                batch_file = argv[++i];
+            }
+        }
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc){
+            serve_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--flush-every") == 0 && i + 1 < argc){
+            batch_options.flush_every = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc){
+            char *end;
+            long precision = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || end == argv[i] || precision < 0 || precision > BATCH_MAX_PRECISION){
+                print_usage();
+                return 1;
+            }
+            batch_options.precision = (int)precision;
+        }
+        else{
+            print_usage();
+            return 1;
+        }
+    }
+    if (serve_path){
+        if (!server.listen(serve_path)){
+            perror(serve_path);
+            return 1;
+        }
+        signal(SIGINT, stop_server);
+        signal(SIGTERM, stop_server);
+        bool ok = server.run();
+        server.close();
+        return ok ? 0 : 1;
+    }
+    if (batch){
+        FILE *in = batch_file ? fopen(batch_file, "r") : stdin;
+        if (!in){
+            perror(batch_file);
+            return 1;
+        }
+        int errors = run_batch(in, stdout, batch_options);
+        if (batch_file){
+            fclose(in);
+        }
+        return errors == 0 ? 0 : 2;
+    }
+
     //Init Manipulator
     bool exit_flag = false;
     Manipulator manipulator;
@@ -62,7 +136,9 @@ int main()
 
         // Get user input
         string input;
-        getline(std::cin, input);
+        if (!getline(std::cin, input)){
+            break;
+        }
         string buffer;
         istringstream ss(input);
         vector<string> commands;
@@ -86,13 +162,13 @@ int main()
         // Change robot parameters
         else if (commands[0] == "links"){
 
-            if (commands.size() < MAX_LINKS && commands.size() > 1){
+            if (commands.size() > 1){
                 int n_links = commands.size() - 1;
-                double links[n_links];
+                vector<double> links(n_links);
                 for (int i = 1; i < commands.size(); i += 1){
                     links[i - 1] = atof(commands[i].c_str());
                 }
-                manipulator.set_parameters(n_links, links);
+                manipulator.set_parameters(n_links, links.data());
                 print_robot_config(manipulator.get_config());
             }
 
@@ -106,11 +182,11 @@ int main()
             Configuration config = manipulator.get_config();
             int n_links = config.num_links;
             if (commands.size() == n_links + 1){
-                double angles[n_links];
+                vector<double> angles(n_links);
                 for (int i = 0; i < commands.size() - 1; i += 1){
                     angles[i] = atof(commands[i + 1].c_str());
                 }
-                manipulator.forward_kinematics(angles);
+                manipulator.forward_kinematics(angles.data());
                 config = manipulator.get_config();
                 cout << "End effector position x: " << config.x << ", y: " 
                         << config.y << ", theta: " << config.theta << endl; 
@@ -126,14 +202,14 @@ int main()
             Configuration config = manipulator.get_config();
             int n_links = config.num_links;
             if (commands.size() == n_links + 4){
-                double angles[MAX_LINKS];
+                vector<double> angles(n_links);
                 double x = atof(commands[1].c_str());
                 double y = atof(commands[2].c_str());
                 double r = atof(commands[3].c_str());
                 for (int i = 4; i < commands.size(); i += 1){
                     angles[i - 4] = atof(commands[i].c_str());
                 }
-                bool is_in_circle = manipulator.intersection(x, y, r, angles);
+                bool is_in_circle = manipulator.intersection(x, y, r, angles.data());
                 config = manipulator.get_config();            
                 cout << "Circle x: " << x << ", y: " << y 
                     << ", r: " << r << endl;
@@ -149,12 +225,13 @@ int main()
 
         // Inverse kinematics
         else if (commands[0] == "inverse_k"){
-            if (commands.size() == 4 && manipulator.get_config().num_links == 3){
+            int n_links = manipulator.get_config().num_links;
+            if (commands.size() == 4 && n_links == 3){
                 double x = atof(commands[1].c_str());
                 double y = atof(commands[2].c_str());
                 double theta = atof(commands[3].c_str());
-                double angles_1[MAX_LINKS];
-                double angles_2[MAX_LINKS];
+                double angles_1[3];
+                double angles_2[3];
                 if (manipulator.inverse_kinematics(x, y, theta, angles_1, angles_2)){
                     cout << "Configuration 1: " << angles_1[0] << ", " << angles_1[1] 
                         << ", " << angles_1[2] << endl;
@@ -166,29 +243,52 @@ int main()
                 }
                 
             }
+            else if (commands.size() == 4){
+                double x = atof(commands[1].c_str());
+                double y = atof(commands[2].c_str());
+                double theta = atof(commands[3].c_str());
+                vector<double> angles(n_links);
+                IkSolverStats stats;
+                if (manipulator.inverse_kinematics_numerical(x, y, theta, angles.data(), 
+                                                default_ik_solver_options(), &stats)){
+                    cout << "Configuration: ";
+                    for (int i = 0; i < n_links; i += 1){
+                        cout << angles[i] << (i + 1 < n_links ? ", " : "\n");
+                    }
+                    cout << "Iterations: " << stats.iterations << endl;
+                }
+                else{
+                    cout << "Position unreachable or solver did not converge.\n";
+                }
+            }
             else{
-                cout << "Invalid arguments or number of links.\n";
+                cout << "Invalid arguments.\n";
             }        
         }
 
         // Inverse dynamics
         else if (commands[0] == "inverse_d"){
             Configuration config = manipulator.get_config();
-            if (commands.size() == 4 && config.num_links == 3){
+            int n_links = config.num_links;
+            if (commands.size() == 4){
                 double fx = atof(commands[1].c_str());
                 double fy = atof(commands[2].c_str());
                 double tau = atof(commands[3].c_str());
-                double torques[MAX_LINKS];
-                if (manipulator.inverse_dynamics(fx, fy, tau, torques)){
-                    cout << "Current Configuration: " << config.angles[0] << ", " << config.angles[1] 
-                        << ", " << config.angles[2] << endl;
-                    cout << "Torques: " << torques[0] << ", " << torques[1] 
-                        << ", " << torques[2] << endl;
+                vector<double> torques(n_links);
+                if (manipulator.inverse_dynamics(fx, fy, tau, torques.data())){
+                    cout << "Current Configuration: ";
+                    for (int i = 0; i < n_links; i += 1){
+                        cout << config.angles[i] << (i + 1 < n_links ? ", " : "\n");
+                    }
+                    cout << "Torques: ";
+                    for (int i = 0; i < n_links; i += 1){
+                        cout << torques[i] << (i + 1 < n_links ? ", " : "\n");
+                    }
                 }
                 
             }
             else{
-                cout << "Invalid arguments or number of links.\n";
+                cout << "Invalid arguments.\n";
             }          
         }
 
@@ -5,41 +5,21 @@
 ********/
 
 #include <iostream>
-#include <math.h>
 #include "manipulator.h"
+#include "kinematics.h"
+#include "parallel_chain.h"
 #include "robot_configuration.h"
+#include "self_collision.h"
 
 using namespace std;
 
-#define PI 3.14159265359
-
-// Utils
-
-// Keep angle between -180 and 180 degres
-double clip_angle_180(double angle){
-    while (angle > 180){
-        angle -= 360;
-    }
-    while (angle <= -180){
-        angle += 360;
-    }
-    return angle;
-}
-
-
-// Check if point is within center
-bool point_in_circle(double x_center, double y_center, double radius, 
-                    double x, double y){
-    double r_squared = pow(radius, 2);
-    double d_squared = pow(x - x_center, 2) + pow(y - y_center, 2);
-    return (d_squared <= r_squared);
-}
-
-
 // Robot Manipulator class functions
 
 // Constructor
-Manipulator::Manipulator(){
+Manipulator::Manipulator() : reachability_options(default_reachability_map_options()),
+                             reachability_enabled(false),
+                             parallel_options(default_parallel_chain_options()),
+                             math(MATH_LIBM), links_hash(0){
     reset();
 }
 
@@ -60,27 +40,77 @@ bool Manipulator::reset(){
 }
 
 
-Configuration Manipulator::get_config(){
+Configuration Manipulator::get_config() const{
+    return robot_config;
+}
+
+
+// Read-only access to the configuration, without copying it
+const Configuration &Manipulator::get_config_ref() const{
     return robot_config;
 }
 
 
 /**
- * Set Robot Manipulator parameters.
+ * Set Robot Manipulator parameters, joints go back to 0.
+ * Any number of links is accepted, storage grows as needed.
  *
  * @param[in] num_links Number of links.
  * @param[in] links Array with links' lengths.
+ * @return bool: false if num_links is not positive or storage could not grow.
  */
-bool Manipulator::set_parameters(int num_links, double links[MAX_LINKS]){
-    robot_config.num_links = num_links;
+bool Manipulator::set_parameters(int num_links, const double *links){
+    if (num_links < 1 || !robot_config.resize(num_links)
+            || !joint_x.resize(num_links + 1) || !joint_y.resize(num_links + 1)
+            || !joint_theta.resize(num_links + 1)){
+        return false;
+    }
     for (int i = 0; i < num_links; i+=1 ){
         robot_config.links[i] = links[i];
         robot_config.angles[i] = 0.0;
     }
+    update_frames(0);
+    update_pose();
+    links_hash = hash_links(robot_config);
+    if (ik_cache){
+        ik_cache->clear();
+    }
+    if (reachability_enabled && !reachability.matches(robot_config)){
+        reachability.build(robot_config, reachability_options);
+    }
     return true;
 }
 
 
+/**
+ * Threads used to compute joint frames of very long chains. Chains too
+ * short for more than one thread keep the serial path.
+ *
+ * @param[in] options Thread limit and crossover.
+ */
+void Manipulator::set_parallel_chain_options(const ParallelChainOptions &options){
+    parallel_options = options;
+}
+
+
+/**
+ * Math used by forward_kinematics, update_joint and inverse_kinematics.
+ * MATH_FAST trades libm accuracy for polynomials within the bounds of
+ * fast_math.h. Joint frames are recomputed. IK cache entries are keyed by
+ * backend, so copies sharing the cache keep their own answers.
+ *
+ * @param[in] math MATH_LIBM (default) or MATH_FAST.
+ */
+void Manipulator::set_math_backend(MathBackend math){
+    if (math == this->math){
+        return;
+    }
+    this->math = math;
+    update_frames(0);
+    update_pose();
+}
+
+
 /**
  * Move each joint of the Robot Manipulator to a specific angle.
  * Angles are assumed to be in degres.
@@ -89,24 +119,75 @@ bool Manipulator::set_parameters(int num_links, double links[MAX_LINKS]){
  * @param[in] angles Array with desired joint angles. 
  * @return true once done. 
  */
-bool Manipulator::forward_kinematics(double angles[MAX_LINKS]){
-    double theta = 0;
-    double x = 0;
-    double y = 0;
+bool Manipulator::forward_kinematics(const double *angles){
     for (int i = 0; i < robot_config.num_links; i += 1){
-        x += robot_config.links[i]*cos((theta + angles[i])*PI/180.0);
-        y += robot_config.links[i]*sin((theta + angles[i])*PI/180.0);
-        theta += angles[i];
         robot_config.angles[i] = angles[i];
     }
-    robot_config.x = x;
-    robot_config.y = y;
-    robot_config.theta = clip_angle_180(theta);
+    update_frames(0);
+    update_pose();
+    return true;
+}
+
+
+/**
+ * Move a single joint. Frames before the joint are reused from the cache,
+ * only the links after it are recomputed.
+ *
+ * @param[in] joint Index of the joint to move.
+ * @param[in] angle New joint angle (deg).
+ * @return number of links recomputed, -1 if joint is out of range.
+ */
+int Manipulator::update_joint(int joint, double angle){
+    if (joint < 0 || joint >= robot_config.num_links){
+        return -1;
+    }
+    robot_config.angles[joint] = angle;
+    update_frames(joint);
+    update_pose();
+    return robot_config.num_links - joint;
+}
 
+
+/**
+ * Positions of all joints from the cache, base first and end effector last.
+ *
+ * @param[out] x Array of num_links + 1 x positions.
+ * @param[out] y Array of num_links + 1 y positions.
+ * @return true once done.
+ */
+bool Manipulator::get_joint_positions(double *x, double *y) const{
+    for (int i = 0; i <= robot_config.num_links; i += 1){
+        x[i] = joint_x[i];
+        y[i] = joint_y[i];
+    }
     return true;
 }
 
 
+// Recompute joint frames after frame first. Long chains already use the
+// vectorized polynomials, whatever the backend.
+void Manipulator::update_frames(int first){
+    int n = robot_config.num_links;
+    if (math == MATH_FAST && n < LONG_CHAIN_LINKS){
+        compute_joint_frames(n, robot_config.links, robot_config.angles, first,
+                            joint_x, joint_y, joint_theta, MATH_FAST);
+    }
+    else{
+        compute_joint_frames_parallel(n, robot_config.links, robot_config.angles, first,
+                                    joint_x, joint_y, joint_theta, parallel_options);
+    }
+}
+
+
+// Copy end effector frame from the cache into the configuration
+void Manipulator::update_pose(){
+    int n = robot_config.num_links;
+    robot_config.x = joint_x[n];
+    robot_config.y = joint_y[n];
+    robot_config.theta = clip_angle_180(joint_theta[n]);
+}
+
+
 /**
  * Checks if end effector is within a given circle.
  * Array must contain at least num_links angles.
@@ -117,36 +198,58 @@ bool Manipulator::forward_kinematics(double angles[MAX_LINKS]){
  * @param[in] angles Array with desired joint angles. 
  * @return is_within_circle bool.
  */
-bool Manipulator::intersection(double x, double y, double r, double angles[MAX_LINKS]){
+bool Manipulator::intersection(double x, double y, double r, const double *angles){
     forward_kinematics(angles);
     return point_in_circle(x, y, r, robot_config.x, robot_config.y);
 }
 
 
+/**
+ * Checks if end effector is within any circle of an obstacle set.
+ *
+ * @param[in] obstacles Set of circles, built for sub-linear queries.
+ * @param[in] angles Array with desired joint angles.
+ * @return bool: true if at least one circle contains the end effector.
+ */
+bool Manipulator::intersection(const ObstacleSet &obstacles, const double *angles){
+    forward_kinematics(angles);
+    return obstacles.contains_any(robot_config.x, robot_config.y);
+}
+
+
+/**
+ * Checks every link of the current configuration against an obstacle set,
+ * using the cached joint positions.
+ *
+ * @param[in] obstacles Set of circles.
+ * @return index of the first link touching a circle, -1 if none does.
+ */
+int Manipulator::arm_collision(const ObstacleSet &obstacles) const{
+    return obstacles.first_collision(robot_config.num_links, joint_x, joint_y);
+}
+
+
+/**
+ * Checks if two non adjacent links of the current configuration cross,
+ * using the cached joint positions.
+ *
+ * @param[out] link_a Lower index of a colliding pair, may be null.
+ * @param[out] link_b Higher index of a colliding pair, may be null.
+ * @return bool: true if the arm collides with itself.
+ */
+bool Manipulator::self_collision(int *link_a, int *link_b) const{
+    return compute_self_collision(robot_config.num_links, joint_x, joint_y, link_a, link_b);
+}
+
+
 /**
  * Solve for angle of joint 1 form angle of joint 2.
  *
  * @param[in] theta2 Angle of joint 2.
  * @return theta1 angle of joint 1.
  */
-double Manipulator::solve_theta_1(double theta2, double x, double y){
-    double A = robot_config.links[0] + robot_config.links[1] * cos(theta2*PI/180);
-    double B = robot_config.links[1] * sin(theta2*PI/180);
-
-    // Find theta1 in radians
-    double theta_c1 = acos( (A*x + B*y) / (pow(A, 2) + pow(B, 2)) ) *180/PI;
-    double theta_c2 = -theta_c1;
-    double theta_s1 = asin( (A*y - B*x) / (pow(A, 2) + pow(B, 2)) ) *180/PI; 
-    double theta_s2 = clip_angle_180( 180 - theta_s1 );
-
-    double theta1;
-    if ( abs(theta_c1 - theta_s1) < 1e-6 || abs(theta_c1 - theta_s2) < 1e-6 ){
-        theta1 = theta_c1;
-    }
-    else{
-        theta1 = theta_c2;
-    }  
-    return theta1;
+double Manipulator::solve_theta_1(double theta2, double x, double y) const{
+    return compute_theta_1(robot_config, theta2, x, y);
 }
 
 
@@ -161,40 +264,40 @@ double Manipulator::solve_theta_1(double theta2, double x, double y){
  * @return bool: true if success, false if not.
  */
 bool Manipulator::inverse_kinematics(double x, double y, double theta, 
-                                    double *angles_1, double *angles_2){
-    if (robot_config.num_links != 3){
+                                    double *angles_1, double *angles_2) const{
+    if (reachability.is_built() && reachability.lookup(x, y, theta) == CELL_UNREACHABLE){
         return false;
     }
-    // Find pos of J3 and check reachability
-    double x3 = x - robot_config.links[2]*cos(theta*PI/180.0);
-    double y3 = y - robot_config.links[2]*sin(theta*PI/180.0);
-    double radius = robot_config.links[0] + robot_config.links[1];
-    if (!point_in_circle(0.0, 0.0, radius, x3, y3)){
-        return false;
+    if (ik_cache){
+        return ik_cache->solve(robot_config, links_hash, x, y, theta, angles_1, angles_2, math);
     }
+    return compute_inverse_kinematics(robot_config, x, y, theta, angles_1, angles_2, math);
+}
 
-    // Find configuration
-    // source: https://drive.google.com/file/d/1j-UEZHs-4KvykbWKMLxDwkFE_MvqaI3l/view
-    double d = 2*robot_config.links[0]*robot_config.links[1];
-    double f = pow(x3, 2) + pow(y3, 2) - pow(robot_config.links[0], 2) - pow(robot_config.links[1], 2);
-    double theta2_a = acos(f/d) * 180/PI;
-    double theta2_b = -theta2_a;
-
-    double theta1_a = solve_theta_1(theta2_a, x3, y3);
-    double theta1_b = solve_theta_1(theta2_b, x3, y3);
 
-    angles_1[0] = theta1_a;
-    angles_1[1] = theta2_a;
-    angles_1[2] = clip_angle_180( theta - theta1_a - theta2_a );
-    angles_2[0] = theta1_b;
-    angles_2[1] = theta2_b;
-    angles_2[2] = clip_angle_180( theta - theta1_b - theta2_b);
-    return true;
+/**
+ * Numerical inverse kinematics of Robot Manipulator, for any number of links.
+ * Starts from the current joint angles.
+ *
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta orientation of end effector.
+ * @param[out] angles Angles of joints.
+ * @param[in] options Solver tolerances and limits.
+ * @param[out] stats Convergence statistics, may be null.
+ * @return bool: true if converged, false if not.
+ */
+bool Manipulator::inverse_kinematics_numerical(double x, double y, double theta, double *angles,
+                                            const IkSolverOptions &options, 
+                                            IkSolverStats *stats) const{
+    return solve_inverse_kinematics_dls(robot_config, x, y, theta, robot_config.angles,
+                                        angles, options, stats);
 }
 
 
 /**
- * Inverse dynamics of Robot Manipulator.
+ * Inverse dynamics of Robot Manipulator, for any number of links.
+ * Uses the cached joint positions, so no trigonometry is needed.
  *
  * @param[in] fx desired force at end effector.
  * @param[in] fy desired force at end effector.
@@ -202,41 +305,99 @@ bool Manipulator::inverse_kinematics(double x, double y, double theta,
  * @param[out] torques at robot joints.
  * @return bool: true if success, false otherwise.
  */
-bool Manipulator::inverse_dynamics(double fx, double fy, double tau, double *torques){
-    if (robot_config.num_links != 3){
+bool Manipulator::inverse_dynamics(double fx, double fy, double tau, double *torques) const{
+    if (robot_config.num_links < 1){
         return false;
     }
+    compute_inverse_dynamics_from_joints(robot_config.num_links, joint_x, joint_y, 
+                                        fx, fy, tau, torques);
+    return true;
+}
+
+
+/**
+ * Keep a reachability map of the current links, rebuilt on set_parameters,
+ * so inverse_kinematics rejects most unreachable targets with one lookup.
+ *
+ * @param[in] options Grid resolution and number of threads used to build.
+ * @return bool: true if the map was built, false for invalid options.
+ */
+bool Manipulator::enable_reachability_map(const ReachabilityMapOptions &options){
+    reachability_options = options;
+    reachability_enabled = reachability.build(robot_config, options);
+    return reachability_enabled;
+}
+
+
+void Manipulator::disable_reachability_map(){
+    reachability_enabled = false;
+    reachability.clear();
+}
+
 
-    // source: http://robotics.sjtu.edu.cn/upload/course/5/files/Jacobian.pdf
-    double l1 = robot_config.links[0];
-    double l2 = robot_config.links[1];
-    double l3 = robot_config.links[2];
-    double a1 = robot_config.angles[0]*PI/180;
-    double a2 = robot_config.angles[1]*PI/180;
-    double a3 = robot_config.angles[2]*PI/180;
-
-    double jacobian[3][3] = {{-l1*sin(a1) -l2*sin(a1 + a2) -l3*sin(a1 + a2 + a3), -l2*sin(a1 + a2) -l3*sin(a1 + a2 + a3), -l3*sin(a1 + a2 + a3)}, 
-                             {l1*cos(a1) + l2*cos(a1 + a2) + l3*cos(a1 + a2 + a3), l2*cos(a1 + a2) + l3*cos(a1 + a2 + a3), l3*cos(a1 + a2 + a3)}, 
-                             {1, 1, 1}};
-
-    double jacobian_t[3][3];
-    for(int i = 0; i < 3; i += 1)
-      for(int j = 0; j < 3; j += 1) {
-         jacobian_t[j][i] = jacobian[i][j];
-      }
-
-    int i, j, k;
-    double mult[3][1];
-    double forces[3][1] = {{fx}, {fy}, {tau}};
-    for(i = 0; i < 3; ++i)
-        for(j = 0; j < 1; ++j)
-            for(k = 0; k < 3; ++k)
-            {
-                mult[i][j] += jacobian_t[i][k] * forces[k][j];
-            }
-
-    torques[0] = mult[0][0];
-    torques[1] = mult[1][0];
-    torques[2] = mult[2][0];
+/**
+ * Use a reachability map saved by save_reachability_map instead of building
+ * it. The map must have been built for the current links.
+ *
+ * @param[in] path File to read.
+ * @return bool: true if loaded, false if unreadable or for other links.
+ */
+bool Manipulator::load_reachability_map(const char *path){
+    ReachabilityMap loaded;
+    if (!loaded.load(path) || !loaded.matches(robot_config)){
+        return false;
+    }
+    reachability = loaded;
+    reachability_options = loaded.get_options();
+    reachability_enabled = true;
     return true;
 }
+
+
+bool Manipulator::save_reachability_map(const char *path) const{
+    return reachability.save(path);
+}
+
+
+/**
+ * Exact reachability of an end effector pose, using the map when enabled.
+ *
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta orientation of end effector.
+ * @return bool: true if some joint angles reach the pose, false otherwise.
+ */
+bool Manipulator::is_reachable(double x, double y, double theta) const{
+    if (reachability.is_built()){
+        return reachability.is_reachable(x, y, theta);
+    }
+    return compute_pose_reachable(robot_config, x, y, theta);
+}
+
+
+/**
+ * Answer inverse_kinematics from a cache of solutions, replacing any
+ * cache already enabled. set_parameters and reset clear it.
+ *
+ * @param[in] options Capacity and quantization tolerances.
+ */
+void Manipulator::enable_ik_cache(const IkCacheOptions &options){
+    ik_cache = make_shared<IkCache>(options);
+}
+
+
+void Manipulator::disable_ik_cache(){
+    ik_cache.reset();
+}
+
+
+// Counters of the cache, all zero while it is disabled
+IkCacheStats Manipulator::get_ik_cache_stats() const{
+    if (ik_cache){
+        return ik_cache->get_stats();
+    }
+    IkCacheStats stats;
+    stats.hits = stats.misses = stats.evictions = 0;
+    stats.size = stats.capacity = 0;
+    return stats;
+}
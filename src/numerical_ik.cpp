@@ -0,0 +1,174 @@
+/********
+ * numerical_ik.cpp
+ * Author: Simon Chamorro
+ * Damped least squares inverse kinematics for any number of links
+********/
+
+#include <math.h>
+#include "kinematics.h"
+#include "numerical_ik.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+#define PI 3.14159265359
+
+
+IkSolverOptions default_ik_solver_options(){
+    IkSolverOptions options;
+    options.max_iterations = 100;
+    options.position_tolerance = 1e-6;
+    options.orientation_tolerance = 1e-4;
+    options.orientation_weight = 1.0;
+    options.damping = 1e-2;
+    options.min_damping = 1e-4;
+    options.max_step = 30.0;
+    return options;
+}
+
+
+// Solve the symmetric positive definite 3x3 system a * out = b
+void solve_3x3(const double a[3][3], const double b[3], double out[3]){
+    double c00 = a[1][1]*a[2][2] - a[1][2]*a[2][1];
+    double c01 = a[1][2]*a[2][0] - a[1][0]*a[2][2];
+    double c02 = a[1][0]*a[2][1] - a[1][1]*a[2][0];
+    double det = a[0][0]*c00 + a[0][1]*c01 + a[0][2]*c02;
+    double inv = 1.0 / det;
+    double c11 = a[0][0]*a[2][2] - a[0][2]*a[2][0];
+    double c12 = a[0][2]*a[1][0] - a[0][0]*a[1][2];
+    double c22 = a[0][0]*a[1][1] - a[0][1]*a[1][0];
+    out[0] = (c00*b[0] + c01*b[1] + c02*b[2]) * inv;
+    out[1] = (c01*b[0] + c11*b[1] + c12*b[2]) * inv;
+    out[2] = (c02*b[0] + c12*b[1] + c22*b[2]) * inv;
+}
+
+
+/**
+ * Iterative inverse kinematics with damped least squares (Levenberg-Marquardt).
+ * Each iteration takes the step J^T (J J^T + lambda^2 I)^-1 e, where e is the
+ * pose error. J J^T is only 3x3 and is accumulated from joint positions, so
+ * iterations allocate nothing and cost two passes over the links.
+ * The damping is halved after an improvement and doubled otherwise.
+ *
+ * @param[in] num_links Number of links, no upper bound.
+ * @param[in] links Array with links' lengths.
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta orientation of end effector (deg).
+ * @param[in] seed Initial joint angles (deg), may be the same array as angles.
+ * @param[out] angles Joint angles (deg) of the best found configuration.
+ * @param[in] options Solver tolerances and limits.
+ * @param[out] stats Convergence statistics, may be null.
+ * @return bool: true if converged within tolerances, false otherwise.
+ */
+bool solve_inverse_kinematics_dls(int num_links, const double *links,
+                                double x, double y, double theta,
+                                const double *seed, double *angles,
+                                const IkSolverOptions &options, IkSolverStats *stats){
+    if (num_links < 1){
+        return false;
+    }
+    double reach = 0;
+    for (int i = 0; i < num_links; i += 1){
+        angles[i] = seed[i];
+        reach += links[i];
+    }
+    const double w = options.orientation_weight;
+    const double min_lambda = options.min_damping * reach;
+    double lambda = options.damping * reach;
+    double previous_error = HUGE_VAL;
+    double position_error = HUGE_VAL;
+    double orientation_error = HUGE_VAL;
+    bool converged = false;
+    int iteration = 0;
+
+    for (;; iteration += 1){
+        // Pass 1: end effector pose and sums of joint positions for J J^T
+        double xe = 0, ye = 0, t = 0;
+        double sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+        for (int i = 0; i < num_links; i += 1){
+            sx += xe;
+            sy += ye;
+            sxx += xe*xe;
+            syy += ye*ye;
+            sxy += xe*ye;
+            t += angles[i];
+            xe += links[i]*cos(t*PI/180.0);
+            ye += links[i]*sin(t*PI/180.0);
+        }
+
+        double e[3];
+        e[0] = x - xe;
+        e[1] = y - ye;
+        e[2] = clip_angle_180(theta - t);
+        position_error = sqrt(e[0]*e[0] + e[1]*e[1]);
+        orientation_error = fabs(e[2]);
+        if (position_error <= options.position_tolerance
+                && orientation_error <= options.orientation_tolerance){
+            converged = true;
+            break;
+        }
+        if (iteration >= options.max_iterations){
+            break;
+        }
+        e[2] *= w*PI/180.0;
+
+        double error = e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
+        if (error < previous_error){
+            lambda = (lambda*0.5 > min_lambda) ? lambda*0.5 : min_lambda;
+        }
+        else{
+            lambda *= 2.0;
+        }
+        previous_error = error;
+
+        // Column i of J is (-(ye - yi), xe - xi, w)
+        double n = num_links;
+        double a[3][3];
+        a[0][0] = n*ye*ye - 2*ye*sy + syy + lambda*lambda;
+        a[1][1] = n*xe*xe - 2*xe*sx + sxx + lambda*lambda;
+        a[2][2] = n*w*w + lambda*lambda;
+        a[0][1] = -(n*xe*ye - xe*sy - ye*sx + sxy);
+        a[0][2] = -w*(n*ye - sy);
+        a[1][2] = w*(n*xe - sx);
+        a[1][0] = a[0][1];
+        a[2][0] = a[0][2];
+        a[2][1] = a[1][2];
+        double v[3];
+        solve_3x3(a, e, v);
+
+        // Pass 2: joint steps dq_i = J_i^T v, using positions before the update
+        double xi = 0, yi = 0;
+        t = 0;
+        for (int i = 0; i < num_links; i += 1){
+            double step = (-(ye - yi)*v[0] + (xe - xi)*v[1] + w*v[2]) * 180.0/PI;
+            step = (step > options.max_step) ? options.max_step : step;
+            step = (step < -options.max_step) ? -options.max_step : step;
+            t += angles[i];
+            xi += links[i]*cos(t*PI/180.0);
+            yi += links[i]*sin(t*PI/180.0);
+            angles[i] += step;
+        }
+    }
+
+    for (int i = 0; i < num_links; i += 1){
+        angles[i] = clip_angle_180(angles[i]);
+    }
+    if (stats){
+        stats->iterations = iteration;
+        stats->position_error = position_error;
+        stats->orientation_error = orientation_error;
+        stats->damping = lambda;
+        stats->converged = converged;
+    }
+    return converged;
+}
+
+
+bool solve_inverse_kinematics_dls(const Configuration &config,
+                                double x, double y, double theta,
+                                const double *seed, double *angles,
+                                const IkSolverOptions &options, IkSolverStats *stats){
+    return solve_inverse_kinematics_dls(config.num_links, config.links, x, y, theta,
+                                        seed, angles, options, stats);
+}
@@ -0,0 +1,540 @@
+/********
+ * obstacle_set.cpp
+ * Author: Simon Chamorro
+ * Set of circles indexed by a uniform grid for point containment queries
+ *
+ * build copies each circle into every grid cell its bounding box overlaps,
+ * laid out cell after cell, so a query reads one contiguous run of circles
+ * near the point. Queries before build, or after add, scan every circle.
+ * Links are segments between joints; a circle touches a link when the
+ * closest point of the segment to its center is within its radius.
+********/
+
+#include <math.h>
+#include "batch_kinematics.h"
+#include "fast_math.h"
+#include "obstacle_set.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OBSTACLE_X86_DISPATCH
+#endif
+
+// Poses converted per call of the batched intersection
+const int OBSTACLE_BATCH_BLOCK = 256;
+
+
+// Squared distance from (cx, cy) to the segment from (x0, y0) to (x1, y1).
+// The projection is clamped without branches, zero length segments give t = 0.
+FAST_MATH_INLINE double segment_distance_squared(double x0, double y0, double x1, double y1,
+                                                double cx, double cy){
+    double dx = x1 - x0;
+    double dy = y1 - y0;
+    double px = cx - x0;
+    double py = cy - y0;
+    double t = (px*dx + py*dy) / (dx*dx + dy*dy + 1e-300);
+    t = (t < 0.0) ? 0.0 : t;
+    t = (t > 1.0) ? 1.0 : t;
+    double qx = px - t*dx;
+    double qy = py - t*dy;
+    return qx*qx + qy*qy;
+}
+
+
+// One circle against one link of many poses, hit lanes are set to 1
+FAST_MATH_INLINE void segment_lanes(int len, const double *__restrict x0,
+                                    const double *__restrict y0, const double *__restrict x1,
+                                    const double *__restrict y1, double cx, double cy,
+                                    double r_squared, double *__restrict hit){
+    for (int i = 0; i < len; i += 1){
+        double d = segment_distance_squared(x0[i], y0[i], x1[i], y1[i], cx, cy);
+        hit[i] = (d <= r_squared) ? 1.0 : hit[i];
+    }
+}
+
+typedef void (*SegmentKernel)(int, const double *, const double *, const double *,
+                            const double *, double, double, double, double *);
+
+static void segment_sse2(int len, const double *x0, const double *y0, const double *x1,
+                        const double *y1, double cx, double cy, double r_squared, double *hit){
+    segment_lanes(len, x0, y0, x1, y1, cx, cy, r_squared, hit);
+}
+
+#ifdef OBSTACLE_X86_DISPATCH
+__attribute__((target("avx2,fma")))
+static void segment_avx2(int len, const double *x0, const double *y0, const double *x1,
+                        const double *y1, double cx, double cy, double r_squared, double *hit){
+    segment_lanes(len, x0, y0, x1, y1, cx, cy, r_squared, hit);
+}
+
+__attribute__((target("avx512f,avx512dq,fma")))
+static void segment_avx512(int len, const double *x0, const double *y0, const double *x1,
+                        const double *y1, double cx, double cy, double r_squared, double *hit){
+    segment_lanes(len, x0, y0, x1, y1, cx, cy, r_squared, hit);
+}
+#endif
+
+
+static SegmentKernel select_segment_kernel(){
+#ifdef OBSTACLE_X86_DISPATCH
+    switch (detect_simd_level()){
+        case SIMD_AVX512:
+            return segment_avx512;
+        case SIMD_AVX2:
+            return segment_avx2;
+        default:
+            break;
+    }
+#endif
+    return segment_sse2;
+}
+
+
+ObstacleSet::ObstacleSet() : built(false), min_x(0), min_y(0), inv_cell_size(0),
+                             cells_x(0), cells_y(0){
+}
+
+
+/**
+ * Add a circle. The grid must be rebuilt before queries are sub-linear again.
+ *
+ * @param[in] x coordinate of the center.
+ * @param[in] y coordinate of the center.
+ * @param[in] r radius, points at distance r are inside.
+ * @return id of the circle, its index in insertion order, or -1 if a value is
+ *         not finite, r is negative or the circle reaches past
+ *         OBSTACLE_MAX_COORDINATE.
+ */
+int ObstacleSet::add(double x, double y, double r){
+    // An infinite circle would make the grid infinite, with a cell size of 0
+    if (!isfinite(x) || !isfinite(y) || !isfinite(r) || r < 0
+            || fabs(x) + r > OBSTACLE_MAX_COORDINATE || fabs(y) + r > OBSTACLE_MAX_COORDINATE){
+        return -1;
+    }
+    Circle circle = {x, y, r};
+    circles.push_back(circle);
+    built = false;
+    return (int)circles.size() - 1;
+}
+
+
+void ObstacleSet::clear(){
+    circles.clear();
+    cell_start.clear();
+    entries.clear();
+    large.clear();
+    built = false;
+}
+
+
+/**
+ * Index every circle in a uniform grid over their bounding box. The cell
+ * size is the mean circle diameter, enlarged so the grid has at most about
+ * four cells per circle, along each axis as well as in total, and at most
+ * OBSTACLE_MAX_GRID_CELLS. Cost is linear in the number of circles and cell overlaps.
+ */
+void ObstacleSet::build(){
+    cell_start.clear();
+    entries.clear();
+    large.clear();
+    built = true;
+    int n = (int)circles.size();
+    if (n == 0){
+        cells_x = 0;
+        cells_y = 0;
+        return;
+    }
+
+    double max_x = -HUGE_VAL, max_y = -HUGE_VAL, diameter = 0;
+    min_x = HUGE_VAL;
+    min_y = HUGE_VAL;
+    for (int i = 0; i < n; i += 1){
+        const Circle &c = circles[i];
+        min_x = (c.x - c.r < min_x) ? c.x - c.r : min_x;
+        min_y = (c.y - c.r < min_y) ? c.y - c.r : min_y;
+        max_x = (c.x + c.r > max_x) ? c.x + c.r : max_x;
+        max_y = (c.y + c.r > max_y) ? c.y + c.r : max_y;
+        diameter += 2*c.r;
+    }
+    double width = max_x - min_x;
+    double height = max_y - min_y;
+    // The area bound alone lets a thin layout have billions of cells along
+    // its long side, so each side is bounded too. The grid then has at most
+    // 3*max_cells + 1 cells.
+    double max_cells = (4.0*n < OBSTACLE_MAX_GRID_CELLS) ? 4.0*n : OBSTACLE_MAX_GRID_CELLS;
+    double cell_size = diameter / n;
+    double min_cell_size = sqrt(width / max_cells)*sqrt(height);
+    double side = (width > height) ? width : height;
+    min_cell_size = (side / max_cells > min_cell_size) ? side / max_cells : min_cell_size;
+    cell_size = (cell_size > min_cell_size) ? cell_size : min_cell_size;
+    if (!(cell_size > 0)){
+        // Only points, any positive size puts them all in one cell
+        cell_size = (width > height) ? width : height;
+        cell_size = (cell_size > 0) ? cell_size : 1.0;
+    }
+    inv_cell_size = 1.0 / cell_size;
+    cells_x = (int)(width * inv_cell_size) + 1;
+    cells_y = (int)(height * inv_cell_size) + 1;
+    int num_cells = cells_x*cells_y;
+
+    // Count entries per cell, then place them (counting sort)
+    vector<int> x0s(n), x1s(n), y0s(n), y1s(n);
+    cell_start.assign(num_cells + 1, 0);
+    for (int i = 0; i < n; i += 1){
+        const Circle &c = circles[i];
+        int x0 = (int)((c.x - c.r - min_x) * inv_cell_size);
+        int x1 = (int)((c.x + c.r - min_x) * inv_cell_size);
+        int y0 = (int)((c.y - c.r - min_y) * inv_cell_size);
+        int y1 = (int)((c.y + c.r - min_y) * inv_cell_size);
+        x1 = (x1 < cells_x) ? x1 : cells_x - 1;
+        y1 = (y1 < cells_y) ? y1 : cells_y - 1;
+        x0s[i] = x0;
+        x1s[i] = x1;
+        y0s[i] = y0;
+        y1s[i] = y1;
+        Entry entry = {c.x, c.y, c.r*c.r, i};
+        if ((x1 - x0 + 1)*(y1 - y0 + 1) > OBSTACLE_MAX_CELLS_PER_CIRCLE){
+            large.push_back(entry);
+            x0s[i] = -1;
+            continue;
+        }
+        for (int cy = y0; cy <= y1; cy += 1){
+            for (int cx = x0; cx <= x1; cx += 1){
+                cell_start[cy*cells_x + cx + 1] += 1;
+            }
+        }
+    }
+    for (int k = 0; k < num_cells; k += 1){
+        cell_start[k + 1] += cell_start[k];
+    }
+    entries.resize(cell_start[num_cells]);
+    vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+    for (int i = 0; i < n; i += 1){
+        if (x0s[i] < 0){
+            continue;
+        }
+        const Circle &c = circles[i];
+        Entry entry = {c.x, c.y, c.r*c.r, i};
+        for (int cy = y0s[i]; cy <= y1s[i]; cy += 1){
+            for (int cx = x0s[i]; cx <= x1s[i]; cx += 1){
+                entries[fill[cy*cells_x + cx]++] = entry;
+            }
+        }
+    }
+}
+
+
+bool ObstacleSet::is_built() const{
+    return built;
+}
+
+
+int ObstacleSet::size() const{
+    return (int)circles.size();
+}
+
+
+Circle ObstacleSet::get(int id) const{
+    return circles[id];
+}
+
+
+// Cell holding a point, -1 if outside the grid
+int ObstacleSet::cell_of(double x, double y) const{
+    double u = (x - min_x) * inv_cell_size;
+    double v = (y - min_y) * inv_cell_size;
+    if (!(u >= 0 && v >= 0 && u < cells_x && v < cells_y)){
+        return -1;
+    }
+    return (int)v*cells_x + (int)u;
+}
+
+
+/**
+ * Check if a point is inside any circle.
+ *
+ * @param[in] x coordinate of the point.
+ * @param[in] y coordinate of the point.
+ * @return bool: true if at least one circle contains the point.
+ */
+bool ObstacleSet::contains_any(double x, double y) const{
+    if (!built){
+        for (size_t i = 0; i < circles.size(); i += 1){
+            const Circle &c = circles[i];
+            if ((x - c.x)*(x - c.x) + (y - c.y)*(y - c.y) <= c.r*c.r){
+                return true;
+            }
+        }
+        return false;
+    }
+    for (size_t i = 0; i < large.size(); i += 1){
+        const Entry &e = large[i];
+        if ((x - e.x)*(x - e.x) + (y - e.y)*(y - e.y) <= e.r_squared){
+            return true;
+        }
+    }
+    int cell = cell_of(x, y);
+    if (cell < 0){
+        return false;
+    }
+    for (int k = cell_start[cell]; k < cell_start[cell + 1]; k += 1){
+        const Entry &e = entries[k];
+        if ((x - e.x)*(x - e.x) + (y - e.y)*(y - e.y) <= e.r_squared){
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Find every circle containing a point.
+ *
+ * @param[in] x coordinate of the point.
+ * @param[in] y coordinate of the point.
+ * @param[out] ids Cleared, then filled with the ids of the circles.
+ * @return number of circles found.
+ */
+int ObstacleSet::find_all(double x, double y, vector<int> &ids) const{
+    ids.clear();
+    if (!built){
+        for (size_t i = 0; i < circles.size(); i += 1){
+            const Circle &c = circles[i];
+            if ((x - c.x)*(x - c.x) + (y - c.y)*(y - c.y) <= c.r*c.r){
+                ids.push_back((int)i);
+            }
+        }
+        return (int)ids.size();
+    }
+    for (size_t i = 0; i < large.size(); i += 1){
+        const Entry &e = large[i];
+        if ((x - e.x)*(x - e.x) + (y - e.y)*(y - e.y) <= e.r_squared){
+            ids.push_back(e.id);
+        }
+    }
+    int cell = cell_of(x, y);
+    if (cell >= 0){
+        for (int k = cell_start[cell]; k < cell_start[cell + 1]; k += 1){
+            const Entry &e = entries[k];
+            if ((x - e.x)*(x - e.x) + (y - e.y)*(y - e.y) <= e.r_squared){
+                ids.push_back(e.id);
+            }
+        }
+    }
+    return (int)ids.size();
+}
+
+
+/**
+ * Check many points against the set.
+ *
+ * @param[in] count Number of points.
+ * @param[in] x Array of count x coordinates.
+ * @param[in] y Array of count y coordinates.
+ * @param[out] hits Array of count flags, 1 if a circle contains the point.
+ * @return bool: true if success, false for a negative count.
+ */
+bool ObstacleSet::contains_any_batch(int count, const double *x, const double *y,
+                                    unsigned char *hits) const{
+    if (count < 0){
+        return false;
+    }
+    for (int k = 0; k < count; k += 1){
+        hits[k] = contains_any(x[k], y[k]);
+    }
+    return true;
+}
+
+
+/**
+ * Check the end effector of many joint configurations against the set,
+ * with batch forward kinematics over blocks of poses.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] count Number of configurations.
+ * @param[in] angles num_links arrays of count joint angles (deg).
+ * @param[out] hits Array of count flags, 1 if a circle contains the end effector.
+ * @return bool: true if success, false for invalid input.
+ */
+bool ObstacleSet::intersection_batch(const Configuration &config, int count,
+                                    const double *const *angles, unsigned char *hits) const{
+    if (count < 0 || config.num_links < 1){
+        return false;
+    }
+    double x[OBSTACLE_BATCH_BLOCK], y[OBSTACLE_BATCH_BLOCK], theta[OBSTACLE_BATCH_BLOCK];
+    vector<const double *> block(config.num_links);
+    for (int first = 0; first < count; first += OBSTACLE_BATCH_BLOCK){
+        int n = (count - first < OBSTACLE_BATCH_BLOCK) ? count - first : OBSTACLE_BATCH_BLOCK;
+        for (int i = 0; i < config.num_links; i += 1){
+            block[i] = angles[i] + first;
+        }
+        forward_kinematics_batch(config, n, &block[0], x, y, theta);
+        contains_any_batch(n, x, y, hits + first);
+    }
+    return true;
+}
+
+
+/**
+ * Check if a segment touches any circle. The bounding box of the segment
+ * selects the grid cells to test; the first hit ends the search.
+ *
+ * @param[in] x0 coordinate of the first end.
+ * @param[in] y0 coordinate of the first end.
+ * @param[in] x1 coordinate of the other end.
+ * @param[in] y1 coordinate of the other end.
+ * @return bool: true if a circle contains any point of the segment.
+ */
+bool ObstacleSet::segment_intersects_any(double x0, double y0, double x1, double y1) const{
+    double box_x0 = (x0 < x1) ? x0 : x1;
+    double box_x1 = (x0 < x1) ? x1 : x0;
+    double box_y0 = (y0 < y1) ? y0 : y1;
+    double box_y1 = (y0 < y1) ? y1 : y0;
+    if (!built){
+        for (size_t i = 0; i < circles.size(); i += 1){
+            const Circle &c = circles[i];
+            if (c.x + c.r < box_x0 || c.x - c.r > box_x1 || c.y + c.r < box_y0 || c.y - c.r > box_y1){
+                continue;
+            }
+            if (segment_distance_squared(x0, y0, x1, y1, c.x, c.y) <= c.r*c.r){
+                return true;
+            }
+        }
+        return false;
+    }
+    for (size_t i = 0; i < large.size(); i += 1){
+        const Entry &e = large[i];
+        if (segment_distance_squared(x0, y0, x1, y1, e.x, e.y) <= e.r_squared){
+            return true;
+        }
+    }
+
+    // Cells overlapped by the bounding box, clipped to the grid
+    double u0 = (box_x0 - min_x) * inv_cell_size;
+    double u1 = (box_x1 - min_x) * inv_cell_size;
+    double v0 = (box_y0 - min_y) * inv_cell_size;
+    double v1 = (box_y1 - min_y) * inv_cell_size;
+    if (!(u1 >= 0 && v1 >= 0 && u0 < cells_x && v0 < cells_y)){
+        return false;
+    }
+    int cx0 = (u0 > 0) ? (int)u0 : 0;
+    int cy0 = (v0 > 0) ? (int)v0 : 0;
+    int cx1 = (u1 < cells_x) ? (int)u1 : cells_x - 1;
+    int cy1 = (v1 < cells_y) ? (int)v1 : cells_y - 1;
+    for (int cy = cy0; cy <= cy1; cy += 1){
+        for (int cx = cx0; cx <= cx1; cx += 1){
+            int cell = cy*cells_x + cx;
+            for (int k = cell_start[cell]; k < cell_start[cell + 1]; k += 1){
+                const Entry &e = entries[k];
+                if (segment_distance_squared(x0, y0, x1, y1, e.x, e.y) <= e.r_squared){
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Check every link of an arm against the set, from the base outwards.
+ *
+ * @param[in] num_links Number of links.
+ * @param[in] joint_x Array of num_links + 1 joint x positions, base first.
+ * @param[in] joint_y Array of num_links + 1 joint y positions, base first.
+ * @return index of the first link touching a circle, -1 if none does.
+ */
+int ObstacleSet::first_collision(int num_links, const double *joint_x,
+                                const double *joint_y) const{
+    for (int i = 0; i < num_links; i += 1){
+        if (segment_intersects_any(joint_x[i], joint_y[i], joint_x[i + 1], joint_y[i + 1])){
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * Whole arm collision of many joint configurations. Joint positions come
+ * from joint_positions_batch over blocks of poses. Small sets test each
+ * circle against each link of the whole block in one vectorized loop,
+ * skipping circles outside the bounding box of that link over the block.
+ * Larger sets run first_collision on each pose.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] count Number of configurations.
+ * @param[in] angles num_links arrays of count joint angles (deg).
+ * @param[out] hits Array of count flags, 1 if any link touches a circle.
+ * @return bool: true if success, false for invalid input.
+ */
+bool ObstacleSet::collision_batch(const Configuration &config, int count,
+                                const double *const *angles, unsigned char *hits) const{
+    int n = config.num_links;
+    if (count < 0 || n < 1){
+        return false;
+    }
+    vector<double> buffer((size_t)2*(n + 1)*OBSTACLE_BATCH_BLOCK);
+    vector<double *> joint_x(n + 1);
+    vector<double *> joint_y(n + 1);
+    for (int j = 0; j <= n; j += 1){
+        joint_x[j] = &buffer[(size_t)(2*j)*OBSTACLE_BATCH_BLOCK];
+        joint_y[j] = &buffer[(size_t)(2*j + 1)*OBSTACLE_BATCH_BLOCK];
+    }
+    vector<const double *> block(n);
+    vector<double> pose_x(n + 1);
+    vector<double> pose_y(n + 1);
+    double hit[OBSTACLE_BATCH_BLOCK];
+    bool lanes = (int)circles.size() <= OBSTACLE_SIMD_MAX_CIRCLES;
+    SegmentKernel kernel = select_segment_kernel();
+
+    for (int first = 0; first < count; first += OBSTACLE_BATCH_BLOCK){
+        int len = (count - first < OBSTACLE_BATCH_BLOCK) ? count - first : OBSTACLE_BATCH_BLOCK;
+        for (int j = 0; j < n; j += 1){
+            block[j] = angles[j] + first;
+        }
+        joint_positions_batch(config, len, &block[0], &joint_x[0], &joint_y[0]);
+
+        if (!lanes){
+            for (int k = 0; k < len; k += 1){
+                for (int j = 0; j <= n; j += 1){
+                    pose_x[j] = joint_x[j][k];
+                    pose_y[j] = joint_y[j][k];
+                }
+                hits[first + k] = first_collision(n, &pose_x[0], &pose_y[0]) >= 0;
+            }
+            continue;
+        }
+
+        for (int k = 0; k < len; k += 1){
+            hit[k] = 0.0;
+        }
+        for (int j = 0; j < n; j += 1){
+            // Broad phase: bounding box of this link over the block
+            double box_x0 = HUGE_VAL, box_x1 = -HUGE_VAL, box_y0 = HUGE_VAL, box_y1 = -HUGE_VAL;
+            for (int e = j; e <= j + 1; e += 1){
+                for (int k = 0; k < len; k += 1){
+                    box_x0 = (joint_x[e][k] < box_x0) ? joint_x[e][k] : box_x0;
+                    box_x1 = (joint_x[e][k] > box_x1) ? joint_x[e][k] : box_x1;
+                    box_y0 = (joint_y[e][k] < box_y0) ? joint_y[e][k] : box_y0;
+                    box_y1 = (joint_y[e][k] > box_y1) ? joint_y[e][k] : box_y1;
+                }
+            }
+            for (size_t i = 0; i < circles.size(); i += 1){
+                const Circle &c = circles[i];
+                if (c.x + c.r < box_x0 || c.x - c.r > box_x1
+                        || c.y + c.r < box_y0 || c.y - c.r > box_y1){
+                    continue;
+                }
+                kernel(len, joint_x[j], joint_y[j], joint_x[j + 1], joint_y[j + 1],
+                       c.x, c.y, c.r*c.r, hit);
+            }
+        }
+        for (int k = 0; k < len; k += 1){
+            hits[first + k] = (hit[k] != 0.0);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,293 @@
+/********
+ * parallel_chain.cpp
+ * Author: Simon Chamorro
+ * Forward kinematics of one very long chain as a parallel prefix sum
+ *
+ * Joint frames are two prefix sums: cumulative angles, then positions as
+ * cumulative link vectors. The chain is cut in one chunk per thread and
+ * each sum is done as a scan in three phases:
+ *   1. every chunk sums its angles,
+ *   2. every chunk offsets its cumulative angles by the sums of the chunks
+ *      before it, computes its link vectors with the vectorized kernel and
+ *      sums them from zero,
+ *   3. every chunk offsets its positions by the sums of the chunks before it.
+ * Offsets are a few additions over the chunk totals, each thread computes
+ * its own after a barrier. Results differ from the serial path only by the
+ * order of additions.
+ *
+ * Phases run one after the other as parallel_for jobs of a ThreadPool, each
+ * with one item per chunk, and the calling thread computes the offsets in
+ * between. Chunks of a phase may share a worker, no phase waits on another
+ * chunk of the same phase.
+********/
+
+#include <assert.h>
+#include <thread>
+#include <vector>
+#include "batch_kinematics.h"
+#include "kinematics.h"
+#include "parallel_chain.h"
+#include "robot_configuration.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Links per call to the link vector kernel, keeps a block in L1
+const int PARALLEL_CHAIN_BLOCK = 256;
+
+// Chunk boundaries are multiples of this many links, one cache line of doubles
+const int PARALLEL_CHAIN_ALIGNMENT = 8;
+
+
+ParallelChainOptions default_parallel_chain_options(){
+    ParallelChainOptions options;
+    options.threads = 0;
+    options.min_links_per_thread = PARALLEL_CHAIN_MIN_LINKS_PER_THREAD;
+    options.min_threads = PARALLEL_CHAIN_MIN_THREADS;
+    options.pool = NULL;
+    return options;
+}
+
+
+// Cores of the machine, hardware_concurrency takes microseconds so it is
+// asked once
+static int core_count(){
+    static const int cores = (thread::hardware_concurrency() > 0)
+                            ? (int)thread::hardware_concurrency() : 1;
+    return cores;
+}
+
+
+// Pool used by scans without one of their own, started on first use
+static ThreadPool &shared_pool(){
+    static ThreadPool pool;
+    return pool;
+}
+
+
+/**
+ * Crossover between the serial and the parallel scan: as many threads as
+ * allowed, as long as each gets options.min_links_per_thread links. The
+ * scan reads the chain about twice as often as the serial path, so it needs
+ * options.min_threads threads to win. Chains too short for that return
+ * before any system call, so short arms pay nothing for the check.
+ *
+ * @param[in] num_links Number of links to compute.
+ * @param[in] options Thread limit and crossover.
+ * @return number of threads to use, 1 for the serial path.
+ */
+int parallel_chain_threads(int num_links, const ParallelChainOptions &options){
+    int per_thread = (options.min_links_per_thread > 1) ? options.min_links_per_thread : 1;
+    int min_threads = (options.min_threads > 2) ? options.min_threads : 2;
+    int useful = num_links / per_thread;
+    if (useful < min_threads){
+        return 1;
+    }
+    int threads = (options.threads > 0) ? options.threads : core_count();
+    threads = (useful < threads) ? useful : threads;
+    return (threads >= min_threads) ? threads : 1;
+}
+
+
+// State shared by the chunks of one scan. Without joint arrays only the
+// end effector pose is computed and phase 3 is skipped.
+struct ChainScan{
+
+    const double *links;
+    const double *angles;
+    int first;
+    double *joint_x;
+    double *joint_y;
+    double *joint_theta;
+    double base_x;
+    double base_y;
+    double base_theta;
+    vector<int> start;
+    vector<double> angle_total;
+    vector<double> x_total;
+    vector<double> y_total;
+    vector<double> offset_theta;
+    vector<double> offset_x;
+    vector<double> offset_y;
+};
+
+
+// Phase 2 over links [begin, end): cumulative angles from theta and link
+// vectors summed from zero, stored as frames begin + 1 to end if wanted
+static void scan_chunk(const ChainScan &scan, int begin, int end, double theta,
+                    double &x, double &y){
+    double block_theta[PARALLEL_CHAIN_BLOCK];
+    double dx[PARALLEL_CHAIN_BLOCK];
+    double dy[PARALLEL_CHAIN_BLOCK];
+    x = 0;
+    y = 0;
+    for (int b = begin; b < end; b += PARALLEL_CHAIN_BLOCK){
+        int len = (end - b < PARALLEL_CHAIN_BLOCK) ? end - b : PARALLEL_CHAIN_BLOCK;
+        double *t = scan.joint_theta ? scan.joint_theta + b + 1 : block_theta;
+        for (int k = 0; k < len; k += 1){
+            theta += scan.angles[b + k];
+            t[k] = theta;
+        }
+        link_vectors_batch(len, scan.links + b, t, dx, dy);
+        for (int k = 0; k < len; k += 1){
+            x += dx[k];
+            y += dy[k];
+            if (scan.joint_x){
+                scan.joint_x[b + k + 1] = x;
+                scan.joint_y[b + k + 1] = y;
+            }
+        }
+    }
+}
+
+
+// Phase 1 on chunk c: sum of its angles
+static void sum_angles(ChainScan &scan, int c){
+    double sum = 0;
+    for (int i = scan.start[c]; i < scan.start[c + 1]; i += 1){
+        sum += scan.angles[i];
+    }
+    scan.angle_total[c] = sum;
+}
+
+
+// Phase 3 on chunk c: offset its positions by the chunks before it
+static void offset_positions(ChainScan &scan, int c){
+    double x = scan.offset_x[c];
+    double y = scan.offset_y[c];
+    double *__restrict joint_x = scan.joint_x;
+    double *__restrict joint_y = scan.joint_y;
+    for (int i = scan.start[c] + 1; i <= scan.start[c + 1]; i += 1){
+        joint_x[i] += x;
+        joint_y[i] += y;
+    }
+}
+
+
+// Cut links [first, num_links) in one chunk per thread and run the phases
+// on the pool, offsets are prefix sums over the chunk totals
+static void run_scan(ChainScan &scan, int num_links, int threads, ThreadPool *pool){
+    ThreadPool &workers = pool ? *pool : shared_pool();
+    int count = num_links - scan.first;
+    scan.start.resize(threads + 1);
+    for (int c = 0; c < threads; c += 1){
+        int offset = (int)((long)count*c / threads);
+        scan.start[c] = scan.first + offset - offset % PARALLEL_CHAIN_ALIGNMENT;
+    }
+    scan.start[threads] = num_links;
+    scan.angle_total.assign(threads, 0.0);
+    scan.x_total.assign(threads, 0.0);
+    scan.y_total.assign(threads, 0.0);
+    scan.offset_theta.resize(threads);
+    scan.offset_x.resize(threads);
+    scan.offset_y.resize(threads);
+
+    workers.parallel_for(threads, 1, [&scan](int begin, int end){
+        for (int c = begin; c < end; c += 1){
+            sum_angles(scan, c);
+        }
+    });
+    scan.offset_theta[0] = scan.base_theta;
+    for (int c = 1; c < threads; c += 1){
+        scan.offset_theta[c] = scan.offset_theta[c - 1] + scan.angle_total[c - 1];
+    }
+
+    workers.parallel_for(threads, 1, [&scan](int begin, int end){
+        for (int c = begin; c < end; c += 1){
+            scan_chunk(scan, scan.start[c], scan.start[c + 1], scan.offset_theta[c],
+                    scan.x_total[c], scan.y_total[c]);
+        }
+    });
+    if (!scan.joint_x){
+        return;
+    }
+    scan.offset_x[0] = scan.base_x;
+    scan.offset_y[0] = scan.base_y;
+    for (int c = 1; c < threads; c += 1){
+        scan.offset_x[c] = scan.offset_x[c - 1] + scan.x_total[c - 1];
+        scan.offset_y[c] = scan.offset_y[c - 1] + scan.y_total[c - 1];
+    }
+
+    workers.parallel_for(threads, 1, [&scan](int begin, int end){
+        for (int c = begin; c < end; c += 1){
+            offset_positions(scan, c);
+        }
+    });
+}
+
+
+/**
+ * End effector pose of one chain, with a parallel scan when the chain is
+ * long enough for parallel_chain_threads to pick more than one thread and
+ * compute_forward_kinematics otherwise.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] angles Array with num_links joint angles (deg).
+ * @param[in] options Thread limit and crossover.
+ * @return Pose of end effector.
+ */
+Pose compute_forward_kinematics_parallel(const Configuration &config, const double *angles,
+                                        const ParallelChainOptions &options){
+    assert(config.is_consistent());
+    int threads = parallel_chain_threads(config.num_links, options);
+    if (threads == 1){
+        return compute_forward_kinematics(config, angles);
+    }
+    ChainScan scan;
+    scan.links = config.links;
+    scan.angles = angles;
+    scan.first = 0;
+    scan.joint_x = NULL;
+    scan.joint_y = NULL;
+    scan.joint_theta = NULL;
+    scan.base_x = 0;
+    scan.base_y = 0;
+    scan.base_theta = 0;
+    run_scan(scan, config.num_links, threads, options.pool);
+
+    Pose pose;
+    pose.x = 0;
+    pose.y = 0;
+    pose.theta = 0;
+    for (int c = 0; c < threads; c += 1){
+        pose.x += scan.x_total[c];
+        pose.y += scan.y_total[c];
+        pose.theta += scan.angle_total[c];
+    }
+    pose.theta = clip_angle_180(pose.theta);
+    return pose;
+}
+
+
+/**
+ * Same as compute_joint_frames, with a parallel scan over frames after
+ * first when there are enough of them for parallel_chain_threads to pick
+ * more than one thread.
+ *
+ * @param[in] options Thread limit and crossover.
+ */
+void compute_joint_frames_parallel(int num_links, const double *links, const double *angles,
+                                int first, double *joint_x, double *joint_y, double *joint_theta,
+                                const ParallelChainOptions &options){
+    int threads = parallel_chain_threads(num_links - first, options);
+    if (threads == 1){
+        compute_joint_frames(num_links, links, angles, first, joint_x, joint_y, joint_theta);
+        return;
+    }
+    if (first == 0){
+        joint_x[0] = 0;
+        joint_y[0] = 0;
+        joint_theta[0] = 0;
+    }
+    ChainScan scan;
+    scan.links = links;
+    scan.angles = angles;
+    scan.first = first;
+    scan.joint_x = joint_x;
+    scan.joint_y = joint_y;
+    scan.joint_theta = joint_theta;
+    scan.base_x = joint_x[first];
+    scan.base_y = joint_y[first];
+    scan.base_theta = joint_theta[first];
+    run_scan(scan, num_links, threads, options.pool);
+}
@@ -0,0 +1,306 @@
+/********
+ * reachability_map.cpp
+ * Author: Simon Chamorro
+ * Precomputed reachability grid over end effector poses (x, y, theta)
+ *
+ * A pose is reachable when its wrist, the pose moved back along the last
+ * link, lies in the annulus covered by the other links. Each cell stores
+ * whether that holds for all, none or some of its poses, using a bound on
+ * how far the wrist moves inside the cell. Only boundary cells need the
+ * exact check, so answers are exact and usually cost one table read.
+ *
+ * File layout (native byte order): magic "RMREACH1", byte order tag,
+ * num_links, xy_cells, theta_cells as uint32, num_links link lengths as
+ * float64, then one byte per cell, x fastest and theta slowest.
+********/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <thread>
+#include "kinematics.h"
+#include "reachability_map.h"
+#include "robot_configuration.h"
+
+using namespace std;
+
+#define PI 3.14159265359
+
+static const char REACHABILITY_MAGIC[8] = {'R', 'M', 'R', 'E', 'A', 'C', 'H', '1'};
+static const uint32_t REACHABILITY_BYTE_ORDER = 0x01020304;
+
+
+ReachabilityMapOptions default_reachability_map_options(){
+    ReachabilityMapOptions options;
+    options.xy_cells = 64;
+    options.theta_cells = 72;
+    options.threads = 0;
+    return options;
+}
+
+
+ReachabilityMap::ReachabilityMap() : xy_cells(0), theta_cells(0), reach(0), cell_size(0),
+                                     theta_size(0), inv_cell_size(0), inv_theta_size(0),
+                                     r_min(0), r_max(0){
+    robot_config.resize(0);
+}
+
+
+bool ReachabilityMap::build(const Configuration &config){
+    return build(config, default_reachability_map_options());
+}
+
+
+/**
+ * Classify every cell for a robot configuration, splitting theta slices
+ * between threads.
+ *
+ * @param[in] config Robot configuration, only links are used.
+ * @param[in] options Grid resolution and number of threads.
+ * @return bool: true if built, false for invalid configuration or options.
+ */
+bool ReachabilityMap::build(const Configuration &config, const ReachabilityMapOptions &options){
+    clear();
+    if (config.num_links < 1
+            || options.xy_cells < 1 || options.theta_cells < 1 || options.threads < 0){
+        return false;
+    }
+    robot_config = config;
+    xy_cells = options.xy_cells;
+    theta_cells = options.theta_cells;
+    set_bounds();
+    cells.resize((size_t)xy_cells*xy_cells*theta_cells);
+
+    int threads = options.threads;
+    if (threads == 0){
+        threads = thread::hardware_concurrency();
+        threads = (threads > 0) ? threads : 1;
+    }
+    threads = (threads > theta_cells) ? theta_cells : threads;
+    if (threads == 1){
+        build_slices(0, theta_cells);
+        return true;
+    }
+    vector<thread> workers;
+    for (int t = 0; t < threads; t += 1){
+        int first = theta_cells*t / threads;
+        int last = theta_cells*(t + 1) / threads;
+        workers.push_back(thread(&ReachabilityMap::build_slices, this, first, last));
+    }
+    for (int t = 0; t < threads; t += 1){
+        workers[t].join();
+    }
+    return true;
+}
+
+
+// Grid spacing and wrist annulus of the current configuration
+void ReachabilityMap::set_bounds(){
+    reach = 0;
+    for (int i = 0; i < robot_config.num_links; i += 1){
+        reach += robot_config.links[i];
+    }
+    cell_size = 2*reach / xy_cells;
+    theta_size = 360.0 / theta_cells;
+    inv_cell_size = 1.0 / cell_size;
+    inv_theta_size = 1.0 / theta_size;
+    compute_wrist_annulus(robot_config, r_min, r_max);
+}
+
+
+// Classify theta slices [first, last)
+void ReachabilityMap::build_slices(int first, int last){
+    double link = robot_config.links[robot_config.num_links - 1];
+    // Within a cell the wrist stays within half the cell diagonal plus the
+    // chord swept by the last link over half the theta range of the cell,
+    // the last term absorbs rounding of cell indices and the exact check.
+    double spread = cell_size*sqrt(0.5) + 2*link*sin(theta_size*PI/720.0) + 1e-9*reach;
+    for (int it = first; it < last; it += 1){
+        double theta = (-180.0 + (it + 0.5)*theta_size)*PI/180.0;
+        double dx = link*cos(theta);
+        double dy = link*sin(theta);
+        unsigned char *slice = &cells[(size_t)it*xy_cells*xy_cells];
+        for (int iy = 0; iy < xy_cells; iy += 1){
+            double yw = -reach + (iy + 0.5)*cell_size - dy;
+            for (int ix = 0; ix < xy_cells; ix += 1){
+                double xw = -reach + (ix + 0.5)*cell_size - dx;
+                double d = sqrt(xw*xw + yw*yw);
+                unsigned char cell = CELL_BOUNDARY;
+                if (d - spread >= r_min && d + spread <= r_max){
+                    cell = CELL_REACHABLE;
+                }
+                else if (d + spread < r_min || d - spread > r_max){
+                    cell = CELL_UNREACHABLE;
+                }
+                slice[iy*xy_cells + ix] = cell;
+            }
+        }
+    }
+}
+
+
+/**
+ * Write the grid and the links it was built for.
+ *
+ * @param[in] path File to create or truncate.
+ * @return bool: true if written, false if not built or on I/O error.
+ */
+bool ReachabilityMap::save(const char *path) const{
+    if (!is_built()){
+        return false;
+    }
+    FILE *file = fopen(path, "wb");
+    if (!file){
+        return false;
+    }
+    uint32_t fields[4] = {REACHABILITY_BYTE_ORDER, (uint32_t)robot_config.num_links,
+                          (uint32_t)xy_cells, (uint32_t)theta_cells};
+    bool ok = fwrite(REACHABILITY_MAGIC, sizeof(REACHABILITY_MAGIC), 1, file) == 1
+        && fwrite(fields, sizeof(fields), 1, file) == 1
+        && fwrite(robot_config.links, sizeof(double), robot_config.num_links, file)
+            == (size_t)robot_config.num_links
+        && fwrite(&cells[0], 1, cells.size(), file) == cells.size();
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+}
+
+
+/**
+ * Read a grid written by save. Use matches to check it against a robot.
+ *
+ * @param[in] path File to read.
+ * @return bool: true if a complete grid was read, false otherwise.
+ */
+bool ReachabilityMap::load(const char *path){
+    clear();
+    FILE *file = fopen(path, "rb");
+    if (!file){
+        return false;
+    }
+    char magic[8];
+    uint32_t fields[4];
+    bool ok = fread(magic, sizeof(magic), 1, file) == 1
+        && fread(fields, sizeof(fields), 1, file) == 1
+        && memcmp(magic, REACHABILITY_MAGIC, sizeof(magic)) == 0
+        && fields[0] == REACHABILITY_BYTE_ORDER
+        && fields[1] >= 1 && fields[1] <= (uint32_t)INT32_MAX
+        && fields[2] >= 1 && fields[2] <= 65536
+        && fields[3] >= 1 && fields[3] <= 65536;
+    if (ok){
+        // Size storage from the header only once the file is known to hold it
+        off_t start = ftello(file);
+        ok = fseeko(file, 0, SEEK_END) == 0
+            && ftello(file) - start == (off_t)(sizeof(double)*fields[1]
+                                               + (uint64_t)fields[2]*fields[2]*fields[3])
+            && fseeko(file, start, SEEK_SET) == 0
+            && robot_config.resize(fields[1]);
+    }
+    if (ok){
+        xy_cells = fields[2];
+        theta_cells = fields[3];
+        cells.resize((size_t)xy_cells*xy_cells*theta_cells);
+        ok = fread(robot_config.links, sizeof(double), robot_config.num_links, file)
+                == (size_t)robot_config.num_links
+            && fread(&cells[0], 1, cells.size(), file) == cells.size()
+            && fgetc(file) == EOF;
+    }
+    fclose(file);
+    for (size_t i = 0; ok && i < cells.size(); i += 1){
+        ok = cells[i] <= CELL_BOUNDARY;
+    }
+    if (!ok){
+        clear();
+        return false;
+    }
+    for (int i = 0; i < robot_config.num_links; i += 1){
+        robot_config.angles[i] = 0;
+    }
+    set_bounds();
+    return true;
+}
+
+
+void ReachabilityMap::clear(){
+    cells.clear();
+    robot_config.resize(0);
+    xy_cells = 0;
+    theta_cells = 0;
+}
+
+
+bool ReachabilityMap::is_built() const{
+    return !cells.empty();
+}
+
+
+// True if the grid was built for the same links as config
+bool ReachabilityMap::matches(const Configuration &config) const{
+    if (!is_built() || config.num_links != robot_config.num_links){
+        return false;
+    }
+    for (int i = 0; i < config.num_links; i += 1){
+        if (config.links[i] != robot_config.links[i]){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+ReachabilityMapOptions ReachabilityMap::get_options() const{
+    ReachabilityMapOptions options = default_reachability_map_options();
+    if (is_built()){
+        options.xy_cells = xy_cells;
+        options.theta_cells = theta_cells;
+    }
+    return options;
+}
+
+
+/**
+ * Class of the cell holding a pose, in constant time. Poses farther than
+ * the total length of the arm are outside the grid and unreachable.
+ * Poses on the edge of the grid and NaN are reported as boundary.
+ *
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta orientation of end effector (deg).
+ * @return cell class, CELL_BOUNDARY if the map is not built.
+ */
+ReachabilityCell ReachabilityMap::lookup(double x, double y, double theta) const{
+    if (!is_built() || theta != theta){
+        return CELL_BOUNDARY;
+    }
+    double u = (x + reach) * inv_cell_size;
+    double v = (y + reach) * inv_cell_size;
+    if (!(u >= 0 && v >= 0 && u < xy_cells && v < xy_cells)){
+        // Rounding may put a fully stretched pose just outside the grid
+        bool far = x*x + y*y > reach*reach*(1 + 1e-9);
+        return far ? CELL_UNREACHABLE : CELL_BOUNDARY;
+    }
+    int ix = (int)u;
+    int iy = (int)v;
+    int it = (int)((clip_angle_180(theta) + 180.0) * inv_theta_size);
+    it = (it < theta_cells) ? it : 0;
+    return (ReachabilityCell)cells[((size_t)it*xy_cells + iy)*xy_cells + ix];
+}
+
+
+/**
+ * Reachability of a pose, from the grid with an exact check in boundary
+ * cells. Always agrees with compute_pose_reachable.
+ *
+ * @param[in] x coordinate of end effector.
+ * @param[in] y coordinate of end effector.
+ * @param[in] theta orientation of end effector (deg).
+ * @return bool: true if reachable, false otherwise or if the map is not built.
+ */
+bool ReachabilityMap::is_reachable(double x, double y, double theta) const{
+    ReachabilityCell cell = lookup(x, y, theta);
+    if (cell == CELL_BOUNDARY){
+        return is_built() && compute_pose_reachable(robot_config, x, y, theta);
+    }
+    return cell == CELL_REACHABLE;
+}
@@ -0,0 +1,147 @@
+/********
+ * robot_configuration.cpp
+ * Author: Simon Chamorro
+ * Link storage of Robot Configuration
+********/
+
+#include <stdlib.h>
+#include <string.h>
+#include "robot_configuration.h"
+
+using namespace std;
+
+
+LinkArray::LinkArray(){
+    values = local;
+    length = 0;
+    allocated = INLINE_CAPACITY;
+    memset(local, 0, sizeof(local));
+}
+
+
+LinkArray::LinkArray(int size){
+    values = local;
+    length = 0;
+    allocated = INLINE_CAPACITY;
+    memset(local, 0, sizeof(local));
+    resize(size);
+}
+
+
+// Only the first size() values are copied, the rest of the copy is zero
+LinkArray::LinkArray(const LinkArray &other){
+    values = local;
+    length = 0;
+    allocated = INLINE_CAPACITY;
+    memset(local, 0, sizeof(local));
+    resize(other.length);
+    memcpy(values, other.values, sizeof(double)*other.length);
+}
+
+
+LinkArray &LinkArray::operator=(const LinkArray &other){
+    if (this == &other){
+        return *this;
+    }
+    if (other.is_inline() && !is_inline()){
+        free(values);
+        values = local;
+        allocated = INLINE_CAPACITY;
+    }
+    if (allocated < other.length){
+        resize(other.length);
+    }
+    memcpy(values, other.values, sizeof(double)*other.length);
+    length = other.length;
+    return *this;
+}
+
+
+LinkArray::~LinkArray(){
+    if (!is_inline()){
+        free(values);
+    }
+}
+
+
+/**
+ * Change the number of values. Values that fit in both sizes are kept and
+ * new ones are zero. Storage only grows, so shrinking never allocates.
+ *
+ * @param[in] size New number of values.
+ * @return bool: false if size is negative or allocation failed, the array is unchanged.
+ */
+bool LinkArray::resize(int size){
+    if (size < 0){
+        return false;
+    }
+    if (size > allocated){
+        // Grow geometrically so chains built one link at a time stay linear
+        int grown = (allocated*2 > size) ? allocated*2 : size;
+        void *memory = NULL;
+        if (posix_memalign(&memory, LINK_ARRAY_ALIGNMENT, sizeof(double)*grown) != 0){
+            return false;
+        }
+        double *bigger = (double*)memory;
+        memcpy(bigger, values, sizeof(double)*length);
+        memset(bigger + length, 0, sizeof(double)*(grown - length));
+        if (!is_inline()){
+            free(values);
+        }
+        values = bigger;
+        allocated = grown;
+    }
+    else if (size > length){
+        memset(values + length, 0, sizeof(double)*(size - length));
+    }
+    length = size;
+    return true;
+}
+
+
+int LinkArray::size() const{
+    return length;
+}
+
+
+int LinkArray::capacity() const{
+    return allocated;
+}
+
+
+// True while values are stored in place, without heap storage
+bool LinkArray::is_inline() const{
+    return values == local;
+}
+
+
+double *LinkArray::data(){
+    return values;
+}
+
+
+const double *LinkArray::data() const{
+    return values;
+}
+
+
+// True if links and angles hold num_links values each, as resize leaves them
+bool Configuration::is_consistent() const{
+    return num_links >= 0 && num_links <= links.size() && num_links <= angles.size();
+}
+
+
+/**
+ * Set the number of links and size links and angles to match. This is the
+ * only way to change num_links.
+ *
+ * @param[in] n Number of links.
+ * @return bool: false if n is negative or allocation failed.
+ */
+bool Configuration::resize(int n){
+    if (!links.resize(n) || !angles.resize(n)){
+        return false;
+    }
+    num_links = n;
+    return true;
+}
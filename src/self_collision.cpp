@@ -0,0 +1,210 @@
+/********
+ * self_collision.cpp
+ * Author: Simon Chamorro
+ * Self-collision of link chains with sweep and prune
+ *
+ * Link i is the segment from joint i to joint i + 1. Adjacent links share a
+ * joint and are never reported; any other pair of links that touch, even at
+ * a single point, is a collision.
+********/
+
+#include <algorithm>
+#include "self_collision.h"
+
+using namespace std;
+
+
+// Sign of the turn from (x0, y0) -> (x1, y1) to (x0, y0) -> (x2, y2)
+static double orientation(double x0, double y0, double x1, double y1, double x2, double y2){
+    return (x1 - x0)*(y2 - y0) - (y1 - y0)*(x2 - x0);
+}
+
+
+// Point known to be collinear with a segment lies within its bounding box
+static bool on_segment(double x0, double y0, double x1, double y1, double x, double y){
+    return x >= min(x0, x1) && x <= max(x0, x1) && y >= min(y0, y1) && y <= max(y0, y1);
+}
+
+
+/**
+ * Check if two segments have at least one common point, including touching
+ * ends and collinear overlaps.
+ *
+ * @return bool: true if the segments intersect.
+ */
+bool segments_intersect(double ax0, double ay0, double ax1, double ay1,
+                        double bx0, double by0, double bx1, double by1){
+    double o1 = orientation(ax0, ay0, ax1, ay1, bx0, by0);
+    double o2 = orientation(ax0, ay0, ax1, ay1, bx1, by1);
+    double o3 = orientation(bx0, by0, bx1, by1, ax0, ay0);
+    double o4 = orientation(bx0, by0, bx1, by1, ax1, ay1);
+    if (((o1 > 0 && o2 < 0) || (o1 < 0 && o2 > 0)) && ((o3 > 0 && o4 < 0) || (o3 < 0 && o4 > 0))){
+        return true;
+    }
+    return (o1 == 0 && on_segment(ax0, ay0, ax1, ay1, bx0, by0))
+        || (o2 == 0 && on_segment(ax0, ay0, ax1, ay1, bx1, by1))
+        || (o3 == 0 && on_segment(bx0, by0, bx1, by1, ax0, ay0))
+        || (o4 == 0 && on_segment(bx0, by0, bx1, by1, ax1, ay1));
+}
+
+
+// Exact test of links i and j, callers have checked they are not adjacent
+static bool links_intersect(const double *joint_x, const double *joint_y, int i, int j){
+    return segments_intersect(joint_x[i], joint_y[i], joint_x[i + 1], joint_y[i + 1],
+                            joint_x[j], joint_y[j], joint_x[j + 1], joint_y[j + 1]);
+}
+
+
+/**
+ * Self-collision by testing every pair of non adjacent links, O(n^2).
+ *
+ * @param[in] num_links Number of links.
+ * @param[in] joint_x Array of num_links + 1 joint x positions, base first.
+ * @param[in] joint_y Array of num_links + 1 joint y positions, base first.
+ * @param[out] link_a Lower index of a colliding pair, may be null.
+ * @param[out] link_b Higher index of a colliding pair, may be null.
+ * @return bool: true if two non adjacent links intersect.
+ */
+bool compute_self_collision_naive(int num_links, const double *joint_x, const double *joint_y,
+                                int *link_a, int *link_b){
+    for (int i = 0; i < num_links; i += 1){
+        double x0 = min(joint_x[i], joint_x[i + 1]);
+        double x1 = max(joint_x[i], joint_x[i + 1]);
+        double y0 = min(joint_y[i], joint_y[i + 1]);
+        double y1 = max(joint_y[i], joint_y[i + 1]);
+        for (int j = i + 2; j < num_links; j += 1){
+            if (max(joint_x[j], joint_x[j + 1]) < x0 || min(joint_x[j], joint_x[j + 1]) > x1
+                    || max(joint_y[j], joint_y[j + 1]) < y0 || min(joint_y[j], joint_y[j + 1]) > y1){
+                continue;
+            }
+            if (links_intersect(joint_x, joint_y, i, j)){
+                if (link_a){
+                    *link_a = i;
+                }
+                if (link_b){
+                    *link_b = j;
+                }
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+/**
+ * Self-collision of a chain, pairwise for short chains and with a one-off
+ * SelfCollisionChecker otherwise. Use a SelfCollisionChecker directly in
+ * loops to avoid allocating on every call.
+ *
+ * @return bool: true if two non adjacent links intersect.
+ */
+bool compute_self_collision(int num_links, const double *joint_x, const double *joint_y,
+                            int *link_a, int *link_b){
+    if (num_links <= SELF_COLLISION_NAIVE_MAX_LINKS){
+        return compute_self_collision_naive(num_links, joint_x, joint_y, link_a, link_b);
+    }
+    SelfCollisionChecker checker;
+    return checker.check(num_links, joint_x, joint_y, link_a, link_b);
+}
+
+
+SelfCollisionChecker::SelfCollisionChecker(){
+}
+
+
+// Order links by min_x. The order of the previous call is repaired with
+// insertion sort, which is linear when configurations change little; past a
+// budget of moves the rest is left to std::sort.
+void SelfCollisionChecker::sort_order(int num_links){
+    if ((int)order.size() != num_links){
+        order.resize(num_links);
+        for (int i = 0; i < num_links; i += 1){
+            order[i] = i;
+        }
+        sort(order.begin(), order.end(), [this](int a, int b){ return min_x[a] < min_x[b]; });
+        return;
+    }
+    long budget = 8L*num_links;
+    for (int i = 1; i < num_links; i += 1){
+        int link = order[i];
+        double key = min_x[link];
+        int j = i - 1;
+        while (j >= 0 && min_x[order[j]] > key){
+            order[j + 1] = order[j];
+            j -= 1;
+            budget -= 1;
+        }
+        order[j + 1] = link;
+        if (budget < 0){
+            sort(order.begin(), order.end(), [this](int a, int b){ return min_x[a] < min_x[b]; });
+            return;
+        }
+    }
+}
+
+
+/**
+ * Self-collision with sweep and prune. Links are swept by increasing min x;
+ * only links whose x intervals overlap are compared, first on their y
+ * intervals and then exactly. O(n log n) plus the number of overlapping
+ * x intervals, chains shorter than SELF_COLLISION_NAIVE_MAX_LINKS use the
+ * pairwise test.
+ *
+ * @param[in] num_links Number of links.
+ * @param[in] joint_x Array of num_links + 1 joint x positions, base first.
+ * @param[in] joint_y Array of num_links + 1 joint y positions, base first.
+ * @param[out] link_a Lower index of a colliding pair, may be null.
+ * @param[out] link_b Higher index of a colliding pair, may be null.
+ * @return bool: true if two non adjacent links intersect.
+ */
+bool SelfCollisionChecker::check(int num_links, const double *joint_x, const double *joint_y,
+                                int *link_a, int *link_b){
+    if (num_links <= SELF_COLLISION_NAIVE_MAX_LINKS){
+        return compute_self_collision_naive(num_links, joint_x, joint_y, link_a, link_b);
+    }
+    min_x.resize(num_links);
+    max_x.resize(num_links);
+    min_y.resize(num_links);
+    max_y.resize(num_links);
+    for (int i = 0; i < num_links; i += 1){
+        min_x[i] = min(joint_x[i], joint_x[i + 1]);
+        max_x[i] = max(joint_x[i], joint_x[i + 1]);
+        min_y[i] = min(joint_y[i], joint_y[i + 1]);
+        max_y[i] = max(joint_y[i], joint_y[i + 1]);
+    }
+    sort_order(num_links);
+
+    active.clear();
+    for (int k = 0; k < num_links; k += 1){
+        int link = order[k];
+        // Drop links that end before this one starts
+        for (size_t a = 0; a < active.size(); ){
+            if (max_x[active[a]] < min_x[link]){
+                active[a] = active.back();
+                active.pop_back();
+            }
+            else{
+                a += 1;
+            }
+        }
+        for (size_t a = 0; a < active.size(); a += 1){
+            int other = active[a];
+            if (other == link - 1 || other == link + 1
+                    || max_y[other] < min_y[link] || min_y[other] > max_y[link]){
+                continue;
+            }
+            if (links_intersect(joint_x, joint_y, link, other)){
+                if (link_a){
+                    *link_a = min(link, other);
+                }
+                if (link_b){
+                    *link_b = max(link, other);
+                }
+                return true;
+            }
+        }
+        active.push_back(link);
+    }
+    return false;
+}
@@ -0,0 +1,617 @@
+/********
+ * socket_server.cpp
+ * Author: Simon Chamorro
+ * Binary request server over a Unix domain socket
+ *
+ * Clients are non-blocking sockets watched by one epoll instance. Input is
+ * appended to a per-client buffer; every complete request in it is answered
+ * in order into an output buffer, which is written until the socket would
+ * block. Output left over arms EPOLLOUT, and reading stops while more than
+ * max_output_bytes are waiting, so a client that never reads cannot make
+ * the server buffer without bound.
+********/
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "manipulator.h"
+#include "numerical_ik.h"
+#include "robot_configuration.h"
+#include "socket_server.h"
+
+using namespace std;
+
+// Bytes read from a socket at a time
+const size_t SOCKET_READ_BYTES = 1 << 16;
+
+// Consumed input is only moved out of the buffer past this size
+const size_t SOCKET_COMPACT_BYTES = 1 << 16;
+
+const int SOCKET_MAX_EVENTS = 64;
+
+
+SocketServerOptions default_socket_server_options(){
+    SocketServerOptions options;
+    options.backlog = 128;
+    options.max_output_bytes = 1 << 20;
+    return options;
+}
+
+
+struct SocketServer::Connection{
+
+    int fd;
+    vector<unsigned char> input;
+    size_t input_start;
+    vector<unsigned char> output;
+    size_t output_start;
+    bool closing;       // Close once output is written
+    bool peer_closed;   // EPOLLRDHUP seen, the client sends nothing more
+    uint32_t events;    // Events registered with epoll
+    Manipulator manipulator;
+    vector<double> args;
+    LinkArray result;
+    LinkArray other;
+};
+
+
+// Header and payload of one message, appended to a buffer
+static void append_message(vector<unsigned char> &buffer, uint16_t opcode, uint16_t status,
+                        uint64_t id, const double *values, int count){
+    uint32_t payload = (uint32_t)(sizeof(double)*count);
+    size_t at = buffer.size();
+    buffer.resize(at + SOCKET_HEADER_BYTES + payload);
+    unsigned char *p = &buffer[at];
+    memcpy(p, &payload, 4);
+    memcpy(p + 4, &opcode, 2);
+    memcpy(p + 6, &status, 2);
+    memcpy(p + 8, &id, 8);
+    if (count > 0){
+        memcpy(p + SOCKET_HEADER_BYTES, values, payload);
+    }
+}
+
+
+SocketServer::SocketServer() : listen_fd(-1), epoll_fd(-1), stop_fd(-1),
+                               options(default_socket_server_options()){
+    socket_path[0] = '\0';
+    memset(&stats, 0, sizeof(stats));
+}
+
+
+SocketServer::~SocketServer(){
+    close();
+}
+
+
+bool SocketServer::listen(const char *path){
+    return listen(path, default_socket_server_options());
+}
+
+
+/**
+ * Bind a Unix domain socket, replacing any file at path, and get ready to
+ * run. The socket file is removed by close.
+ *
+ * @param[in] path Socket path, shorter than 108 bytes.
+ * @param[in] options Listen backlog and output limit per client.
+ * @return bool: true if listening, false otherwise.
+ */
+bool SocketServer::listen(const char *path, const SocketServerOptions &options){
+    close();
+    if (strlen(path) >= sizeof(socket_path)){
+        return false;
+    }
+    this->options = options;
+    memset(&stats, 0, sizeof(stats));
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen_fd < 0 || epoll_fd < 0 || stop_fd < 0){
+        close();
+        return false;
+    }
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0){
+        close();
+        return false;
+    }
+    strcpy(socket_path, path);
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    bool ok = ::listen(listen_fd, options.backlog) == 0
+        && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event) == 0;
+    event.data.fd = stop_fd;
+    ok = ok && epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &event) == 0;
+    if (!ok){
+        close();
+    }
+    return ok;
+}
+
+
+/**
+ * Serve clients until stop is called.
+ *
+ * @return bool: true after stop, false if not listening or epoll failed.
+ */
+bool SocketServer::run(){
+    if (listen_fd < 0){
+        return false;
+    }
+    struct epoll_event events[SOCKET_MAX_EVENTS];
+    while (true){
+        int count = epoll_wait(epoll_fd, events, SOCKET_MAX_EVENTS, -1);
+        if (count < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return false;
+        }
+        for (int i = 0; i < count; i += 1){
+            int fd = events[i].data.fd;
+            if (fd == stop_fd){
+                uint64_t value;
+                ssize_t ignored = read(stop_fd, &value, sizeof(value));
+                (void)ignored;
+                return true;
+            }
+            if (fd == listen_fd){
+                accept_clients();
+            }
+            else if (fd < (int)connections.size() && connections[fd]){
+                handle(*connections[fd], events[i].events);
+            }
+        }
+    }
+}
+
+
+// Make run return. Only writes to an eventfd, so it is safe from any thread
+// and from signal handlers.
+void SocketServer::stop(){
+    if (stop_fd >= 0){
+        uint64_t one = 1;
+        ssize_t ignored = write(stop_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+
+// Close every client and the listening socket, and remove the socket file
+void SocketServer::close(){
+    for (size_t fd = 0; fd < connections.size(); fd += 1){
+        if (connections[fd]){
+            drop((int)fd);
+        }
+    }
+    connections.clear();
+    if (listen_fd >= 0){
+        ::close(listen_fd);
+        listen_fd = -1;
+    }
+    if (epoll_fd >= 0){
+        ::close(epoll_fd);
+        epoll_fd = -1;
+    }
+    if (stop_fd >= 0){
+        ::close(stop_fd);
+        stop_fd = -1;
+    }
+    if (socket_path[0]){
+        unlink(socket_path);
+        socket_path[0] = '\0';
+    }
+}
+
+
+// Counters, read them from the thread running run or once it returned
+SocketServerStats SocketServer::get_stats() const{
+    return stats;
+}
+
+
+void SocketServer::accept_clients(){
+    while (true){
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        Connection *connection = new Connection();
+        connection->fd = fd;
+        connection->input_start = 0;
+        connection->output_start = 0;
+        connection->closing = false;
+        connection->peer_closed = false;
+        connection->events = EPOLLIN | EPOLLRDHUP;
+
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = connection->events;
+        event.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0){
+            ::close(fd);
+            delete connection;
+            continue;
+        }
+        if ((int)connections.size() <= fd){
+            connections.resize(fd + 1, NULL);
+        }
+        connections[fd] = connection;
+        stats.connections += 1;
+        stats.active += 1;
+    }
+}
+
+
+void SocketServer::drop(int fd){
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    ::close(fd);
+    delete connections[fd];
+    connections[fd] = NULL;
+    stats.active -= 1;
+}
+
+
+// Read everything available, answer complete requests and write back
+void SocketServer::handle(Connection &connection, uint32_t events){
+    int fd = connection.fd;
+    if (events & EPOLLERR){
+        drop(fd);
+        return;
+    }
+    if (events & EPOLLRDHUP){
+        connection.peer_closed = true;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP)){
+        unsigned char buffer[SOCKET_READ_BYTES];
+        while (!connection.closing
+                && connection.output.size() - connection.output_start < options.max_output_bytes){
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n > 0){
+                connection.input.insert(connection.input.end(), buffer, buffer + n);
+                stats.bytes_in += n;
+                process(connection);
+            }
+            else if (n == 0){
+                connection.closing = true;
+            }
+            else if (errno == EINTR){
+                continue;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK){
+                break;
+            }
+            else{
+                drop(fd);
+                return;
+            }
+        }
+    }
+    if (!flush(connection)){
+        drop(fd);
+        return;
+    }
+    if (connection.closing && connection.output.empty()){
+        drop(fd);
+        return;
+    }
+    update_events(connection);
+}
+
+
+// False if a value is not finite or beyond SOCKET_MAX_VALUE
+static bool values_in_range(const double *values, int count){
+    bool in_range = true;
+    for (int i = 0; i < count; i += 1){
+        in_range = in_range && fabs(values[i]) <= SOCKET_MAX_VALUE;
+    }
+    return in_range;
+}
+
+
+// Answer every complete request in the input buffer
+void SocketServer::process(Connection &connection){
+    Manipulator &manipulator = connection.manipulator;
+    while (!connection.closing){
+        size_t available = connection.input.size() - connection.input_start;
+        if (available < SOCKET_HEADER_BYTES){
+            break;
+        }
+        const unsigned char *p = &connection.input[connection.input_start];
+        uint32_t payload;
+        uint16_t opcode;
+        uint64_t id;
+        memcpy(&payload, p, 4);
+        memcpy(&opcode, p + 4, 2);
+        memcpy(&id, p + 8, 8);
+        if (payload % sizeof(double) != 0 || payload > SOCKET_MAX_PAYLOAD_BYTES){
+            append_message(connection.output, opcode, STATUS_BAD_REQUEST, id, NULL, 0);
+            connection.closing = true;
+            break;
+        }
+        if (available < SOCKET_HEADER_BYTES + payload){
+            break;
+        }
+        int count = payload / sizeof(double);
+        connection.args.resize(count > 0 ? count : 1);
+        memcpy(&connection.args[0], p + SOCKET_HEADER_BYTES, payload);
+        connection.input_start += SOCKET_HEADER_BYTES + payload;
+
+        double *args = &connection.args[0];
+        const Configuration &config = manipulator.get_config_ref();
+        int n = config.num_links;
+        connection.result.resize(n > 6 ? n : 6);
+        connection.other.resize(n > 3 ? n : 3);
+        double *result = connection.result;
+        int result_count = 0;
+        uint16_t status = STATUS_OK;
+
+        // Checked before dispatching, wraps and solvers assume finite input
+        if (!values_in_range(args, count)){
+            append_message(connection.output, opcode, STATUS_BAD_REQUEST, id, NULL, 0);
+            stats.requests += 1;
+            continue;
+        }
+
+        switch (opcode){
+            case OP_PING:
+                break;
+            case OP_RESET:
+                manipulator.reset();
+                break;
+            case OP_LINKS:
+                if (count < 1 || !manipulator.set_parameters(count, args)){
+                    status = STATUS_BAD_REQUEST;
+                }
+                break;
+            case OP_FORWARD:
+                if (count == n){
+                    manipulator.forward_kinematics(args);
+                    result[0] = config.x;
+                    result[1] = config.y;
+                    result[2] = config.theta;
+                    result_count = 3;
+                }
+                else{
+                    status = STATUS_BAD_REQUEST;
+                }
+                break;
+            case OP_INTERSECTION:
+                if (count == n + 3){
+                    result[0] = manipulator.intersection(args[0], args[1], args[2], args + 3);
+                    result_count = 1;
+                }
+                else{
+                    status = STATUS_BAD_REQUEST;
+                }
+                break;
+            case OP_INVERSE_K:
+                if (count != 3){
+                    status = STATUS_BAD_REQUEST;
+                }
+                else if (n == 3){
+                    double *other = connection.other;
+                    if (manipulator.inverse_kinematics(args[0], args[1], args[2], result, other)
+                            && result[1] == result[1]){
+                        memcpy(result + 3, other, sizeof(double)*3);
+                        result_count = 6;
+                    }
+                    else{
+                        status = STATUS_UNREACHABLE;
+                    }
+                }
+                else if (manipulator.inverse_kinematics_numerical(args[0], args[1], args[2], result,
+                                                            default_ik_solver_options(), NULL)){
+                    result_count = n;
+                }
+                else{
+                    status = STATUS_UNREACHABLE;
+                }
+                break;
+            case OP_INVERSE_D:
+                if (count == 3 && manipulator.inverse_dynamics(args[0], args[1], args[2], result)){
+                    result_count = n;
+                }
+                else{
+                    status = STATUS_BAD_REQUEST;
+                }
+                break;
+            default:
+                status = STATUS_UNKNOWN_OPCODE;
+                break;
+        }
+        append_message(connection.output, opcode, status, id, result, result_count);
+        stats.requests += 1;
+    }
+
+    if (connection.input_start == connection.input.size()){
+        connection.input.clear();
+        connection.input_start = 0;
+    }
+    else if (connection.input_start > SOCKET_COMPACT_BYTES){
+        connection.input.erase(connection.input.begin(),
+                            connection.input.begin() + connection.input_start);
+        connection.input_start = 0;
+    }
+}
+
+
+// Write pending output until done or the socket would block
+bool SocketServer::flush(Connection &connection){
+    while (connection.output_start < connection.output.size()){
+        ssize_t n = send(connection.fd, &connection.output[connection.output_start],
+                        connection.output.size() - connection.output_start, MSG_NOSIGNAL);
+        if (n > 0){
+            connection.output_start += n;
+            stats.bytes_out += n;
+        }
+        else if (n < 0 && errno == EINTR){
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return true;
+        }
+        else{
+            return false;
+        }
+    }
+    connection.output.clear();
+    connection.output_start = 0;
+    return true;
+}
+
+
+// Read while output is below the limit, wait for writability while any is left.
+// EPOLLRDHUP is level-triggered: once seen it is dropped, else a half-closed
+// client that does not read would wake the loop until its output drains.
+// EPOLLIN still reports the end of input once there is room to read it.
+void SocketServer::update_events(Connection &connection){
+    size_t pending = connection.output.size() - connection.output_start;
+    uint32_t events = 0;
+    if (!connection.closing && !connection.peer_closed){
+        events |= EPOLLRDHUP;
+    }
+    if (!connection.closing && pending < options.max_output_bytes){
+        events |= EPOLLIN;
+    }
+    if (pending > 0){
+        events |= EPOLLOUT;
+    }
+    if (events != connection.events){
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = events;
+        event.data.fd = connection.fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.events = events;
+    }
+}
+
+
+// Client
+
+SocketClient::SocketClient() : fd(-1){
+}
+
+
+SocketClient::~SocketClient(){
+    close();
+}
+
+
+bool SocketClient::connect(const char *path){
+    close();
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)){
+        return false;
+    }
+    strcpy(address.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0){
+        return false;
+    }
+    if (::connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0){
+        close();
+        return false;
+    }
+    return true;
+}
+
+
+void SocketClient::close(){
+    if (fd >= 0){
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+
+/**
+ * Send one request without waiting for its response.
+ *
+ * @param[in] opcode SocketOpcode of the request.
+ * @param[in] id Echoed in the response.
+ * @param[in] values Request values.
+ * @param[in] count Number of values.
+ * @return bool: true if the request was written.
+ */
+bool SocketClient::send(uint16_t opcode, uint64_t id, const double *values, int count){
+    if (fd < 0 || count < 0){
+        return false;
+    }
+    vector<unsigned char> message;
+    append_message(message, opcode, STATUS_OK, id, values, count);
+    size_t done = 0;
+    while (done < message.size()){
+        ssize_t n = ::send(fd, &message[done], message.size() - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0){
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+
+// Read exactly size bytes
+static bool read_all(int fd, unsigned char *data, size_t size){
+    size_t done = 0;
+    while (done < size){
+        ssize_t n = recv(fd, data + done, size - done, 0);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0){
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+
+/**
+ * Wait for the next response, responses arrive in request order.
+ *
+ * @param[out] response Opcode, status, id and values of the response.
+ * @return bool: true if a whole response was read.
+ */
+bool SocketClient::receive(SocketResponse &response){
+    unsigned char header[SOCKET_HEADER_BYTES];
+    if (fd < 0 || !read_all(fd, header, sizeof(header))){
+        return false;
+    }
+    uint32_t payload;
+    memcpy(&payload, header, 4);
+    memcpy(&response.opcode, header + 4, 2);
+    memcpy(&response.status, header + 6, 2);
+    memcpy(&response.id, header + 8, 8);
+    if (payload % sizeof(double) != 0 || payload > SOCKET_MAX_PAYLOAD_BYTES){
+        return false;
+    }
+    response.values.resize(payload / sizeof(double));
+    return payload == 0 || read_all(fd, (unsigned char *)&response.values[0], payload);
+}
@@ -0,0 +1,551 @@
+/********
+ * thread_pool.cpp
+ * Author: Simon Chamorro
+ * Work-stealing thread pool for batch kinematics jobs
+ *
+ * Each worker owns a queue of chunks, runs them from the front and, once
+ * empty, steals from the back of other queues so the chunks it takes are
+ * the ones their owner would reach last. On Linux the NUMA topology is read
+ * from sysfs; workers are ordered node by node, so contiguous runs of a job,
+ * and thieves, stay on one node as long as possible.
+********/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "batch_kinematics.h"
+#include "obstacle_set.h"
+#include "robot_configuration.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Chunks are a multiple of this many items, so SIMD kernels run full vectors
+const int THREAD_POOL_CHUNK_ALIGNMENT = 16;
+
+
+struct ThreadPool::Worker{
+
+    thread handle;
+    int cpu;
+    int node;
+    vector<int> victims;    // Queues to steal from, same node first
+
+    mutex guard;
+    deque<pair<int, int> > chunks;
+
+    atomic<uint64_t> chunks_run;
+    atomic<uint64_t> chunks_stolen;
+    atomic<uint64_t> busy_ns;
+};
+
+
+struct ThreadPool::Job{
+
+    mutex run_guard;        // One parallel_for at a time
+    mutex guard;
+    condition_variable wake;
+    condition_variable done;
+    int generation;
+    bool stopping;
+    atomic<int> remaining;
+    const function<void(int, int)> *body;
+    chrono::steady_clock::time_point stats_start;
+};
+
+
+ThreadPoolOptions default_thread_pool_options(){
+    ThreadPoolOptions options;
+    options.threads = 0;
+    options.pinning = PIN_NONE;
+    options.chunk_bytes = THREAD_POOL_CHUNK_BYTES;
+    return options;
+}
+
+
+#ifdef __linux__
+// Parse a sysfs CPU list such as "0-3,8,10-11"
+static vector<int> parse_cpu_list(const char *text){
+    vector<int> cpus;
+    const char *p = text;
+    while (*p >= '0' && *p <= '9'){
+        char *end;
+        int first = strtol(p, &end, 10);
+        int last = first;
+        if (*end == '-'){
+            last = strtol(end + 1, &end, 10);
+        }
+        for (int cpu = first; cpu <= last; cpu += 1){
+            cpus.push_back(cpu);
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return cpus;
+}
+#endif
+
+
+/**
+ * CPUs the process may run on, ordered node by node, with the NUMA node of
+ * each. Nodes are numbered from 0 in order, skipping nodes with no usable
+ * CPU. Without NUMA information every CPU is on node 0.
+ *
+ * @param[out] cpus Usable CPUs.
+ * @param[out] nodes Node of each CPU.
+ * @return number of nodes.
+ */
+static int read_topology(vector<int> &cpus, vector<int> &nodes){
+    cpus.clear();
+    nodes.clear();
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0){
+        return 1;
+    }
+    vector<int> node_ids;
+    DIR *dir = opendir("/sys/devices/system/node");
+    if (dir){
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL){
+            int id;
+            char tail;
+            if (sscanf(entry->d_name, "node%d%c", &id, &tail) == 1){
+                node_ids.push_back(id);
+            }
+        }
+        closedir(dir);
+    }
+    sort(node_ids.begin(), node_ids.end());
+
+    vector<bool> placed(CPU_SETSIZE, false);
+    int num_nodes = 0;
+    for (size_t i = 0; i < node_ids.size(); i += 1){
+        char path[64];
+        char list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node_ids[i]);
+        FILE *file = fopen(path, "r");
+        if (!file){
+            continue;
+        }
+        bool read = fgets(list, sizeof(list), file) != NULL;
+        fclose(file);
+        if (!read){
+            continue;
+        }
+        vector<int> node_cpus = parse_cpu_list(list);
+        bool used = false;
+        for (size_t k = 0; k < node_cpus.size(); k += 1){
+            int cpu = node_cpus[k];
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed) && !placed[cpu]){
+                cpus.push_back(cpu);
+                nodes.push_back(num_nodes);
+                placed[cpu] = true;
+                used = true;
+            }
+        }
+        num_nodes += used ? 1 : 0;
+    }
+    // CPUs sysfs did not list, or no NUMA information at all
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu += 1){
+        if (CPU_ISSET(cpu, &allowed) && !placed[cpu]){
+            cpus.push_back(cpu);
+            nodes.push_back(num_nodes > 0 ? num_nodes - 1 : 0);
+        }
+    }
+    return (num_nodes > 0) ? num_nodes : 1;
+#else
+    return 1;
+#endif
+}
+
+
+ThreadPool::ThreadPool(){
+    start(default_thread_pool_options());
+}
+
+
+ThreadPool::ThreadPool(const ThreadPoolOptions &options){
+    start(options);
+}
+
+
+ThreadPool::~ThreadPool(){
+    {
+        lock_guard<mutex> lock(job->guard);
+        job->stopping = true;
+    }
+    job->wake.notify_all();
+    for (size_t w = 0; w < workers.size(); w += 1){
+        workers[w]->handle.join();
+    }
+}
+
+
+// Create the workers, pin them and set their stealing order
+void ThreadPool::start(const ThreadPoolOptions &options){
+    this->options = options;
+    if (this->options.chunk_bytes < 1){
+        this->options.chunk_bytes = THREAD_POOL_CHUNK_BYTES;
+    }
+    job.reset(new Job());
+    job->generation = 0;
+    job->stopping = false;
+    job->remaining = 0;
+    job->body = NULL;
+    job->stats_start = chrono::steady_clock::now();
+
+    vector<int> cpus, nodes;
+    num_nodes = read_topology(cpus, nodes);
+    int threads = options.threads;
+    if (threads <= 0){
+        threads = cpus.empty() ? (int)thread::hardware_concurrency() : (int)cpus.size();
+        threads = (threads > 0) ? threads : 1;
+    }
+
+    for (int w = 0; w < threads; w += 1){
+        Worker *worker = new Worker();
+        worker->cpu = -1;
+        worker->node = 0;
+        if (options.pinning != PIN_NONE && !cpus.empty()){
+            int k = w % (int)cpus.size();
+            worker->cpu = (options.pinning == PIN_CORES) ? cpus[k] : -1;
+            worker->node = nodes[k];
+        }
+        worker->chunks_run = 0;
+        worker->chunks_stolen = 0;
+        worker->busy_ns = 0;
+        workers.push_back(unique_ptr<Worker>(worker));
+    }
+    if (options.pinning == PIN_NONE || cpus.empty()){
+        num_nodes = 1;
+    }
+
+    for (int w = 0; w < threads; w += 1){
+        for (int pass = 0; pass < 2; pass += 1){
+            for (int k = 1; k < threads; k += 1){
+                int v = (w + k) % threads;
+                if ((workers[v]->node == workers[w]->node) == (pass == 0)){
+                    workers[w]->victims.push_back(v);
+                }
+            }
+        }
+    }
+
+    for (int w = 0; w < threads; w += 1){
+        Worker &worker = *workers[w];
+        worker.handle = thread(&ThreadPool::run_worker, this, w);
+#ifdef __linux__
+        if (options.pinning != PIN_NONE && !cpus.empty()){
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (size_t k = 0; k < cpus.size(); k += 1){
+                bool same = (options.pinning == PIN_CORES) ? cpus[k] == worker.cpu
+                                                           : nodes[k] == worker.node;
+                if (same){
+                    CPU_SET(cpus[k], &set);
+                }
+            }
+            pthread_setaffinity_np(worker.handle.native_handle(), sizeof(set), &set);
+        }
+#endif
+    }
+}
+
+
+int ThreadPool::size() const{
+    return (int)workers.size();
+}
+
+
+// NUMA nodes workers are spread over, 1 without pinning
+int ThreadPool::get_num_nodes() const{
+    return num_nodes;
+}
+
+
+/**
+ * Items per chunk so that one chunk uses about options.chunk_bytes,
+ * a multiple of THREAD_POOL_CHUNK_ALIGNMENT.
+ *
+ * @param[in] bytes_per_item Bytes read and written per item.
+ * @return chunk size in items.
+ */
+int ThreadPool::chunk_size(size_t bytes_per_item) const{
+    size_t items = options.chunk_bytes / (bytes_per_item > 0 ? bytes_per_item : 1);
+    items -= items % THREAD_POOL_CHUNK_ALIGNMENT;
+    return (items > (size_t)THREAD_POOL_CHUNK_ALIGNMENT) ? (int)items
+                                                         : THREAD_POOL_CHUNK_ALIGNMENT;
+}
+
+
+/**
+ * Run body over [0, count) cut in chunks of at most chunk items, and wait
+ * until every chunk is done. Worker w starts with the w-th run of chunks.
+ * A job of a single chunk, or any job of a pool of one worker, runs on the
+ * calling thread.
+ *
+ * @param[in] count Number of items.
+ * @param[in] chunk Items per chunk.
+ * @param[in] body Called with [begin, end) of each chunk, from any worker.
+ */
+void ThreadPool::parallel_for(int count, int chunk, const function<void(int, int)> &body){
+    if (count <= 0){
+        return;
+    }
+    chunk = (chunk > 0) ? chunk : 1;
+    int num_chunks = (int)(((long)count + chunk - 1) / chunk);
+    if (num_chunks == 1){
+        body(0, count);
+        return;
+    }
+    if (workers.size() == 1){
+        // Nothing to balance, skip the hand-off but keep the counters
+        Worker &worker = *workers[0];
+        for (int begin = 0; begin < count; begin += chunk){
+            int end = (count - begin < chunk) ? count : begin + chunk;
+            chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+            body(begin, end);
+            chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+            worker.busy_ns += chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count();
+            worker.chunks_run += 1;
+        }
+        return;
+    }
+
+    lock_guard<mutex> run_lock(job->run_guard);
+    job->body = &body;
+    job->remaining = num_chunks;
+    int threads = (int)workers.size();
+    for (int w = 0; w < threads; w += 1){
+        lock_guard<mutex> lock(workers[w]->guard);
+        int first = (int)((long)num_chunks*w / threads);
+        int last = (int)((long)num_chunks*(w + 1) / threads);
+        for (int c = first; c < last; c += 1){
+            int begin = c*chunk;
+            int end = (count - begin < chunk) ? count : begin + chunk;
+            workers[w]->chunks.push_back(make_pair(begin, end));
+        }
+    }
+    {
+        lock_guard<mutex> lock(job->guard);
+        job->generation += 1;
+    }
+    job->wake.notify_all();
+
+    unique_lock<mutex> lock(job->guard);
+    job->done.wait(lock, [&]{ return job->remaining.load() == 0; });
+}
+
+
+// Next chunk for worker w, from its own queue or stolen from another
+bool ThreadPool::next_chunk(int w, int &begin, int &end, bool &stolen){
+    Worker &worker = *workers[w];
+    {
+        lock_guard<mutex> lock(worker.guard);
+        if (!worker.chunks.empty()){
+            begin = worker.chunks.front().first;
+            end = worker.chunks.front().second;
+            worker.chunks.pop_front();
+            stolen = false;
+            return true;
+        }
+    }
+    for (size_t k = 0; k < worker.victims.size(); k += 1){
+        Worker &victim = *workers[worker.victims[k]];
+        lock_guard<mutex> lock(victim.guard);
+        if (!victim.chunks.empty()){
+            begin = victim.chunks.back().first;
+            end = victim.chunks.back().second;
+            victim.chunks.pop_back();
+            stolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Worker loop: sleep until a job starts, run chunks until none are left
+void ThreadPool::run_worker(int w){
+    Worker &worker = *workers[w];
+    int seen = 0;
+    while (true){
+        {
+            unique_lock<mutex> lock(job->guard);
+            job->wake.wait(lock, [&]{ return job->stopping || job->generation != seen; });
+            if (job->stopping){
+                return;
+            }
+            seen = job->generation;
+        }
+        int begin, end;
+        bool stolen;
+        while (next_chunk(w, begin, end, stolen)){
+            chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+            (*job->body)(begin, end);
+            chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+            worker.busy_ns += chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count();
+            worker.chunks_run += 1;
+            worker.chunks_stolen += stolen ? 1 : 0;
+            if (job->remaining.fetch_sub(1) == 1){
+                lock_guard<mutex> lock(job->guard);
+                job->done.notify_all();
+            }
+        }
+    }
+}
+
+
+/**
+ * Counters of one worker, for capacity planning.
+ *
+ * @param[in] worker Index of the worker, from 0 to size() - 1.
+ * @return counters since the pool started or since reset_stats.
+ */
+WorkerStats ThreadPool::get_worker_stats(int worker) const{
+    WorkerStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (worker < 0 || worker >= (int)workers.size()){
+        stats.cpu = -1;
+        return stats;
+    }
+    const Worker &w = *workers[worker];
+    stats.cpu = w.cpu;
+    stats.node = w.node;
+    stats.chunks = w.chunks_run;
+    stats.stolen = w.chunks_stolen;
+    stats.busy_seconds = w.busy_ns * 1e-9;
+    chrono::steady_clock::time_point start;
+    {
+        lock_guard<mutex> lock(job->guard);
+        start = job->stats_start;
+    }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    stats.utilization = (elapsed > 0) ? stats.busy_seconds / elapsed : 0.0;
+    return stats;
+}
+
+
+void ThreadPool::reset_stats(){
+    lock_guard<mutex> lock(job->guard);
+    for (size_t w = 0; w < workers.size(); w += 1){
+        workers[w]->chunks_run = 0;
+        workers[w]->chunks_stolen = 0;
+        workers[w]->busy_ns = 0;
+    }
+    job->stats_start = chrono::steady_clock::now();
+}
+
+
+// Batch jobs
+
+/**
+ * forward_kinematics_batch split across a pool, in chunks that keep the
+ * angles and pose of a chunk in cache. Same results as the single thread call.
+ *
+ * @return bool: true if success, false otherwise.
+ */
+bool forward_kinematics_batch(ThreadPool &pool, const Configuration &config, int count,
+                            const double *const *angles,
+                            double *x, double *y, double *theta){
+    int n = config.num_links;
+    if (count < 0 || n < 1){
+        return false;
+    }
+    pool.parallel_for(count, pool.chunk_size(sizeof(double)*(n + 3)), [&](int begin, int end){
+        vector<const double *> block(n);
+        for (int j = 0; j < n; j += 1){
+            block[j] = angles[j] + begin;
+        }
+        forward_kinematics_batch(config, end - begin, &block[0], x + begin, y + begin,
+                                theta + begin);
+    });
+    return true;
+}
+
+
+/**
+ * inverse_kinematics_batch split across a pool, for a 3 links robot.
+ *
+ * @return bool: true if success, false otherwise.
+ */
+bool inverse_kinematics_batch(ThreadPool &pool, const Configuration &config, int count,
+                            const double *x, const double *y, const double *theta,
+                            double *const *angles_1, double *const *angles_2,
+                            unsigned char *reachable){
+    if (count < 0 || config.num_links != 3){
+        return false;
+    }
+    pool.parallel_for(count, pool.chunk_size(sizeof(double)*9 + 1), [&](int begin, int end){
+        double *block_1[3];
+        double *block_2[3];
+        for (int j = 0; j < 3; j += 1){
+            block_1[j] = angles_1[j] + begin;
+            block_2[j] = angles_2[j] + begin;
+        }
+        inverse_kinematics_batch(config, end - begin, x + begin, y + begin, theta + begin,
+                                block_1, block_2, reachable + begin);
+    });
+    return true;
+}
+
+
+/**
+ * ObstacleSet::intersection_batch split across a pool.
+ *
+ * @return bool: true if success, false otherwise.
+ */
+bool intersection_batch(ThreadPool &pool, const ObstacleSet &obstacles,
+                        const Configuration &config, int count,
+                        const double *const *angles, unsigned char *hits){
+    int n = config.num_links;
+    if (count < 0 || n < 1){
+        return false;
+    }
+    pool.parallel_for(count, pool.chunk_size(sizeof(double)*n + 1), [&](int begin, int end){
+        vector<const double *> block(n);
+        for (int j = 0; j < n; j += 1){
+            block[j] = angles[j] + begin;
+        }
+        obstacles.intersection_batch(config, end - begin, &block[0], hits + begin);
+    });
+    return true;
+}
+
+
+/**
+ * inverse_dynamics_batch split across a pool, each chunk takes a share of
+ * the wrenches and computes the joint positions once.
+ *
+ * @return bool: true if success, false otherwise.
+ */
+bool inverse_dynamics_batch(ThreadPool &pool, const Configuration &config, const double *angles,
+                            int count, const double *fx, const double *fy, const double *tau,
+                            double *const *torques){
+    int n = config.num_links;
+    if (count < 0 || n < 1){
+        return false;
+    }
+    pool.parallel_for(count, pool.chunk_size(sizeof(double)*(n + 3)), [&](int begin, int end){
+        vector<double *> block(n);
+        for (int j = 0; j < n; j += 1){
+            block[j] = torques[j] + begin;
+        }
+        inverse_dynamics_batch(config, angles, end - begin, fx + begin, fy + begin, tau + begin,
+                            &block[0]);
+    });
+    return true;
+}
@@ -0,0 +1,376 @@
+/********
+ * velocity_controller.cpp
+ * Author: Simon Chamorro
+ * Resolved-rate velocity control loop on a fixed-period thread
+ *
+ * The loop thread owns its working angles and only takes the state lock to
+ * read the commanded twist and to publish the integrated angles, so readers
+ * never stall a cycle for longer than a copy. Release times are absolute:
+ * period k starts at start + k*period, whatever the previous cycles took.
+********/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#endif
+#include "kinematics.h"
+#include "numerical_ik.h"
+#include "robot_configuration.h"
+#include "velocity_controller.h"
+
+#define PI 3.14159265359
+
+using namespace std;
+
+
+struct VelocityController::Loop{
+
+    thread worker;
+    atomic<bool> running;
+
+    // Shared with callers, under state_guard
+    mutable mutex state_guard;
+    Twist twist;
+    vector<double> angles;
+    vector<double> velocities;
+
+    // Used by the loop thread only
+    vector<double> work_angles;
+    vector<double> work_velocities;
+    vector<double> jacobian;
+
+    mutable mutex stats_guard;
+    uint64_t cycles;
+    uint64_t overruns;
+    uint64_t missed_periods;
+    double jitter_sum_us;
+    double compute_sum_us;
+    double max_compute_us;
+    bool realtime;
+    vector<double> jitters;
+    size_t jitter_next;
+};
+
+
+VelocityControllerOptions default_velocity_controller_options(){
+    VelocityControllerOptions options;
+    options.rate_hz = 1000.0;
+    options.damping = 1e-3;
+    options.orientation_weight = 1.0;
+    options.max_joint_speed = 0.0;
+    options.spin_us = 0.0;
+    options.priority = 0;
+    return options;
+}
+
+
+/**
+ * Joint velocities of a resolved-rate step, with damped least squares:
+ * qdot = J^T (J J^T + damping^2 I)^-1 twist. The orientation row of J and
+ * the angular rate are scaled by orientation_weight so both are lengths.
+ *
+ * @param[in] num_links Number of links.
+ * @param[in] jacobian Row major 3 x num_links matrix from compute_jacobian.
+ * @param[in] twist Desired end effector velocity.
+ * @param[in] damping Damping factor, same unit as links.
+ * @param[in] orientation_weight Length unit per radian of orientation rate.
+ * @param[out] velocities Joint velocities (deg/s).
+ * @return bool: false if num_links is not positive.
+ */
+bool compute_joint_velocities(int num_links, const double *jacobian, const Twist &twist,
+                            double damping, double orientation_weight, double *velocities){
+    if (num_links < 1){
+        return false;
+    }
+    const double w = orientation_weight;
+    const double *jac_x = jacobian;
+    const double *jac_y = jacobian + num_links;
+    const double *jac_t = jacobian + 2*num_links;
+
+    double a[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+    for (int i = 0; i < num_links; i += 1){
+        double t = w*jac_t[i];
+        a[0][0] += jac_x[i]*jac_x[i];
+        a[0][1] += jac_x[i]*jac_y[i];
+        a[0][2] += jac_x[i]*t;
+        a[1][1] += jac_y[i]*jac_y[i];
+        a[1][2] += jac_y[i]*t;
+        a[2][2] += t*t;
+    }
+    a[0][0] += damping*damping;
+    a[1][1] += damping*damping;
+    a[2][2] += damping*damping;
+    a[1][0] = a[0][1];
+    a[2][0] = a[0][2];
+    a[2][1] = a[1][2];
+
+    double b[3] = {twist.vx, twist.vy, w*twist.omega*PI/180.0};
+    double v[3];
+    solve_3x3(a, b, v);
+    for (int i = 0; i < num_links; i += 1){
+        velocities[i] = (jac_x[i]*v[0] + jac_y[i]*v[1] + w*jac_t[i]*v[2]) * 180.0/PI;
+    }
+    return true;
+}
+
+
+VelocityController::VelocityController(const Configuration &config, const double *angles)
+    : VelocityController(config, angles, default_velocity_controller_options()){
+}
+
+
+VelocityController::VelocityController(const Configuration &config, const double *angles,
+                                    const VelocityControllerOptions &options)
+    : config(config), options(options), loop(new Loop){
+    int n = config.num_links > 0 ? config.num_links : 0;
+    loop->running = false;
+    loop->twist.vx = loop->twist.vy = loop->twist.omega = 0.0;
+    loop->angles.assign(angles, angles + n);
+    loop->velocities.assign(n, 0.0);
+    loop->work_angles.resize(n);
+    loop->work_velocities.resize(n);
+    loop->jacobian.resize(3*n);
+    loop->realtime = false;
+    reset_stats();
+}
+
+
+VelocityController::~VelocityController(){
+    stop();
+}
+
+
+/**
+ * Start the control loop on its own thread, from the current state.
+ *
+ * @return bool: false if already running, if the rate is outside
+ *         [VELOCITY_CONTROL_MIN_HZ, VELOCITY_CONTROL_MAX_HZ] or without links.
+ */
+bool VelocityController::start(){
+    if (loop->running || config.num_links < 1
+            || !(options.rate_hz >= VELOCITY_CONTROL_MIN_HZ)
+            || !(options.rate_hz <= VELOCITY_CONTROL_MAX_HZ)){
+        return false;
+    }
+    {
+        lock_guard<mutex> lock(loop->state_guard);
+        loop->work_angles = loop->angles;
+    }
+    loop->running = true;
+    loop->worker = thread(&VelocityController::run_loop, this);
+    return true;
+}
+
+
+// Stop the loop after its current cycle, the last published state is kept
+void VelocityController::stop(){
+    loop->running = false;
+    if (loop->worker.joinable()){
+        loop->worker.join();
+    }
+}
+
+
+bool VelocityController::is_running() const{
+    return loop->running;
+}
+
+
+/**
+ * Twist used from the next cycle on.
+ *
+ * @param[in] twist Desired end effector velocity.
+ * @return bool: false if a component is not finite, the twist is unchanged.
+ */
+bool VelocityController::set_twist(const Twist &twist){
+    if (!isfinite(twist.vx) || !isfinite(twist.vy) || !isfinite(twist.omega)){
+        return false;
+    }
+    lock_guard<mutex> lock(loop->state_guard);
+    loop->twist = twist;
+    return true;
+}
+
+
+/**
+ * Latest published state of the loop.
+ *
+ * @param[out] angles Array with num_links joint angles (deg).
+ * @param[out] velocities Array with num_links joint velocities (deg/s), may be null.
+ */
+void VelocityController::get_state(double *angles, double *velocities) const{
+    lock_guard<mutex> lock(loop->state_guard);
+    copy(loop->angles.begin(), loop->angles.end(), angles);
+    if (velocities){
+        copy(loop->velocities.begin(), loop->velocities.end(), velocities);
+    }
+}
+
+
+VelocityControllerStats VelocityController::get_stats() const{
+    VelocityControllerStats stats;
+    vector<double> jitters;
+    double jitter_sum, compute_sum;
+    {
+        lock_guard<mutex> lock(loop->stats_guard);
+        stats.cycles = loop->cycles;
+        stats.overruns = loop->overruns;
+        stats.missed_periods = loop->missed_periods;
+        stats.max_compute_us = loop->max_compute_us;
+        stats.realtime = loop->realtime;
+        jitter_sum = loop->jitter_sum_us;
+        compute_sum = loop->compute_sum_us;
+        jitters = loop->jitters;
+    }
+    stats.rate_hz = options.rate_hz;
+    stats.mean_jitter_us = stats.p50_jitter_us = stats.p99_jitter_us = stats.max_jitter_us = 0.0;
+    stats.mean_compute_us = stats.cycles > 0 ? compute_sum / stats.cycles : 0.0;
+    if (!jitters.empty()){
+        stats.mean_jitter_us = jitter_sum / stats.cycles;
+        sort(jitters.begin(), jitters.end());
+        size_t last = jitters.size() - 1;
+        stats.p50_jitter_us = jitters[(size_t)(0.50*last + 0.5)];
+        stats.p99_jitter_us = jitters[(size_t)(0.99*last + 0.5)];
+        stats.max_jitter_us = jitters[last];
+    }
+    return stats;
+}
+
+
+void VelocityController::reset_stats(){
+    lock_guard<mutex> lock(loop->stats_guard);
+    loop->cycles = 0;
+    loop->overruns = 0;
+    loop->missed_periods = 0;
+    loop->jitter_sum_us = 0.0;
+    loop->compute_sum_us = 0.0;
+    loop->max_compute_us = 0.0;
+    loop->jitters.clear();
+    loop->jitter_next = 0;
+}
+
+
+// One resolved-rate step over dt seconds, then publish the new state
+void VelocityController::control_cycle(double dt){
+    Loop &l = *loop;
+    int n = config.num_links;
+    Twist twist;
+    {
+        lock_guard<mutex> lock(l.state_guard);
+        twist = l.twist;
+    }
+
+    double reach = 0;
+    for (int i = 0; i < n; i += 1){
+        reach += config.links[i];
+    }
+    compute_jacobian(config, l.work_angles.data(), l.jacobian.data());
+    compute_joint_velocities(n, l.jacobian.data(), twist, options.damping*reach,
+                            options.orientation_weight, l.work_velocities.data());
+
+    // Scale all joints together so the end effector keeps its direction
+    if (options.max_joint_speed > 0.0){
+        double fastest = 0;
+        for (int i = 0; i < n; i += 1){
+            fastest = max(fastest, fabs(l.work_velocities[i]));
+        }
+        if (fastest > options.max_joint_speed){
+            double scale = options.max_joint_speed / fastest;
+            for (int i = 0; i < n; i += 1){
+                l.work_velocities[i] *= scale;
+            }
+        }
+    }
+    // A joint whose step overflows holds still, the wrap itself never loops
+    for (int i = 0; i < n; i += 1){
+        double angle = l.work_angles[i] + l.work_velocities[i]*dt;
+        if (isfinite(angle)){
+            l.work_angles[i] = clip_angle_180(angle);
+        }
+        else{
+            l.work_velocities[i] = 0.0;
+        }
+    }
+
+    lock_guard<mutex> lock(l.state_guard);
+    l.angles = l.work_angles;
+    l.velocities = l.work_velocities;
+}
+
+
+void VelocityController::run_loop(){
+    Loop &l = *loop;
+    bool realtime = false;
+#ifdef __linux__
+    // The default 50 us timer slack is half a period at 10 kHz
+    prctl(PR_SET_TIMERSLACK, 1UL);
+    if (options.priority > 0){
+        sched_param param;
+        param.sched_priority = options.priority;
+        realtime = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+#endif
+    {
+        lock_guard<mutex> lock(l.stats_guard);
+        l.realtime = realtime;
+    }
+
+    typedef chrono::steady_clock clock;
+    const double seconds = 1.0 / options.rate_hz;
+    const auto period = chrono::duration_cast<clock::duration>(chrono::duration<double>(seconds));
+    const auto spin = chrono::duration_cast<clock::duration>(
+        chrono::duration<double, micro>(options.spin_us));
+    auto release = clock::now();
+    uint64_t steps = 1;     // Periods covered by the next cycle
+
+    while (l.running){
+        auto scheduled = release;
+        auto wake = clock::now();
+        control_cycle(steps*seconds);
+        auto done = clock::now();
+
+        // Skip the periods already over, so the loop stays on its grid
+        release += period;
+        steps = 1;
+        while (release <= done){
+            release += period;
+            steps += 1;
+        }
+
+        double jitter = chrono::duration<double, micro>(wake - scheduled).count();
+        double compute = chrono::duration<double, micro>(done - wake).count();
+        {
+            lock_guard<mutex> lock(l.stats_guard);
+            l.cycles += 1;
+            l.overruns += steps > 1;
+            l.missed_periods += steps - 1;
+            l.jitter_sum_us += jitter;
+            l.compute_sum_us += compute;
+            l.max_compute_us = max(l.max_compute_us, compute);
+            if ((int)l.jitters.size() < VELOCITY_CONTROL_JITTER_SAMPLES){
+                l.jitters.push_back(jitter);
+            }
+            else{
+                l.jitters[l.jitter_next] = jitter;
+            }
+            l.jitter_next = (l.jitter_next + 1) % VELOCITY_CONTROL_JITTER_SAMPLES;
+        }
+
+        if (spin > clock::duration::zero()){
+            this_thread::sleep_until(release - spin);
+            while (clock::now() < release){
+            }
+        }
+        else{
+            this_thread::sleep_until(release);
+        }
+    }
+}
@@ -6,11 +6,44 @@
 ********/
 
 #define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
 #include "catch.h"
 #include "robot_configuration.h"
 #include "manipulator.h"
+#include "kinematics.h"
+#include "fixed_manipulator.h"
+#include "numerical_ik.h"
+#include "ik_tracker.h"
+#include "ik_cache.h"
+#include "ik_scheduler.h"
+#include "batch_kinematics.h"
+#include "batch_mode.h"
+#include "columnar_io.h"
+#include "fast_math.h"
+#include "obstacle_set.h"
+#include "parallel_chain.h"
+#include "reachability_map.h"
+#include "self_collision.h"
+#include "socket_server.h"
+#include "thread_pool.h"
+#include "velocity_controller.h"
 
 
 TEST_CASE( "Manipulator Robot Tests" ) {
@@ -34,7 +67,7 @@ TEST_CASE( "Manipulator Robot Tests" ) {
     }
 
     SECTION( "Forward kinematics" ) {
-        double angles[MAX_LINKS];
+        double angles[INLINE_LINKS];
 
         angles[0] = 0.0;
         angles[1] = 90.0;
@@ -57,7 +90,7 @@ TEST_CASE( "Manipulator Robot Tests" ) {
 
     SECTION( "Intersection" ) {
         double x, y, r;
-        double angles[MAX_LINKS];
+        double angles[INLINE_LINKS];
 
         x = 3.0;
         y = 0.0;
@@ -154,8 +187,8 @@ TEST_CASE( "Manipulator Robot Tests" ) {
     SECTION( "Changing Robot Configuration" ){
         double x_circle, y_circle, r, n_links;
 
-        double links[MAX_LINKS];
-        double angles[MAX_LINKS];
+        double links[INLINE_LINKS];
+        double angles[INLINE_LINKS];
 
         // Change links
         n_links = 4;
@@ -193,7 +226,7 @@ TEST_CASE( "Manipulator Robot Tests" ) {
         r = 0.05;
         REQUIRE( !manipulator.intersection(x_circle, y_circle, r, angles) );
 
-        // Inverse kinematics and dynamics fail
+        // Inverse kinematics fails
         double x = 0;
         double y = 0;
         double theta = 0;
@@ -201,10 +234,2534 @@ TEST_CASE( "Manipulator Robot Tests" ) {
         double ang_2[4];
         REQUIRE( !manipulator.inverse_kinematics(x, y, theta, ang_1, ang_2) );
 
-        double fx = 0;
+        // Inverse dynamics works for any number of links
+        double fx = 1;
         double fy = 0;
         double tau = 0;
         double torques[4];
-        REQUIRE( !manipulator.inverse_dynamics(fx, fy, tau, torques) );
+        REQUIRE( manipulator.inverse_dynamics(fx, fy, tau, torques) );
+        REQUIRE( abs(torques[0] - (-1.0)) < 1e-6 );
+        REQUIRE( abs(torques[1] - (-1.0)) < 1e-6 );
+        REQUIRE( abs(torques[2] - 1.0) < 1e-6 );
+        REQUIRE( abs(torques[3] - 1.0) < 1e-6 );
+    }
+}
+
+
+TEST_CASE( "Batch Forward Kinematics Tests" ) {
+
+    Manipulator manipulator;
+    double links[INLINE_LINKS] = {1.0, 0.5, 2.0, 0.7, 1.3};
+    manipulator.set_parameters(5, links);
+    Configuration config = manipulator.get_config();
+    srand(0);
+
+    const int count = 1037;
+    double joints[5][count];
+    double *angles[5];
+    double x[count], y[count], theta[count];
+    for (int j = 0; j < 5; j += 1){
+        for (int i = 0; i < count; i += 1){
+            joints[j][i] = (double)rand() * 2000 / RAND_MAX - 1000;
+        }
+        angles[j] = joints[j];
+    }
+
+    SECTION( "Scalar kernel matches forward kinematics" ) {
+        REQUIRE( forward_kinematics_batch(config, count, angles, x, y, theta, SIMD_SCALAR) );
+        for (int i = 0; i < count; i += 1){
+            double pose[INLINE_LINKS];
+            for (int j = 0; j < 5; j += 1){
+                pose[j] = joints[j][i];
+            }
+            manipulator.forward_kinematics(pose);
+            Configuration ref = manipulator.get_config();
+            REQUIRE( x[i] == ref.x );
+            REQUIRE( y[i] == ref.y );
+            REQUIRE( theta[i] == ref.theta );
+        }
+    }
+
+    SECTION( "SIMD kernels within tolerance" ) {
+        double x_ref[count], y_ref[count], theta_ref[count];
+        forward_kinematics_batch(config, count, angles, x_ref, y_ref, theta_ref, SIMD_SCALAR);
+        SimdLevel levels[3] = {SIMD_SSE2, SIMD_AVX2, SIMD_AVX512};
+        for (int l = 0; l < 3; l += 1){
+            REQUIRE( forward_kinematics_batch(config, count, angles, x, y, theta, levels[l]) );
+            for (int i = 0; i < count; i += 1){
+                REQUIRE( abs(x[i] - x_ref[i]) < BATCH_FK_TOLERANCE );
+                REQUIRE( abs(y[i] - y_ref[i]) < BATCH_FK_TOLERANCE );
+                REQUIRE( abs(theta[i] - theta_ref[i]) < BATCH_FK_TOLERANCE );
+            }
+        }
+    }
+
+    SECTION( "Invalid arguments" ) {
+        REQUIRE( !forward_kinematics_batch(config, -1, angles, x, y, theta) );
+        REQUIRE( forward_kinematics_batch(config, 0, angles, x, y, theta) );
+    }
+}
+
+
+TEST_CASE( "Stateless Kinematics Tests" ) {
+
+    Manipulator manipulator;
+    const Configuration &config = manipulator.get_config_ref();
+    srand(0);
+
+    SECTION( "Matches Manipulator" ) {
+        double joints[3];
+        double ang_1[3], ang_2[3], ref_1[3], ref_2[3];
+        double torques[3], ref_torques[3];
+        for (int i = 0; i < 10; i += 1){
+            joints[0] = (double)rand() * 360 / RAND_MAX - 180;
+            joints[1] = (double)rand() * 360 / RAND_MAX - 180;
+            joints[2] = (double)rand() * 360 / RAND_MAX - 180;
+            Pose pose = compute_forward_kinematics(config, joints);
+            manipulator.forward_kinematics(joints);
+            REQUIRE( pose.x == config.x );
+            REQUIRE( pose.y == config.y );
+            REQUIRE( pose.theta == config.theta );
+
+            REQUIRE( compute_inverse_kinematics(config, pose.x, pose.y, pose.theta, ang_1, ang_2) );
+            REQUIRE( manipulator.inverse_kinematics(pose.x, pose.y, pose.theta, ref_1, ref_2) );
+            REQUIRE( ang_1[0] == ref_1[0] );
+            REQUIRE( ang_2[2] == ref_2[2] );
+
+            REQUIRE( compute_inverse_dynamics(config, joints, 1.0, 2.0, 0.5, torques) );
+            REQUIRE( manipulator.inverse_dynamics(1.0, 2.0, 0.5, ref_torques) );
+            REQUIRE( abs(torques[0] - ref_torques[0]) < 1e-9 );
+            REQUIRE( abs(torques[1] - ref_torques[1]) < 1e-9 );
+            REQUIRE( abs(torques[2] - ref_torques[2]) < 1e-9 );
+        }
+    }
+
+    SECTION( "Queries do not modify the configuration" ) {
+        double joints[3] = {10.0, 20.0, 30.0};
+        REQUIRE( compute_intersection(config, 3.0, 0.0, 0.1, joints) == false );
+        compute_forward_kinematics(config, joints);
+        REQUIRE( config.angles[0] == 0.0 );
+        REQUIRE( config.x == 3.0 );
+    }
+
+    SECTION( "Angles of any size are clipped" ) {
+        REQUIRE( clip_angle_180(180.0) == 180.0 );
+        REQUIRE( clip_angle_180(-180.0) == 180.0 );
+        REQUIRE( clip_angle_180(1e12 + 90.0) == 10.0 );
+        REQUIRE( clip_angle_180(-1e12 - 90.0) == -10.0 );
+        REQUIRE( clip_angle_180(-1e300) == remainder(-1e300, 360.0) );
+        REQUIRE( fabs(clip_angle_180(1e300)) <= 180.0 );
+        REQUIRE( isnan(clip_angle_180(INFINITY)) );
+        REQUIRE( isnan(clip_angle_180(-INFINITY)) );
+        REQUIRE( isnan(clip_angle_180(NAN)) );
+    }
+
+    SECTION( "Concurrent queries on a shared configuration" ) {
+        const int n_threads = 4;
+        vector<int> failures(n_threads, 0);
+        vector<thread> workers;
+        for (int t = 0; t < n_threads; t += 1){
+            workers.push_back(thread([&config, &failures, t]{
+                for (int i = 0; i < 1000; i += 1){
+                    double joints[3] = {i * 0.1 + t, 30.0 - i * 0.02, i * 0.3};
+                    double ang_1[3], ang_2[3];
+                    Pose pose = compute_forward_kinematics(config, joints);
+                    if (!compute_inverse_kinematics(config, pose.x, pose.y, pose.theta, ang_1, ang_2)){
+                        failures[t] += 1;
+                    }
+                }
+            }));
+        }
+        for (int t = 0; t < n_threads; t += 1){
+            workers[t].join();
+        }
+        for (int t = 0; t < n_threads; t += 1){
+            REQUIRE( failures[t] == 0 );
+        }
+    }
+}
+
+
+TEST_CASE( "Fixed Manipulator Tests" ) {
+
+    static_assert(clip_angle_180(540.0) == 180.0, "clip_angle_180 is constexpr");
+    static_assert(clip_angle_180(-190.0) == 170.0, "clip_angle_180 is constexpr");
+
+    FixedManipulator<3> fixed;
+    Manipulator manipulator;
+    srand(0);
+
+    SECTION( "Initialization" ) {
+        REQUIRE( fixed.get_config().x == 3.0 );
+        REQUIRE( fixed.get_config().y == 0.0 );
+        REQUIRE( fixed.get_config().theta == 0.0 );
+    }
+
+    SECTION( "Matches Manipulator" ) {
+        array<double, 3> joints;
+        array<double, 3> torques;
+        double ref_torques[3];
+        for (int i = 0; i < 10; i += 1){
+            joints[0] = (double)rand() * 360 / RAND_MAX - 180;
+            joints[1] = (double)rand() * 360 / RAND_MAX - 180;
+            joints[2] = (double)rand() * 360 / RAND_MAX - 180;
+            fixed.forward_kinematics(joints);
+            manipulator.forward_kinematics(joints.data());
+            Configuration config = manipulator.get_config();
+            REQUIRE( abs(fixed.get_config().x - config.x) < 1e-9 );
+            REQUIRE( abs(fixed.get_config().y - config.y) < 1e-9 );
+            REQUIRE( abs(fixed.get_config().theta - config.theta) < 1e-9 );
+
+            fixed.inverse_dynamics(1.0, -2.0, 0.5, torques);
+            manipulator.inverse_dynamics(1.0, -2.0, 0.5, ref_torques);
+            REQUIRE( abs(torques[0] - ref_torques[0]) < 1e-9 );
+            REQUIRE( abs(torques[1] - ref_torques[1]) < 1e-9 );
+            REQUIRE( abs(torques[2] - ref_torques[2]) < 1e-9 );
+        }
+    }
+
+    SECTION( "Six links" ) {
+        FixedManipulator<6> six({2.0, 1.0, 1.0, 0.5, 0.5, 1.0});
+        REQUIRE( six.intersection(6.0, 0.0, 1e-6, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}) );
+        six.forward_kinematics({90.0, -90.0, 0.0, 0.0, 0.0, 90.0});
+        REQUIRE( abs(six.get_config().x - 3.0) < 1e-6 );
+        REQUIRE( abs(six.get_config().y - 3.0) < 1e-6 );
+        REQUIRE( abs(six.get_config().theta - 90.0) < 1e-6 );
+
+        Configuration config = six.to_configuration();
+        REQUIRE( config.num_links == 6 );
+        REQUIRE( config.links[0] == 2.0 );
+        REQUIRE( abs(config.x - 3.0) < 1e-6 );
+    }
+}
+
+
+TEST_CASE( "Batch Inverse Kinematics Tests" ) {
+
+    Manipulator manipulator;
+    const Configuration &config = manipulator.get_config_ref();
+    srand(0);
+
+    const int count = 515;
+    double x[count], y[count], theta[count];
+    double a1[3][count], a2[3][count];
+    double *angles_1[3] = {a1[0], a1[1], a1[2]};
+    double *angles_2[3] = {a2[0], a2[1], a2[2]};
+    unsigned char reachable[count];
+    for (int i = 0; i < count; i += 1){
+        double joints[3];
+        joints[0] = (double)rand() * 360 / RAND_MAX - 180;
+        joints[1] = (double)rand() * 340 / RAND_MAX - 170;
+        joints[2] = (double)rand() * 360 / RAND_MAX - 180;
+        Pose pose = compute_forward_kinematics(config, joints);
+        x[i] = pose.x;
+        y[i] = pose.y;
+        theta[i] = pose.theta;
+    }
+
+    SECTION( "Matches single target inverse kinematics" ) {
+        SimdLevel levels[4] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512};
+        for (int l = 0; l < 4; l += 1){
+            REQUIRE( inverse_kinematics_batch(config, count, x, y, theta, angles_1, angles_2, 
+                                                reachable, levels[l]) );
+            for (int i = 0; i < count; i += 1){
+                double ref_1[3], ref_2[3];
+                REQUIRE( compute_inverse_kinematics(config, x[i], y[i], theta[i], ref_1, ref_2) );
+                REQUIRE( reachable[i] == 1 );
+                for (int j = 0; j < 3; j += 1){
+                    REQUIRE( abs(clip_angle_180(a1[j][i] - ref_1[j])) < 1e-6 );
+                    REQUIRE( abs(clip_angle_180(a2[j][i] - ref_2[j])) < 1e-6 );
+                }
+            }
+        }
+    }
+
+    SECTION( "Unreachable targets are masked" ) {
+        double links[INLINE_LINKS] = {1.0, 0.5, 1.0};
+        manipulator.set_parameters(3, links);
+        double tx[3] = {4.0, 1.0, 2.5};
+        double ty[3] = {0.0, 0.0, 0.0};
+        double tt[3] = {0.0, 0.0, 0.0};
+        REQUIRE( inverse_kinematics_batch(config, 3, tx, ty, tt, angles_1, angles_2, reachable) );
+        REQUIRE( reachable[0] == 0 );
+        REQUIRE( reachable[1] == 0 );
+        REQUIRE( reachable[2] == 1 );
+        REQUIRE( a1[0][0] != a1[0][0] );
+        REQUIRE( abs(a1[0][2] - 0.0) < 1e-9 );
+        REQUIRE( abs(a1[1][2] - 0.0) < 1e-9 );
+        REQUIRE( abs(a1[2][2] - 0.0) < 1e-9 );
+    }
+
+    SECTION( "Requires three links" ) {
+        double links[INLINE_LINKS] = {1.0, 1.0, 1.0, 1.0};
+        manipulator.set_parameters(4, links);
+        REQUIRE( !inverse_kinematics_batch(config, count, x, y, theta, angles_1, angles_2, reachable) );
+    }
+}
+
+
+TEST_CASE( "Numerical Inverse Kinematics Tests" ) {
+
+    IkSolverOptions options = default_ik_solver_options();
+    IkSolverStats stats;
+    srand(0);
+
+    SECTION( "Redundant arms" ) {
+        int link_counts[3] = {4, 7, 10};
+        for (int c = 0; c < 3; c += 1){
+            int n = link_counts[c];
+            double links[INLINE_LINKS];
+            double joints[INLINE_LINKS];
+            double seed[INLINE_LINKS];
+            double angles[INLINE_LINKS];
+            for (int i = 0; i < n; i += 1){
+                links[i] = 0.5 + (double)rand() / RAND_MAX;
+            }
+            Manipulator manipulator;
+            manipulator.set_parameters(n, links);
+            const Configuration &config = manipulator.get_config_ref();
+            for (int k = 0; k < 10; k += 1){
+                for (int i = 0; i < n; i += 1){
+                    joints[i] = (double)rand() * 180 / RAND_MAX - 90;
+                    seed[i] = joints[i] + (double)rand() * 40 / RAND_MAX - 20;
+                }
+                Pose target = compute_forward_kinematics(config, joints);
+                REQUIRE( solve_inverse_kinematics_dls(config, target.x, target.y, target.theta,
+                                                        seed, angles, options, &stats) );
+                REQUIRE( stats.converged );
+                REQUIRE( stats.iterations <= options.max_iterations );
+                Pose pose = compute_forward_kinematics(config, angles);
+                REQUIRE( abs(pose.x - target.x) < 1e-6 );
+                REQUIRE( abs(pose.y - target.y) < 1e-6 );
+                REQUIRE( abs(clip_angle_180(pose.theta - target.theta)) < 1e-4 );
+            }
+        }
+    }
+
+    SECTION( "More links than INLINE_LINKS" ) {
+        const int n = 25;
+        double links[n], joints[n], angles[n];
+        for (int i = 0; i < n; i += 1){
+            links[i] = 0.2;
+            joints[i] = 10.0;
+            angles[i] = 0.0;
+        }
+        double x = 0, y = 0, t = 0;
+        for (int i = 0; i < n; i += 1){
+            t += joints[i];
+            x += links[i]*cos(t*3.14159265359/180.0);
+            y += links[i]*sin(t*3.14159265359/180.0);
+        }
+        REQUIRE( solve_inverse_kinematics_dls(n, links, x, y, clip_angle_180(t), angles, 
+                                                angles, options, &stats) );
+    }
+
+    SECTION( "Unreachable target" ) {
+        Manipulator manipulator;
+        double links[INLINE_LINKS] = {1.0, 1.0, 1.0, 1.0};
+        manipulator.set_parameters(4, links);
+        double angles[INLINE_LINKS];
+        options.max_iterations = 20;
+        REQUIRE( !manipulator.inverse_kinematics_numerical(10.0, 0.0, 0.0, angles, options, &stats) );
+        REQUIRE( !stats.converged );
+        REQUIRE( stats.iterations == 20 );
+        REQUIRE( abs(stats.position_error - 6.0) < 1e-3 );
+    }
+}
+
+
+TEST_CASE( "Trajectory Tracking Tests" ) {
+
+    Manipulator manipulator;
+    const int steps = 1000;
+
+    SECTION( "Three links keep the elbow branch" ) {
+        double joints[INLINE_LINKS] = {30.0, -60.0, 10.0};
+        manipulator.forward_kinematics(joints);
+        IkTracker tracker(manipulator.get_config_ref());
+        REQUIRE( tracker.get_elbow() == -1 );
+
+        double previous[INLINE_LINKS] = {30.0, -60.0, 10.0};
+        double angles[INLINE_LINKS];
+        IkSolverStats stats;
+        for (int k = 0; k < steps; k += 1){
+            double a = 2*3.14159265359*k/steps;
+            double x = 1.5 + 0.4*cos(a);
+            double y = 0.8 + 0.4*sin(a);
+            double theta = atan2(y, x)*180.0/3.14159265359;
+            REQUIRE( tracker.track(x, y, theta, angles, &stats) );
+            REQUIRE( angles[1] < 0 );
+            for (int i = 0; i < 3; i += 1){
+                REQUIRE( (k == 0 || abs(angles[i] - previous[i]) < 5.0) );
+                previous[i] = angles[i];
+            }
+            Pose pose = compute_forward_kinematics(manipulator.get_config_ref(), angles);
+            REQUIRE( abs(pose.x - x) < 1e-6 );
+            REQUIRE( abs(pose.y - y) < 1e-6 );
+        }
+        REQUIRE( !tracker.track(10.0, 0.0, 0.0, angles, &stats) );
+    }
+
+    SECTION( "Redundant arm converges in few iterations" ) {
+        double links[INLINE_LINKS] = {1.0, 0.8, 0.6, 0.4, 0.3};
+        double joints[INLINE_LINKS] = {20.0, 60.0, -40.0, 50.0, 30.0};
+        manipulator.set_parameters(5, links);
+        manipulator.forward_kinematics(joints);
+        Configuration config = manipulator.get_config();
+        IkTracker tracker(config);
+
+        double previous[INLINE_LINKS];
+        for (int i = 0; i < 5; i += 1){
+            previous[i] = joints[i];
+        }
+        double angles[INLINE_LINKS];
+        IkSolverStats stats;
+        int total_iterations = 0;
+        for (int k = 0; k < steps; k += 1){
+            double a = 2*3.14159265359*k/steps;
+            double x = config.x + 0.15*sin(a);
+            double y = config.y + 0.1*sin(2*a);
+            REQUIRE( tracker.track(x, y, config.theta, angles, &stats) );
+            REQUIRE( stats.converged );
+            REQUIRE( stats.iterations <= 2 );
+            total_iterations += stats.iterations;
+            for (int i = 0; i < 5; i += 1){
+                REQUIRE( abs(angles[i] - previous[i]) < 5.0 );
+                previous[i] = angles[i];
+            }
+        }
+        REQUIRE( total_iterations <= steps + steps/10 );
+    }
+}
+
+
+TEST_CASE( "Incremental Forward Kinematics Tests" ) {
+
+    Manipulator manipulator;
+    double links[INLINE_LINKS] = {1.0, 0.5, 2.0, 0.7, 1.3, 0.9};
+    manipulator.set_parameters(6, links);
+    const Configuration &config = manipulator.get_config_ref();
+    srand(0);
+
+    SECTION( "Matches full forward kinematics" ) {
+        double joints[INLINE_LINKS] = {10.0, 20.0, 30.0, 40.0, 50.0, 60.0};
+        manipulator.forward_kinematics(joints);
+        for (int k = 0; k < 100; k += 1){
+            int joint = rand() % 6;
+            joints[joint] = (double)rand() * 360 / RAND_MAX - 180;
+            REQUIRE( manipulator.update_joint(joint, joints[joint]) == 6 - joint );
+            Pose pose = compute_forward_kinematics(config, joints);
+            REQUIRE( config.x == pose.x );
+            REQUIRE( config.y == pose.y );
+            REQUIRE( config.theta == pose.theta );
+            REQUIRE( config.angles[joint] == joints[joint] );
+        }
+    }
+
+    SECTION( "Joint positions" ) {
+        double joints[INLINE_LINKS] = {90.0, -90.0, 0.0, 0.0, 0.0, 0.0};
+        manipulator.forward_kinematics(joints);
+        double x[INLINE_LINKS + 1], y[INLINE_LINKS + 1];
+        REQUIRE( manipulator.get_joint_positions(x, y) );
+        REQUIRE( abs(x[0]) < 1e-9 );
+        REQUIRE( abs(y[1] - 1.0) < 1e-9 );
+        REQUIRE( abs(x[2] - 0.5) < 1e-9 );
+        REQUIRE( abs(x[6] - config.x) < 1e-12 );
+        REQUIRE( abs(y[6] - config.y) < 1e-12 );
+
+        REQUIRE( manipulator.update_joint(5, 90.0) == 1 );
+        manipulator.get_joint_positions(x, y);
+        REQUIRE( abs(x[6] - 4.5) < 1e-9 );
+        REQUIRE( abs(y[6] - 1.9) < 1e-9 );
+    }
+
+    SECTION( "Invalid joint" ) {
+        REQUIRE( manipulator.update_joint(-1, 0.0) == -1 );
+        REQUIRE( manipulator.update_joint(6, 0.0) == -1 );
+    }
+}
+
+
+TEST_CASE( "Generalized Inverse Dynamics Tests" ) {
+
+    Manipulator manipulator;
+    double links[INLINE_LINKS] = {1.0, 0.5, 2.0, 0.7, 1.3, 0.9, 0.4};
+    manipulator.set_parameters(7, links);
+    const Configuration &config = manipulator.get_config_ref();
+    srand(0);
+
+    double joints[INLINE_LINKS];
+    for (int i = 0; i < 7; i += 1){
+        joints[i] = (double)rand() * 360 / RAND_MAX - 180;
+    }
+    manipulator.forward_kinematics(joints);
+
+    double jacobian[3*INLINE_LINKS];
+    REQUIRE( compute_jacobian(config, joints, jacobian) );
+
+    SECTION( "Torques are J^T * forces" ) {
+        double torques[INLINE_LINKS], ref_torques[INLINE_LINKS];
+        double fx = 0.3, fy = -1.2, tau = 0.7;
+        REQUIRE( manipulator.inverse_dynamics(fx, fy, tau, torques) );
+        REQUIRE( compute_inverse_dynamics(config, joints, fx, fy, tau, ref_torques) );
+        for (int i = 0; i < 7; i += 1){
+            double expected = jacobian[i]*fx + jacobian[7 + i]*fy + jacobian[14 + i]*tau;
+            REQUIRE( abs(torques[i] - expected) < 1e-9 );
+            REQUIRE( abs(ref_torques[i] - expected) < 1e-9 );
+        }
+    }
+
+    SECTION( "Jacobian matches finite differences" ) {
+        const double h = 1e-6;
+        for (int i = 0; i < 7; i += 1){
+            double moved[INLINE_LINKS];
+            for (int j = 0; j < 7; j += 1){
+                moved[j] = joints[j];
+            }
+            moved[i] += h*180.0/3.14159265359;
+            Pose p0 = compute_forward_kinematics(config, joints);
+            Pose p1 = compute_forward_kinematics(config, moved);
+            REQUIRE( abs((p1.x - p0.x)/h - jacobian[i]) < 1e-4 );
+            REQUIRE( abs((p1.y - p0.y)/h - jacobian[7 + i]) < 1e-4 );
+        }
+    }
+
+    SECTION( "Batch of wrenches" ) {
+        const int count = 33;
+        double fx[count], fy[count], tau[count];
+        double out[7][count];
+        double *torques[7];
+        for (int i = 0; i < 7; i += 1){
+            torques[i] = out[i];
+        }
+        for (int k = 0; k < count; k += 1){
+            fx[k] = (double)rand() / RAND_MAX - 0.5;
+            fy[k] = (double)rand() / RAND_MAX - 0.5;
+            tau[k] = (double)rand() / RAND_MAX - 0.5;
+        }
+        REQUIRE( inverse_dynamics_batch(config, joints, count, fx, fy, tau, torques) );
+        for (int k = 0; k < count; k += 1){
+            double ref[INLINE_LINKS];
+            manipulator.inverse_dynamics(fx[k], fy[k], tau[k], ref);
+            for (int i = 0; i < 7; i += 1){
+                REQUIRE( abs(out[i][k] - ref[i]) < 1e-12 );
+            }
+        }
+    }
+}
+
+
+TEST_CASE( "Batch Mode Tests" ) {
+
+    const char *input =
+        "# comment\n"
+        "\n"
+        "forward 90 0 -90\n"
+        "intersection 3 0 0.5 0 0 0\n"
+        "links 1 1\n"
+        "inverse_d 1 0 0\n"
+        "forward 1 2 3\n"
+        "unknown\n"
+        "exit\n"
+        "forward 0 0\n";
+    char output[1024];
+    FILE *in = fmemopen((void *)input, strlen(input), "r");
+    FILE *out = fmemopen(output, sizeof(output), "w");
+    REQUIRE( in != NULL );
+    REQUIRE( out != NULL );
+
+    BatchOptions options = default_batch_options();
+    options.flush_every = 2;
+    int errors = run_batch(in, out, options);
+    fclose(in);
+    fclose(out);
+
+    REQUIRE( errors == 2 );
+    REQUIRE( strcmp(output,
+        "1.000 2.000 0.000\n"
+        "true\n"
+        "ok\n"
+        "0.000 0.000\n"
+        "error: invalid number of angles\n"
+        "error: not a valid command\n") == 0 );
+
+    // Out of range precisions are rejected, the widest number is not cut
+    const char *huge = "links 1e300\nforward 0\n";
+    char wide[1024];
+    int precisions[3] = {-1, BATCH_MAX_PRECISION + 1, BATCH_MAX_PRECISION};
+    for (int p = 0; p < 3; p += 1){
+        in = fmemopen((void *)huge, strlen(huge), "r");
+        out = fmemopen(wide, sizeof(wide), "w");
+        options.precision = precisions[p];
+        errors = run_batch(in, out, options);
+        fclose(in);
+        fclose(out);
+        REQUIRE( errors == (p < 2 ? -1 : 0) );
+    }
+    REQUIRE( strlen(wide) > 300 );
+    REQUIRE( strstr(wide, ".00000000000000000 ") != NULL );
+}
+
+
+TEST_CASE( "Columnar File Tests" ) {
+
+    Manipulator manipulator;
+    double links[4] = {1.0, 0.5, 0.75, 0.25};
+    manipulator.set_parameters(4, links);
+    Configuration config = manipulator.get_config();
+
+    // Rows span two full blocks and a partial one
+    const int count = 80;
+    double values[4][count];
+    const double *columns[4];
+    for (int i = 0; i < 4; i += 1){
+        for (int k = 0; k < count; k += 1){
+            values[i][k] = (double)rand() / RAND_MAX * 360.0 - 180.0;
+        }
+        columns[i] = values[i];
+    }
+    char angles_path[] = "/tmp/robot-columnar-XXXXXX";
+    char pose_path[] = "/tmp/robot-columnar-XXXXXX";
+    ::close(mkstemp(angles_path));
+    ::close(mkstemp(pose_path));
+
+    SECTION( "Round trip in float64" ) {
+        ColumnarWriter writer;
+        REQUIRE( writer.open(angles_path, config, COLUMN_FLOAT64, COLUMNS_ANGLES, 32) );
+        REQUIRE( writer.write(50, columns) );
+        double row[4];
+        for (int k = 50; k < count; k += 1){
+            for (int i = 0; i < 4; i += 1){
+                row[i] = values[i][k];
+            }
+            REQUIRE( writer.write_row(row) );
+        }
+        REQUIRE( writer.close() );
+
+        ColumnarReader reader;
+        REQUIRE( reader.open(angles_path) );
+        REQUIRE( reader.get_config().num_links == 4 );
+        REQUIRE( reader.get_config().links[2] == 0.75 );
+        REQUIRE( reader.get_num_rows() == count );
+        REQUIRE( reader.get_num_blocks() == 3 );
+        REQUIRE( reader.get_block_rows(2) == 16 );
+        for (int b = 0; b < 3; b += 1){
+            for (int i = 0; i < 4; i += 1){
+                const double *column = reader.column_f64(b, i);
+                REQUIRE( (uintptr_t)column % COLUMNAR_ALIGNMENT == 0 );
+                for (int k = 0; k < reader.get_block_rows(b); k += 1){
+                    REQUIRE( column[k] == values[i][32*b + k] );
+                }
+            }
+        }
+        double out[count];
+        REQUIRE( reader.read(20, 50, 3, out) );
+        for (int k = 0; k < 50; k += 1){
+            REQUIRE( out[k] == values[3][20 + k] );
+        }
+        REQUIRE_FALSE( reader.read(40, 50, 0, out) );
+        REQUIRE_FALSE( reader.read(0, 1, 4, out) );
+    }
+
+    SECTION( "Forward kinematics from float32 file" ) {
+        ColumnarWriter writer;
+        REQUIRE( writer.open(angles_path, config, COLUMN_FLOAT32, COLUMNS_ANGLES, 32) );
+        REQUIRE( writer.write(count, columns) );
+        REQUIRE( writer.close() );
+
+        ColumnarReader reader;
+        REQUIRE( reader.open(angles_path) );
+        REQUIRE( reader.column_f64(0, 0) == NULL );
+        ColumnarWriter poses;
+        REQUIRE( poses.open(pose_path, config, COLUMN_FLOAT64, COLUMNS_ANGLES | COLUMNS_POSE, 32) );
+        REQUIRE( forward_kinematics_columnar(reader, poses) );
+        REQUIRE( poses.close() );
+
+        ColumnarReader result;
+        REQUIRE( result.open(pose_path) );
+        REQUIRE( result.get_num_columns() == 7 );
+        REQUIRE( result.get_num_rows() == count );
+        double angles[4][count], x[count], y[count], theta[count];
+        for (int i = 0; i < 4; i += 1){
+            REQUIRE( result.read(0, count, i, angles[i]) );
+        }
+        REQUIRE( result.read(0, count, 4, x) );
+        REQUIRE( result.read(0, count, 5, y) );
+        REQUIRE( result.read(0, count, 6, theta) );
+        for (int k = 0; k < count; k += 1){
+            double joints[4];
+            for (int i = 0; i < 4; i += 1){
+                joints[i] = angles[i][k];
+                REQUIRE( joints[i] == (double)(float)values[i][k] );
+            }
+            manipulator.forward_kinematics(joints);
+            Configuration expected = manipulator.get_config();
+            REQUIRE( abs(x[k] - expected.x) < BATCH_FK_TOLERANCE );
+            REQUIRE( abs(y[k] - expected.y) < BATCH_FK_TOLERANCE );
+            REQUIRE( abs(clip_angle_180(theta[k] - expected.theta)) < BATCH_FK_TOLERANCE );
+        }
+    }
+
+    SECTION( "Invalid files" ) {
+        ColumnarWriter writer;
+        REQUIRE_FALSE( writer.open(angles_path, config, COLUMN_FLOAT64, COLUMNS_ANGLES, 20) );
+        REQUIRE_FALSE( writer.write(1, columns) );
+        ColumnarReader reader;
+        REQUIRE_FALSE( reader.open("/nonexistent/robot-columnar") );
+        FILE *file = fopen(angles_path, "wb");
+        fputs("not a columnar file, just some text padding the header", file);
+        fclose(file);
+        REQUIRE_FALSE( reader.open(angles_path) );
+
+        // Row counts whose block count does not fit in an int, or whose last
+        // block lies past the end of the file
+        REQUIRE( writer.open(angles_path, config, COLUMN_FLOAT64, COLUMNS_ANGLES, 16) );
+        REQUIRE( writer.write(20, columns) );
+        REQUIRE( writer.close() );
+        REQUIRE( reader.open(angles_path) );
+        REQUIRE( reader.get_num_blocks() == 2 );
+        reader.close();
+        int64_t forged[3] = {((int64_t)1 << 32)*16 + 1, (int64_t)INT_MAX*16 + 1, 33};
+        for (int f = 0; f < 3; f += 1){
+            file = fopen(angles_path, "r+b");
+            fseek(file, 32, SEEK_SET);
+            fwrite(&forged[f], sizeof(forged[f]), 1, file);
+            fclose(file);
+            REQUIRE_FALSE( reader.open(angles_path) );
+        }
+    }
+
+    remove(angles_path);
+    remove(pose_path);
+}
+
+
+TEST_CASE( "Reachability Map Tests" ) {
+
+    Manipulator manipulator;
+    double links[3] = {2.0, 0.5, 1.0};
+    manipulator.set_parameters(3, links);
+    Configuration config = manipulator.get_config();
+
+    ReachabilityMapOptions options = default_reachability_map_options();
+    options.xy_cells = 32;
+    options.theta_cells = 36;
+    options.threads = 3;
+    ReachabilityMap map;
+    REQUIRE( map.build(config, options) );
+
+    SECTION( "Inner annulus is unreachable" ) {
+        // Wrist at 1.0 from the base, inside the inner radius 1.5
+        double angles_1[INLINE_LINKS], angles_2[INLINE_LINKS];
+        REQUIRE_FALSE( compute_pose_reachable(config, 2.0, 0.0, 0.0) );
+        REQUIRE_FALSE( manipulator.inverse_kinematics(2.0, 0.0, 0.0, angles_1, angles_2) );
+        REQUIRE_FALSE( map.is_reachable(2.0, 0.0, 0.0) );
+        REQUIRE( map.lookup(0.0, 0.0, 0.0) == CELL_UNREACHABLE );
+
+        // Wrist on the inner and outer boundaries
+        REQUIRE( manipulator.inverse_kinematics(2.5, 0.0, 0.0, angles_1, angles_2) );
+        REQUIRE( angles_1[1] == angles_1[1] );
+        REQUIRE( manipulator.inverse_kinematics(3.5, 0.0, 0.0, angles_1, angles_2) );
+        REQUIRE( angles_1[1] == angles_1[1] );
+    }
+
+    SECTION( "Agrees with the exact check" ) {
+        int cells[3] = {0, 0, 0};
+        for (int k = 0; k < 20000; k += 1){
+            double x = ((double)rand() / RAND_MAX - 0.5) * 8.0;
+            double y = ((double)rand() / RAND_MAX - 0.5) * 8.0;
+            double theta = ((double)rand() / RAND_MAX - 0.5) * 720.0;
+            cells[map.lookup(x, y, theta)] += 1;
+            REQUIRE( map.is_reachable(x, y, theta) == compute_pose_reachable(config, x, y, theta) );
+        }
+        REQUIRE( cells[CELL_REACHABLE] > 0 );
+        REQUIRE( cells[CELL_UNREACHABLE] > cells[CELL_BOUNDARY] );
+    }
+
+    SECTION( "Reachable targets solve" ) {
+        for (int k = 0; k < 1000; k += 1){
+            double joints[3];
+            for (int i = 0; i < 3; i += 1){
+                joints[i] = ((double)rand() / RAND_MAX - 0.5) * 360.0;
+            }
+            Pose pose = compute_forward_kinematics(config, joints);
+            REQUIRE( map.is_reachable(pose.x, pose.y, pose.theta) );
+        }
+    }
+
+    SECTION( "Save and load" ) {
+        char path[] = "/tmp/robot-reachability-XXXXXX";
+        ::close(mkstemp(path));
+        REQUIRE( map.save(path) );
+
+        ReachabilityMap loaded;
+        REQUIRE( loaded.load(path) );
+        REQUIRE( loaded.matches(config) );
+        REQUIRE( loaded.get_options().xy_cells == 32 );
+        for (int k = 0; k < 1000; k += 1){
+            double x = ((double)rand() / RAND_MAX - 0.5) * 8.0;
+            double y = ((double)rand() / RAND_MAX - 0.5) * 8.0;
+            double theta = ((double)rand() / RAND_MAX - 0.5) * 360.0;
+            REQUIRE( loaded.lookup(x, y, theta) == map.lookup(x, y, theta) );
+        }
+
+        Manipulator other;
+        REQUIRE_FALSE( other.load_reachability_map(path) );
+        REQUIRE( manipulator.load_reachability_map(path) );
+        REQUIRE_FALSE( manipulator.is_reachable(2.0, 0.0, 0.0) );
+
+        FILE *file = fopen(path, "ab");
+        fputc(0, file);
+        fclose(file);
+        REQUIRE_FALSE( loaded.load(path) );
+        REQUIRE_FALSE( loaded.is_built() );
+        remove(path);
+    }
+
+    SECTION( "Rebuilt on set_parameters" ) {
+        REQUIRE( manipulator.enable_reachability_map(options) );
+        REQUIRE_FALSE( manipulator.is_reachable(2.0, 0.0, 0.0) );
+        double other_links[4] = {1.0, 1.0, 1.0, 1.0};
+        manipulator.set_parameters(4, other_links);
+        REQUIRE( manipulator.is_reachable(2.0, 0.0, 0.0) );
+        REQUIRE_FALSE( manipulator.is_reachable(4.5, 0.0, 0.0) );
+        manipulator.disable_reachability_map();
+        REQUIRE( manipulator.is_reachable(2.0, 0.0, 0.0) );
+    }
+}
+
+
+TEST_CASE( "Obstacle Set Tests" ) {
+
+    ObstacleSet obstacles;
+    for (int i = 0; i < 2000; i += 1){
+        double x = ((double)rand() / RAND_MAX - 0.5) * 20.0;
+        double y = ((double)rand() / RAND_MAX - 0.5) * 20.0;
+        double r = (double)rand() / RAND_MAX * 0.3;
+        REQUIRE( obstacles.add(x, y, r) == i );
+    }
+    // Keep-in region larger than the grid cells
+    REQUIRE( obstacles.add(1.0, -2.0, 6.0) == 2000 );
+    REQUIRE( obstacles.add(0.0, 0.0, -1.0) == -1 );
+    REQUIRE( obstacles.add(0.0, 0.0, HUGE_VAL) == -1 );
+    REQUIRE( obstacles.add(-HUGE_VAL, 0.0, 1.0) == -1 );
+    REQUIRE( obstacles.add(0.0, HUGE_VAL, 1.0) == -1 );
+    REQUIRE( obstacles.add(NAN, 0.0, 1.0) == -1 );
+    REQUIRE( obstacles.add(0.0, 0.0, NAN) == -1 );
+    REQUIRE( obstacles.add(1e308, 0.0, 1.0) == -1 );
+    REQUIRE( obstacles.size() == 2001 );
+
+    SECTION( "Grid matches linear scan" ) {
+        vector<double> xs, ys;
+        vector<vector<int> > expected;
+        vector<int> ids;
+        for (int k = 0; k < 2000; k += 1){
+            xs.push_back(((double)rand() / RAND_MAX - 0.5) * 24.0);
+            ys.push_back(((double)rand() / RAND_MAX - 0.5) * 24.0);
+            obstacles.find_all(xs[k], ys[k], ids);
+            sort(ids.begin(), ids.end());
+            expected.push_back(ids);
+            REQUIRE( obstacles.contains_any(xs[k], ys[k]) == !ids.empty() );
+        }
+        obstacles.build();
+        REQUIRE( obstacles.is_built() );
+        int found = 0;
+        for (int k = 0; k < 2000; k += 1){
+            obstacles.find_all(xs[k], ys[k], ids);
+            sort(ids.begin(), ids.end());
+            REQUIRE( ids == expected[k] );
+            REQUIRE( obstacles.contains_any(xs[k], ys[k]) == !ids.empty() );
+            found += (int)ids.size();
+        }
+        REQUIRE( found > 0 );
+
+        vector<unsigned char> hits(2000);
+        REQUIRE( obstacles.contains_any_batch(2000, xs.data(), ys.data(), hits.data()) );
+        for (int k = 0; k < 2000; k += 1){
+            REQUIRE( hits[k] == !expected[k].empty() );
+        }
+        obstacles.add(100.0, 100.0, 1.0);
+        REQUIRE_FALSE( obstacles.is_built() );
+        REQUIRE( obstacles.contains_any(100.5, 100.0) );
+    }
+
+    SECTION( "Far apart circles keep a small grid" ) {
+        double spans[3] = {1e15, 1e9*1.37, 3e299};
+        for (int k = 0; k < 3; k += 1){
+            ObstacleSet far;
+            REQUIRE( far.add(0.0, 0.0, 0.001) == 0 );
+            REQUIRE( far.add(spans[k], 0.0, 0.001) == 1 );
+            REQUIRE( far.add(0.5*spans[k], 2.0, 0.001) == 2 );
+            far.build();
+            REQUIRE( far.contains_any(0.0, 0.0) );
+            REQUIRE( far.contains_any(spans[k], 0.0) );
+            REQUIRE( far.contains_any(0.5*spans[k], 2.0) );
+            REQUIRE_FALSE( far.contains_any(0.25*spans[k], 0.0) );
+        }
+    }
+
+    SECTION( "Manipulator end effector" ) {
+        ObstacleSet single;
+        single.add(3.0, 0.0, 0.1);
+        single.add(-3.0, 0.0, 0.1);
+        single.build();
+        Manipulator manipulator;
+        double straight[3] = {0.0, 0.0, 0.0};
+        double bent[3] = {90.0, 0.0, 0.0};
+        double back[3] = {180.0, 0.0, 0.0};
+        REQUIRE( manipulator.intersection(single, straight) );
+        REQUIRE_FALSE( manipulator.intersection(single, bent) );
+        REQUIRE( manipulator.intersection(single, back) );
+        REQUIRE( manipulator.get_config().theta == 180.0 );
+
+        obstacles.build();
+        Configuration config = manipulator.get_config();
+        const int count = 300;
+        double values[3][count];
+        const double *angles[3] = {values[0], values[1], values[2]};
+        for (int k = 0; k < count; k += 1){
+            for (int i = 0; i < 3; i += 1){
+                values[i][k] = ((double)rand() / RAND_MAX - 0.5) * 360.0;
+            }
+        }
+        unsigned char hits[count];
+        REQUIRE( obstacles.intersection_batch(config, count, angles, hits) );
+        for (int k = 0; k < count; k += 1){
+            double joints[3] = {values[0][k], values[1][k], values[2][k]};
+            REQUIRE( hits[k] == manipulator.intersection(obstacles, joints) );
+        }
+    }
+}
+
+
+TEST_CASE( "Arm Collision Tests" ) {
+
+    Manipulator manipulator;
+    double straight[3] = {0.0, 0.0, 0.0};
+    double up[3] = {90.0, 0.0, 0.0};
+    manipulator.forward_kinematics(straight);
+
+    SECTION( "Segments against circles" ) {
+        ObstacleSet obstacles;
+        obstacles.add(1.5, 0.5, 0.4);
+        REQUIRE_FALSE( obstacles.segment_intersects_any(0.0, 0.0, 3.0, 0.0) );
+        REQUIRE( obstacles.segment_intersects_any(0.0, 0.0, 3.0, 0.2) );
+        // Only the end lies in the circle, then a zero length segment inside
+        REQUIRE( obstacles.segment_intersects_any(1.5, 0.2, 1.5, -5.0) );
+        REQUIRE( obstacles.segment_intersects_any(1.5, 0.5, 1.5, 0.5) );
+        obstacles.build();
+        REQUIRE_FALSE( obstacles.segment_intersects_any(0.0, 0.0, 3.0, 0.0) );
+        REQUIRE( obstacles.segment_intersects_any(0.0, 0.0, 3.0, 0.2) );
+        REQUIRE( obstacles.segment_intersects_any(1.5, 0.2, 1.5, -5.0) );
+    }
+
+    SECTION( "First colliding link" ) {
+        ObstacleSet obstacles;
+        obstacles.add(1.5, 0.05, 0.1);
+        obstacles.add(-0.5, 2.05, 0.1);
+        obstacles.build();
+        REQUIRE( manipulator.arm_collision(obstacles) == 1 );
+        // End effector is clear of both circles
+        REQUIRE_FALSE( obstacles.contains_any(manipulator.get_config().x, 
+                                              manipulator.get_config().y) );
+        manipulator.forward_kinematics(up);
+        REQUIRE( manipulator.arm_collision(obstacles) == -1 );
+        double bent[3] = {90.0, 0.0, 90.0};
+        manipulator.forward_kinematics(bent);
+        REQUIRE( manipulator.arm_collision(obstacles) == 2 );
+    }
+
+    SECTION( "Batch matches single arm checks" ) {
+        double links[5] = {1.0, 0.8, 0.6, 0.4, 0.2};
+        manipulator.set_parameters(5, links);
+        Configuration config = manipulator.get_config();
+        const int count = 700;
+        double values[5][count];
+        const double *angles[5];
+        for (int i = 0; i < 5; i += 1){
+            for (int k = 0; k < count; k += 1){
+                values[i][k] = ((double)rand() / RAND_MAX - 0.5) * 360.0;
+            }
+            angles[i] = values[i];
+        }
+
+        // Few circles take the vectorized path, many take the grid
+        int sizes[2] = {8, 500};
+        for (int s = 0; s < 2; s += 1){
+            ObstacleSet obstacles;
+            for (int c = 0; c < sizes[s]; c += 1){
+                double x = ((double)rand() / RAND_MAX - 0.5) * 6.0;
+                double y = ((double)rand() / RAND_MAX - 0.5) * 6.0;
+                obstacles.add(x, y, (double)rand() / RAND_MAX * 0.4 / (1 + s*4));
+            }
+            obstacles.build();
+            unsigned char hits[count];
+            REQUIRE( obstacles.collision_batch(config, count, angles, hits) );
+            int collisions = 0;
+            for (int k = 0; k < count; k += 1){
+                double joints[5];
+                for (int i = 0; i < 5; i += 1){
+                    joints[i] = values[i][k];
+                }
+                manipulator.forward_kinematics(joints);
+                REQUIRE( hits[k] == (manipulator.arm_collision(obstacles) >= 0) );
+                collisions += hits[k];
+            }
+            REQUIRE( collisions > 0 );
+            REQUIRE( collisions < count );
+        }
+    }
+
+    SECTION( "Batch joint positions" ) {
+        const int count = 37;
+        double values[3][count];
+        const double *angles[3] = {values[0], values[1], values[2]};
+        double out_x[4][count], out_y[4][count];
+        double *joint_x[4] = {out_x[0], out_x[1], out_x[2], out_x[3]};
+        double *joint_y[4] = {out_y[0], out_y[1], out_y[2], out_y[3]};
+        for (int k = 0; k < count; k += 1){
+            for (int i = 0; i < 3; i += 1){
+                values[i][k] = ((double)rand() / RAND_MAX - 0.5) * 720.0;
+            }
+        }
+        Configuration config = manipulator.get_config();
+        for (int level = SIMD_SCALAR; level <= SIMD_AVX512; level += 1){
+            REQUIRE( joint_positions_batch(config, count, angles, joint_x, joint_y, 
+                                           (SimdLevel)level) );
+            for (int k = 0; k < count; k += 1){
+                double joints[3] = {values[0][k], values[1][k], values[2][k]};
+                double x[4], y[4];
+                manipulator.forward_kinematics(joints);
+                manipulator.get_joint_positions(x, y);
+                for (int j = 0; j < 4; j += 1){
+                    if (level == SIMD_SCALAR){
+                        REQUIRE( out_x[j][k] == x[j] );
+                        REQUIRE( out_y[j][k] == y[j] );
+                    }
+                    REQUIRE( abs(out_x[j][k] - x[j]) < BATCH_FK_TOLERANCE );
+                    REQUIRE( abs(out_y[j][k] - y[j]) < BATCH_FK_TOLERANCE );
+                }
+            }
+        }
+    }
+}
+
+
+TEST_CASE( "Self Collision Tests" ) {
+
+    SECTION( "Segment intersection" ) {
+        REQUIRE( segments_intersect(0, 0, 2, 2, 0, 2, 2, 0) );
+        REQUIRE_FALSE( segments_intersect(0, 0, 1, 1, 2, 2, 3, 0) );
+        // Touching end, collinear overlap and collinear gap
+        REQUIRE( segments_intersect(0, 0, 1, 0, 1, 0, 1, 1) );
+        REQUIRE( segments_intersect(0, 0, 2, 0, 1, 0, 3, 0) );
+        REQUIRE_FALSE( segments_intersect(0, 0, 1, 0, 2, 0, 3, 0) );
+    }
+
+    SECTION( "Manipulator" ) {
+        Manipulator manipulator;
+        double links[4] = {1.0, 1.0, 1.0, 1.0};
+        manipulator.set_parameters(4, links);
+        REQUIRE_FALSE( manipulator.self_collision(NULL, NULL) );
+
+        // Third link ends on the base, fourth lies over the first
+        double folded[4] = {0.0, 120.0, 120.0, 120.0};
+        manipulator.forward_kinematics(folded);
+        int a = -1, b = -1;
+        REQUIRE( manipulator.self_collision(&a, &b) );
+        REQUIRE( a == 0 );
+        REQUIRE( b >= 2 );
+
+        // Third link crosses the first
+        double crossed[4] = {0.0, 170.0, 170.0, 0.0};
+        manipulator.forward_kinematics(crossed);
+        REQUIRE( manipulator.self_collision(&a, &b) );
+        REQUIRE( a == 0 );
+        REQUIRE( b == 2 );
+        double square[4] = {0.0, 90.0, 90.0, 80.0};
+        manipulator.forward_kinematics(square);
+        REQUIRE_FALSE( manipulator.self_collision(&a, &b) );
+    }
+
+    SECTION( "Sweep and prune matches pairwise tests" ) {
+        const int n = 200;
+        vector<double> links(n, 1.0), angles(n), x(n + 1), y(n + 1), theta(n + 1);
+        SelfCollisionChecker checker;
+        int collisions = 0;
+        for (int trial = 0; trial < 200; trial += 1){
+            // Curls with small noise, some of them wrap over themselves
+            double turn = 300.0 / n + (trial % 5) * 0.15;
+            for (int i = 0; i < n; i += 1){
+                angles[i] = turn + ((double)rand() / RAND_MAX - 0.5) * (trial % 7);
+            }
+            compute_joint_frames(n, links.data(), angles.data(), 0, x.data(), y.data(), theta.data());
+            int a, b;
+            bool naive = compute_self_collision_naive(n, x.data(), y.data(), NULL, NULL);
+            bool swept = checker.check(n, x.data(), y.data(), &a, &b);
+            REQUIRE( swept == naive );
+            REQUIRE( compute_self_collision(n, x.data(), y.data(), NULL, NULL) == naive );
+            if (swept){
+                REQUIRE( b - a >= 2 );
+                REQUIRE( segments_intersect(x[a], y[a], x[a + 1], y[a + 1], 
+                                            x[b], y[b], x[b + 1], y[b + 1]) );
+            }
+            collisions += swept;
+        }
+        REQUIRE( collisions > 0 );
+        REQUIRE( collisions < 200 );
+    }
+}
+
+
+TEST_CASE( "Long Chain Tests" ) {
+
+    SECTION( "Link storage" ) {
+        LinkArray a(INLINE_LINKS + 1);
+        REQUIRE( a.is_inline() );
+        a[INLINE_LINKS] = 2.0;
+        REQUIRE( a.resize(1000) );
+        REQUIRE_FALSE( a.is_inline() );
+        REQUIRE( (uintptr_t)a.data() % LINK_ARRAY_ALIGNMENT == 0 );
+        REQUIRE( a[INLINE_LINKS] == 2.0 );
+        REQUIRE( a[999] == 0.0 );
+        a[999] = 3.0;
+
+        LinkArray b(a);
+        LinkArray c;
+        c = a;
+        REQUIRE( b.size() == 1000 );
+        REQUIRE( b.data() != a.data() );
+        REQUIRE( b[999] == 3.0 );
+        REQUIRE( c[999] == 3.0 );
+        LinkArray d(3);
+        d[2] = 4.0;
+        c = d;
+        REQUIRE( c.size() == 3 );
+        REQUIRE( c[2] == 4.0 );
+        REQUIRE_FALSE( a.resize(-1) );
+
+        // Values dropped by a shrink come back as zeros, whether the array
+        // grows within its storage or past it, and copies only take size()
+        for (int grow = 8; grow <= 100; grow += 92){
+            LinkArray e(8);
+            for (int i = 0; i < 8; i += 1){
+                e[i] = i + 1.0;
+            }
+            REQUIRE( e.resize(2) );
+            LinkArray f(e);
+            REQUIRE( e.resize(grow) );
+            REQUIRE( f.resize(grow) );
+            REQUIRE( e[1] == 2.0 );
+            REQUIRE( f[1] == 2.0 );
+            for (int i = 2; i < grow; i += 1){
+                REQUIRE( e[i] == 0.0 );
+                REQUIRE( f[i] == 0.0 );
+            }
+        }
+
+        Configuration config;
+        REQUIRE( config.resize(500) );
+        REQUIRE( config.num_links == 500 );
+        REQUIRE( config.links.size() == 500 );
+        REQUIRE( config.angles.size() == 500 );
+        REQUIRE( config.is_consistent() );
+        Configuration copy = config;
+        REQUIRE( copy.resize(4) );
+        REQUIRE( copy.links.size() == 4 );
+        REQUIRE( copy.is_consistent() );
+    }
+
+    SECTION( "Manipulator beyond the inline size" ) {
+        Manipulator manipulator;
+        double links[INLINE_LINKS + 2];
+        for (int i = 0; i < INLINE_LINKS + 2; i += 1){
+            links[i] = 0.5;
+        }
+        REQUIRE_FALSE( manipulator.set_parameters(0, links) );
+        REQUIRE( manipulator.set_parameters(INLINE_LINKS + 2, links) );
+        Configuration config = manipulator.get_config();
+        REQUIRE( config.num_links == INLINE_LINKS + 2 );
+        REQUIRE( config.x == Approx(0.5*(INLINE_LINKS + 2)) );
+        REQUIRE( config.y == Approx(0.0) );
+    }
+
+    SECTION( "Long chain kinematics match libm" ) {
+        const int n = 1000;
+        vector<double> links(n), angles(n);
+        for (int i = 0; i < n; i += 1){
+            links[i] = 0.01 + 0.01*((double)rand() / RAND_MAX);
+            angles[i] = 360.0*((double)rand() / RAND_MAX) - 180.0;
+        }
+        Manipulator manipulator;
+        REQUIRE( manipulator.set_parameters(n, links.data()) );
+        REQUIRE( manipulator.forward_kinematics(angles.data()) );
+
+        // Reference with libm, one link at a time
+        const double pi = 3.14159265359;
+        vector<double> ref_x(n + 1), ref_y(n + 1);
+        double t = 0;
+        ref_x[0] = 0;
+        ref_y[0] = 0;
+        for (int i = 0; i < n; i += 1){
+            t += angles[i];
+            ref_x[i + 1] = ref_x[i] + links[i]*cos(t*pi/180.0);
+            ref_y[i + 1] = ref_y[i] + links[i]*sin(t*pi/180.0);
+        }
+        vector<double> x(n + 1), y(n + 1);
+        manipulator.get_joint_positions(x.data(), y.data());
+        for (int i = 0; i <= n; i += 1){
+            REQUIRE( fabs(x[i] - ref_x[i]) < BATCH_FK_TOLERANCE );
+            REQUIRE( fabs(y[i] - ref_y[i]) < BATCH_FK_TOLERANCE );
+        }
+        const Configuration &config = manipulator.get_config_ref();
+        Pose pose = compute_forward_kinematics(config, angles.data());
+        REQUIRE( pose.x == config.x );
+        REQUIRE( pose.y == config.y );
+        REQUIRE( pose.theta == config.theta );
+
+        // Partial updates give the same frames as a full pass
+        REQUIRE( manipulator.update_joint(n / 3, 12.5) == n - n / 3 );
+        angles[n / 3] = 12.5;
+        vector<double> full_x(n + 1), full_y(n + 1), full_theta(n + 1);
+        compute_joint_frames(n, links.data(), angles.data(), 0, 
+                            full_x.data(), full_y.data(), full_theta.data());
+        manipulator.get_joint_positions(x.data(), y.data());
+        for (int i = 0; i <= n; i += 1){
+            REQUIRE( x[i] == full_x[i] );
+            REQUIRE( y[i] == full_y[i] );
+        }
+
+        // Jacobian columns and torques from the joint positions
+        vector<double> jacobian(3*n), torques(n), expected(n);
+        REQUIRE( compute_jacobian(config, angles.data(), jacobian.data()) );
+        REQUIRE( compute_inverse_dynamics(config, angles.data(), 1.0, -2.0, 0.5, torques.data()) );
+        compute_inverse_dynamics_from_joints(n, full_x.data(), full_y.data(), 1.0, -2.0, 0.5, 
+                                            expected.data());
+        for (int i = 0; i < n; i += 1){
+            REQUIRE( fabs(jacobian[i] + (full_y[n] - full_y[i])) < BATCH_FK_TOLERANCE );
+            REQUIRE( fabs(jacobian[n + i] - (full_x[n] - full_x[i])) < BATCH_FK_TOLERANCE );
+            REQUIRE( jacobian[2*n + i] == 1.0 );
+            REQUIRE( fabs(torques[i] - expected[i]) < BATCH_FK_TOLERANCE );
+        }
+    }
+}
+
+
+TEST_CASE( "Parallel Chain Tests" ) {
+    const int n = 20000;
+    vector<double> links(n), angles(n);
+    for (int i = 0; i < n; i += 1){
+        links[i] = 0.001 + 0.001*((double)rand() / RAND_MAX);
+        angles[i] = 20.0*((double)rand() / RAND_MAX) - 10.0;
+    }
+    ParallelChainOptions options = default_parallel_chain_options();
+    options.threads = 4;
+    options.min_links_per_thread = 1000;
+
+    SECTION( "Crossover" ) {
+        REQUIRE( parallel_chain_threads(n, options) == 4 );
+        REQUIRE( parallel_chain_threads(3500, options) == 3 );
+        REQUIRE( parallel_chain_threads(2999, options) == 1 );
+        REQUIRE( parallel_chain_threads(100, default_parallel_chain_options()) == 1 );
+
+        // Lower crossover, as used to measure two threads
+        ParallelChainOptions two = options;
+        two.min_threads = 2;
+        REQUIRE( parallel_chain_threads(2999, two) == 2 );
+        REQUIRE( parallel_chain_threads(1999, two) == 1 );
+    }
+
+    SECTION( "Runs on the given pool" ) {
+        ThreadPoolOptions pool_options = default_thread_pool_options();
+        pool_options.threads = 2;
+        ThreadPool pool(pool_options);
+        ParallelChainOptions on_pool = options;
+        on_pool.pool = &pool;
+        vector<double> x(n + 1), y(n + 1), theta(n + 1);
+        vector<double> px(n + 1), py(n + 1), ptheta(n + 1);
+        compute_joint_frames(n, links.data(), angles.data(), 0, x.data(), y.data(), theta.data());
+        compute_joint_frames_parallel(n, links.data(), angles.data(), 0, 
+                                    px.data(), py.data(), ptheta.data(), on_pool);
+        REQUIRE( pool.size() == 2 );
+        for (int i = 0; i <= n; i += 1){
+            REQUIRE( fabs(px[i] - x[i]) < BATCH_FK_TOLERANCE );
+            REQUIRE( fabs(py[i] - y[i]) < BATCH_FK_TOLERANCE );
+        }
+        uint64_t chunks = 0;
+        for (int w = 0; w < pool.size(); w += 1){
+            chunks += pool.get_worker_stats(w).chunks;
+        }
+        REQUIRE( chunks == 12 );
+    }
+
+    SECTION( "Matches the serial path" ) {
+        vector<double> x(n + 1), y(n + 1), theta(n + 1);
+        vector<double> px(n + 1), py(n + 1), ptheta(n + 1);
+        compute_joint_frames(n, links.data(), angles.data(), 0, x.data(), y.data(), theta.data());
+        compute_joint_frames_parallel(n, links.data(), angles.data(), 0, 
+                                    px.data(), py.data(), ptheta.data(), options);
+        for (int i = 0; i <= n; i += 1){
+            REQUIRE( fabs(px[i] - x[i]) < BATCH_FK_TOLERANCE );
+            REQUIRE( fabs(py[i] - y[i]) < BATCH_FK_TOLERANCE );
+            REQUIRE( fabs(ptheta[i] - theta[i]) < BATCH_FK_TOLERANCE );
+        }
+
+        // Partial update from a frame in the middle of a chunk
+        angles[7777] += 5.0;
+        compute_joint_frames(n, links.data(), angles.data(), 7777, x.data(), y.data(), theta.data());
+        compute_joint_frames_parallel(n, links.data(), angles.data(), 7777, 
+                                    px.data(), py.data(), ptheta.data(), options);
+        for (int i = 0; i <= n; i += 1){
+            REQUIRE( fabs(px[i] - x[i]) < BATCH_FK_TOLERANCE );
+            REQUIRE( fabs(py[i] - y[i]) < BATCH_FK_TOLERANCE );
+        }
+
+        Configuration config;
+        config.resize(n);
+        for (int i = 0; i < n; i += 1){
+            config.links[i] = links[i];
+        }
+        Pose pose = compute_forward_kinematics_parallel(config, angles.data(), options);
+        REQUIRE( fabs(pose.x - x[n]) < BATCH_FK_TOLERANCE );
+        REQUIRE( fabs(pose.y - y[n]) < BATCH_FK_TOLERANCE );
+        REQUIRE( fabs(pose.theta - clip_angle_180(theta[n])) < BATCH_FK_TOLERANCE );
+    }
+
+    SECTION( "Manipulator" ) {
+        Manipulator serial, parallel;
+        parallel.set_parallel_chain_options(options);
+        REQUIRE( serial.set_parameters(n, links.data()) );
+        REQUIRE( parallel.set_parameters(n, links.data()) );
+        serial.forward_kinematics(angles.data());
+        parallel.forward_kinematics(angles.data());
+        REQUIRE( fabs(parallel.get_config_ref().x - serial.get_config_ref().x) < BATCH_FK_TOLERANCE );
+        REQUIRE( fabs(parallel.get_config_ref().y - serial.get_config_ref().y) < BATCH_FK_TOLERANCE );
+        REQUIRE( parallel.update_joint(100, 30.0) == n - 100 );
+        serial.update_joint(100, 30.0);
+        REQUIRE( fabs(parallel.get_config_ref().x - serial.get_config_ref().x) < BATCH_FK_TOLERANCE );
+        REQUIRE( fabs(parallel.get_config_ref().y - serial.get_config_ref().y) < BATCH_FK_TOLERANCE );
+    }
+}
+
+
+TEST_CASE( "Thread Pool Tests" ) {
+    ThreadPoolOptions options = default_thread_pool_options();
+    options.threads = 4;
+
+    SECTION( "Every item runs once" ) {
+        ThreadPool pool(options);
+        REQUIRE( pool.size() == 4 );
+        vector<int> runs(10007, 0);
+        for (int job = 0; job < 3; job += 1){
+            pool.parallel_for((int)runs.size(), 64, [&](int begin, int end){
+                for (int i = begin; i < end; i += 1){
+                    runs[i] += 1;
+                }
+            });
+        }
+        uint64_t chunks = 0;
+        for (int w = 0; w < pool.size(); w += 1){
+            WorkerStats stats = pool.get_worker_stats(w);
+            chunks += stats.chunks;
+            REQUIRE( stats.stolen <= stats.chunks );
+            REQUIRE( stats.utilization >= 0.0 );
+            REQUIRE( stats.utilization <= 1.0 );
+        }
+        REQUIRE( chunks == 3*157 );
+        for (size_t i = 0; i < runs.size(); i += 1){
+            REQUIRE( runs[i] == 3 );
+        }
+        pool.reset_stats();
+        REQUIRE( pool.get_worker_stats(0).chunks == 0 );
+        REQUIRE( pool.chunk_size(8) == THREAD_POOL_CHUNK_BYTES / 8 );
+        REQUIRE( pool.chunk_size(1 << 20) == 16 );
+    }
+
+    SECTION( "Idle workers steal" ) {
+        ThreadPool pool(options);
+        // Only the chunks of worker 0 are slow, others finish and take them
+        pool.parallel_for(64, 1, [&](int begin, int){
+            if (begin < 16){
+                this_thread::sleep_for(chrono::milliseconds(2));
+            }
+        });
+        uint64_t stolen = 0;
+        for (int w = 0; w < pool.size(); w += 1){
+            stolen += pool.get_worker_stats(w).stolen;
+        }
+        REQUIRE( stolen > 0 );
+    }
+
+    SECTION( "Pinned workers" ) {
+        options.pinning = PIN_CORES;
+        ThreadPool cores(options);
+        REQUIRE( cores.get_worker_stats(0).cpu >= 0 );
+        REQUIRE( cores.get_num_nodes() >= 1 );
+        options.pinning = PIN_NUMA_NODES;
+        ThreadPool nodes(options);
+        REQUIRE( nodes.get_worker_stats(0).cpu == -1 );
+        atomic<int> sum(0);
+        nodes.parallel_for(1000, 16, [&](int begin, int end){
+            sum += end - begin;
+        });
+        REQUIRE( sum == 1000 );
+    }
+
+    SECTION( "Batch jobs match single thread calls" ) {
+        ThreadPool pool(options);
+        const int count = 5000;
+        Configuration config;
+        config.resize(3);
+        config.links[0] = 1.0;
+        config.links[1] = 0.8;
+        config.links[2] = 0.5;
+        vector<double> a0(count), a1(count), a2(count);
+        for (int i = 0; i < count; i += 1){
+            a0[i] = 360.0*((double)rand() / RAND_MAX) - 180.0;
+            a1[i] = 360.0*((double)rand() / RAND_MAX) - 180.0;
+            a2[i] = 360.0*((double)rand() / RAND_MAX) - 180.0;
+        }
+        const double *angles[3] = {a0.data(), a1.data(), a2.data()};
+
+        vector<double> x(count), y(count), t(count), px(count), py(count), pt(count);
+        REQUIRE( forward_kinematics_batch(config, count, angles, x.data(), y.data(), t.data()) );
+        REQUIRE( forward_kinematics_batch(pool, config, count, angles, 
+                                        px.data(), py.data(), pt.data()) );
+        REQUIRE( px == x );
+        REQUIRE( py == y );
+        REQUIRE( pt == t );
+
+        vector<double> s1(3*count), s2(3*count), p1(3*count), p2(3*count);
+        double *sol_1[3] = {&s1[0], &s1[count], &s1[2*count]};
+        double *sol_2[3] = {&s2[0], &s2[count], &s2[2*count]};
+        double *par_1[3] = {&p1[0], &p1[count], &p1[2*count]};
+        double *par_2[3] = {&p2[0], &p2[count], &p2[2*count]};
+        vector<unsigned char> reach(count), par_reach(count);
+        REQUIRE( inverse_kinematics_batch(config, count, x.data(), y.data(), t.data(),
+                                        sol_1, sol_2, reach.data()) );
+        REQUIRE( inverse_kinematics_batch(pool, config, count, x.data(), y.data(), t.data(),
+                                        par_1, par_2, par_reach.data()) );
+        REQUIRE( par_reach == reach );
+        for (int i = 0; i < 3*count; i += 1){
+            REQUIRE( (p1[i] == s1[i] || (p1[i] != p1[i] && s1[i] != s1[i])) );
+        }
+
+        ObstacleSet obstacles;
+        obstacles.add(1.0, 1.0, 0.5);
+        obstacles.add(-1.5, 0.2, 0.7);
+        obstacles.build();
+        vector<unsigned char> hits(count), par_hits(count);
+        REQUIRE( obstacles.intersection_batch(config, count, angles, hits.data()) );
+        REQUIRE( intersection_batch(pool, obstacles, config, count, angles, par_hits.data()) );
+        REQUIRE( par_hits == hits );
+
+        double joint_angles[3] = {30.0, -45.0, 10.0};
+        vector<double> torques(3*count), par_torques(3*count);
+        double *tq[3] = {&torques[0], &torques[count], &torques[2*count]};
+        double *ptq[3] = {&par_torques[0], &par_torques[count], &par_torques[2*count]};
+        REQUIRE( inverse_dynamics_batch(config, joint_angles, count, a0.data(), a1.data(), 
+                                        a2.data(), tq) );
+        REQUIRE( inverse_dynamics_batch(pool, config, joint_angles, count, a0.data(), a1.data(),
+                                        a2.data(), ptq) );
+        REQUIRE( par_torques == torques );
+    }
+}
+
+
+TEST_CASE( "Socket Server Tests" ) {
+
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/robot-manipulator-test-%d.sock", (int)getpid());
+    SocketServer server;
+    REQUIRE( server.listen(path) );
+    thread serving([&server](){ server.run(); });
+
+    // Stops the server even when a section fails
+    struct Stopper{
+        SocketServer &server;
+        thread &serving;
+        ~Stopper(){
+            if (serving.joinable()){
+                server.stop();
+                serving.join();
+            }
+        }
+    } stopper = {server, serving};
+
+    SECTION( "Pipelined requests come back in order" ) {
+        SocketClient client;
+        REQUIRE( client.connect(path) );
+        Manipulator manipulator;
+        const int count = 200;
+        vector<double> angles(3*count);
+        for (int i = 0; i < 3*count; i += 1){
+            angles[i] = 360.0*((double)rand() / RAND_MAX) - 180.0;
+        }
+        REQUIRE( client.send(OP_PING, 7, NULL, 0) );
+        for (int i = 0; i < count; i += 1){
+            REQUIRE( client.send(OP_FORWARD, 100 + i, &angles[3*i], 3) );
+        }
+
+        SocketResponse response;
+        REQUIRE( client.receive(response) );
+        REQUIRE( response.opcode == OP_PING );
+        REQUIRE( response.id == 7 );
+        REQUIRE( response.values.empty() );
+        for (int i = 0; i < count; i += 1){
+            REQUIRE( client.receive(response) );
+            REQUIRE( response.status == STATUS_OK );
+            REQUIRE( response.id == (uint64_t)(100 + i) );
+            REQUIRE( response.values.size() == 3 );
+            manipulator.forward_kinematics(&angles[3*i]);
+            Configuration config = manipulator.get_config();
+            REQUIRE( response.values[0] == config.x );
+            REQUIRE( response.values[1] == config.y );
+            REQUIRE( response.values[2] == config.theta );
+        }
+    }
+
+    SECTION( "Commands follow batch mode" ) {
+        SocketClient client;
+        REQUIRE( client.connect(path) );
+        SocketResponse response;
+
+        double target[3] = {1.0, 1.0, 45.0};
+        REQUIRE( client.send(OP_INVERSE_K, 1, target, 3) );
+        REQUIRE( client.receive(response) );
+        REQUIRE( response.status == STATUS_OK );
+        REQUIRE( response.values.size() == 6 );
+        Manipulator manipulator;
+        manipulator.forward_kinematics(response.values.data());
+        REQUIRE( manipulator.get_config().x == Approx(1.0) );
+        REQUIRE( manipulator.get_config().y == Approx(1.0) );
+
+        double far[3] = {10.0, 10.0, 0.0};
+        REQUIRE( client.send(OP_INVERSE_K, 2, far, 3) );
+        REQUIRE( client.receive(response) );
+        REQUIRE( response.status == STATUS_UNREACHABLE );
+        REQUIRE( response.values.empty() );
+
+        double circle[6] = {3.0, 0.0, 0.2, 0.0, 0.0, 0.0};
+        REQUIRE( client.send(OP_INTERSECTION, 3, circle, 6) );
+        REQUIRE( client.receive(response) );
+        REQUIRE( response.values.size() == 1 );
+        REQUIRE( response.values[0] == 1.0 );
+
+        double links[4] = {1.0, 1.0, 1.0, 1.0};
+        REQUIRE( client.send(OP_LINKS, 4, links, 4) );
+        REQUIRE( client.receive(response) );
+        REQUIRE( response.status == STATUS_OK );
+        REQUIRE( client.send(OP_FORWARD, 5, links, 3) );
+        REQUIRE( client.receive(response) );
+        REQUIRE( response.status == STATUS_BAD_REQUEST );
+
+        double force[3] = {0.0, 1.0, 0.0};
+        REQUIRE( client.send(OP_INVERSE_D, 6, force, 3) );
+        REQUIRE( client.receive(response) );
+        REQUIRE( response.status == STATUS_OK );
+        REQUIRE( response.values.size() == 4 );
+        REQUIRE( response.values[0] == Approx(4.0) );
+
+        REQUIRE( client.send(99, 7, NULL, 0) );
+        REQUIRE( client.receive(response) );
+        REQUIRE( response.status == STATUS_UNKNOWN_OPCODE );
+        REQUIRE( response.id == 7 );
+    }
+
+    SECTION( "Half-closed client with unread output" ) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+        REQUIRE( ::connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0 );
+        struct timeval timeout = {5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        // Pipeline pings until the server stops reading, its output full
+        unsigned char ping[SOCKET_HEADER_BYTES];
+        memset(ping, 0, sizeof(ping));
+        uint64_t sent = 0;
+        for (int stalls = 0; stalls < 20; ){
+            if (send(fd, ping, sizeof(ping), MSG_DONTWAIT) == (ssize_t)sizeof(ping)){
+                sent += 1;
+                stalls = 0;
+            }
+            else{
+                stalls += 1;
+                this_thread::sleep_for(chrono::milliseconds(5));
+            }
+        }
+        REQUIRE( sent*SOCKET_HEADER_BYTES > default_socket_server_options().max_output_bytes );
+        REQUIRE( shutdown(fd, SHUT_WR) == 0 );
+
+        // The server must wait for the client to read, not spin
+        clockid_t clock;
+        REQUIRE( pthread_getcpuclockid(serving.native_handle(), &clock) == 0 );
+        struct timespec before, after;
+        clock_gettime(clock, &before);
+        this_thread::sleep_for(chrono::milliseconds(200));
+        clock_gettime(clock, &after);
+        double busy = (after.tv_sec - before.tv_sec) + 1e-9*(after.tv_nsec - before.tv_nsec);
+        REQUIRE( busy < 0.05 );
+
+        // Every ping is answered, then the server closes the connection
+        unsigned char buffer[65536];
+        uint64_t received = 0;
+        ssize_t n;
+        while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0){
+            received += n;
+        }
+        REQUIRE( n == 0 );
+        REQUIRE( received == sent*SOCKET_HEADER_BYTES );
+        ::close(fd);
+    }
+
+    SECTION( "Out of range values are rejected" ) {
+        SocketClient client;
+        REQUIRE( client.connect(path) );
+        SocketResponse response;
+        double angles[3] = {0.0, INFINITY, 1e300};
+        REQUIRE( client.send(OP_FORWARD, 1, angles, 3) );
+        double circle[6] = {NAN, 0.0, 0.2, 0.0, 0.0, 0.0};
+        REQUIRE( client.send(OP_INTERSECTION, 2, circle, 6) );
+        double target[3] = {1.0, 1.0, 1e12};
+        REQUIRE( client.send(OP_INVERSE_K, 3, target, 3) );
+        for (int i = 1; i <= 3; i += 1){
+            REQUIRE( client.receive(response) );
+            REQUIRE( response.id == (uint64_t)i );
+            REQUIRE( response.status == STATUS_BAD_REQUEST );
+            REQUIRE( response.values.empty() );
+        }
+
+        // The connection still serves valid requests
+        double zero[3] = {0.0, 0.0, 0.0};
+        REQUIRE( client.send(OP_FORWARD, 4, zero, 3) );
+        REQUIRE( client.receive(response) );
+        REQUIRE( response.status == STATUS_OK );
+        REQUIRE( response.values[0] == Approx(3.0) );
+    }
+
+    SECTION( "Each client has its own manipulator" ) {
+        SocketClient a, b;
+        REQUIRE( a.connect(path) );
+        REQUIRE( b.connect(path) );
+        SocketResponse response;
+        double links[2] = {1.0, 1.0};
+        double angles[3] = {0.0, 0.0, 0.0};
+        REQUIRE( a.send(OP_LINKS, 1, links, 2) );
+        REQUIRE( a.receive(response) );
+        REQUIRE( b.send(OP_FORWARD, 2, angles, 3) );
+        REQUIRE( a.send(OP_FORWARD, 3, angles, 2) );
+        REQUIRE( b.receive(response) );
+        REQUIRE( response.values[0] == Approx(3.0) );
+        REQUIRE( a.receive(response) );
+        REQUIRE( response.values[0] == Approx(2.0) );
+    }
+
+    server.stop();
+    serving.join();
+    SocketServerStats stats = server.get_stats();
+    REQUIRE( stats.connections >= 1 );
+    REQUIRE( stats.requests >= 2 );
+    REQUIRE( stats.bytes_out > 0 );
+    server.close();
+    REQUIRE( access(path, F_OK) != 0 );
+}
+
+
+TEST_CASE( "IK Scheduler Tests" ) {
+
+    Configuration config;
+    config.resize(3);
+    config.links[0] = 1.0;
+    config.links[1] = 0.8;
+    config.links[2] = 0.5;
+    const int count = 256;
+    vector<double> x(count), y(count), t(count);
+    for (int i = 0; i < count; i += 1){
+        double angles[3];
+        for (int j = 0; j < 3; j += 1){
+            angles[j] = 360.0*((double)rand() / RAND_MAX) - 180.0;
+        }
+        Pose pose = compute_forward_kinematics(config, angles);
+        x[i] = pose.x;
+        y[i] = pose.y;
+        t[i] = pose.theta;
+    }
+    x[0] = 10.0;
+
+    vector<double> s1(3*count), s2(3*count);
+    double *sol_1[3] = {&s1[0], &s1[count], &s1[2*count]};
+    double *sol_2[3] = {&s2[0], &s2[count], &s2[2*count]};
+    vector<unsigned char> reach(count);
+    REQUIRE( inverse_kinematics_batch(config, count, x.data(), y.data(), t.data(),
+                                    sol_1, sol_2, reach.data()) );
+
+    SECTION( "Full batches match the batch kernel" ) {
+        IkSchedulerOptions options = default_ik_scheduler_options();
+        options.max_batch = 16;
+        options.max_delay_us = 1e7;
+        IkScheduler scheduler(config, options);
+        vector<IkResult> results(count);
+        atomic<int> done(0);
+        for (int i = 0; i < count; i += 1){
+            REQUIRE( scheduler.submit(x[i], y[i], t[i], [&results, &done, i](const IkResult &r){
+                results[i] = r;
+                done += 1;
+            }) );
+        }
+        while (done < count){
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        for (int i = 0; i < count; i += 1){
+            REQUIRE( results[i].reachable == (reach[i] != 0) );
+            for (int j = 0; j < 3; j += 1){
+                REQUIRE( (results[i].angles_1[j] == sol_1[j][i] || !reach[i]) );
+                REQUIRE( (results[i].angles_2[j] == sol_2[j][i] || !reach[i]) );
+            }
+        }
+        IkSchedulerStats stats = scheduler.get_stats();
+        REQUIRE( stats.requests == (uint64_t)count );
+        REQUIRE( stats.batches == (uint64_t)(count / 16) );
+        REQUIRE( stats.full_batches == stats.batches );
+        REQUIRE( stats.batch_sizes.size() == 17 );
+        REQUIRE( stats.batch_sizes[16] == stats.batches );
+        REQUIRE( stats.mean_batch == 16.0 );
+    }
+
+    SECTION( "A lone request leaves at its deadline" ) {
+        IkSchedulerOptions options = default_ik_scheduler_options();
+        options.max_batch = 64;
+        options.max_delay_us = 200.0;
+        IkScheduler scheduler(config, options);
+        double a1[3], a2[3];
+        REQUIRE( scheduler.solve(x[1], y[1], t[1], a1, a2) == (reach[1] != 0) );
+        REQUIRE( !scheduler.solve(x[0], y[0], t[0], a1, a2) );
+        REQUIRE( a1[0] != a1[0] );
+        IkSchedulerStats stats = scheduler.get_stats();
+        REQUIRE( stats.batches == 2 );
+        REQUIRE( stats.deadline_batches == 2 );
+        REQUIRE( stats.batch_sizes[1] == 2 );
+        REQUIRE( stats.p50_us >= 150.0 );
+        REQUIRE( stats.max_us >= stats.p99_us );
+
+        scheduler.reset_stats();
+        REQUIRE( scheduler.get_stats().requests == 0 );
+    }
+
+    SECTION( "Flush and destruction dispatch pending requests" ) {
+        IkSchedulerOptions options = default_ik_scheduler_options();
+        options.max_batch = 1000;
+        options.max_delay_us = 1e9;
+        atomic<int> done(0);
+        {
+            IkScheduler scheduler(config, options);
+            for (int i = 0; i < 10; i += 1){
+                scheduler.submit(x[i], y[i], t[i], [&done](const IkResult &){ done += 1; });
+            }
+            scheduler.flush();
+            while (done < 10){
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+            REQUIRE( scheduler.get_stats().batch_sizes[10] == 1 );
+            scheduler.submit(x[0], y[0], t[0], [&done](const IkResult &){ done += 1; });
+        }
+        REQUIRE( done == 11 );
+    }
+
+    SECTION( "Concurrent callers share batches" ) {
+        IkSchedulerOptions options = default_ik_scheduler_options();
+        options.max_batch = 8;
+        options.max_delay_us = 100.0;
+        IkScheduler scheduler(config, options);
+        atomic<int> mismatches(0);
+        vector<thread> callers;
+        for (int c = 0; c < 8; c += 1){
+            callers.push_back(thread([&, c](){
+                double a1[3], a2[3];
+                for (int i = c; i < count; i += 8){
+                    bool ok = scheduler.solve(x[i], y[i], t[i], a1, a2);
+                    // Batches of any size, so tails may run the scalar kernel
+                    if (ok != (reach[i] != 0) || (ok && (fabs(a1[0] - sol_1[0][i]) > BATCH_IK_TOLERANCE
+                                                    || fabs(a2[2] - sol_2[2][i]) > BATCH_IK_TOLERANCE))){
+                        mismatches += 1;
+                    }
+                }
+            }));
+        }
+        for (size_t c = 0; c < callers.size(); c += 1){
+            callers[c].join();
+        }
+        REQUIRE( mismatches == 0 );
+        IkSchedulerStats stats = scheduler.get_stats();
+        REQUIRE( stats.requests == (uint64_t)count );
+        uint64_t total = 0;
+        for (size_t b = 1; b < stats.batch_sizes.size(); b += 1){
+            total += b*stats.batch_sizes[b];
+        }
+        REQUIRE( total == (uint64_t)count );
+    }
+
+    SECTION( "Only 3 links are batched" ) {
+        Configuration four;
+        four.resize(4);
+        IkScheduler scheduler(four);
+        REQUIRE( !scheduler.submit(1.0, 1.0, 0.0, [](const IkResult &){}) );
+    }
+}
+
+
+TEST_CASE( "IK Cache Tests" ) {
+
+    Configuration config;
+    config.resize(3);
+    config.links[0] = 1.0;
+    config.links[1] = 0.8;
+    config.links[2] = 0.5;
+    uint64_t links_hash = hash_links(config);
+
+    SECTION( "Link hash follows the link lengths" ) {
+        Configuration other = config;
+        REQUIRE( hash_links(other) == links_hash );
+        other.links[2] = 0.5000001;
+        REQUIRE( hash_links(other) != links_hash );
+        other.resize(4);
+        other.links[2] = 0.5;
+        REQUIRE( hash_links(other) != links_hash );
+    }
+
+    SECTION( "Hits return the solution of the first target" ) {
+        IkCache cache;
+        double a1[3], a2[3], e1[3], e2[3];
+        REQUIRE( compute_inverse_kinematics(config, 1.2, 0.6, 30.0, e1, e2) );
+        REQUIRE( cache.solve(config, links_hash, 1.2, 0.6, 30.0, a1, a2) );
+        REQUIRE( cache.solve(config, links_hash, 1.2, 0.6, 30.0, a1, a2) );
+        for (int i = 0; i < 3; i += 1){
+            REQUIRE( a1[i] == e1[i] );
+            REQUIRE( a2[i] == e2[i] );
+        }
+        REQUIRE( !cache.solve(config, links_hash, 10.0, 0.0, 0.0, a1, a2) );
+        REQUIRE( !cache.solve(config, links_hash, 10.0, 0.0, 0.0, a1, a2) );
+        IkCacheStats stats = cache.get_stats();
+        REQUIRE( stats.hits == 2 );
+        REQUIRE( stats.misses == 2 );
+        REQUIRE( stats.size == 2 );
+        REQUIRE( stats.evictions == 0 );
+
+        cache.clear();
+        REQUIRE( cache.get_stats().size == 0 );
+        cache.reset_stats();
+        REQUIRE( cache.get_stats().hits == 0 );
+    }
+
+    SECTION( "Targets in one cell share a solution" ) {
+        IkCacheOptions options = default_ik_cache_options();
+        options.position_tolerance = 1e-3;
+        options.angle_tolerance = 1e-2;
+        IkCache cache(options);
+        double a1[3], a2[3], b1[3], b2[3];
+        REQUIRE( cache.solve(config, links_hash, 1.2001, 0.6001, 30.001, a1, a2) );
+        REQUIRE( cache.solve(config, links_hash, 1.2004, 0.6004, 30.004, b1, b2) );
+        REQUIRE( cache.get_stats().hits == 1 );
+        REQUIRE( b1[0] == a1[0] );
+        REQUIRE( cache.solve(config, links_hash, 1.2014, 0.6004, 30.004, b1, b2) );
+        REQUIRE( cache.get_stats().misses == 2 );
+    }
+
+    SECTION( "Invalid tolerances fall back to the defaults" ) {
+        IkCacheOptions options = default_ik_cache_options();
+        options.position_tolerance = 0.0;
+        options.angle_tolerance = -1e-3;
+        IkCache cache(options);
+        REQUIRE( cache.get_options().position_tolerance == default_ik_cache_options().position_tolerance );
+        REQUIRE( cache.get_options().angle_tolerance == default_ik_cache_options().angle_tolerance );
+        double a1[3], a2[3], b1[3], b2[3];
+        REQUIRE( cache.solve(config, links_hash, 1.2, 0.6, 30.0, a1, a2) );
+        REQUIRE( cache.solve(config, links_hash, 1.2, 0.6, 30.0, b1, b2) );
+        REQUIRE( cache.solve(config, links_hash, 1.2001, 0.6, 30.0, b1, b2) );
+        REQUIRE( cache.get_stats().hits == 1 );
+        REQUIRE( cache.get_stats().misses == 2 );
+
+        options.position_tolerance = NAN;
+        options.angle_tolerance = INFINITY;
+        IkCache other(options);
+        REQUIRE( other.get_options().position_tolerance == default_ik_cache_options().position_tolerance );
+        REQUIRE( other.get_options().angle_tolerance == default_ik_cache_options().angle_tolerance );
+    }
+
+    SECTION( "Targets without a cell count as misses" ) {
+        IkCache cache;
+        double a1[3], a2[3];
+        REQUIRE( !cache.solve(config, links_hash, NAN, 0.6, 30.0, a1, a2) );
+        REQUIRE( !cache.solve(config, links_hash, 1e300, 0.6, 30.0, a1, a2) );
+        IkCacheStats stats = cache.get_stats();
+        REQUIRE( stats.hits == 0 );
+        REQUIRE( stats.misses == 2 );
+        REQUIRE( stats.size == 0 );
+    }
+
+    SECTION( "Capacity is bounded" ) {
+        IkCacheOptions options = default_ik_cache_options();
+        options.capacity = 100;
+        IkCache cache(options);
+        REQUIRE( cache.get_options().capacity == IK_CACHE_SHARDS*IK_CACHE_WAYS*2 );
+        double a1[3], a2[3];
+        for (int i = 0; i < 1000; i += 1){
+            cache.solve(config, links_hash, 1.0 + 1e-4*i, 0.5, 10.0, a1, a2);
+        }
+        IkCacheStats stats = cache.get_stats();
+        REQUIRE( stats.misses == 1000 );
+        REQUIRE( stats.size <= stats.capacity );
+        REQUIRE( stats.evictions == 1000 - (uint64_t)stats.size );
+    }
+
+    SECTION( "Manipulator clears it on set_parameters" ) {
+        Manipulator manipulator;
+        manipulator.enable_ik_cache(default_ik_cache_options());
+        double a1[3], a2[3], b1[3], b2[3];
+        REQUIRE( manipulator.inverse_kinematics(1.0, 1.0, 45.0, a1, a2) );
+        REQUIRE( manipulator.inverse_kinematics(1.0, 1.0, 45.0, a1, a2) );
+        REQUIRE( manipulator.get_ik_cache_stats().hits == 1 );
+
+        double links[3] = {1.0, 0.8, 0.5};
+        manipulator.set_parameters(3, links);
+        REQUIRE( manipulator.get_ik_cache_stats().size == 0 );
+        REQUIRE( manipulator.inverse_kinematics(1.0, 1.0, 45.0, b1, b2) );
+        REQUIRE( manipulator.get_ik_cache_stats().hits == 1 );
+        REQUIRE( b1[0] != a1[0] );
+
+        manipulator.reset();
+        REQUIRE( manipulator.get_ik_cache_stats().size == 0 );
+        manipulator.disable_ik_cache();
+        REQUIRE( manipulator.get_ik_cache_stats().capacity == 0 );
+        REQUIRE( manipulator.inverse_kinematics(1.0, 1.0, 45.0, b1, b2) );
+        REQUIRE( b1[0] == a1[0] );
+    }
+
+    SECTION( "Threads share the cache" ) {
+        IkCache cache;
+        const int targets = 8;
+        atomic<int> mismatches(0);
+        vector<thread> threads;
+        for (int t = 0; t < 4; t += 1){
+            threads.push_back(thread([&](){
+                double a1[3], a2[3], e1[3], e2[3];
+                for (int i = 0; i < 2000; i += 1){
+                    double x = 1.0 + 0.05*(i % targets);
+                    bool ok = cache.solve(config, links_hash, x, 0.5, 20.0, a1, a2);
+                    compute_inverse_kinematics(config, x, 0.5, 20.0, e1, e2);
+                    if (!ok || a1[0] != e1[0] || a2[2] != e2[2]){
+                        mismatches += 1;
+                    }
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t += 1){
+            threads[t].join();
+        }
+        REQUIRE( mismatches == 0 );
+        IkCacheStats stats = cache.get_stats();
+        REQUIRE( stats.hits + stats.misses == 8000 );
+        REQUIRE( stats.size == targets );
+    }
+}
+
+
+TEST_CASE( "Fast Math Tests" ) {
+
+    const long double exact_pi = 3.141592653589793238462643383279502884L;
+
+    SECTION( "sincos is within its bound over the whole input range" ) {
+        double worst = 0;
+        for (int k = 0; k < 400000; k += 1){
+            // Dense around the first turns, then every binade up to 2^50
+            double deg = (k < 200000) ? (k - 100000)*0.0073
+                                      : ldexp(1.0 + (k % 997)/997.0, k % 50)*((k & 1) ? 1 : -1);
+            double s, c;
+            fast_sincos_deg(deg, s, c);
+            long double r = fmodl((long double)deg, 360.0L)*exact_pi/180.0L;
+            worst = max(worst, fabs(s - (double)sinl(r)));
+            worst = max(worst, fabs(c - (double)cosl(r)));
+        }
+        REQUIRE( worst <= FAST_SINCOS_MAX_ERROR );
+        REQUIRE( FAST_SINCOS_MAX_ERROR*FAST_RAD_TO_DEG <= FAST_SINCOS_MAX_ERROR_DEG );
+
+        double s, c;
+        fast_sincos_deg(90.0, s, c);
+        REQUIRE( s == 1.0 );
+        REQUIRE( c == 0.0 );
+        fast_sincos_deg(-180.0, s, c);
+        REQUIRE( c == -1.0 );
+    }
+
+    SECTION( "acos and asin are within their bound on [-1, 1]" ) {
+        double worst = 0;
+        for (int k = -500000; k <= 500000; k += 1){
+            double x = k*2e-6;
+            worst = max(worst, fabs(fast_acos_deg(x) - (double)(acosl(x)*180.0L/exact_pi)));
+            worst = max(worst, fabs(fast_asin_deg(x) - (double)(asinl(x)*180.0L/exact_pi)));
+        }
+        // Steepest next to +-1
+        for (int e = 1; e < 60; e += 1){
+            for (int sign = -1; sign <= 1; sign += 2){
+                double x = sign*(1.0 - ldexp(1.0, -e));
+                worst = max(worst, fabs(fast_acos_deg(x) - (double)(acosl(x)*180.0L/exact_pi)));
+                worst = max(worst, fabs(fast_asin_deg(x) - (double)(asinl(x)*180.0L/exact_pi)));
+            }
+        }
+        REQUIRE( worst <= FAST_ACOS_MAX_ERROR_DEG );
+        REQUIRE( fast_acos_deg(1.0) == 0.0 );
+        REQUIRE( fast_acos_deg(-1.0) == 180.0 );
+        REQUIRE( fast_asin_deg(0.0) == 0.0 );
+    }
+
+    SECTION( "atan2 is within its bound in every quadrant" ) {
+        double worst = 0;
+        for (int i = -600; i <= 600; i += 1){
+            for (int j = -600; j <= 600; j += 1){
+                double y = i*0.0131;
+                double x = j*0.0173;
+                double r = (double)(atan2l(y, x)*180.0L/exact_pi);
+                worst = max(worst, fabs(fast_atan2(y, x)*FAST_RAD_TO_DEG - r));
+            }
+        }
+        REQUIRE( worst <= FAST_ATAN2_MAX_ERROR_DEG );
+    }
+
+    SECTION( "Fast backend agrees with libm kinematics" ) {
+        Configuration config;
+        config.resize(6);
+        for (int i = 0; i < 6; i += 1){
+            config.links[i] = 0.4 + 0.1*i;
+        }
+        Configuration three;
+        three.resize(3);
+        three.links[0] = 1.0;
+        three.links[1] = 0.8;
+        three.links[2] = 0.5;
+        for (int k = 0; k < 2000; k += 1){
+            double angles[6];
+            for (int i = 0; i < 6; i += 1){
+                angles[i] = 360.0*((double)rand() / RAND_MAX) - 180.0;
+            }
+            Pose a = compute_forward_kinematics(config, angles);
+            Pose b = compute_forward_kinematics(config, angles, MATH_FAST);
+            REQUIRE( fabs(a.x - b.x) < BATCH_FK_TOLERANCE );
+            REQUIRE( fabs(a.y - b.y) < BATCH_FK_TOLERANCE );
+            REQUIRE( a.theta == b.theta );
+
+            double ja[18], jb[18], ta[6], tb[6];
+            REQUIRE( compute_jacobian(config, angles, ja, MATH_FAST) );
+            compute_jacobian(config, angles, jb);
+            REQUIRE( compute_inverse_dynamics(config, angles, 1.0, -2.0, 0.5, ta, MATH_FAST) );
+            compute_inverse_dynamics(config, angles, 1.0, -2.0, 0.5, tb);
+            for (int i = 0; i < 18; i += 1){
+                REQUIRE( fabs(ja[i] - jb[i]) < BATCH_FK_TOLERANCE );
+            }
+            for (int i = 0; i < 6; i += 1){
+                REQUIRE( fabs(ta[i] - tb[i]) < BATCH_FK_TOLERANCE );
+            }
+
+            // Away from the straight elbow, where IK is ill-conditioned
+            if (fabs(angles[1]) < 1.0 || fabs(angles[1]) > 179.0){
+                continue;
+            }
+            Pose target = compute_forward_kinematics(three, angles);
+            double a1[3], a2[3], b1[3], b2[3];
+            REQUIRE( compute_inverse_kinematics(three, target.x, target.y, target.theta, a1, a2) );
+            REQUIRE( compute_inverse_kinematics(three, target.x, target.y, target.theta,
+                                                b1, b2, MATH_FAST) );
+            // theta_1 takes acos of a ratio next to +-1 when the first joint is
+            // near 0 or 180, which turns 1 ulp into about 1e-8 degrees
+            for (int i = 0; i < 3; i += 1){
+                REQUIRE( fabs(a1[i] - b1[i]) < 1e-6 );
+                REQUIRE( fabs(a2[i] - b2[i]) < 1e-6 );
+            }
+        }
+    }
+
+    SECTION( "Manipulator switches backends" ) {
+        Manipulator manipulator;
+        double angles[3] = {30.0, -45.0, 10.0};
+        manipulator.forward_kinematics(angles);
+        Configuration libm = manipulator.get_config();
+        manipulator.set_math_backend(MATH_FAST);
+        Configuration fast = manipulator.get_config();
+        REQUIRE( fabs(fast.x - libm.x) < BATCH_FK_TOLERANCE );
+        REQUIRE( fabs(fast.y - libm.y) < BATCH_FK_TOLERANCE );
+        REQUIRE( manipulator.update_joint(1, -40.0) == 2 );
+        Pose pose = compute_forward_kinematics(manipulator.get_config(),
+                                            manipulator.get_config().angles, MATH_FAST);
+        REQUIRE( manipulator.get_config().x == pose.x );
+
+        double a1[3], a2[3], e1[3], e2[3];
+        REQUIRE( manipulator.inverse_kinematics(1.0, 1.0, 45.0, a1, a2) );
+        compute_inverse_kinematics(manipulator.get_config(), 1.0, 1.0, 45.0, e1, e2, MATH_FAST);
+        REQUIRE( a1[0] == e1[0] );
+        REQUIRE( a2[2] == e2[2] );
+    }
+
+    SECTION( "Copies on different backends share the IK cache" ) {
+        Manipulator libm;
+        libm.enable_ik_cache(default_ik_cache_options());
+        Manipulator fast = libm;
+        fast.set_math_backend(MATH_FAST);
+        int differ = 0;
+        for (int i = 0; i < 50; i += 1){
+            double x = 0.9 + 0.013*i, y = 1.1 - 0.011*i, theta = 30.0 + 1.7*i;
+            double f1[3], f2[3], l1[3], l2[3], e1[3], e2[3];
+            // The fast copy solves first, the libm copy must not get its answer
+            REQUIRE( fast.inverse_kinematics(x, y, theta, f1, f2) );
+            REQUIRE( libm.inverse_kinematics(x, y, theta, l1, l2) );
+            compute_inverse_kinematics(libm.get_config(), x, y, theta, e1, e2);
+            for (int j = 0; j < 3; j += 1){
+                REQUIRE( l1[j] == e1[j] );
+                REQUIRE( l2[j] == e2[j] );
+                differ += f1[j] != e1[j];
+            }
+        }
+        REQUIRE( differ > 0 );
+        REQUIRE( libm.get_ik_cache_stats().misses == 100 );
+    }
+}
+
+
+TEST_CASE( "Radian API Tests" ) {
+
+    const long double exact_pi = 3.141592653589793238462643383279502884L;
+    srand(0);
+
+    SECTION( "sincos in radians is within its bound" ) {
+        double worst = 0;
+        for (int k = 0; k < 400000; k += 1){
+            double rad = (k < 200000) ? (k - 100000)*0.000127
+                                      : ldexp(1.0 + (k % 997)/997.0, k % 20)*((k & 1) ? 1 : -1);
+            double s, c;
+            fast_sincos(rad, s, c);
+            worst = max(worst, fabs(s - (double)sinl((long double)rad)));
+            worst = max(worst, fabs(c - (double)cosl((long double)rad)));
+        }
+        REQUIRE( worst <= FAST_SINCOS_MAX_ERROR );
+    }
+
+    SECTION( "Wrap is in (-pi, pi] and removes whole turns" ) {
+        for (int k = 0; k < 200000; k += 1){
+            double rad = (k < 100000) ? (k - 50000)*0.00731
+                                      : ldexp(1.0 + (k % 991)/991.0, k % 19)*((k & 1) ? 1 : -1);
+            double w = wrap_angle_pi(rad);
+            REQUIRE( w > -FAST_PI );
+            REQUIRE( w <= FAST_PI );
+            long double turns = roundl(((long double)rad - w) / (2*exact_pi));
+            REQUIRE( fabs((double)((long double)rad - w - turns*2*exact_pi)) < 1e-12 );
+        }
+        REQUIRE( wrap_angle_pi(FAST_PI) == FAST_PI );
+        REQUIRE( wrap_angle_pi(-FAST_PI) == FAST_PI );
+        REQUIRE( wrap_angle_pi(0.0) == 0.0 );
+        // The double nearest 2 pi is not a whole turn
+        REQUIRE( fabs(wrap_angle_pi(2*FAST_PI)) < 1e-15 );
+
+        // Past the exact range, still wrapped
+        double large[6] = {FAST_WRAP_MAX_RAD, -FAST_WRAP_MAX_RAD, 1e17, -1e17, 1e20, 1e300};
+        for (int k = 0; k < 6; k += 1){
+            double w = wrap_angle_pi(large[k]);
+            REQUIRE( w > -FAST_PI );
+            REQUIRE( w <= FAST_PI );
+            REQUIRE( w == Approx(remainder(large[k], 2*FAST_PI)).margin(1e-9) );
+        }
+        REQUIRE( isnan(wrap_angle_pi(INFINITY)) );
+        REQUIRE( isnan(wrap_angle_pi(NAN)) );
+    }
+
+    SECTION( "Radian functions agree with the degree ones" ) {
+        Configuration config;
+        config.resize(6);
+        for (int i = 0; i < 6; i += 1){
+            config.links[i] = 0.4 + 0.1*i;
+        }
+        Configuration three;
+        three.resize(3);
+        three.links[0] = 1.0;
+        three.links[1] = 0.8;
+        three.links[2] = 0.5;
+        MathBackend backends[2] = {MATH_LIBM, MATH_FAST};
+        for (int k = 0; k < 1000; k += 1){
+            double deg[6], rad[6];
+            for (int i = 0; i < 6; i += 1){
+                deg[i] = 360.0*((double)rand() / RAND_MAX) - 180.0;
+                rad[i] = deg[i]*FAST_DEG_TO_RAD;
+            }
+            for (int m = 0; m < 2; m += 1){
+                Pose a = compute_forward_kinematics(config, deg, backends[m]);
+                Pose b = compute_forward_kinematics_rad(config, rad, backends[m]);
+                REQUIRE( fabs(a.x - b.x) < BATCH_FK_TOLERANCE );
+                REQUIRE( fabs(a.y - b.y) < BATCH_FK_TOLERANCE );
+                REQUIRE( fabs(wrap_angle_pi(a.theta*FAST_DEG_TO_RAD - b.theta)) < 1e-12 );
+                REQUIRE( b.theta > -FAST_PI );
+                REQUIRE( b.theta <= FAST_PI );
+
+                double ja[18], jb[18], ta[6], tb[6];
+                compute_jacobian(config, deg, ja, backends[m]);
+                REQUIRE( compute_jacobian_rad(config, rad, jb, backends[m]) );
+                compute_inverse_dynamics(config, deg, 1.0, -2.0, 0.5, ta, backends[m]);
+                REQUIRE( compute_inverse_dynamics_rad(config, rad, 1.0, -2.0, 0.5, tb,
+                                                    backends[m]) );
+                for (int i = 0; i < 18; i += 1){
+                    REQUIRE( fabs(ja[i] - jb[i]) < BATCH_FK_TOLERANCE );
+                }
+                for (int i = 0; i < 6; i += 1){
+                    REQUIRE( fabs(ta[i] - tb[i]) < BATCH_FK_TOLERANCE );
+                }
+
+                // Away from the straight elbow, where IK is ill-conditioned
+                if (fabs(deg[1]) < 1.0 || fabs(deg[1]) > 179.0){
+                    continue;
+                }
+                Pose target = compute_forward_kinematics(three, deg);
+                double a1[3], a2[3], b1[3], b2[3];
+                REQUIRE( compute_inverse_kinematics(three, target.x, target.y, target.theta,
+                                                    a1, a2, backends[m]) );
+                REQUIRE( compute_inverse_kinematics_rad(three, target.x, target.y,
+                                                        target.theta*FAST_DEG_TO_RAD,
+                                                        b1, b2, backends[m]) );
+                for (int i = 0; i < 3; i += 1){
+                    REQUIRE( fabs(wrap_angle_pi(a1[i]*FAST_DEG_TO_RAD - b1[i])) < 1e-6 );
+                    REQUIRE( fabs(wrap_angle_pi(a2[i]*FAST_DEG_TO_RAD - b2[i])) < 1e-6 );
+                    REQUIRE( b1[i] > -FAST_PI );
+                    REQUIRE( b1[i] <= FAST_PI );
+                }
+            }
+        }
+    }
+
+    SECTION( "Long chains use the radian link vectors" ) {
+        const int n = 300;
+        Configuration config;
+        config.resize(n);
+        double deg[n], rad[n];
+        for (int i = 0; i < n; i += 1){
+            config.links[i] = 0.01 + 0.001*(i % 7);
+            deg[i] = 10.0*((double)rand() / RAND_MAX) - 5.0;
+            rad[i] = deg[i]*FAST_DEG_TO_RAD;
+        }
+        Pose a = compute_forward_kinematics(config, deg);
+        Pose b = compute_forward_kinematics_rad(config, rad);
+        REQUIRE( fabs(a.x - b.x) < n*BATCH_FK_TOLERANCE );
+        REQUIRE( fabs(a.y - b.y) < n*BATCH_FK_TOLERANCE );
+
+        double xa[n + 1], ya[n + 1], ta[n + 1], xb[n + 1], yb[n + 1], tb[n + 1];
+        compute_joint_frames(n, config.links, deg, 0, xa, ya, ta);
+        compute_joint_frames_rad(n, config.links, rad, 0, xb, yb, tb);
+        for (int i = 0; i <= n; i += 1){
+            REQUIRE( fabs(xa[i] - xb[i]) < n*BATCH_FK_TOLERANCE );
+            REQUIRE( fabs(ya[i] - yb[i]) < n*BATCH_FK_TOLERANCE );
+            REQUIRE( fabs(ta[i]*FAST_DEG_TO_RAD - tb[i]) < 1e-12 );
+        }
+    }
+
+    SECTION( "Batch radian kernels match the scalar radian path" ) {
+        Configuration config;
+        config.resize(3);
+        config.links[0] = 1.0;
+        config.links[1] = 0.8;
+        config.links[2] = 0.5;
+        const int count = 517;
+        double joints[3][count];
+        double *angles[3] = {joints[0], joints[1], joints[2]};
+        double x[count], y[count], theta[count];
+        for (int i = 0; i < count; i += 1){
+            joints[0][i] = 2*FAST_PI*((double)rand() / RAND_MAX) - FAST_PI;
+            joints[1][i] = 3.0*((double)rand() / RAND_MAX) - 1.5;
+            joints[2][i] = 2*FAST_PI*((double)rand() / RAND_MAX) - FAST_PI;
+        }
+
+        REQUIRE( forward_kinematics_batch_rad(config, count, angles, x, y, theta, SIMD_SCALAR) );
+        for (int i = 0; i < count; i += 1){
+            double pose[3] = {joints[0][i], joints[1][i], joints[2][i]};
+            Pose ref = compute_forward_kinematics_rad(config, pose);
+            REQUIRE( x[i] == ref.x );
+            REQUIRE( y[i] == ref.y );
+            REQUIRE( theta[i] == ref.theta );
+        }
+
+        double a1[3][count], a2[3][count];
+        double *angles_1[3] = {a1[0], a1[1], a1[2]};
+        double *angles_2[3] = {a2[0], a2[1], a2[2]};
+        unsigned char reachable[count];
+        SimdLevel levels[4] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512};
+        for (int l = 0; l < 4; l += 1){
+            double fx[count], fy[count], ft[count];
+            REQUIRE( forward_kinematics_batch_rad(config, count, angles, fx, fy, ft, levels[l]) );
+            for (int i = 0; i < count; i += 1){
+                REQUIRE( fabs(fx[i] - x[i]) < BATCH_FK_TOLERANCE );
+                REQUIRE( fabs(fy[i] - y[i]) < BATCH_FK_TOLERANCE );
+                REQUIRE( fabs(wrap_angle_pi(ft[i] - theta[i])) < BATCH_FK_TOLERANCE );
+            }
+
+            REQUIRE( inverse_kinematics_batch_rad(config, count, x, y, theta, angles_1, angles_2,
+                                                reachable, levels[l]) );
+            for (int i = 0; i < count; i += 1){
+                double ref_1[3], ref_2[3];
+                REQUIRE( compute_inverse_kinematics_rad(config, x[i], y[i], theta[i],
+                                                        ref_1, ref_2) );
+                REQUIRE( reachable[i] == 1 );
+                for (int j = 0; j < 3; j += 1){
+                    REQUIRE( fabs(wrap_angle_pi(a1[j][i] - ref_1[j])) < 1e-6 );
+                    REQUIRE( fabs(wrap_angle_pi(a2[j][i] - ref_2[j])) < 1e-6 );
+                }
+            }
+        }
+    }
+}
+
+
+TEST_CASE( "Mixed Precision Tests" ) {
+
+    Configuration config;
+    config.resize(5);
+    double links[5] = {1.0, 0.5, 2.0, 0.7, 1.3};
+    for (int i = 0; i < 5; i += 1){
+        config.links[i] = links[i];
+    }
+    srand(0);
+
+    const int count = 3001;
+    vector<double> joints[5];
+    vector<float> joints_f[5];
+    const double *angles[5];
+    const float *angles_f[5];
+    for (int j = 0; j < 5; j += 1){
+        joints[j].resize(count);
+        joints_f[j].resize(count);
+        for (int i = 0; i < count; i += 1){
+            joints[j][i] = (double)rand() * 360 / RAND_MAX - 180;
+            joints_f[j][i] = (float)joints[j][i];
+        }
+        angles[j] = joints[j].data();
+        angles_f[j] = joints_f[j].data();
+    }
+
+    SECTION( "float sincos is within its bound" ) {
+        const long double exact_pi = 3.141592653589793238462643383279502884L;
+        double worst = 0;
+        for (int k = 0; k < 400000; k += 1){
+            float deg = (k < 200000) ? (float)((k - 100000)*0.0073)
+                                     : (float)ldexp(1.0 + (k % 997)/997.0, k % 22)*((k & 1) ? 1 : -1);
+            float s, c;
+            fast_sincosf_deg(deg, s, c);
+            long double r = fmodl((long double)deg, 360.0L)*exact_pi/180.0L;
+            worst = max(worst, (double)fabsl(s - sinl(r)));
+            worst = max(worst, (double)fabsl(c - cosl(r)));
+        }
+        REQUIRE( worst <= FAST_SINCOSF_MAX_ERROR );
+    }
+
+    SECTION( "float kernels are within the error bound of double" ) {
+        vector<double> x(count), y(count), theta(count);
+        vector<float> xf(count), yf(count), tf(count);
+        forward_kinematics_batch(config, count, angles, x.data(), y.data(), theta.data(),
+                                SIMD_SCALAR);
+        SimdLevel levels[4] = {SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512};
+        for (int l = 0; l < 4; l += 1){
+            REQUIRE( forward_kinematics_batch(config, count, angles_f, xf.data(), yf.data(),
+                                            tf.data(), levels[l]) );
+            for (int i = 0; i < count; i += 1){
+                double sum = 0;
+                for (int j = 0; j < 5; j += 1){
+                    sum += fabs(joints[j][i]);
+                }
+                double error = hypot(xf[i] - x[i], yf[i] - y[i]);
+                REQUIRE( error <= float_fk_error_bound(config, sum) );
+                REQUIRE( fabs(clip_angle_180(tf[i] - theta[i])) < 1e-3 );
+                REQUIRE( tf[i] > -180.0f );
+                REQUIRE( tf[i] <= 180.0f );
+            }
+        }
+
+        PrecisionReport report;
+        REQUIRE( float_precision_report(config, count, angles, report) );
+        REQUIRE( report.count == count );
+        REQUIRE( report.max_bound_ratio <= 1.0 );
+        REQUIRE( report.max_position_error > 0.0 );
+        REQUIRE( report.max_position_error < 1e-4 );
+        REQUIRE( report.mean_position_error <= report.max_position_error );
+    }
+
+    SECTION( "Mixed mode gives the double decisions" ) {
+        vector<unsigned char> hits_d(count), hits_f(count), hits_m(count);
+        // Circles sized so that many end effectors fall right on the edge
+        double x[count], y[count], theta[count];
+        forward_kinematics_batch(config, count, angles, x, y, theta);
+        for (int c = 0; c < 8; c += 1){
+            double cx = 0.5*c - 2.0;
+            double cy = 1.0 - 0.3*c;
+            double r = hypot(x[c*97] - cx, y[c*97] - cy);
+            int refined = -1;
+            REQUIRE( intersection_batch(config, cx, cy, r, count, angles, &hits_d[0],
+                                        PRECISION_DOUBLE, &refined) );
+            REQUIRE( refined == 0 );
+            REQUIRE( intersection_batch(config, cx, cy, r, count, angles, &hits_f[0],
+                                        PRECISION_FLOAT, NULL) );
+            REQUIRE( intersection_batch(config, cx, cy, r, count, angles, &hits_m[0],
+                                        PRECISION_MIXED, &refined) );
+            REQUIRE( refined >= 1 );
+            REQUIRE( refined < count / 10 );
+            for (int i = 0; i < count; i += 1){
+                REQUIRE( hits_m[i] == hits_d[i] );
+                double pose[5] = {joints[0][i], joints[1][i], joints[2][i], joints[3][i],
+                                joints[4][i]};
+                double d = hypot(x[i] - cx, y[i] - cy);
+                if (fabs(d - r) > 1e-4){
+                    REQUIRE( hits_f[i] == hits_d[i] );
+                    REQUIRE( hits_d[i] == compute_intersection(config, cx, cy, r, pose) );
+                }
+            }
+        }
+        REQUIRE( !intersection_batch(config, 0, 0, 1, -1, angles, &hits_m[0], PRECISION_MIXED,
+                                    NULL) );
+    }
+}
+
+
+TEST_CASE( "Velocity Controller Tests" ) {
+
+    Configuration config;
+    config.resize(3);
+    for (int i = 0; i < 3; i += 1){
+        config.links[i] = 1.0;
+    }
+    double start_angles[3] = {30.0, 45.0, -30.0};
+
+    SECTION( "Joint velocities reproduce the twist" ) {
+        Configuration long_config;
+        long_config.resize(6);
+        double links[6] = {1.0, 0.5, 2.0, 0.7, 1.3, 0.4};
+        double angles[6] = {10.0, -35.0, 60.0, 20.0, -80.0, 15.0};
+        for (int i = 0; i < 6; i += 1){
+            long_config.links[i] = links[i];
+        }
+        const Configuration *configs[2] = {&config, &long_config};
+        const double *poses[2] = {start_angles, angles};
+        Twist twist = {0.3, -0.2, 12.0};
+        for (int c = 0; c < 2; c += 1){
+            int n = configs[c]->num_links;
+            double jacobian[18], velocities[6];
+            REQUIRE( compute_jacobian(*configs[c], poses[c], jacobian) );
+            REQUIRE( compute_joint_velocities(n, jacobian, twist, 0.0, 1.0, velocities) );
+            double v[3] = {0, 0, 0};
+            for (int i = 0; i < n; i += 1){
+                for (int r = 0; r < 3; r += 1){
+                    v[r] += jacobian[r*n + i]*velocities[i]*FAST_PI/180.0;
+                }
+            }
+            REQUIRE( fabs(v[0] - twist.vx) < 1e-9 );
+            REQUIRE( fabs(v[1] - twist.vy) < 1e-9 );
+            REQUIRE( fabs(v[2]*180.0/FAST_PI - twist.omega) < 1e-7 );
+        }
+        Twist zero = {0.0, 0.0, 0.0};
+        double jacobian[9], velocities[3];
+        compute_jacobian(config, start_angles, jacobian);
+        REQUIRE( compute_joint_velocities(3, jacobian, zero, 1e-3, 1.0, velocities) );
+        for (int i = 0; i < 3; i += 1){
+            REQUIRE( velocities[i] == 0.0 );
+        }
+        REQUIRE( !compute_joint_velocities(0, jacobian, zero, 1e-3, 1.0, velocities) );
+    }
+
+    SECTION( "Loop follows the twist at a fixed rate" ) {
+        VelocityControllerOptions options = default_velocity_controller_options();
+        options.rate_hz = 2000.0;
+        options.damping = 0.0;
+        VelocityController controller(config, start_angles, options);
+        Twist twist = {0.2, 0.0, 0.0};
+        REQUIRE( controller.set_twist(twist) );
+        REQUIRE( controller.start() );
+        REQUIRE( controller.is_running() );
+        REQUIRE( !controller.start() );
+        this_thread::sleep_for(chrono::milliseconds(100));
+        controller.stop();
+        REQUIRE( !controller.is_running() );
+
+        VelocityControllerStats stats = controller.get_stats();
+        REQUIRE( stats.cycles > 20 );
+        REQUIRE( stats.rate_hz == 2000.0 );
+        REQUIRE( stats.overruns <= stats.cycles );
+        REQUIRE( stats.missed_periods >= stats.overruns );
+        REQUIRE( stats.p50_jitter_us <= stats.p99_jitter_us );
+        REQUIRE( stats.p99_jitter_us <= stats.max_jitter_us );
+        REQUIRE( stats.mean_compute_us <= stats.max_compute_us );
+        REQUIRE( !stats.realtime );
+
+        // Every period is integrated once, skipped ones by the next cycle
+        double angles[3], velocities[3];
+        controller.get_state(angles, velocities);
+        Pose begin = compute_forward_kinematics(config, start_angles);
+        Pose end = compute_forward_kinematics(config, angles);
+        double elapsed = (stats.cycles + stats.missed_periods) / options.rate_hz;
+        REQUIRE( fabs(end.x - begin.x - twist.vx*elapsed) < 1e-4 );
+        REQUIRE( fabs(end.y - begin.y) < 1e-4 );
+        REQUIRE( fabs(clip_angle_180(end.theta - begin.theta)) < 1e-3 );
+
+        controller.reset_stats();
+        REQUIRE( controller.get_stats().cycles == 0 );
+        REQUIRE( controller.get_stats().max_jitter_us == 0.0 );
+    }
+
+    SECTION( "Joint speed limit scales all joints" ) {
+        VelocityControllerOptions options = default_velocity_controller_options();
+        options.max_joint_speed = 5.0;
+        VelocityController controller(config, start_angles, options);
+        Twist twist = {5.0, 5.0, 90.0};
+        REQUIRE( controller.set_twist(twist) );
+        REQUIRE( controller.start() );
+        this_thread::sleep_for(chrono::milliseconds(20));
+        controller.stop();
+        double angles[3], velocities[3];
+        controller.get_state(angles, velocities);
+        double fastest = 0;
+        for (int i = 0; i < 3; i += 1){
+            fastest = max(fastest, fabs(velocities[i]));
+        }
+        REQUIRE( fabs(fastest - 5.0) < 1e-9 );
+    }
+
+    SECTION( "Huge twists do not stall the loop" ) {
+        VelocityController controller(config, start_angles);
+        Twist bad = {INFINITY, 0.0, 0.0};
+        REQUIRE( !controller.set_twist(bad) );
+        bad.vx = 0.0;
+        bad.omega = NAN;
+        REQUIRE( !controller.set_twist(bad) );
+
+        Twist huge = {1e300, -1e300, 1e300};
+        REQUIRE( controller.set_twist(huge) );
+        REQUIRE( controller.start() );
+        this_thread::sleep_for(chrono::milliseconds(20));
+        auto before = chrono::steady_clock::now();
+        controller.stop();
+        REQUIRE( chrono::steady_clock::now() - before < chrono::milliseconds(100) );
+        REQUIRE( controller.get_stats().cycles > 5 );
+        double angles[3], velocities[3];
+        controller.get_state(angles, velocities);
+        for (int i = 0; i < 3; i += 1){
+            REQUIRE( angles[i] > -180.0 );
+            REQUIRE( angles[i] <= 180.0 );
+            REQUIRE( isfinite(velocities[i]) );
+        }
+    }
+
+    SECTION( "Invalid rates are rejected" ) {
+        VelocityControllerOptions options = default_velocity_controller_options();
+        options.rate_hz = 500.0;
+        VelocityController slow(config, start_angles, options);
+        REQUIRE( !slow.start() );
+        options.rate_hz = 20000.0;
+        VelocityController fast(config, start_angles, options);
+        REQUIRE( !fast.start() );
+        double angles[3];
+        fast.get_state(angles, NULL);
+        for (int i = 0; i < 3; i += 1){
+            REQUIRE( angles[i] == start_angles[i] );
+        }
     }
 }